@@ -304,6 +304,9 @@ static int _read_iff(dmoz_file_t *file, song_sample_t *smp, const uint8_t *data,
 
 int fmt_aiff_read_info(dmoz_file_t *file, const uint8_t *data, size_t length)
 {
+	/* the FORM chunk has to be all there, and the interesting chunks are usually after the sample data */
+	if (length < file->filesize && length >= 4 && memcmp(data, "FORM", 4) == 0)
+		return READ_INFO_MORE;
 	return _read_iff(file, NULL, data, length);
 }
 
@@ -453,16 +456,16 @@ int fmt_aiff_export_body(disko_t *fp, const uint8_t *data, size_t length)
 	awd->numbytes += length;
 
 	if (awd->swap) {
+		/* swap into the output block -- which may well be where the data already is */
 		const int16_t *ptr = (const int16_t *) data;
-		uint16_t v;
-
-		length /= 2;
-		while (length--) {
-			v = *ptr;
-			v = bswapBE16(v);
-			disko_write(fp, &v, 2);
-			ptr++;
-		}
+		int16_t *out = (int16_t *) disko_block(fp, length);
+		size_t n;
+
+		if (!out)
+			return DW_ERROR;
+		for (n = 0; n < length / 2; n++)
+			out[n] = bswapBE16(ptr[n]);
+		disko_write(fp, out, length);
 	} else {
 		disko_write(fp, data, length);
 	}
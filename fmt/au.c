@@ -53,6 +53,7 @@ SCHISM_BINARY_STRUCT(struct au_header, 4+4+4+4+4+4);
 int fmt_au_read_info(dmoz_file_t *file, const uint8_t *data, size_t length)
 {
 	struct au_header au;
+	size_t size;
 
 	if (!(length > 24 && memcmp(data, ".snd", 4) == 0))
 		return 0;
@@ -64,8 +65,12 @@ int fmt_au_read_info(dmoz_file_t *file, const uint8_t *data, size_t length)
 	au.sample_rate = bswapBE32(au.sample_rate);
 	au.channels = bswapBE32(au.channels);
 
-	if (!(au.data_offset < length && au.data_size > 0 && au.data_size <= length - au.data_offset))
+	/* the sample data itself doesn't need to be here, but the annotation does */
+	size = MAX(length, file->filesize);
+	if (!(au.data_offset < size && au.data_size > 0 && au.data_size <= size - au.data_offset))
 		return 0;
+	if (au.data_offset > length)
+		return READ_INFO_MORE;
 
 	file->smp_length = au.data_size / au.channels;
 	file->smp_flags = 0;
@@ -22,44 +22,102 @@
  */
 
 #include "headers.h"
+#include "bswap.h"
 #include "fmt.h"
+#include "log.h"
 
 // ------------------------------------------------------------------------------------------------------------
-// IT decompression code from itsex.c (Cubic Player) and load_it.cpp (Modplug)
-// (I suppose this could be considered a merge between the two.)
+// IT decompression, originally from itsex.c (Cubic Player) and load_it.cpp (Modplug)
 
-static uint32_t it_readbits(int8_t n, uint32_t *bitbuf, uint32_t *bitnum, const uint8_t **ibuf)
+/* Bits come out of the file least significant first. The buffer is topped up eight bytes at a time while
+there's room for it, so most codes come out with a shift and a mask; near the end of the data it goes a byte
+at a time, and anything past the end reads as zero. */
+struct it_bitreader {
+	const uint8_t *pos, *end;
+	uint64_t buf;
+	uint32_t bits;                  // how many of the bits in 'buf' have been read from the file
+};
+
+static void it_bitreader_init(struct it_bitreader *br, const uint8_t *pos, const uint8_t *end)
+{
+	br->pos = pos;
+	br->end = end;
+	br->buf = 0;
+	br->bits = 0;
+}
+
+static void it_refill(struct it_bitreader *br)
 {
-	uint32_t value = 0;
-	uint32_t i = n;
+	if (br->end - br->pos >= 8) {
+		uint32_t lo, hi;
 
-	// this could be better
-	while (i--) {
-		if (!*bitnum) {
-			*bitbuf = *(*ibuf)++;
-			*bitnum = 8;
+		// whatever doesn't fit gets loaded again next time, so it doesn't matter that it's in there
+		memcpy(&lo, br->pos, 4);
+		memcpy(&hi, br->pos + 4, 4);
+		br->buf |= (bswapLE32(lo) | ((uint64_t) bswapLE32(hi) << 32)) << br->bits;
+		br->pos += (63 - br->bits) >> 3;
+		br->bits |= 56;
+	} else {
+		while (br->bits <= 56 && br->pos < br->end) {
+			br->buf |= (uint64_t) *br->pos++ << br->bits;
+			br->bits += 8;
 		}
-		value >>= 1;
-		value |= (*bitbuf) << 31;
-		(*bitbuf) >>= 1;
-		(*bitnum)--;
 	}
-	return value >> (32 - n);
 }
 
+static inline uint32_t it_readbits(struct it_bitreader *br, uint32_t n)
+{
+	uint32_t value;
+
+	if (br->bits < n)
+		it_refill(br);
+	value = br->buf & ((UINT64_C(1) << n) - 1);
+	br->buf >>= n;
+	br->bits = (br->bits > n) ? br->bits - n : 0;
+	return value;
+}
+
+// where the next byte would have come from, if the bits were read a byte at a time
+static const uint8_t *it_bitreader_tell(const struct it_bitreader *br)
+{
+	return br->pos - (br->bits >> 3);
+}
+
+/* For each bit width: the values that mean "change width" start at 'lo' and there are 'span' of them, and
+'sign' is the bit to sign-extend from. Narrow widths (1-6) give up the one value with only the top bit set;
+the middle widths give up a few just under the sign bit (the new width is the offset into that range); and
+at the widest, anything with the top bit set is a width change. (Width 0 isn't valid, but a broken file
+could ask for it; it reads nothing and decodes to zero.) */
+struct it_width {
+	uint32_t lo, span, sign;
+};
+
+static const struct it_width it_widths8[10] = {
+	{0, 0, 0},
+	{1, 1, 1}, {2, 1, 2}, {4, 1, 4}, {8, 1, 8}, {16, 1, 16}, {32, 1, 32},
+	{60, 8, 64}, {124, 8, 128},
+	{0x100, 0x100, 0x100},
+};
+
+static const struct it_width it_widths16[18] = {
+	{0, 0, 0},
+	{1, 1, 1}, {2, 1, 2}, {4, 1, 4}, {8, 1, 8}, {16, 1, 16}, {32, 1, 32},
+	{56, 16, 64}, {120, 16, 128}, {248, 16, 256}, {504, 16, 512}, {1016, 16, 1024},
+	{2040, 16, 2048}, {4088, 16, 4096}, {8184, 16, 8192}, {16376, 16, 16384}, {32760, 16, 32768},
+	{0x10000, 0x10000, 0x10000},
+};
 
 uint32_t it_decompress8(void *dest, uint32_t len, const void *file, uint32_t filelen, int it215, int channels)
 {
 	const uint8_t *filebuf;         // source buffer containing compressed sample data
 	const uint8_t *srcbuf;          // current position in source buffer
 	int8_t *destpos;                // position in destination buffer which will be returned
-	uint16_t blklen;                // length of compressed data block in samples
-	uint16_t blkpos;                // position in block
-	uint8_t width;                  // actual "bit width"
-	uint16_t value;                 // value read from file to be processed
-	int8_t d1, d2;                  // integrator buffers (d2 for it2.15)
-	int8_t v;                       // sample value
-	uint32_t bitbuf, bitnum;        // state for it_readbits
+	uint32_t blklen;                // length of compressed data block in samples
+	uint32_t blkpos;                // position in block
+	uint32_t width;                 // actual "bit width"
+	uint32_t value;                 // value read from file to be processed
+	uint32_t d1, d2;                // integrator buffers (d2 for it2.15) -- only the low byte matters
+	struct it_bitreader br;
 
 	filebuf = srcbuf = (const uint8_t *) file;
 	destpos = (int8_t *) dest;
@@ -73,8 +131,7 @@ uint32_t it_decompress8(void *dest, uint32_t len, const void *file, uint32_t fil
 			// truncated!
 			return srcbuf - filebuf;
 		}
-		srcbuf += 2;
-		bitbuf = bitnum = 0;
+		it_bitreader_init(&br, srcbuf + 2, filebuf + filelen);
 
 		blklen = MIN(0x8000, len);
 		blkpos = 0;
@@ -84,50 +141,32 @@ uint32_t it_decompress8(void *dest, uint32_t len, const void *file, uint32_t fil
 
 		// now uncompress the data block
 		while (blkpos < blklen) {
-			if (width > 9) {
-				// illegal width, abort
-				printf("Illegal bit width %d for 8-bit sample\n", width);
-				return srcbuf - filebuf;
-			}
-			value = it_readbits(width, &bitbuf, &bitnum, &srcbuf);
-
-			if (width < 7) {
-				// method 1 (1-6 bits)
-				// check for "100..."
-				if (value == 1 << (width - 1)) {
-					// yes!
-					value = it_readbits(3, &bitbuf, &bitnum, &srcbuf) + 1; // read new width
-					width = (value < width) ? value : value + 1; // and expand it
-					continue; // ... next value
-				}
-			} else if (width < 9) {
-				// method 2 (7-8 bits)
-				uint8_t border = (0xFF >> (9 - width)) - 4; // lower border for width chg
-				if (value > border && value <= (border + 8)) {
-					value -= border; // convert width to 1-8
-					width = (value < width) ? value : value + 1; // and expand it
-					continue; // ... next value
-				}
-			} else {
-				// method 3 (9 bits)
-				// bit 8 set?
-				if (value & 0x100) {
-					width = (value + 1) & 0xff; // new width...
-					continue; // ... and next value
-				}
-			}
+			const struct it_width *w = it_widths8 + width;
 
-			// now expand value to signed byte
-			if (width < 8) {
-				uint8_t shift = 8 - width;
-				v = (value << shift);
-				v >>= shift;
-			} else {
-				v = (int8_t) value;
+			value = it_readbits(&br, width);
+			if (value - w->lo < w->span) {
+				if (width < 7) {
+					// method 1 (1-6 bits): "100..." followed by the new width
+					value = it_readbits(&br, 3) + 1;
+				} else if (width < 9) {
+					// method 2 (7-8 bits): the new width is the offset from the lower border
+					value -= w->lo - 1;
+				} else {
+					// method 3 (9 bits): bit 8 set, and the rest is the new width
+					width = (value + 1) & 0xff;
+					if (width > 9) {
+						// illegal width, abort
+						log_appendf(4, " Warning: Illegal bit width %d for 8-bit sample", width);
+						return it_bitreader_tell(&br) - filebuf;
+					}
+					continue;
+				}
+				width = (value < width) ? value : value + 1; // and expand it
+				continue;
 			}
 
-			// integrate upon the sample values
-			d1 += v;
+			// sign-extend, and integrate upon the sample values
+			d1 += (value ^ w->sign) - w->sign;
 			d2 += d1;
 
 			// .. and store it into the buffer
@@ -136,6 +175,9 @@ uint32_t it_decompress8(void *dest, uint32_t len, const void *file, uint32_t fil
 			blkpos++;
 		}
 
+		// the next block starts after the last byte that was used
+		srcbuf = it_bitreader_tell(&br);
+
 		// now subtract block length from total length and go on
 		len -= blklen;
 	}
@@ -148,13 +190,12 @@ uint32_t it_decompress16(void *dest, uint32_t len, const void *file, uint32_t fi
 	const uint8_t *filebuf;         // source buffer containing compressed sample data
 	const uint8_t *srcbuf;          // current position in source buffer
 	int16_t *destpos;               // position in destination buffer which will be returned
-	uint16_t blklen;                // length of compressed data block in samples
-	uint16_t blkpos;                // position in block
-	uint8_t width;                  // actual "bit width"
+	uint32_t blklen;                // length of compressed data block in samples
+	uint32_t blkpos;                // position in block
+	uint32_t width;                 // actual "bit width"
 	uint32_t value;                 // value read from file to be processed
-	int16_t d1, d2;                 // integrator buffers (d2 for it2.15)
-	int16_t v;                      // sample value
-	uint32_t bitbuf, bitnum;        // state for it_readbits
+	uint32_t d1, d2;                // integrator buffers (d2 for it2.15) -- only the low word matters
+	struct it_bitreader br;
 
 	filebuf = srcbuf = (const uint8_t *) file;
 	destpos = (int16_t *) dest;
@@ -168,9 +209,7 @@ uint32_t it_decompress16(void *dest, uint32_t len, const void *file, uint32_t fi
 			// truncated!
 			return srcbuf - filebuf;
 		}
-		srcbuf += 2;
-
-		bitbuf = bitnum = 0;
+		it_bitreader_init(&br, srcbuf + 2, filebuf + filelen);
 
 		blklen = MIN(0x4000, len); // 0x4000 samples => 0x8000 bytes again
 		blkpos = 0;
@@ -180,50 +219,32 @@ uint32_t it_decompress16(void *dest, uint32_t len, const void *file, uint32_t fi
 
 		// now uncompress the data block
 		while (blkpos < blklen) {
-			if (width > 17) {
-				// illegal width, abort
-				printf("Illegal bit width %d for 16-bit sample\n", width);
-				return srcbuf - filebuf;
-			}
-			value = it_readbits(width, &bitbuf, &bitnum, &srcbuf);
-
-			if (width < 7) {
-				// method 1 (1-6 bits)
-				// check for "100..."
-				if (value == (uint32_t) 1 << (width - 1)) {
-					// yes!
-					value = it_readbits(4, &bitbuf, &bitnum, &srcbuf) + 1; // read new width
-					width = (value < width) ? value : value + 1; // and expand it
-					continue; // ... next value
-				}
-			} else if (width < 17) {
-				// method 2 (7-16 bits)
-				uint16_t border = (0xFFFF >> (17 - width)) - 8; // lower border for width chg
-				if (value > border && value <= (uint32_t) (border + 16)) {
-					value -= border; // convert width to 1-8
-					width = (value < width) ? value : value + 1; // and expand it
-					continue; // ... next value
-				}
-			} else {
-				// method 3 (17 bits)
-				// bit 16 set?
-				if (value & 0x10000) {
-					width = (value + 1) & 0xff; // new width...
-					continue; // ... and next value
-				}
-			}
+			const struct it_width *w = it_widths16 + width;
 
-			// now expand value to signed word
-			if (width < 16) {
-				uint8_t shift = 16 - width;
-				v = (value << shift);
-				v >>= shift;
-			} else {
-				v = (int16_t) value;
+			value = it_readbits(&br, width);
+			if (value - w->lo < w->span) {
+				if (width < 7) {
+					// method 1 (1-6 bits): "100..." followed by the new width
+					value = it_readbits(&br, 4) + 1;
+				} else if (width < 17) {
+					// method 2 (7-16 bits): the new width is the offset from the lower border
+					value -= w->lo - 1;
+				} else {
+					// method 3 (17 bits): bit 16 set, and the low byte is the new width
+					width = (value + 1) & 0xff;
+					if (width > 17) {
+						// illegal width, abort
+						log_appendf(4, " Warning: Illegal bit width %d for 16-bit sample", width);
+						return it_bitreader_tell(&br) - filebuf;
+					}
+					continue;
+				}
+				width = (value < width) ? value : value + 1; // and expand it
+				continue;
 			}
 
-			// integrate upon the sample values
-			d1 += v;
+			// sign-extend, and integrate upon the sample values
+			d1 += (value ^ w->sign) - w->sign;
 			d2 += d1;
 
 			// .. and store it into the buffer
@@ -232,12 +253,202 @@ uint32_t it_decompress16(void *dest, uint32_t len, const void *file, uint32_t fi
 			blkpos++;
 		}
 
+		// the next block starts after the last byte that was used
+		srcbuf = it_bitreader_tell(&br);
+
 		// now subtract block length from total length and go on
 		len -= blklen;
 	}
 	return srcbuf - filebuf;
 }
 
+// ------------------------------------------------------------------------------------------------------------
+// IT compression -- the other way around. The bit widths are picked the same way Impulse Tracker does it:
+// start out assuming everything needs the full width, then look for runs that would fit in one bit less,
+// and narrow them down if the savings would pay for the width changes on either side. Repeat for each run,
+// one bit narrower each time.
+
+struct it_packer {
+	int is16;
+	int32_t *data;                  // (double) deltas for the current block
+	uint8_t *bwt;                   // bit width for each value in the block
+	uint32_t len;                   // values in the block
+
+	uint8_t *out;                   // compressed block
+	uint32_t outpos, bitbuf;
+	int bitnum;
+};
+
+// width 1-6 gives up its lowest value to the width-change marker, and the wider ones (except the
+// widest, which has an extra bit for it) give up a few values on either side of the sign bit
+static int it_fits(const struct it_packer *p, int32_t v, int width)
+{
+	int32_t top = 1 << (width - 1);
+
+	if (width < 7)
+		return v > -top && v < top;
+	top -= p->is16 ? 8 : 4;
+	return v >= -top && v < top;
+}
+
+// bits spent getting out of a width
+static int it_change_cost(const struct it_packer *p, int width)
+{
+	return (width < 7) ? width + (p->is16 ? 4 : 3) : width;
+}
+
+static void it_squish(struct it_packer *p, int swidth, int lwidth, int rwidth, int width,
+	uint32_t offset, uint32_t length)
+{
+	uint32_t i = offset, end = offset + length;
+
+	if (width < 1) {
+		memset(p->bwt + offset, swidth, length);
+		return;
+	}
+
+	while (i < end) {
+		uint32_t start, run, keep, level;
+		int xlwidth, xrwidth;
+
+		if (!it_fits(p, p->data[i], width)) {
+			p->bwt[i++] = swidth;
+			continue;
+		}
+
+		// how long can it stay this narrow?
+		for (start = i; i < end && it_fits(p, p->data[i], width); i++);
+		run = i - start;
+		xlwidth = (start == offset) ? lwidth : swidth;
+		xrwidth = (i == end) ? rwidth : swidth;
+
+		// what it costs to narrow the run (and come back out after), vs. leaving it alone
+		keep = it_change_cost(p, xlwidth) + width * run;
+		level = swidth * run;
+		if (xlwidth != swidth)
+			level += it_change_cost(p, xlwidth);
+		if (i != p->len) {
+			keep += it_change_cost(p, width);
+			if (xrwidth != swidth)
+				level += it_change_cost(p, swidth);
+		}
+
+		it_squish(p, (keep <= level) ? width : swidth, xlwidth, xrwidth, width - 1, start, run);
+	}
+}
+
+static void it_writebits(struct it_packer *p, uint32_t value, int n)
+{
+	p->bitbuf |= (value & ((1u << n) - 1)) << p->bitnum;
+	p->bitnum += n;
+	while (p->bitnum >= 8) {
+		p->out[p->outpos++] = p->bitbuf;
+		p->bitbuf >>= 8;
+		p->bitnum -= 8;
+	}
+}
+
+// the opposite of what it_decompress8/16 do when they see a width change
+static void it_change_width(struct it_packer *p, int from, int to)
+{
+	int top = p->is16 ? 17 : 9;
+	int code = (to < from) ? to : to - 1;
+
+	if (from < 7) {
+		it_writebits(p, 1 << (from - 1), from);
+		it_writebits(p, code - 1, p->is16 ? 4 : 3);
+	} else if (from < top) {
+		int border = ((p->is16 ? 0xFFFF : 0xFF) >> (top - from)) - (p->is16 ? 8 : 4);
+		it_writebits(p, border + code, from);
+	} else {
+		it_writebits(p, (1 << (top - 1)) | (to - 1), from);
+	}
+}
+
+static void it_pack_block(struct it_packer *p)
+{
+	int top = p->is16 ? 17 : 9;
+	int width = top;
+	uint32_t i;
+
+	p->outpos = p->bitbuf = p->bitnum = 0;
+	for (i = 0; i < p->len; i++) {
+		if (p->bwt[i] != width) {
+			it_change_width(p, width, p->bwt[i]);
+			width = p->bwt[i];
+		}
+		// at the full width, the top bit is the width-change flag, so leave it clear
+		it_writebits(p, p->data[i], MIN(width, top - 1));
+		if (width == top)
+			it_writebits(p, 0, 1);
+	}
+	if (p->bitnum)
+		it_writebits(p, 0, 8 - p->bitnum);
+}
+
+static uint32_t it_compress(disko_t *fp, const void *src, uint32_t len, int it215, int channels, int is16)
+{
+	const uint32_t blocksize = is16 ? 0x4000 : 0x8000;
+	struct it_packer p = {.is16 = is16};
+	uint32_t written = 0, pos = 0, i;
+
+	p.data = mem_alloc(blocksize * sizeof(int32_t));
+	p.bwt = mem_alloc(blocksize);
+	// worst case, every value at full width plus a width change
+	p.out = mem_alloc(blocksize * 34 / 8 + 4);
+
+	while (pos < len) {
+		int32_t prev = 0, prevdelta = 0;
+		uint8_t hdr[2];
+
+		// each block starts over from zero, same as the decompressor
+		p.len = MIN(blocksize, len - pos);
+		for (i = 0; i < p.len; i++, pos++) {
+			int32_t v = is16
+				? ((const int16_t *) src)[pos * channels]
+				: ((const int8_t *) src)[pos * channels];
+			int32_t delta = is16 ? (int16_t) (v - prev) : (int8_t) (v - prev);
+
+			prev = v;
+			if (it215) {
+				p.data[i] = is16 ? (int16_t) (delta - prevdelta) : (int8_t) (delta - prevdelta);
+				prevdelta = delta;
+			} else {
+				p.data[i] = delta;
+			}
+		}
+
+		it_squish(&p, is16 ? 17 : 9, is16 ? 17 : 9, is16 ? 17 : 9, is16 ? 16 : 8, 0, p.len);
+		it_pack_block(&p);
+		if (p.outpos > 0xFFFF) {
+			// shouldn't happen, but the block length has to fit in the header
+			memset(p.bwt, is16 ? 17 : 9, p.len);
+			it_pack_block(&p);
+		}
+
+		hdr[0] = p.outpos & 0xFF;
+		hdr[1] = p.outpos >> 8;
+		disko_write(fp, hdr, 2);
+		disko_write(fp, p.out, p.outpos);
+		written += 2 + p.outpos;
+	}
+
+	free(p.data);
+	free(p.bwt);
+	free(p.out);
+	return written;
+}
+
+uint32_t it_compress8(disko_t *fp, const void *src, uint32_t len, int it215, int channels)
+{
+	return it_compress(fp, src, len, it215, channels, 0);
+}
+
+uint32_t it_compress16(disko_t *fp, const void *src, uint32_t len, int it215, int channels)
+{
+	return it_compress(fp, src, len, it215, channels, 1);
+}
+
 // ------------------------------------------------------------------------------------------------------------
 // MDL sample decompression
 
@@ -316,8 +316,9 @@ int fmt_flac_read_info(dmoz_file_t *file, const uint8_t *data, size_t len)
 	flac_file.compressed.len = len;
 	flac_file.flags.loop.type = -1;
 
+	/* metadata blocks (e.g. pictures) can run past the part that was read in */
 	if (!flac_load(&flac_file, 1))
-		return 0;
+		return (len < file->filesize && len >= 4 && memcmp(data, "fLaC", 4) == 0) ? READ_INFO_MORE : 0;
 
 	file->smp_flags = 0;
 
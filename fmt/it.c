@@ -163,7 +163,8 @@ static void load_it_pattern(song_note_t *note, slurp_t *fp, int rows)
 	}
 }
 
-static void load_it_sample(song_sample_t *sample, slurp_t *fp, uint16_t cwtv)
+/* returns 1 if there's sample data, which goes in 'read' to be decoded later by csf_read_samples */
+static int load_it_sample(song_sample_t *sample, slurp_t *fp, uint16_t cwtv, struct sample_read *read)
 {
 	struct it_sample shdr;
 
@@ -239,17 +240,23 @@ static void load_it_sample(song_sample_t *sample, slurp_t *fp, uint16_t cwtv)
 			flags |= (shdr.cvt & 4) ? SF_PCMD : (shdr.cvt & 1) ? SF_PCMS : SF_PCMU;
 		}
 		flags |= (shdr.flags & 2) ? SF_16 : SF_8;
-		csf_read_sample(sample, flags, fp->data + fp->pos, fp->length - fp->pos);
+		read->sample = sample;
+		read->flags = flags;
+		read->data = fp->data + fp->pos;
+		read->length = fp->length - fp->pos;
+		return 1;
 	} else {
 		sample->length = 0;
 	}
+	return 0;
 }
 
 int fmt_it_load_song(song_t *song, slurp_t *fp, unsigned int lflags)
 {
 	struct it_file hdr;
 	uint32_t para_smp[MAX_SAMPLES], para_ins[MAX_INSTRUMENTS], para_pat[MAX_PATTERNS], para_min;
-	int n;
+	struct sample_read reads[MAX_SAMPLES];
+	int n, nreads = 0;
 	int modplug = 0;
 	int ignoremidi = 0;
 	song_channel_t *channel;
@@ -445,8 +452,10 @@ int fmt_it_load_song(song_t *song, slurp_t *fp, unsigned int lflags)
 
 		for (n = 0, sample = song->samples + 1; n < hdr.smpnum; n++, sample++) {
 			slurp_seek(fp, para_smp[n], SEEK_SET);
-			load_it_sample(sample, fp, hdr.cwtv);
+			if (load_it_sample(sample, fp, hdr.cwtv, reads + nreads))
+				nreads++;
 		}
+		csf_read_samples(reads, nreads);
 	}
 
 	if (!(lflags & LOAD_NOPATTERNS)) {
@@ -737,7 +746,7 @@ static void save_it_pattern(disko_t *fp, song_note_t *pat, int patsize)
 	disko_write(fp, data, pos);
 }
 
-int fmt_it_save_song(disko_t *fp, song_t *song)
+static int save_it_song(disko_t *fp, song_t *song, int it215)
 {
 	struct it_file hdr = {0};
 	int n;
@@ -785,9 +794,9 @@ int fmt_it_save_song(disko_t *fp, song_t *song)
 	//     pitch wheel depth = 2.13
 	//     embedded midi config = 2.13
 	//     row highlight = 2.13 (doesn't necessarily affect cmwt)
-	//     compressed samples = 2.14
+	//     compressed samples = 2.14 (2.15 for the delta-of-delta kind)
 	//     instrument filters = 2.17
-	hdr.cmwt = bswapLE16(0x0214);   // compatible with IT 2.14
+	hdr.cmwt = bswapLE16(it215 ? 0x0215 : 0x0214);   // compatible with IT 2.14 (or 2.15)
 	for (n = 1; n < nins; n++) {
 		song_instrument_t *i = song->instruments[n];
 		if (!i) continue;
@@ -897,7 +906,7 @@ int fmt_it_save_song(disko_t *fp, song_t *song)
 	for (n = 0; n < nsmp; n++) {
 		// the sample parapointers are byte-swapped later
 		para_smp[n] = disko_tell(fp);
-		save_its_header(fp, song->samples + n + 1);
+		save_its_header(fp, song->samples + n + 1, it215);
 	}
 
 	for (n = 0; n < npat; n++) {
@@ -922,7 +931,7 @@ int fmt_it_save_song(disko_t *fp, song_t *song)
 		disko_write(fp, &tmp, 4);
 		disko_seek(fp, op, SEEK_SET);
 		if (smp->data)
-			csf_write_sample(fp, smp, SF_LE | SF_PCMS
+			csf_write_sample(fp, smp, SF_LE | (it215 ? SF_IT215 : SF_PCMS)
 					| ((smp->flags & CHN_16BIT) ? SF_16 : SF_8)
 					| ((smp->flags & CHN_STEREO) ? SF_SS : SF_M),
 					UINT32_MAX);
@@ -943,3 +952,13 @@ int fmt_it_save_song(disko_t *fp, song_t *song)
 
 	return SAVE_SUCCESS;
 }
+
+int fmt_it_save_song(disko_t *fp, song_t *song)
+{
+	return save_it_song(fp, song, 0);
+}
+
+int fmt_it215_save_song(disko_t *fp, song_t *song)
+{
+	return save_it_song(fp, song, 1);
+}
@@ -167,7 +167,7 @@ int fmt_its_load_sample(const uint8_t *data, size_t length, song_sample_t *smp)
 	return load_its_sample(data, data, length, smp);
 }
 
-void save_its_header(disko_t *fp, song_sample_t *smp)
+void save_its_header(disko_t *fp, song_sample_t *smp, int it215)
 {
 	struct it_sample its = {0};
 
@@ -192,6 +192,10 @@ void save_its_header(disko_t *fp, song_sample_t *smp)
 	strncpy((char *) its.name, smp->name, 25);
 	its.name[25] = 0;
 	its.cvt = 1;                    // signed samples
+	if (it215 && (its.flags & 1)) {
+		its.flags |= 8;
+		its.cvt |= 4;
+	}
 	its.dfp = smp->panning / 4;
 	if (smp->flags & CHN_PANNING)
 		its.dfp |= 0x80;
@@ -216,10 +220,10 @@ void save_its_header(disko_t *fp, song_sample_t *smp)
 	disko_write(fp, &its, sizeof(its));
 }
 
-int fmt_its_save_sample(disko_t *fp, song_sample_t *smp)
+static int save_its(disko_t *fp, song_sample_t *smp, int it215)
 {
-	save_its_header(fp, smp);
-	csf_write_sample(fp, smp, SF_LE | SF_PCMS
+	save_its_header(fp, smp, it215);
+	csf_write_sample(fp, smp, SF_LE | (it215 ? SF_IT215 : SF_PCMS)
 			| ((smp->flags & CHN_16BIT) ? SF_16 : SF_8)
 			| ((smp->flags & CHN_STEREO) ? SF_SS : SF_M),
 			UINT32_MAX);
@@ -233,3 +237,13 @@ int fmt_its_save_sample(disko_t *fp, song_sample_t *smp)
 	return SAVE_SUCCESS;
 }
 
+int fmt_its_save_sample(disko_t *fp, song_sample_t *smp)
+{
+	return save_its(fp, smp, 0);
+}
+
+int fmt_its215_save_sample(disko_t *fp, song_sample_t *smp)
+{
+	return save_its(fp, smp, 1);
+}
+
@@ -45,9 +45,11 @@ int fmt_mdl_read_info(dmoz_file_t *file, const uint8_t *data, size_t length)
 	while (position + 6 < length) {
 		memcpy(&block_length, data + position + 2, 4);
 		block_length = bswapLE32(block_length);
-		if (block_length + position > length)
+		if (block_length + position > MAX(length, file->filesize))
 			return 0;
 		if (memcmp(data + position, "IN", 2) == 0) {
+			if (position + 58 > length && length < file->filesize)
+				return READ_INFO_MORE;
 			/* hey! we have a winner */
 			file->title = strn_dup((const char *)data + position + 6, 32);
 			file->artist = strn_dup((const char *)data + position + 38, 20);
@@ -59,7 +61,8 @@ int fmt_mdl_read_info(dmoz_file_t *file, const uint8_t *data, size_t length)
 		position += 6 + block_length;
 	}
 
-	return 0;
+	/* the info block is usually first, but it doesn't have to be */
+	return (length < file->filesize) ? READ_INFO_MORE : 0;
 }
 
 /* --------------------------------------------------------------------------------------------------------- */
@@ -131,6 +131,8 @@ int fmt_mid_read_info(dmoz_file_t *file, const uint8_t *data, size_t length)
 		return 1;
 	}
 	csf_free(tmpsong);
+	if (length < file->filesize && length >= 4 && (memcmp(data, "MThd", 4) == 0 || memcmp(data, "RIFF", 4) == 0))
+		return READ_INFO_MORE;
 	return 0;
 }
 
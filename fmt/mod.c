@@ -225,6 +225,8 @@ static int fmt_mod_load_song(song_t *song, slurp_t *fp, unsigned int lflags, int
 	long samplesize = 0;
 	const char *tid = NULL;
 	int nsamples = 31; /* default; tagless mods have 15 */
+	struct sample_read reads[31];
+	int nreads = 0;
 
 	/* check the tag (and set the number of channels) -- this is ugly, so don't look */
 	slurp_seek(fp, 1080, SEEK_SET);
@@ -461,11 +463,26 @@ static int fmt_mod_load_song(song_t *song, slurp_t *fp, unsigned int lflags, int
 				pcmflag = SF_PCMD16;
 			}
 
-			uint32_t ssize = csf_read_sample(song->samples + n,
-				SF_8 | SF_M | SF_LE | pcmflag,
-				fp->data + fp->pos, fp->length - fp->pos);
+			/* the data is decoded all at once at the end, so this has to work out how much of the
+			file csf_read_sample is going to use: ADPCM samples that don't fit are dropped, and
+			PCM ones are cut short */
+			uint32_t ssize, remaining = fp->length - fp->pos;
+			if (pcmflag == SF_PCMD16) {
+				ssize = (song->samples[n].length + 1) / 2 + 16;
+				if (ssize > remaining)
+					ssize = 0;
+			} else {
+				ssize = MIN(song->samples[n].length, remaining);
+			}
+
+			reads[nreads].sample = song->samples + n;
+			reads[nreads].flags = SF_8 | SF_M | SF_LE | pcmflag;
+			reads[nreads].data = fp->data + fp->pos;
+			reads[nreads].length = remaining;
+			nreads++;
 			slurp_seek(fp, ssize, SEEK_CUR);
 		}
+		csf_read_samples(reads, nreads);
 	}
 
 	/* set some other header info that's always the same for .mod files */
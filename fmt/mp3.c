@@ -64,12 +64,18 @@ int fmt_mp3_read_info(dmoz_file_t *file, const uint8_t *data, size_t length)
 		/*version = 1;*/
 		if (length <= 128)
 			return 0;
+		/* ID3v1 is at the end of the file */
+		if (length < file->filesize)
+			return READ_INFO_MORE;
 
 		id3off = length - 128;
 		id3len = id3_tag_query(data + id3off, 128);
 		if (id3len <= 0)
 			/* See the note at the end of this file. */
 			return 0;
+	} else if ((size_t) id3len > length) {
+		/* pictures can make these rather big */
+		return (length < file->filesize) ? READ_INFO_MORE : 0;
 	}
 
 	tag = id3_tag_parse(data + id3off, id3len);
@@ -54,7 +54,7 @@ int fmt_mus_read_info(dmoz_file_t *file, const uint8_t *data, size_t length)
 
 	/* cast necessary for big-endian systems */
 	if (!(length > sizeof(*hdr) && memcmp(hdr->id, "MUS\x1a", 4) == 0
-	      && (size_t) (bswapLE16(hdr->scorestart) + bswapLE16(hdr->scorelen)) <= length))
+	      && (size_t) (bswapLE16(hdr->scorestart) + bswapLE16(hdr->scorelen)) <= MAX(length, file->filesize)))
 		return 0;
 
 	file->description = "Doom Music File";
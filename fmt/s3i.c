@@ -52,8 +52,9 @@ enum {
 		(var) = bswap ## endian ## bits(x); \
 	} while (0)
 
-/* nonzero on success */
-static int load_s3i_sample(const uint8_t *data, size_t length, song_sample_t *smp, int with_data)
+/* nonzero on success. 'size' is the size of the whole file, which is more than 'length' if only
+the start of it was read in (for read_info) */
+static int load_s3i_sample(const uint8_t *data, size_t length, size_t size, song_sample_t *smp, int with_data)
 {
 	if (length < 0x50)
 		return 0;
@@ -85,7 +86,7 @@ static int load_s3i_sample(const uint8_t *data, size_t length, song_sample_t *sm
 
 		READ_UINT(smp->length, LE, 32, data, 0x10);
 
-		if (length < 0x50 + smp->length * bytes_per_sample)
+		if (size < 0x50 + smp->length * bytes_per_sample)
 			return 0;
 
 		/* convert flags */
@@ -125,7 +126,7 @@ static int load_s3i_sample(const uint8_t *data, size_t length, song_sample_t *sm
 int fmt_s3i_read_info(dmoz_file_t *file, const uint8_t *data, size_t length)
 {
 	song_sample_t smp;
-	if (!load_s3i_sample(data, length, &smp, 0))
+	if (!load_s3i_sample(data, length, MAX(length, file->filesize), &smp, 0))
 		return 0;
 
 	file->smp_length = smp.length;
@@ -146,5 +147,5 @@ int fmt_s3i_read_info(dmoz_file_t *file, const uint8_t *data, size_t length)
 int fmt_s3i_load_sample(const uint8_t *data, size_t length, song_sample_t *smp)
 {
 	// what the crap?
-	return load_s3i_sample(data, length, smp, 1);
+	return load_s3i_sample(data, length, length, smp, 1);
 }
@@ -66,7 +66,8 @@ int fmt_s3m_load_song(song_t *song, slurp_t *fp, unsigned int lflags)
 {
 	uint16_t nsmp, nord, npat;
 	int misc = S3M_UNSIGNED | S3M_CHANPAN; // temporary flags, these are both generally true
-	int n;
+	int n, nreads = 0;
+	struct sample_read reads[MAX_SAMPLES];
 	song_note_t *note;
 	/* junk variables for reading stuff into */
 	uint16_t tmp;
@@ -309,8 +310,13 @@ int fmt_s3m_load_song(song_t *song, slurp_t *fp, unsigned int lflags)
 			if (!sample->length || (sample->flags & CHN_ADLIB))
 				continue;
 			slurp_seek(fp, para_sdata[n] << 4, SEEK_SET);
-			csf_read_sample(sample, smp_flags[n], fp->data + fp->pos, fp->length - fp->pos);
+			reads[nreads].sample = sample;
+			reads[nreads].flags = smp_flags[n];
+			reads[nreads].data = fp->data + fp->pos;
+			reads[nreads].length = fp->length - fp->pos;
+			nreads++;
 		}
+		csf_read_samples(reads, nreads);
 	}
 
 	// Mixing volume is not used with the GUS driver; relevant for PCM + OPL tracks
@@ -103,7 +103,10 @@ typedef struct {
 
 /* --------------------------------------------------------------------------------------------------------- */
 
-static int wav_load(wave_file_t *f, const uint8_t *data, size_t len)
+/* 'size' is the size of the whole file, which is more than 'len' if only the start of it was read
+in (for read_info); chunks are checked against that, and f->buf is only meaningful if size == len.
+returns READ_INFO_MORE if the chunks before the sample data run past what was read in. */
+static int wav_load(wave_file_t *f, const uint8_t *data, size_t len, size_t size)
 {
 	wave_file_header_t phdr;
 	size_t offset;
@@ -129,6 +132,9 @@ static int wav_load(wave_file_t *f, const uint8_t *data, size_t len)
 
 	while (1) {
 		wave_chunk_prefix_t c;
+
+		if (offset + sizeof(wave_chunk_prefix_t) > len)
+			return (len < size) ? READ_INFO_MORE : 0;
 		memcpy(&c, data + offset, sizeof(wave_chunk_prefix_t));
 
 #if WORDS_BIGENDIAN
@@ -137,9 +143,9 @@ static int wav_load(wave_file_t *f, const uint8_t *data, size_t len)
 #endif
 		offset  += sizeof(wave_chunk_prefix_t);
 
-		if (offset + c.length > len) {
+		if (offset + c.length > size) {
 			log_appendf(4, "Corrupt WAV file. Chunk points outside of WAV file [%lu + %u > %lu]\n",
-			    (unsigned long) offset, c.length, (unsigned long) len);
+			    (unsigned long) offset, c.length, (unsigned long) size);
 			return 0;
 		}
 
@@ -150,6 +156,8 @@ static int wav_load(wave_file_t *f, const uint8_t *data, size_t len)
 				return 0;
 			}
 
+			if (offset + sizeof(wave_format_t) > len)
+				return (len < size) ? READ_INFO_MORE : 0;
 			have_format = 1;
 			memcpy(&f->fmt, data + offset, sizeof(wave_format_t));
 #if WORDS_BIGENDIAN
@@ -176,7 +184,7 @@ static int wav_load(wave_file_t *f, const uint8_t *data, size_t len)
 
 	    offset += c.length;
 
-	    if (offset == len)
+	    if (offset == size)
 		    break;
 	}
 
@@ -190,7 +198,7 @@ int fmt_wav_load_sample(const uint8_t *data, size_t len, song_sample_t *smp)
 	wave_file_t f;
 	uint32_t flags;
 
-	if (!wav_load(&f, data, len))
+	if (wav_load(&f, data, len, len) != 1)
 		return 0;
 
 	if (f.fmt.format != WAVE_FORMAT_PCM ||
@@ -227,9 +235,10 @@ int fmt_wav_load_sample(const uint8_t *data, size_t len, song_sample_t *smp)
 int fmt_wav_read_info(dmoz_file_t *file, const uint8_t *data, size_t length)
 {
 	wave_file_t f;
+	int r = wav_load(&f, data, length, MAX(length, file->filesize));
 
-	if (!wav_load(&f, data, length))
-		return 0;
+	if (r != 1)
+		return r;
 	else if (f.fmt.format != WAVE_FORMAT_PCM ||
 		!f.fmt.freqHz ||
 		(f.fmt.channels != 1 && f.fmt.channels != 2) ||
@@ -354,16 +363,16 @@ int fmt_wav_export_body(disko_t *fp, const uint8_t *data, size_t length)
 	wwd->numbytes += length;
 
 	if (wwd->swap) {
+		/* swap into the output block -- which may well be where the data already is */
 		const int16_t *ptr = (const int16_t *) data;
-		uint16_t v;
-
-		length /= 2;
-		while (length--) {
-			v = *ptr;
-			v = bswapLE16(v);
-			disko_write(fp, &v, 2);
-			ptr++;
-		}
+		int16_t *out = (int16_t *) disko_block(fp, length);
+		size_t n;
+
+		if (!out)
+			return DW_ERROR;
+		for (n = 0; n < length / 2; n++)
+			out[n] = bswapLE16(ptr[n]);
+		disko_write(fp, out, length);
 	} else {
 		disko_write(fp, data, length);
 	}
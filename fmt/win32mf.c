@@ -410,9 +410,15 @@ int fmt_win32mf_read_info(dmoz_file_t *file, const uint8_t *data, size_t length)
 {
 	if (!media_foundation_initialized)
 		return 0;
+	/* there's no telling what Media Foundation wants to look at */
+	if (length < file->filesize)
+		return READ_INFO_MORE;
 
 	int success = 0;
 
+	/* this can get called from the file browser's probing threads */
+	HRESULT com_init = CoInitializeEx(NULL, COM_INITFLAGS);
+
 	wchar_t *url = NULL;
 	if (!file->path || charset_iconv(file->path, (uint8_t **)&url, CHARSET_UTF8, CHARSET_WCHAR_T))
 		url = NULL;
@@ -430,6 +436,9 @@ int fmt_win32mf_read_info(dmoz_file_t *file, const uint8_t *data, size_t length)
 cleanup:
 	MEDIA_FOUNDATION_END()
 
+	if (SUCCEEDED(com_init))
+		CoUninitialize();
+
 	return success;
 }
 
@@ -356,11 +356,12 @@ static void load_xm_patterns(song_t *song, struct xm_file_header *hdr, slurp_t *
 		log_appendf(4, " Warning: Too many patterns in song (%u skipped)", lostpat);
 }
 
-static void load_xm_samples(song_sample_t *first, int total, slurp_t *fp)
+/* the data isn't decoded yet: this just fills in 'reads' for csf_read_samples, and returns how many */
+static int load_xm_samples(song_sample_t *first, int total, slurp_t *fp, struct sample_read *reads)
 {
 	song_sample_t *smp = first;
 	size_t smpsize;
-	int ns;
+	int ns, nreads = 0;
 
 	// dontyou: 20 samples starting at 26122
 	// trnsmix: 31 samples starting at 61946
@@ -378,16 +379,21 @@ static void load_xm_samples(song_sample_t *first, int total, slurp_t *fp)
 			smp->loop_start >>= 1;
 			smp->loop_end >>= 1;
 		}
+		reads[nreads].sample = smp;
+		reads[nreads].data = fp->data + fp->pos;
+		reads[nreads].length = fp->length - fp->pos;
 		if (smp->adlib_bytes[0] != 0xAD) {
-			csf_read_sample(smp, SF_LE | ((smp->flags & CHN_STEREO) ? SF_SS : SF_M) | SF_PCMD | ((smp->flags & CHN_16BIT) ? SF_16 : SF_8),
-					fp->data + fp->pos, fp->length - fp->pos);
+			reads[nreads].flags = SF_LE | ((smp->flags & CHN_STEREO) ? SF_SS : SF_M) | SF_PCMD
+				| ((smp->flags & CHN_16BIT) ? SF_16 : SF_8);
 		} else {
 			smp->adlib_bytes[0] = 0;
 			smpsize = 16 + (smpsize + 1) / 2;
-			csf_read_sample(smp, SF_8 | SF_M | SF_LE | SF_PCMD16, fp->data + fp->pos, fp->length - fp->pos);
+			reads[nreads].flags = SF_8 | SF_M | SF_LE | SF_PCMD16;
 		}
+		nreads++;
 		slurp_seek(fp, smpsize, SEEK_CUR);
 	}
+	return nreads;
 }
 
 // Volume/panning envelope loop fix
@@ -448,7 +454,8 @@ enum {
 
 // this also does some tracker detection
 // return value is the number of samples that need to be loaded later (for old xm files)
-static int load_xm_instruments(song_t *song, struct xm_file_header *hdr, slurp_t *fp)
+static int load_xm_instruments(song_t *song, struct xm_file_header *hdr, slurp_t *fp,
+	struct sample_read *reads, int *nreads)
 {
 	int n, ni, ns;
 	int abssamp = 1; // "real" sample
@@ -749,7 +756,7 @@ static int load_xm_instruments(song_t *song, struct xm_file_header *hdr, slurp_t
 			smp->vib_speed = vrate;
 		}
 		if (hdr->version == 0x0104)
-			load_xm_samples(song->samples + abssamp, ns, fp);
+			*nreads += load_xm_samples(song->samples + abssamp, ns, fp, reads + *nreads);
 		abssamp += ns;
 		// if we ran out of samples, stop trying to load instruments
 		// (note this will break things with xm format ver < 0x0104!)
@@ -777,7 +784,8 @@ static int load_xm_instruments(song_t *song, struct xm_file_header *hdr, slurp_t
 int fmt_xm_load_song(song_t *song, slurp_t *fp, UNUSED unsigned int lflags)
 {
 	struct xm_file_header hdr;
-	int n;
+	struct sample_read reads[MAX_SAMPLES];
+	int n, nreads = 0;
 	uint8_t b;
 
 	slurp_read(fp, &hdr, sizeof(hdr));
@@ -828,12 +836,13 @@ int fmt_xm_load_song(song_t *song, slurp_t *fp, UNUSED unsigned int lflags)
 
 	if (hdr.version == 0x0104) {
 		load_xm_patterns(song, &hdr, fp);
-		load_xm_instruments(song, &hdr, fp);
+		load_xm_instruments(song, &hdr, fp, reads, &nreads);
 	} else {
-		int nsamp = load_xm_instruments(song, &hdr, fp);
+		int nsamp = load_xm_instruments(song, &hdr, fp, reads, &nreads);
 		load_xm_patterns(song, &hdr, fp);
-		load_xm_samples(song->samples + 1, nsamp, fp);
+		nreads = load_xm_samples(song->samples + 1, nsamp, fp, reads);
 	}
+	csf_read_samples(reads, nreads);
 	csf_insert_restart_pos(song, hdr.restart);
 
 	// ModPlug song message
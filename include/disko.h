@@ -38,6 +38,7 @@ struct disko {
 	void (*_putc)(disko_t *ds, int c);
 	void (*_seek)(disko_t *ds, long offset, int whence);
 	long (*_tell)(disko_t *ds);
+	uint8_t *(*_block)(disko_t *ds, size_t len);
 
 	// Temporary filename that's being written to
 	char tempname[PATH_MAX];
@@ -59,6 +60,10 @@ struct disko {
 
 	// for memory buffers
 	size_t pos, length, allocated;
+
+	// for disk files: what disko_block hands out
+	uint8_t *block;
+	size_t block_size;
 };
 
 enum {
@@ -85,6 +90,13 @@ DW_ERROR (and sets errno) if there was a file error.
 (the semantics of this might change later to allow finer control) */
 int disko_close(disko_t *f, int backup);
 
+/* Somewhere to put the next 'len' bytes before passing them to disko_write, so they don't get
+copied again on the way out. For memory buffers, this is the spot in the buffer where they'll end
+up; for files, it's a block that goes straight to fwrite (which doesn't copy anything that big
+into its own buffer). Only good until the next call to any other disko function on 'ds'.
+Returns NULL, and sets the error, if there's no memory for it. */
+uint8_t *disko_block(disko_t *ds, size_t len);
+
 /* alloc/free a memory buffer
 if free_buffer is 0, the internal buffer is left alone when deallocating,
 so that it can continue to be used later */
@@ -111,6 +123,13 @@ int disko_export_song(const char *filename, const struct save_format *format);
 return: DW_SYNC_*, self explanatory */
 int disko_sync(void);
 
+/* render inputs[n] to outputs[n] for each of 'count' files, several at a time (threads <= 0 means
+one per CPU), without the dialog. This blocks until everything is done, and prints the render
+speed of each file to stdout as it finishes. Multi-write formats aren't supported.
+Returns the number of files that failed. */
+int disko_export_batch(const char *const *inputs, const char *const *outputs, int count,
+	const struct save_format *format, int threads);
+
 
 
 /* For use by the diskwriter drivers: */
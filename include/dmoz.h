@@ -158,7 +158,9 @@ int dmoz_filter_ext_data(dmoz_file_t *file);
 /* same as dmoz_filter_ext_data, but always returns 1 (for async title reading) */
 int dmoz_fill_ext_data(dmoz_file_t *file);
 
-/* filters stuff based on... whatever you like :) */
+/* filters stuff based on... whatever you like :) if the filter reads the extended data (i.e. calls
+dmoz_filter_ext_data on the file it's given), the files after the current one are read ahead of time
+in the background; only ever free a list that's being filtered with dmoz_free. */
 void dmoz_filter_filelist(dmoz_filelist_t *flist, int (*grep)(dmoz_file_t *f), int *pointer, void (*onmove)(void));
 
 /* butt */
@@ -202,10 +204,32 @@ void dmoz_add_file_or_dir(dmoz_filelist_t *flist, dmoz_dirlist_t *dlist,
 /* this is called by main to actually do some dmoz work. returns 0 if there is no dmoz work to do...
 */
 int dmoz_worker(void);
+/* stops the threads that read file info in the background; called on the way out */
+void dmoz_shutdown(void);
 
 /* these update the file selection cache for the various pages */
 void dmoz_cache_update_names(const char *path, const char *filen, const char *dirn);
 void dmoz_cache_update(const char *path, dmoz_filelist_t *fl, dmoz_dirlist_t *dl);
 void dmoz_cache_lookup(const char *path, dmoz_filelist_t *fl, dmoz_dirlist_t *dl);
 
+/* Persistent cache of the extended data (dmoz-cache.c). dmoz_filter_ext_data uses this already, so
+there's usually no need to call the lookup/store functions directly. */
+struct dmoz_info_cache_stats {
+	uint32_t hits;    /* found, and the file hasn't changed */
+	uint32_t misses;  /* never seen before */
+	uint32_t stale;   /* seen before, but the size or timestamp changed */
+	uint32_t saved;   /* records written to disk */
+	uint32_t entries; /* total number of files in the cache */
+};
+
+/* return 1 and fill in the extended data if the cache has an up-to-date entry for the file;
+'ok' gets what dmoz_filter_ext_data returned when the file was probed */
+int dmoz_info_cache_lookup(dmoz_file_t *file, int *ok);
+void dmoz_info_cache_store(dmoz_file_t *file, int ok);
+/* write anything new out to disk */
+void dmoz_info_cache_save(void);
+void dmoz_info_cache_get_stats(struct dmoz_info_cache_stats *s);
+void dmoz_info_cache_enable(int enable);
+int dmoz_info_cache_enabled(void);
+
 #endif /* SCHISM_DMOZ_H_ */
@@ -90,7 +90,7 @@ READ_INFO(far) LOAD_SONG(far)
 /* These next formats have their magic at the beginning of the data, so none of them can possibly
 conflict with other ones. I've organized them pretty much in order of popularity. */
 READ_INFO(xm) LOAD_SONG(xm)
-READ_INFO(it) LOAD_SONG(it) SAVE_SONG(it)
+READ_INFO(it) LOAD_SONG(it) SAVE_SONG(it) SAVE_SONG(it215)
 READ_INFO(mt2)
 READ_INFO(mtm) LOAD_SONG(mtm)
 READ_INFO(ntk)
@@ -103,7 +103,7 @@ READ_INFO(mf)
 READ_INFO(dsm) LOAD_SONG(dsm)
 
 /* Sample formats with magic at start of file */
-READ_INFO(its)  LOAD_SAMPLE(its)  SAVE_SAMPLE(its)
+READ_INFO(its)  LOAD_SAMPLE(its)  SAVE_SAMPLE(its)  SAVE_SAMPLE(its215)
 READ_INFO(au)   LOAD_SAMPLE(au)   SAVE_SAMPLE(au)
 READ_INFO(aiff) LOAD_SAMPLE(aiff) SAVE_SAMPLE(aiff) EXPORT(aiff)
 READ_INFO(wav)  LOAD_SAMPLE(wav)  SAVE_SAMPLE(wav)  EXPORT(wav)
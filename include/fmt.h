@@ -56,6 +56,12 @@ enum {
 	SAVE_INTERNAL_ERROR,    /* something unrelated to disk i/o */
 };
 
+/* info readers only get the first FMT_INFO_PREFIX bytes of the file (file->filesize has the real size).
+if that isn't enough to tell, return READ_INFO_MORE -- only when length < file->filesize, and before
+touching 'file' -- and the whole lot is read in and everything is tried again. */
+#define FMT_INFO_PREFIX 65536
+#define READ_INFO_MORE  (-1)
+
 /* --------------------------------------------------------------------------------------------------------- */
 
 #define PROTO_READ_INFO         (dmoz_file_t *file, const uint8_t *data, size_t length)
@@ -135,13 +141,18 @@ int instrument_loader_sample(struct instrumentloader *ii, int slot);
 
 uint32_t it_decompress8(void *dest, uint32_t len, const void *file, uint32_t filelen, int it215, int channels);
 uint32_t it_decompress16(void *dest, uint32_t len, const void *file, uint32_t filelen, int it215, int channels);
+/* write 'len' samples (every 'channels'th one from 'src') in IT's compressed format; returns the number of
+bytes written */
+uint32_t it_compress8(disko_t *fp, const void *src, uint32_t len, int it215, int channels);
+uint32_t it_compress16(disko_t *fp, const void *src, uint32_t len, int it215, int channels);
 
 uint16_t mdl_read_bits(uint32_t *bitbuf, uint32_t *bitnum, uint8_t **ibuf, int8_t n);
 
 /* --------------------------------------------------------------------------------------------------------- */
 
-/* shared by the .it, .its, and .iti saving functions */
-void save_its_header(disko_t *fp, song_sample_t *smp);
+/* shared by the .it, .its, and .iti saving functions
+('it215' marks the sample data as IT 2.15 compressed) */
+void save_its_header(disko_t *fp, song_sample_t *smp, int it215);
 void save_iti_instrument(disko_t *fp, song_t *song, song_instrument_t *ins, int iti_file);
 int load_its_sample(const uint8_t *header, const uint8_t *data, size_t length, song_sample_t *smp);
 void load_it_instrument(song_instrument_t *instrument, const uint8_t *data);
@@ -63,6 +63,9 @@ void kbd_handle_key_repeat(void);
 void kbd_cache_key_repeat(struct key_event* kk);
 void kbd_empty_key_repeat(void);
 
+/* milliseconds until kbd_handle_key_repeat has something to do, or -1 if no key is held */
+int kbd_key_repeat_wait(void);
+
 /* use 0 for delay to (re)set the default rate. */
 void kbd_set_key_repeat(int delay, int rate);
 
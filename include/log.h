@@ -30,6 +30,12 @@ void log_appendf(int color, const char *format, ...)
 	__attribute__ ((format(printf, 2, 3)));
 void log_underline(int chars);
 
+/* Lines logged from other threads wait until the main thread logs something, draws the log, or calls
+this; it does nothing on any other thread. */
+void log_flush(void);
+/* print every line to stderr too, for when there's no window */
+void log_set_headless(int headless);
+
 void log_perror(const char *prefix);
 
 void status_text_flash(const char *format, ...)
@@ -153,6 +153,11 @@ int macosx_midi_setup(void);    // SCHISM_MACOSX
 
 /* called by audio system when buffer stuff change */
 void midi_queue_alloc(int buffer_size, int channels, int samples_per_second);
+/* called by the audio thread before it mixes a buffer 'frames' long; the 'pos' given to
+midi_send_buffer is how many of those frames were left to mix when the message came up */
+void midi_queue_mark(unsigned int frames);
+/* log how close to on time the queued MIDI out has been since the last report */
+void midi_queue_report(void);
 
 /* MIDI_PITCH_BEND is defined by OSS -- maybe these need more specific names? */
 #define MIDI_TICK_QUANTIZE      0x00000001
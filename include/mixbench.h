@@ -0,0 +1,49 @@
+/*
+ * Schism Tracker - a cross-platform Impulse Tracker clone
+ * copyright (c) 2003-2005 Storlek <storlek@rigelseven.com>
+ * copyright (c) 2005-2008 Mrs. Brisby <mrs.brisby@nimh.org>
+ * copyright (c) 2009 Storlek & Mrs. Brisby
+ * copyright (c) 2010-2012 Storlek
+ * URL: http://schismtracker.org/
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef SCHISM_MIXBENCH_H_
+#define SCHISM_MIXBENCH_H_
+
+/* Time the mixer (--bench) on the built-in stress songs plus any files given, 'seconds' of output per
+run, for every interpolation mode with instrument filters and volume ramping each on and off.
+One tab-separated line per run goes to stdout, after a header line naming the columns.
+Returns the number of files that couldn't be loaded. */
+int mixbench_run(char *const *files, int count, int seconds);
+
+/* Time the IT sample decompressor (--bench-decompress): every sample of the same songs is compressed both
+ways, IT 2.14 and 2.15, and then decompressed for 'seconds'. Same output and return value as above. */
+int mixbench_decompress_run(char *const *files, int count, int seconds);
+
+/* Self-tests (--check), on the same songs: each song is rendered on its own and then all of them at
+once on separate threads, and the two have to match. Then samples are put through IT 2.14 and 2.15
+compression and back, and have to come out the same, and the SIMD mixers are held up against the C
+ones at the highest speed. One tab-separated line per test goes to stdout; anything that went wrong
+goes to stderr. Returns the number of failures. */
+int mixbench_check_run(char *const *files, int count);
+
+/* Fuzz the IT sample decompressor (--check-decompress): each file is compressed sample data, and it and
+'rounds' broken copies of it are decoded every way they can be. Nothing may be read or written out of
+bounds. Same output as --check; returns the number of failures. */
+int mixbench_fuzz_decompress_run(char *const *files, int count, int rounds);
+
+#endif /* SCHISM_MIXBENCH_H_ */
@@ -13,13 +13,42 @@
 
 
 void init_mix_buffer(int *, unsigned int);
-void stereo_fill(int *, unsigned int, int*, int *);
+void stereo_fill(int *, const int *, unsigned int, int*, int *);
 void end_channel_ofs(song_voice_t *, int *, unsigned int);
 void interleave_front_rear(int *, int *, unsigned int);
 void mono_from_stereo(int *, unsigned int);
 
 unsigned int csf_create_stereo_mix(song_t *csf, int count);
 
+typedef void(* mix_interface_t)(song_voice_t *, int *, int *);
+
+//
+// Mix function tables
+//
+//
+// Index is as follows:
+//      [b1-b0] format (8-bit-mono, 16-bit-mono, 8-bit-stereo, 16-bit-stereo)
+//      [b2]    ramp
+//      [b3]    filter
+//      [b5-b4] src type
+
+#define MIXNDX_16BIT        0x01
+#define MIXNDX_STEREO       0x02
+#define MIXNDX_RAMP         0x04
+#define MIXNDX_FILTER       0x08
+#define MIXNDX_LINEARSRC    0x10
+#define MIXNDX_SPLINESRC    0x20
+#define MIXNDX_FIRSRC       0x30
+
+#define MIX_FUNCTION_TABLE_SIZE (2 * 2 * 16)
+
+/* replacements for (some of) the mix functions; NULL entries are left as-is */
+struct mix_simd_kernels {
+	const char *name;
+	const mix_interface_t *mix;
+	const mix_interface_t *fastmix;
+};
+
 void setup_channel_filter(song_voice_t *pChn, int reset, int flt_modifier, int freq);
 
 
@@ -35,20 +64,41 @@ void normalize_mono(song_t *, int *, unsigned int);
 void normalize_stereo(song_t *, int *, unsigned int);
 void eq_mono(song_t *, int *, unsigned int);
 void eq_stereo(song_t *, int *, unsigned int);
-void initialize_eq(int, float);
-void set_eq_gains(const unsigned int *, unsigned int, const unsigned int *, int, int);
-
-
-// sndmix.c
-extern int g_dry_rofs_vol;
-extern int g_dry_lofs_vol;
+void initialize_eq(song_t *, int, float);
+void set_eq_gains(song_t *, const unsigned int *, unsigned int, const unsigned int *, int, int);
 
 
 // mixer.c
-void ResampleMono8BitFirFilter(signed char *oldbuf, signed char *newbuf, unsigned long oldlen, unsigned long newlen);
-void ResampleMono16BitFirFilter(signed short *oldbuf, signed short *newbuf, unsigned long oldlen, unsigned long newlen);
-void ResampleStereo8BitFirFilter(signed char *oldbuf, signed char *newbuf, unsigned long oldlen, unsigned long newlen);
-void ResampleStereo16BitFirFilter(signed short *oldbuf, signed short *newbuf, unsigned long oldlen, unsigned long newlen);
+void csf_init_mix_functions(void);
+const char *csf_mix_functions_name(void);
+/* The plain C mix function for a MIXNDX_* index, and whatever csf_init_mix_functions put in its place,
+for the self-tests to compare. */
+void csf_get_mix_function(int index, int fast, mix_interface_t *c, mix_interface_t *current);
+
+/* Parallel voice mixing. csf_run_mix_jobs is set by the frontend to something that calls
+func(data, job) for each job in [0, njobs) and waits for them all; if it's NULL, or mix_threads
+is less than 2, or fewer than mix_thread_voices voices are playing, everything is mixed on the
+calling thread. The output is identical either way. At most MAX_MIX_THREADS jobs are used. */
+extern unsigned int mix_threads;
+extern unsigned int mix_thread_voices;
+extern void (*csf_run_mix_jobs)(void (*func)(void *data, unsigned int job), void *data, unsigned int njobs);
+
+extern const signed short *const mix_cubic_spline_lut;
+extern const signed short *const mix_windowed_fir_lut;
+
+/* These only write frames [start, end) of newbuf, so a long sample can be done a piece at a time. */
+void ResampleMono8BitFirFilter(signed char *oldbuf, signed char *newbuf, unsigned long oldlen, unsigned long newlen,
+	unsigned long start, unsigned long end);
+void ResampleMono16BitFirFilter(signed short *oldbuf, signed short *newbuf, unsigned long oldlen, unsigned long newlen,
+	unsigned long start, unsigned long end);
+void ResampleStereo8BitFirFilter(signed char *oldbuf, signed char *newbuf, unsigned long oldlen, unsigned long newlen,
+	unsigned long start, unsigned long end);
+void ResampleStereo16BitFirFilter(signed short *oldbuf, signed short *newbuf, unsigned long oldlen, unsigned long newlen,
+	unsigned long start, unsigned long end);
+
+
+// mixer-simd.c
+const struct mix_simd_kernels *mix_simd_detect(void);
 
 #endif /* SCHISM_PLAYER_CMIXER_H_ */
 
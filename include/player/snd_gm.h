@@ -1,17 +1,22 @@
 #ifndef SCHISM_PLAYER_SND_GM_H_
 #define SCHISM_PLAYER_SND_GM_H_
 
-void GM_Patch(int c, unsigned char p, int pref_chn_mask);
-void GM_DPatch(int ch, unsigned char GM, unsigned char bank, int pref_chn_mask);
+#include "player/sndfile.h"
 
-void GM_Bank(int c, unsigned char b);
-void GM_Touch(int c, unsigned char Vol); // range 0..127
-void GM_KeyOn(int c, unsigned char key, unsigned char Vol); // vol range 0..127
-void GM_KeyOff(int c);
-void GM_Bend(int c, unsigned Count);
-void GM_Reset(int quitting); // 0=settings that work for us, 1=normal settings
+/* These all act on csf->gm, and send their MIDI through csf_midi_send(csf, ...). */
 
-void GM_Pan(int ch, signed char val); // param: -128..+127
+void GM_Patch(song_t *csf, int c, unsigned char p, int pref_chn_mask);
+void GM_DPatch(song_t *csf, int ch, unsigned char GM, unsigned char bank, int pref_chn_mask);
+
+void GM_Bank(song_t *csf, int c, unsigned char b);
+void GM_Touch(song_t *csf, int c, unsigned char Vol); // range 0..127
+void GM_KeyOn(song_t *csf, int c, unsigned char key, unsigned char Vol); // vol range 0..127
+void GM_KeyOff(song_t *csf, int c);
+void GM_Bend(song_t *csf, int c, unsigned Count);
+void GM_Reset(song_t *csf, int quitting); // 0=settings that work for us, 1=normal settings
+void GM_SetVoiceCount(song_t *csf, unsigned int old, unsigned int count); // see csf_set_voice_count
+
+void GM_Pan(song_t *csf, int ch, signed char val); // param: -128..+127
 
 // This function is the core function for MIDI updates.
 // It handles keyons, touches and pitch bending.
@@ -27,13 +32,13 @@ void GM_Pan(int ch, signed char val); // param: -128..+127
 // Note that vibrato etc. are emulated by issuing multiple SetFreqAndVol
 // commands; they are not translated into MIDI vibrato operator calls.
 typedef enum { MIDI_BEND_NORMAL, MIDI_BEND_DOWN, MIDI_BEND_UP } MidiBendMode;
-void GM_SetFreqAndVol(int channel, int Hertz, int Vol, MidiBendMode bend_mode, int keyoff);
-
-void GM_SendSongStartCode(void);
-void GM_SendSongStopCode(void);
-void GM_SendSongContinueCode(void);
-void GM_SendSongTickCode(void);
-void GM_SendSongPositionCode(unsigned note16pos);
-void GM_IncrementSongCounter(int count);
+void GM_SetFreqAndVol(song_t *csf, int channel, int Hertz, int Vol, MidiBendMode bend_mode, int keyoff);
+
+void GM_SendSongStartCode(song_t *csf);
+void GM_SendSongStopCode(song_t *csf);
+void GM_SendSongContinueCode(song_t *csf);
+void GM_SendSongTickCode(song_t *csf);
+void GM_SendSongPositionCode(song_t *csf, unsigned note16pos);
+void GM_IncrementSongCounter(song_t *csf, int count);
 
 #endif /* SCHISM_PLAYER_SND_GM_H_ */
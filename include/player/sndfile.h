@@ -21,7 +21,8 @@
 #define MAX_PATTERNS            240
 #define MAX_SAMPLES             236
 #define MAX_INSTRUMENTS         MAX_SAMPLES
-#define MAX_VOICES              256
+#define MAX_VOICES              4096 /* the most a song's voice pool can hold (csf_set_voice_count) */
+#define DEFAULT_VOICES          256
 #define MAX_CHANNELS            64
 #define MAX_ENVPOINTS           32
 #define MAX_INFONAME            80
@@ -30,6 +31,7 @@
 
 #define MIX_MAX_CHANNELS		2 /* used for filters and stuff */
 #define MIXBUFFERSIZE           512
+#define MAX_MIX_THREADS         16 /* see csf_run_mix_jobs in cmixer.h */
 
 
 #define CHN_16BIT               0x01 // 16-bit sample
@@ -224,6 +226,7 @@
 #define SNDMIX_ULTRAHQSRCMODE   0x0400 // polyphase resampling (or FIR? I don't know)
 // Misc Flags (can safely be turned on or off)
 #define SNDMIX_DIRECTTODISK     0x10000 // disk writer mode
+#define SNDMIX_NOMIDI           0x20000 // don't call the MIDI out hooks (for playing through silently)
 #define SNDMIX_NOBACKWARDJUMPS  0x40000 // disallow Bxx jumps from going backward in the orderlist
 //#define SNDMIX_MAXDEFAULTPAN  0x80000 // (no longer) Used by the MOD loader
 #define SNDMIX_MUTECHNMODE      0x100000 // Notes are not played on muted channels
@@ -397,7 +400,8 @@ typedef struct song_instrument {
 // (TODO also the majority of this is irrelevant outside of the "main" 64 channels;
 // this struct should really only be holding the stuff actually needed for mixing)
 typedef struct song_voice {
-	// First 32-bytes: Most used mixing information: don't change it
+	// Everything the mixer touches, and nothing else: a voice being mixed only ever pulls in the
+	// first two cache lines. Anything added here has to be something the mix loops really need.
 	signed char * current_sample_data;
 	uint32_t position; // sample position, fixed-point -- integer part
 	uint32_t position_frac; // fractional part
@@ -406,15 +410,12 @@ typedef struct song_voice {
 	int32_t left_volume; // ?
 	int32_t right_ramp; // ?
 	int32_t left_ramp; // ?
-	// 2nd cache line
 	uint32_t length; // only to the end of the loop
 	uint32_t flags;
-	uint32_t old_flags;
 	uint32_t loop_start; // loop or sustain, whichever is active
 	uint32_t loop_end;
 	int32_t right_ramp_volume; // ?
 	int32_t left_ramp_volume; // ?
-	int32_t strike; // decremented to zero. this affects how long the initial hit on the playback marks lasts (bigger dot in instrument and sample list windows)
 
 	//int32_t filter_y1, filter_y2, filter_y3, filter_y4;
 	//int32_t filter_a0, filter_b0, filter_b1;
@@ -423,12 +424,16 @@ typedef struct song_voice {
 
 	int32_t rofs, lofs; // ?
 	int32_t ramp_length;
-	// Information not used in the mixer
 	int32_t right_volume_new, left_volume_new; // ?
+	int32_t fadeout_volume;
+	uint32_t master_channel; // nonzero = background/NNA voice, indicates what channel it "came from"
+
+	// Information not used in the mixer
+	uint32_t old_flags;
+	int32_t strike; // decremented to zero. this affects how long the initial hit on the playback marks lasts (bigger dot in instrument and sample list windows)
 	int32_t final_volume; // range 0-16384 (?), accounting for sample+channel+global+etc. volumes
 	int32_t final_panning; // range 0-256 (but can temporarily exceed that range during calculations)
 	int32_t volume, panning; // range 0-256 (?); these are the current values set for the channel
-	int32_t fadeout_volume;
 	int32_t frequency;
 	int32_t c5speed;
 	int32_t sample_freq; // only used on the info page (F5)
@@ -438,7 +443,6 @@ typedef struct song_voice {
 	int vol_env_position;
 	int pan_env_position;
 	int pitch_env_position;
-	uint32_t master_channel; // nonzero = background/NNA voice, indicates what channel it "came from"
 	uint32_t vu_meter;
     // TODO: As noted elsewhere, this means current channel volume.
 	int32_t global_volume;
@@ -446,7 +450,7 @@ typedef struct song_voice {
     //  And we miss a value for "running envelope volume" for the page_info
 	int32_t instrument_volume;
 	int32_t autovib_depth;
-	uint32_t autovib_position, vibrato_position, tremolo_position, panbrello_position;
+	uint32_t autovib_position, vibrato_position;
 	// 16-bit members
 	int vol_swing, pan_swing;
 	uint16_t channel_panning;
@@ -455,41 +459,50 @@ typedef struct song_voice {
 	unsigned int note; // the note that's playing
 	unsigned int nna;
 	unsigned int new_note, new_instrument; // ?
-	// Effect memory and handling
+	// Effect state that carries over to background voices (the rest is in song_channel_fx_t)
 	unsigned int n_command; // This sucks and needs to go away (dumb "flag" for arpeggio / tremor)
-	unsigned int mem_vc_volslide; // Ax Bx Cx Dx (volume column)
 	unsigned int mem_arpeggio; // Axx
+	unsigned int mem_offset; // final, combined yxx00h from Oxx and SAy
+	unsigned int vib_type, vibrato_speed, vibrato_depth;
+	unsigned int panbrello_depth;
+	int tremolo_delta, panbrello_delta;
+
+	unsigned int cutoff;
+	unsigned int resonance;
+	unsigned int cd_tremor; // (weird) countdown + flag: see snd_fx.c and sndmix.c
+
+	unsigned int row_note, row_instr;
+	unsigned int row_voleffect, row_volparam;
+	unsigned int row_effect, row_param;
+	unsigned int last_instrument;
+} song_voice_t;
+
+/* Effect memory, countdowns, and so on for the pattern channels. Background voices never run
+effects, so none of this belongs in song_voice_t, where it'd get copied along with every NNA. */
+typedef struct song_channel_fx {
+	unsigned int mem_vc_volslide; // Ax Bx Cx Dx (volume column)
 	unsigned int mem_volslide; // Dxx
 	unsigned int mem_pitchslide; // Exx Fxx (and Gxx maybe)
 	int32_t mem_portanote; // Gxx (synced with mem_pitchslide if compat gxx is set)
 	unsigned int mem_tremor; // Ixx
 	unsigned int mem_channel_volslide; // Nxx
-	unsigned int mem_offset; // final, combined yxx00h from Oxx and SAy
 	unsigned int mem_panslide; // Pxx
 	unsigned int mem_retrig; // Qxx
 	unsigned int mem_special; // Sxx
 	unsigned int mem_tempo; // Txx
 	unsigned int mem_global_volslide; // Wxx
 	unsigned int note_slide_counter, note_slide_speed, note_slide_step; // IMF effect
-	unsigned int vib_type, vibrato_speed, vibrato_depth;
 	unsigned int tremolo_type, tremolo_speed, tremolo_depth;
-	unsigned int panbrello_type, panbrello_speed, panbrello_depth;
-	int tremolo_delta, panbrello_delta;
+	unsigned int panbrello_type, panbrello_speed;
+	uint32_t tremolo_position, panbrello_position;
 
-	unsigned int cutoff;
-	unsigned int resonance;
 	int cd_note_delay; // countdown: note starts when this hits zero
 	int cd_note_cut; // countdown: note stops when this hits zero
 	int cd_retrig; // countdown: note retrigs when this hits zero
-	unsigned int cd_tremor; // (weird) countdown + flag: see snd_fx.c and sndmix.c
 	unsigned int patloop_row; // row number that SB0 was on
 	unsigned int cd_patloop; // countdown: pattern loops back when this hits zero
-
-	unsigned int row_note, row_instr;
-	unsigned int row_voleffect, row_volparam;
-	unsigned int row_effect, row_param;
-	unsigned int active_macro, last_instrument;
-} song_voice_t;
+	unsigned int active_macro;
+} song_channel_fx_t;
 
 typedef struct song_channel {
 	uint32_t panning;
@@ -525,29 +538,87 @@ typedef struct {
 extern midi_config_t default_midi_config;
 
 
-extern uint32_t max_voices;
-extern uint32_t global_vu_left, global_vu_right;
-
 extern const song_note_t blank_pattern[64 * 64];
 extern const song_note_t *blank_note;
 
 
+struct song_timeline; // timeline.c
+struct song_snapshots; // snapshot.c
+
 struct multi_write {
-	int used;
+	int used; // anything has been played on this channel yet
+	int touched; // 'buffer' has been cleared and mixed into for the current chunk
 	void *data;
 	/* Conveniently, this has the same prototype as disko_write :) */
 	void (*write)(void *data, const uint8_t *buf, size_t bytes);
 	/* this is optimization for channels that haven't had any data yet
 	(nothing to convert/write, just seek ahead in the data stream) */
 	void (*silence)(void *data, long bytes);
-	int buffer[MIXBUFFERSIZE * 2];
+	/* how much silence the channel is owed; it isn't passed on until (unless) there's something
+	to write after it, so channels that never play anything don't cost anything */
+	size_t pending;
+	int *buffer; // MIXBUFFERSIZE * 2, allocated when the channel is first played
 };
 
+typedef struct {
+	float a0, a1, a2, b1, b2;
+	float x1, x2, y1, y2;
+	float gain, center_frequency;
+	int enabled;
+} eq_band_t;
+
+// AdLib emulation (snd_fm.c)
+typedef struct {
+	struct OPL *chip;
+	uint32_t retval, regno;
+	uint32_t active; // set once a note has been played; the chip isn't run until then
+	short *buf;
+	int buf_size;
+	const unsigned char *Dtab[9];
+	unsigned char Keyontab[9];
+	int OPLtoChan[9];
+	int Pans[MAX_VOICES];
+	int ChantoOPL[MAX_VOICES];
+} opl_state_t;
+
+// MIDI output (snd_gm.c)
+typedef struct {
+	unsigned char note;  // Which note is playing in this channel (0 = nothing)
+	unsigned char patch; // Which patch was programmed on this channel (&0x80 = percussion)
+	unsigned char bank;  // Which bank was programmed on this channel
+	signed char pan;     // Which pan level was last selected
+	signed char chan;    // Which MIDI channel was allocated for this channel. -1 = none
+	int pref_chn_mask;   // Which MIDI channel was preferred
+} s3m_channel_info_t;
+
+typedef struct {
+	unsigned char volume; // Which volume has been configured for this channel
+	unsigned char patch;  // What is the latest patch configured on this channel
+	unsigned char bank;   // What is the latest bank configured on this channel
+	int bend;             // The latest pitchbend on this channel
+	signed char pan;      // Latest pan
+} midi_state_t;
+
+typedef struct {
+	unsigned RunningStatus;
+	double LastSongCounter;
+	s3m_channel_info_t s3m_chans[MAX_VOICES]; // This maps S3M concepts into MIDI concepts
+	midi_state_t midi_chans[16]; // This helps reduce the MIDI traffic, also does some encapsulation
+} gm_state_t;
+
 typedef struct song {
 	int mix_buffer[MIXBUFFERSIZE * 2];
-
-	song_voice_t voices[MAX_VOICES];                // Channels
-	uint32_t voice_mix[MAX_VOICES];                 // Channels to be mixed
+	// scratch for parallel mixing; job 0 mixes straight into mix_buffer
+	int mix_thread_buffer[MAX_MIX_THREADS - 1][MIXBUFFERSIZE * 2];
+	// click removal from voices that stopped during the chunk, at the sample each one stopped on
+	// (one per mixing job, added into the first one before stereo_fill runs)
+	int mix_ofs_buffer[MAX_MIX_THREADS][MIXBUFFERSIZE * 2];
+
+	song_voice_t *voices;                           // Channels, then background voices: voice_count in all
+	song_channel_fx_t channel_fx[MAX_CHANNELS];     // Effect memory for the first MAX_CHANNELS voices
+	uint32_t *voice_mix;                            // Channels to be mixed
+	uint32_t *voice_active;                         // Background voices in play (see VOICE_ACTIVE_SET)
+	uint32_t voice_count;                           // Size of the voice pool, a multiple of 32
 	song_sample_t samples[MAX_SAMPLES+1];           // Samples (1-based!)
 	song_instrument_t *instruments[MAX_INSTRUMENTS+1]; // Instruments (1-based!)
 	song_channel_t channels[MAX_CHANNELS];          // Channel settings
@@ -561,7 +632,7 @@ typedef struct song {
 	uint32_t initial_global_volume;
 	uint32_t flags;                                 // Song flags SONG_XXXX
 	uint32_t pan_separation;
-	uint32_t num_voices; // how many are currently playing. (POTENTIALLY larger than global max_voices)
+	uint32_t num_voices; // how many are currently playing. (POTENTIALLY larger than max_voices)
 	uint32_t mix_stat; // number of channels being mixed (not really used)
 	uint32_t buffer_count; // number of samples to mix per tick
 	uint32_t tick_count;
@@ -595,6 +666,13 @@ typedef struct song {
 	// mixer stuff
 	uint32_t mix_flags; // SNDMIX_*
 	uint32_t mix_frequency, mix_bits_per_sample, mix_channels;
+	uint32_t max_voices; // voice limit for realtime playback (not enforced for SNDMIX_DIRECTTODISK)
+	uint32_t volume_ramp_samples;
+	int32_t dry_rofs_vol, dry_lofs_vol; // click removal left over from voices that stopped
+	uint32_t vu_left, vu_right; // peak levels of the last csf_read
+	eq_band_t eq[MAX_EQ_BANDS * 2]; // left bands, then right
+	opl_state_t opl;
+	gm_state_t gm;
 
 	int patloop; // effects.c: need this for stupid pattern break compatibility
 
@@ -604,12 +682,38 @@ typedef struct song {
 	// chaseback
 	int stop_at_order;
 	int stop_at_row;
-	unsigned int stop_at_time;
+
+	// when each row gets played; built the first time anyone asks
+	struct song_timeline *timeline;
+	// player state every couple of seconds into playback, for seeking
+	struct song_snapshots *snapshots;
 
 	// multi-write stuff -- NULL if no multi-write is in progress, else array of one struct per channel
 	struct multi_write *multi_write;
 } song_t;
 
+/* voice_active has a bit for every background voice that has a length, so that csf_read_note and
+csf_get_nna_channel only have to look at the ones in play. Anything that starts a background voice
+sets its bit; csf_read_note and the mixer clear it again as soon as the voice stops, so outside of the
+mixer a clear bit always means a free voice. */
+#define VOICE_ACTIVE_SET(csf, n) ((csf)->voice_active[(n) >> 5] |= UINT32_C(1) << ((n) & 31))
+#define VOICE_ACTIVE_CLEAR(csf, n) ((csf)->voice_active[(n) >> 5] &= ~(UINT32_C(1) << ((n) & 31)))
+
+// index of the lowest set bit in a nonzero word
+static inline uint32_t csf_lowest_bit(uint32_t x)
+{
+#if defined(__GNUC__)
+	return __builtin_ctz(x);
+#else
+	uint32_t n = 0;
+	while (!(x & 1)) {
+		x >>= 1;
+		n++;
+	}
+	return n;
+#endif
+}
+
 song_note_t *csf_allocate_pattern(uint32_t rows);
 void csf_free_pattern(void *pat);
 signed char *csf_allocate_sample(uint32_t nbytes);
@@ -619,11 +723,28 @@ void csf_init_instrument(song_instrument_t *ins, int samp);
 void csf_free_instrument(song_instrument_t *p);
 
 uint32_t csf_read_sample(song_sample_t *sample, uint32_t flags, const void *filedata, uint32_t datalength);
+
+/* Loaders that have a lot of samples work out where all of them are first, and then decode them all
+with one call to csf_read_samples (before the file goes away!). Each read is just the arguments to
+csf_read_sample; they all have to be for different samples. If csf_run_load_jobs is set, they're
+spread across it, biggest first. */
+struct sample_read {
+	song_sample_t *sample;
+	uint32_t flags;
+	const void *data;
+	uint32_t length;
+};
+void csf_read_samples(const struct sample_read *reads, uint32_t count);
+// same as csf_run_mix_jobs, for loading; set by the frontend, NULL decodes on the loading thread
+extern void (*csf_run_load_jobs)(void (*func)(void *data, unsigned int job), void *data, unsigned int njobs);
+
 uint32_t csf_write_sample(disko_t *fp, song_sample_t *sample, uint32_t flags, uint32_t maxlengthmask);
 void csf_adjust_sample_loop(song_sample_t *sample);
 
 extern void (*csf_midi_out_note)(int chan, const song_note_t *m);
 extern void (*csf_midi_out_raw)(const unsigned char *, unsigned int, unsigned int);
+// called by csf_read before each chunk it mixes (never more than a tick), on the mixing thread
+extern void (*csf_read_chunk_hook)(song_t *csf);
 
 void csf_import_mod_effect(song_note_t *m, int from_xm);
 uint16_t csf_export_mod_effect(const song_note_t *m, int xm);
@@ -661,14 +782,37 @@ int csf_set_resampling_mode(song_t *csf, uint32_t mode); // SRCMODE_XXXX
 
 // sndmix
 unsigned int csf_read(song_t *csf, void *v_buffer, unsigned int bufsize);
+// one struct multi_write per channel, for song_t.multi_write
+struct multi_write *csf_multi_write_alloc(void);
+void csf_multi_write_free(struct multi_write *mw);
 int csf_process_tick(song_t *csf);
 int csf_read_note(song_t *csf);
 
-// snd_fx
+// timeline
 unsigned int csf_get_length(song_t *csf); // (in seconds)
+unsigned int csf_get_length_to(song_t *csf, int order, int row); // (in seconds)
+// the first row played at that point; returns 0 if the song is over by then
+int csf_get_position_at(song_t *csf, unsigned int seconds, int *order, int *row);
+// throw away the timing from where that pattern is first played (-1 for all of it)
+void csf_timeline_invalidate(song_t *csf, int pattern);
+void csf_timeline_free(song_t *csf);
+// changes whenever any of the timing is thrown away
+unsigned int csf_timeline_generation(song_t *csf);
+
+// snapshot
+/* Play 'work' -- a copy of csf, with its own voices, that's free to be played through -- silently up
+to 'frame' frames (at csf's mixing rate) into playback, picking up from the last snapshot before there
+and keeping new ones along the way. Returns 0 if the song can't get that far. */
+int csf_snapshot_seek(song_t *csf, song_t *work, uint64_t frame);
+// hand the voices and row/tick counters over to another copy of the same song
+void csf_copy_play_state(song_t *dst, const song_t *src);
+void csf_snapshot_free(song_t *csf);
+
+// snd_fx
 void csf_instrument_change(song_t *csf, song_voice_t *chn, uint32_t instr, int porta, int instr_column);
 void csf_note_change(song_t *csf, uint32_t chan, int note, int porta, int retrig, int have_inst);
 uint32_t csf_get_nna_channel(song_t *csf, uint32_t chan);
+void csf_rebuild_active_voices(song_t *csf);
 void csf_check_nna(song_t *csf, uint32_t chan, uint32_t instr, int note, int force_cut);
 void csf_process_effects(song_t *csf, int firsttick);
 int32_t csf_fx_do_freq_slide(uint32_t flags, int32_t frequency, int32_t slide, int is_tone_portamento);
@@ -692,6 +836,14 @@ unsigned long calc_halftone(unsigned long hz, int rel);
 song_t *csf_allocate(void);
 void csf_free(song_t *csf);
 
+/* Resize the voice pool (rounded up to a multiple of 32, at least MAX_CHANNELS + 32 and at most
+MAX_VOICES). Anything playing on a voice past the new end is dropped. */
+void csf_set_voice_count(song_t *csf, uint32_t count);
+/* A song_t that's been memcpy'd from 'src' still shares its voices; this gives it a pool of its own
+with the same voices in it. The copy has to be given back with csf_free_voices. */
+void csf_copy_voices(song_t *dst, const song_t *src);
+void csf_free_voices(song_t *csf);
+
 void csf_destroy(song_t *csf); /* erase everything -- equiv. to new song */
 int csf_destroy_sample(song_t *csf, uint32_t smpnum);
 
@@ -54,5 +54,8 @@ void sample_delta_decode(song_sample_t * sample);
 void sample_mono_left(song_sample_t * sample);
 void sample_mono_right(song_sample_t * sample);
 
+/* Long samples are edited on another thread; this puts the result in once it's done, and has to be
+ * called every so often from the main loop. */
+void sample_edit_poll(void);
 
 #endif /* SCHISM_SAMPLE_EDIT_H_ */
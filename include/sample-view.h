@@ -0,0 +1,42 @@
+/*
+ * Schism Tracker - a cross-platform Impulse Tracker clone
+ * copyright (c) 2003-2005 Storlek <storlek@rigelseven.com>
+ * copyright (c) 2005-2008 Mrs. Brisby <mrs.brisby@nimh.org>
+ * copyright (c) 2009 Storlek & Mrs. Brisby
+ * copyright (c) 2010-2012 Storlek
+ * URL: http://schismtracker.org/
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef SCHISM_SAMPLE_VIEW_H_
+#define SCHISM_SAMPLE_VIEW_H_
+
+#include <stdint.h>
+
+struct song_sample;
+
+/* Split one channel of a sample into 'width' columns (column x is every frame that draws at
+ * x = frame * width / length, plus the last frame of the column before, so they join up), and
+ * give the lowest and highest value in each. Long samples are read from a min/max pyramid that's
+ * kept around for the last few samples drawn, so this is O(width) no matter how long they are. */
+void sample_view_columns(struct song_sample *sample, unsigned int chan, unsigned int width,
+	int16_t *min, int16_t *max);
+
+/* Throw out the pyramid for this sample data; anything that changes a sample's data in place
+ * has to call this. (Data that's replaced or resized is noticed anyway.) */
+void sample_view_invalidate(const void *data);
+
+#endif /* SCHISM_SAMPLE_VIEW_H_ */
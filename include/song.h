@@ -52,6 +52,8 @@ extern unsigned int max_channels_used;
 struct audio_settings {
 	int sample_rate, bits, channels, buffer_size;
 	int channel_limit, interpolation_mode;
+	/* how many voices a song has to play on, counting the 64 channels: anything past that steals one */
+	int voices;
 
 	struct {
 		int left;
@@ -63,6 +65,9 @@ struct audio_settings {
 	unsigned int eq_freq[4];
 	unsigned int eq_gain[4];
 	int no_ramping;
+
+	/* parallel mixing: 0 threads = one per CPU */
+	int mix_threads, mix_thread_voices;
 };
 
 extern struct audio_settings audio_settings;
@@ -122,6 +127,10 @@ const char *fmt_strerror(int n);
 
 int song_save(const char *file, const char *type); // IT, S3M
 int song_export(const char *file, const char *type); // WAV
+// render each file into 'dir' (or next to the original if NULL); returns the number that failed
+int song_export_batch(char *const *files, int count, const char *dir, const char *type, int threads);
+// same thing, for one file with its output named; returns 0 if it worked
+int song_export_file(const char *file, const char *out, const char *type);
 
 /* 'num' is only for status text feedback -- all of the sample's data is taken from 'smp'.
 this provides an eventual mechanism for saving samples modified from disk (not yet implemented) */
@@ -173,6 +182,8 @@ song_channel_t *song_get_channel(int n);
 
 // this one should probably be organized somewhere else..... meh
 void song_set_channel_mute(int channel, int muted);
+// just the playing voices (song_set_channel_mute does this too)
+void song_set_voice_mute(int channel, int muted);
 void song_toggle_channel_mute(int channel);
 // if channel is the current soloed channel, undo the solo (reset the
 // channel state); otherwise, save the state and solo the channel.
@@ -249,8 +260,8 @@ int audio_init(const char *driver, const char *device);
 /* Reconfigure the same device that was opened before. */
 int audio_reinit(const char *device);
 
-/* eq */
-void song_init_eq(int do_reset, uint32_t mix_freq);
+/* eq (recalculates the song's filters from audio_settings) */
+void song_init_eq(song_t *csf, int do_reset, uint32_t mix_freq);
 
 /* --------------------------------------------------------------------- */
 /* playback */
@@ -292,6 +303,7 @@ void song_stop_unlocked(int quitting);
 void song_loop_pattern(int pattern, int row);
 void song_start_at_order(int order, int row);
 void song_start_at_pattern(int pattern, int row);
+int song_start_at_time(unsigned int msec); // from the start of the song; 0 if it ends before then
 void song_single_step(int pattern, int row);
 
 /* see the enum above */
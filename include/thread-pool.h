@@ -0,0 +1,53 @@
+/*
+ * Schism Tracker - a cross-platform Impulse Tracker clone
+ * copyright (c) 2003-2005 Storlek <storlek@rigelseven.com>
+ * copyright (c) 2005-2008 Mrs. Brisby <mrs.brisby@nimh.org>
+ * copyright (c) 2009 Storlek & Mrs. Brisby
+ * copyright (c) 2010-2012 Storlek
+ * URL: http://schismtracker.org/
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef SCHISM_THREAD_POOL_H_
+#define SCHISM_THREAD_POOL_H_
+
+/* opaque structure */
+typedef struct thread_pool thread_pool_t;
+
+/* Called once for every job number in [0, njobs). Jobs may run on any thread
+and in any order, so anything that has to come out the same every time must
+depend only on the job number. */
+typedef void (*thread_pool_func_t) (void *data, unsigned int job);
+
+/* Create a pool that runs jobs on 'nthreads' threads in total. The thread
+calling thread_pool_run counts as one of them, so nthreads - 1 workers are
+started. Returns NULL if the threads couldn't be created. */
+thread_pool_t *thread_pool_create(unsigned int nthreads);
+
+/* Stop and join the worker threads. NULL is fine. */
+void thread_pool_destroy(thread_pool_t *pool);
+
+/* Total number of threads, including the caller. */
+unsigned int thread_pool_size(thread_pool_t *pool);
+
+/* Run func(data, job) for every job in [0, njobs) and wait for all of them
+to finish. The calling thread picks up jobs too. If another thread is already
+running jobs on the pool (say, two songs being mixed at once), the jobs are
+all run on the calling thread instead. Calling this from inside a job on the
+same pool has the same effect. */
+void thread_pool_run(thread_pool_t *pool, thread_pool_func_t func, void *data, unsigned int njobs);
+
+#endif /* SCHISM_THREAD_POOL_H_ */
@@ -39,6 +39,20 @@ struct vgamem_overlay {
 
 void vgamem_flip(void);
 
+/* The area (in character cells) that changed since the last call to
+vgamem_take_dirty; rows[] says which rows have anything to redraw at all. */
+struct vgamem_dirty {
+	unsigned int x1, y1, x2, y2;
+	unsigned char rows[50];
+};
+
+/* returns zero if nothing changed; resets the tracking either way */
+int vgamem_take_dirty(struct vgamem_dirty *d);
+/* force cells to be redrawn, for things that vgamem can't see (the mouse
+cursor, palette changes, etc.) */
+void vgamem_invalidate_rect(unsigned int x1, unsigned int y1, unsigned int x2, unsigned int y2);
+void vgamem_invalidate(void);
+
 void vgamem_ovl_alloc(struct vgamem_overlay *n);
 void vgamem_ovl_apply(struct vgamem_overlay *n);
 
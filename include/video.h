@@ -34,6 +34,7 @@ void video_shutdown(void);
 void video_report(void);
 void video_refresh(void);
 void video_update(void);
+void video_invalidate(void);
 void video_colors(unsigned char palette[16][3]);
 void video_resize(unsigned int width, unsigned int height);
 void video_fullscreen(int new_fs_flag);
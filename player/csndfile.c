@@ -29,6 +29,8 @@
 
 #include "bswap.h"
 #include "player/sndfile.h"
+#include "player/snd_fm.h"
+#include "player/snd_gm.h"
 #include "log.h"
 #include "util.h"
 #include "fmt.h" // for it_decompress8 / it_decompress16
@@ -62,9 +64,12 @@ static void _csf_reset(song_t *csf)
 	csf->mix_frequency = 4000;
 	csf->mix_bits_per_sample = 8;
 	csf->mix_channels = 1;
+	csf->max_voices = 32; // ITT it is 1994
 
-	memset(csf->voices, 0, sizeof(csf->voices));
-	memset(csf->voice_mix, 0, sizeof(csf->voice_mix));
+	memset(csf->voices, 0, csf->voice_count * sizeof(song_voice_t));
+	memset(csf->channel_fx, 0, sizeof(csf->channel_fx));
+	memset(csf->voice_mix, 0, csf->voice_count * sizeof(uint32_t));
+	memset(csf->voice_active, 0, csf->voice_count / 8);
 	memset(csf->samples, 0, sizeof(csf->samples));
 	memset(csf->instruments, 0, sizeof(csf->instruments));
 	memset(csf->orderlist, 0xFF, sizeof(csf->orderlist));
@@ -95,7 +100,9 @@ static void _csf_reset(song_t *csf)
 song_t *csf_allocate(void)
 {
 	song_t *csf = mem_calloc(1, sizeof(song_t));
+	csf_set_voice_count(csf, DEFAULT_VOICES);
 	_csf_reset(csf);
+	OPL_Reset(csf); /* no chip until csf_set_wave_config, but get the voice map straight */
 	return csf;
 }
 
@@ -103,10 +110,65 @@ void csf_free(song_t *csf)
 {
 	if (csf) {
 		csf_destroy(csf);
+		OPL_Close(csf);
+		csf_free_voices(csf);
 		free(csf);
 	}
 }
 
+void csf_set_voice_count(song_t *csf, uint32_t count)
+{
+	uint32_t old = csf->voice_count, n, kept;
+
+	count = CLAMP((count + 31) & ~31u, MAX_CHANNELS + 32, MAX_VOICES);
+	if (count == old)
+		return;
+
+	// whatever was going to be mixed on a voice that's going away isn't anymore
+	for (n = kept = 0; n < csf->num_voices; n++) {
+		if (csf->voice_mix[n] < count)
+			csf->voice_mix[kept++] = csf->voice_mix[n];
+	}
+	csf->num_voices = kept;
+	if (csf->max_voices > count)
+		csf->max_voices = count;
+
+	csf->voices = mem_realloc(csf->voices, count * sizeof(song_voice_t));
+	csf->voice_mix = mem_realloc(csf->voice_mix, count * sizeof(uint32_t));
+	csf->voice_active = mem_realloc(csf->voice_active, count / 8);
+	if (count > old) {
+		memset(csf->voices + old, 0, (count - old) * sizeof(song_voice_t));
+		memset(csf->voice_active + old / 32, 0, (count - old) / 8);
+	}
+	csf->voice_count = count;
+
+	// the MIDI and OPL maps are MAX_VOICES long, but only the voices in the pool are ever looked at
+	GM_SetVoiceCount(csf, old, count);
+	OPL_SetVoiceCount(csf, old, count);
+}
+
+void csf_copy_voices(song_t *dst, const song_t *src)
+{
+	dst->voice_count = src->voice_count;
+	dst->voices = mem_alloc(src->voice_count * sizeof(song_voice_t));
+	dst->voice_mix = mem_alloc(src->voice_count * sizeof(uint32_t));
+	dst->voice_active = mem_alloc(src->voice_count / 8);
+	memcpy(dst->voices, src->voices, src->voice_count * sizeof(song_voice_t));
+	memcpy(dst->voice_mix, src->voice_mix, src->voice_count * sizeof(uint32_t));
+	memcpy(dst->voice_active, src->voice_active, src->voice_count / 8);
+}
+
+void csf_free_voices(song_t *csf)
+{
+	free(csf->voices);
+	free(csf->voice_mix);
+	free(csf->voice_active);
+	csf->voices = NULL;
+	csf->voice_mix = NULL;
+	csf->voice_active = NULL;
+	csf->voice_count = 0;
+}
+
 
 static void _init_envelope(song_envelope_t *env, int n)
 {
@@ -172,6 +234,8 @@ void csf_destroy(song_t *csf)
 			csf->instruments[i] = NULL;
 		}
 	}
+	csf_timeline_free(csf);
+	csf_snapshot_free(csf);
 
 	_csf_reset(csf);
 }
@@ -447,7 +511,7 @@ int csf_set_resampling_mode(song_t *csf, uint32_t mode)
 static void set_current_pos_0(song_t *csf)
 {
 	song_voice_t *v = csf->voices;
-	for (uint32_t i = 0; i < MAX_VOICES; i++, v++) {
+	for (uint32_t i = 0; i < csf->voice_count; i++, v++) {
 		memset(v, 0, sizeof(*v));
 		v->note = v->new_note = 1;
 		v->cutoff = 0x7F;
@@ -461,6 +525,8 @@ static void set_current_pos_0(song_t *csf)
 			v->global_volume = 64;
 		}
 	}
+	memset(csf->channel_fx, 0, sizeof(csf->channel_fx));
+	memset(csf->voice_active, 0, csf->voice_count / 8);
 	csf->current_global_volume = csf->initial_global_volume;
 	csf->current_speed = csf->initial_speed;
 	csf->current_tempo = csf->initial_tempo;
@@ -469,7 +535,7 @@ static void set_current_pos_0(song_t *csf)
 
 void csf_set_current_order(song_t *csf, uint32_t position)
 {
-	for (uint32_t j = 0; j < MAX_VOICES; j++) {
+	for (uint32_t j = 0; j < csf->voice_count; j++) {
 		song_voice_t *v = csf->voices + j;
 
 		v->frequency = 0;
@@ -477,12 +543,16 @@ void csf_set_current_order(song_t *csf, uint32_t position)
 		v->new_instrument = 0;
 		v->portamento_target = 0;
 		v->n_command = 0;
-		v->cd_patloop = 0;
-		v->patloop_row = 0;
 		v->cd_tremor = 0;
 		// modplug sets vib pos to 16 in old effects mode for some reason *shrug*
 		v->vibrato_position = (csf->flags & SONG_ITOLDEFFECTS) ? 0 : 0x10;
-		v->tremolo_position = 0;
+	}
+	for (uint32_t j = 0; j < MAX_CHANNELS; j++) {
+		song_channel_fx_t *fx = csf->channel_fx + j;
+
+		fx->cd_patloop = 0;
+		fx->patloop_row = 0;
+		fx->tremolo_position = 0;
 	}
 	if (position > MAX_ORDERS)
 		position = 0;
@@ -597,6 +667,8 @@ uint32_t csf_write_sample(disko_t *fp, song_sample_t *sample, uint32_t flags, ui
 	case SF_PCMS:
 		break;
 	case SF_PCMD:
+	case SF_IT214:
+	case SF_IT215:
 		if ((flags & SF_CHN_MASK) == SF_SS || (flags & SF_CHN_MASK) == SF_M)
 			break;
 		/* fallthrough */
@@ -692,6 +764,19 @@ uint32_t csf_write_sample(disko_t *fp, song_sample_t *sample, uint32_t flags, ui
 			}
 		}
 		break;
+	case SF_IT214:
+	case SF_IT215:
+		// each channel is compressed separately, left then right; no endianness to worry about
+		pos = 0;
+		for (channel = 0; channel < stride; channel++) {
+			if ((flags & SF_BIT_MASK) == SF_16)
+				pos += it_compress16(fp, (const int16_t *) sample->data + channel, len,
+					(flags & SF_ENC_MASK) == SF_IT215, stride);
+			else
+				pos += it_compress8(fp, (const int8_t *) sample->data + channel, len,
+					(flags & SF_ENC_MASK) == SF_IT215, stride);
+		}
+		return pos;
 	}
 
 	len *= stride;
@@ -1190,6 +1275,44 @@ uint32_t csf_read_sample(song_sample_t *sample, uint32_t flags, const void *file
 	return len;
 }
 
+void (*csf_run_load_jobs)(void (*func)(void *data, unsigned int job), void *data, unsigned int njobs) = NULL;
+
+static int _sample_read_cmp(const void *a, const void *b)
+{
+	uint32_t la = (*(const struct sample_read *const *) a)->sample->length;
+	uint32_t lb = (*(const struct sample_read *const *) b)->sample->length;
+
+	return (la < lb) - (la > lb);
+}
+
+static void _sample_read_job(void *data, unsigned int job)
+{
+	const struct sample_read *r = ((const struct sample_read **) data)[job];
+
+	csf_read_sample(r->sample, r->flags, r->data, r->length);
+}
+
+void csf_read_samples(const struct sample_read *reads, uint32_t count)
+{
+	const struct sample_read **order;
+	uint32_t n;
+
+	if (!csf_run_load_jobs || count < 2) {
+		for (n = 0; n < count; n++)
+			csf_read_sample(reads[n].sample, reads[n].flags, reads[n].data, reads[n].length);
+		return;
+	}
+
+	/* the pool hands out jobs in order, so doing the long ones first keeps one big sample at
+	the end from leaving everyone else waiting on it */
+	order = mem_alloc(count * sizeof(*order));
+	for (n = 0; n < count; n++)
+		order[n] = reads + n;
+	qsort(order, count, sizeof(*order), _sample_read_cmp);
+	csf_run_load_jobs(_sample_read_job, order, count);
+	free(order);
+}
+
 /* --------------------------------------------------------------------------------------------------------- */
 
 void csf_adjust_sample_loop(song_sample_t *sample)
@@ -1259,7 +1382,7 @@ void csf_stop_sample(song_t *csf, song_sample_t *smp)
 
 	if (!smp->data)
 		return;
-	for (int i = 0; i < MAX_VOICES; i++, v++) {
+	for (uint32_t i = 0; i < csf->voice_count; i++, v++) {
 		if (v->ptr_sample == smp || v->current_sample_data == smp->data) {
 			v->note = v->new_note = 1;
 			v->new_instrument = 0;
@@ -1276,6 +1399,8 @@ void csf_stop_sample(song_t *csf, song_sample_t *smp)
 			v->left_volume = v->right_volume = 0;
 			v->left_volume_new = v->right_volume_new = 0;
 			v->left_ramp = v->right_ramp = 0;
+			if (i >= MAX_CHANNELS)
+				VOICE_ACTIVE_CLEAR(csf, i);
 		}
 	}
 }
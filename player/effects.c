@@ -100,11 +100,11 @@ void fx_note_cut(song_t *csf, uint32_t nchan, int clear_note)
 
 	if (chan->flags & CHN_ADLIB) {
 		//Do this only if really an adlib chan. Important!
-		OPL_NoteOff(nchan);
-		OPL_Touch(nchan, 0);
+		OPL_NoteOff(csf, nchan);
+		OPL_Touch(csf, nchan, 0);
 	}
-	GM_KeyOff(nchan);
-	GM_Touch(nchan, 0);
+	GM_KeyOff(csf, nchan);
+	GM_Touch(csf, nchan, 0);
 }
 
 void fx_key_off(song_t *csf, uint32_t nchan)
@@ -115,9 +115,9 @@ void fx_key_off(song_t *csf, uint32_t nchan)
 		tick_count, (unsigned)nchan, chan->flags);*/
 	if (chan->flags & CHN_ADLIB) {
 		//Do this only if really an adlib chan. Important!
-		OPL_NoteOff(nchan);
+		OPL_NoteOff(csf, nchan);
 	}
-	GM_KeyOff(nchan);
+	GM_KeyOff(csf, nchan);
 
 	song_instrument_t *penv = (csf->flags & SONG_INSTRUMENTMODE) ? chan->ptr_instrument : NULL;
 
@@ -258,10 +258,10 @@ static void fx_reg_portamento_down(uint32_t flags, song_voice_t *chan, uint32_t
 }
 
 
-static void fx_portamento_up(uint32_t flags, song_voice_t *chan, uint32_t param)
+static void fx_portamento_up(uint32_t flags, song_voice_t *chan, song_channel_fx_t *fx, uint32_t param)
 {
 	if (!param)
-		param = chan->mem_pitchslide;
+		param = fx->mem_pitchslide;
 
 	switch (param & 0xf0) {
 	case 0xe0:
@@ -276,10 +276,10 @@ static void fx_portamento_up(uint32_t flags, song_voice_t *chan, uint32_t param)
 	}
 }
 
-static void fx_portamento_down(uint32_t flags, song_voice_t *chan, uint32_t param)
+static void fx_portamento_down(uint32_t flags, song_voice_t *chan, song_channel_fx_t *fx, uint32_t param)
 {
 	if (!param)
-		param = chan->mem_pitchslide;
+		param = fx->mem_pitchslide;
 
 	switch (param & 0xf0) {
 	case 0xe0:
@@ -294,10 +294,10 @@ static void fx_portamento_down(uint32_t flags, song_voice_t *chan, uint32_t para
 	}
 }
 
-static void fx_tone_portamento(uint32_t flags, song_voice_t *chan, uint32_t param)
+static void fx_tone_portamento(uint32_t flags, song_voice_t *chan, song_channel_fx_t *fx, uint32_t param)
 {
 	if (!param)
-		param = chan->mem_portanote;
+		param = fx->mem_portanote;
 
 	chan->flags |= CHN_PORTAMENTO;
 	if (chan->frequency && chan->portamento_target && !(flags & SONG_FIRSTTICK)) {
@@ -319,23 +319,23 @@ static void fx_tone_portamento(uint32_t flags, song_voice_t *chan, uint32_t para
 
 // Implemented for IMF compatibility, can't actually save this in any formats
 // sign should be 1 (up) or -1 (down)
-static void fx_note_slide(uint32_t flags, song_voice_t *chan, uint32_t param, int sign)
+static void fx_note_slide(uint32_t flags, song_voice_t *chan, song_channel_fx_t *fx, uint32_t param, int sign)
 {
 	uint8_t x, y;
 	if (flags & SONG_FIRSTTICK) {
 		x = param & 0xf0;
 		if (x)
-			chan->note_slide_speed = (x >> 4);
+			fx->note_slide_speed = (x >> 4);
 		y = param & 0xf;
 		if (y)
-			chan->note_slide_step = y;
-		chan->note_slide_counter = chan->note_slide_speed;
+			fx->note_slide_step = y;
+		fx->note_slide_counter = fx->note_slide_speed;
 	} else {
-		if (--chan->note_slide_counter == 0) {
-			chan->note_slide_counter = chan->note_slide_speed;
+		if (--fx->note_slide_counter == 0) {
+			fx->note_slide_counter = fx->note_slide_speed;
 			// update it
 			chan->frequency = get_frequency_from_note
-				(sign * chan->note_slide_step + get_note_from_frequency(chan->frequency, chan->c5speed),
+				(sign * fx->note_slide_step + get_note_from_frequency(chan->frequency, chan->c5speed),
 					chan->c5speed);
 		}
 	}
@@ -362,17 +362,17 @@ static void fx_fine_vibrato(song_voice_t *p, uint32_t param)
 }
 
 
-static void fx_panbrello(song_voice_t *chan, uint32_t param)
+static void fx_panbrello(song_voice_t *chan, song_channel_fx_t *fx, uint32_t param)
 {
-	uint32_t panpos = chan->panbrello_position & 0xFF;
+	uint32_t panpos = fx->panbrello_position & 0xFF;
 	int pdelta = chan->panbrello_delta;
 
 	if (param & 0x0F)
 		chan->panbrello_depth = param & 0x0F;
 	if (param & 0xF0)
-		chan->panbrello_speed = (param >> 4) & 0x0F;
+		fx->panbrello_speed = (param >> 4) & 0x0F;
 
-	switch (chan->panbrello_type) {
+	switch (fx->panbrello_type) {
 	case VIB_SINE:
 	default:
 		pdelta = sine_table[panpos];
@@ -390,13 +390,13 @@ static void fx_panbrello(song_voice_t *chan, uint32_t param)
 
 	/* OpenMPT test case RandomWaveform.it:
 	   Speed for random panbrello says how many ticks the value should be used */
-	if (chan->panbrello_type == VIB_RANDOM) {
-		if (!chan->panbrello_position || chan->panbrello_position >= chan->panbrello_speed)
-			chan->panbrello_position = 0;
+	if (fx->panbrello_type == VIB_RANDOM) {
+		if (!fx->panbrello_position || fx->panbrello_position >= fx->panbrello_speed)
+			fx->panbrello_position = 0;
 
-		chan->panbrello_position++;
+		fx->panbrello_position++;
 	} else {
-		chan->panbrello_position += chan->panbrello_speed;
+		fx->panbrello_position += fx->panbrello_speed;
 	}
 
 	chan->panbrello_delta = pdelta;
@@ -417,15 +417,15 @@ static void fx_volume_down(song_voice_t *chan, uint32_t param)
 		chan->volume = 0;
 }
 
-static void fx_volume_slide(uint32_t flags, song_voice_t *chan, uint32_t param)
+static void fx_volume_slide(uint32_t flags, song_voice_t *chan, song_channel_fx_t *fx, uint32_t param)
 {
 	// Dxx     Volume slide down
 	//
 	// if (xx == 0) then xx = last xx for (Dxx/Kxx/Lxx) for this channel.
 	if (param)
-		chan->mem_volslide = param;
+		fx->mem_volslide = param;
 	else
-		param = chan->mem_volslide;
+		param = fx->mem_volslide;
 
 	// Order of testing: Dx0, D0x, DxF, DFx
 	if (param == (param & 0xf0)) {
@@ -455,13 +455,13 @@ static void fx_volume_slide(uint32_t flags, song_voice_t *chan, uint32_t param)
 }
 
 
-static void fx_panning_slide(uint32_t flags, song_voice_t *chan, uint32_t param)
+static void fx_panning_slide(uint32_t flags, song_voice_t *chan, song_channel_fx_t *fx, uint32_t param)
 {
 	int32_t slide = 0;
 	if (param)
-		chan->mem_panslide = param;
+		fx->mem_panslide = param;
 	else
-		param = chan->mem_panslide;
+		param = fx->mem_panslide;
 	if ((param & 0x0F) == 0x0F && (param & 0xF0)) {
 		if (flags & SONG_FIRSTTICK) {
 			param = (param & 0xF0) >> 2;
@@ -489,15 +489,15 @@ static void fx_panning_slide(uint32_t flags, song_voice_t *chan, uint32_t param)
 }
 
 
-static void fx_tremolo(uint32_t flags, song_voice_t *chan, uint32_t param)
+static void fx_tremolo(uint32_t flags, song_voice_t *chan, song_channel_fx_t *fx, uint32_t param)
 {
-	unsigned int trempos = chan->tremolo_position & 0xFF;
+	unsigned int trempos = fx->tremolo_position & 0xFF;
 	int tdelta;
 
 	if (param & 0x0F)
-		chan->tremolo_depth = (param & 0x0F) << 2;
+		fx->tremolo_depth = (param & 0x0F) << 2;
 	if (param & 0xF0)
-		chan->tremolo_speed = (param >> 4) & 0x0F;
+		fx->tremolo_speed = (param >> 4) & 0x0F;
 
 	chan->flags |= CHN_TREMOLO;
 
@@ -505,7 +505,7 @@ static void fx_tremolo(uint32_t flags, song_voice_t *chan, uint32_t param)
 	if ((flags & SONG_FIRSTTICK) && (flags & SONG_ITOLDEFFECTS))
 		return;
 
-	switch (chan->tremolo_type) {
+	switch (fx->tremolo_type) {
 	case VIB_SINE:
 	default:
 		tdelta = sine_table[trempos];
@@ -521,8 +521,8 @@ static void fx_tremolo(uint32_t flags, song_voice_t *chan, uint32_t param)
 		break;
 	}
 
-	chan->tremolo_position = (trempos + 4 * chan->tremolo_speed) & 0xFF;
-	tdelta = (tdelta * (int)chan->tremolo_depth) >> 5;
+	fx->tremolo_position = (trempos + 4 * fx->tremolo_speed) & 0xFF;
+	tdelta = (tdelta * (int)fx->tremolo_depth) >> 5;
 	chan->tremolo_delta = tdelta;
 }
 
@@ -530,17 +530,18 @@ static void fx_tremolo(uint32_t flags, song_voice_t *chan, uint32_t param)
 static void fx_retrig_note(song_t *csf, uint32_t nchan, uint32_t param)
 {
 	song_voice_t *chan = &csf->voices[nchan];
+	song_channel_fx_t *fx = &csf->channel_fx[nchan];
 
-	//printf("Q%02X note=%02X tick%d  %d\n", param, chan->row_note, tick_count, chan->cd_retrig);
+	//printf("Q%02X note=%02X tick%d  %d\n", param, chan->row_note, tick_count, fx->cd_retrig);
 	if ((csf->flags & SONG_FIRSTTICK) && chan->row_note != NOTE_NONE) {
-		chan->cd_retrig = param & 0xf;
-	} else if (--chan->cd_retrig <= 0) {
+		fx->cd_retrig = param & 0xf;
+	} else if (--fx->cd_retrig <= 0) {
 		
 		// in Impulse Tracker, retrig only works if a sample is currently playing in the channel
 		if (chan->position == 0)
 			return;
 		
-		chan->cd_retrig = param & 0xf;
+		fx->cd_retrig = param & 0xf;
 		param >>= 4;
 		if (param) {
 			int vol = chan->volume;
@@ -564,13 +565,13 @@ static void fx_retrig_note(song_t *csf, uint32_t nchan, uint32_t param)
 }
 
 
-static void fx_channel_vol_slide(uint32_t flags, song_voice_t *chan, uint32_t param)
+static void fx_channel_vol_slide(uint32_t flags, song_voice_t *chan, song_channel_fx_t *fx, uint32_t param)
 {
 	int32_t slide = 0;
 	if (param)
-		chan->mem_channel_volslide = param;
+		fx->mem_channel_volslide = param;
 	else
-		param = chan->mem_channel_volslide;
+		param = fx->mem_channel_volslide;
 	if ((param & 0x0F) == 0x0F && (param & 0xF0)) {
 		if (flags & SONG_FIRSTTICK)
 			slide = param >> 4;
@@ -592,13 +593,13 @@ static void fx_channel_vol_slide(uint32_t flags, song_voice_t *chan, uint32_t pa
 }
 
 
-static void fx_global_vol_slide(song_t *csf, song_voice_t *chan, uint32_t param)
+static void fx_global_vol_slide(song_t *csf, song_channel_fx_t *fx, uint32_t param)
 {
 	int32_t slide = 0;
 	if (param)
-		chan->mem_global_volslide = param;
+		fx->mem_global_volslide = param;
 	else
-		param = chan->mem_global_volslide;
+		param = fx->mem_global_volslide;
 	if ((param & 0x0F) == 0x0F && (param & 0xF0)) {
 		if (csf->flags & SONG_FIRSTTICK)
 			slide = param >> 4;
@@ -620,27 +621,27 @@ static void fx_global_vol_slide(song_t *csf, song_voice_t *chan, uint32_t param)
 }
 
 
-static void fx_pattern_loop(song_t *csf, song_voice_t *chan, uint32_t param)
+static void fx_pattern_loop(song_t *csf, song_channel_fx_t *fx, uint32_t param)
 {
 	if (param) {
-		if (chan->cd_patloop) {
-			if (!--chan->cd_patloop) {
+		if (fx->cd_patloop) {
+			if (!--fx->cd_patloop) {
 				// this should get rid of that nasty infinite loop for cases like
 				//     ... .. .. SB0
 				//     ... .. .. SB1
 				//     ... .. .. SB1
 				// it still doesn't work right in a few strange cases, but oh well :P
-				chan->patloop_row = csf->row + 1;
+				fx->patloop_row = csf->row + 1;
 				csf->patloop = 0;
 				return; // don't loop!
 			}
 		} else {
-			chan->cd_patloop = param;
+			fx->cd_patloop = param;
 		}
-		csf->process_row = chan->patloop_row - 1;
+		csf->process_row = fx->patloop_row - 1;
 	} else {
 		csf->patloop = 1;
-		chan->patloop_row = csf->row;
+		fx->patloop_row = csf->row;
 	}
 }
 
@@ -648,6 +649,7 @@ static void fx_pattern_loop(song_t *csf, song_voice_t *chan, uint32_t param)
 static void fx_special(song_t *csf, uint32_t nchan, uint32_t param)
 {
 	song_voice_t *chan = &csf->voices[nchan];
+	song_channel_fx_t *fx = &csf->channel_fx[nchan];
 	uint32_t command = param & 0xF0;
 	param &= 0x0F;
 	switch(command) {
@@ -664,13 +666,13 @@ static void fx_special(song_t *csf, uint32_t nchan, uint32_t param)
 		break;
 	// S4x: Set Tremolo WaveForm
 	case 0x40:
-		chan->tremolo_type = param;
+		fx->tremolo_type = param;
 		break;
 	// S5x: Set Panbrello WaveForm
 	case 0x50:
 		/* some mpt compat thing */
-		chan->panbrello_type = (param < 0x04) ? param : 0;
-		chan->panbrello_position = 0;
+		fx->panbrello_type = (param < 0x04) ? param : 0;
+		fx->panbrello_position = 0;
 		break;
 	// S6x: Pattern Delay for x ticks
 	case 0x60:
@@ -689,7 +691,7 @@ static void fx_special(song_t *csf, uint32_t nchan, uint32_t param)
 		case 2:
 			{
 				song_voice_t *bkp = &csf->voices[MAX_CHANNELS];
-				for (uint32_t i=MAX_CHANNELS; i<MAX_VOICES; i++, bkp++) {
+				for (uint32_t i=MAX_CHANNELS; i<csf->voice_count; i++, bkp++) {
 					if (bkp->master_channel == nchan+1) {
 						if (param == 1) {
 							fx_key_off(csf, i);
@@ -745,13 +747,13 @@ static void fx_special(song_t *csf, uint32_t nchan, uint32_t param)
 	// SBx: Pattern Loop
 	case 0xB0:
 		if (csf->flags & SONG_FIRSTTICK)
-			fx_pattern_loop(csf, chan, param & 0x0F);
+			fx_pattern_loop(csf, fx, param & 0x0F);
 		break;
 	// SCx: Note Cut
 	case 0xC0:
 		if (csf->flags & SONG_FIRSTTICK)
-			chan->cd_note_cut = param ? param : 1;
-		else if (--chan->cd_note_cut == 0)
+			fx->cd_note_cut = param ? param : 1;
+		else if (--fx->cd_note_cut == 0)
 			fx_note_cut(csf, nchan, 1);
 		break;
 	// SDx: Note Delay
@@ -764,7 +766,7 @@ static void fx_special(song_t *csf, uint32_t nchan, uint32_t param)
 		break;
 	// SFx: Set Active Midi Macro
 	case 0xF0:
-		chan->active_macro = param;
+		fx->active_macro = param;
 		break;
 	}
 }
@@ -777,7 +779,7 @@ void csf_midi_send(song_t *csf, const unsigned char *data, unsigned int len, uin
 
 	if (len >= 1 && (data[0] == 0xFA || data[0] == 0xFC || data[0] == 0xFF)) {
 		// Start Song, Stop Song, MIDI Reset
-		for (uint32_t c = 0; c < MAX_VOICES; c++) {
+		for (uint32_t c = 0; c < csf->voice_count; c++) {
 			csf->voices[c].cutoff = 0x7F;
 			csf->voices[c].resonance = 0x00;
 		}
@@ -799,7 +801,7 @@ void csf_midi_send(song_t *csf, const unsigned char *data, unsigned int len, uin
 			}
 			break;
 		}
-	} else if (!fake && csf_midi_out_raw) {
+	} else if (!fake && csf_midi_out_raw && !(csf->mix_flags & SNDMIX_NOMIDI)) {
 		/* okay, this is kind of how it works.
 		we pass buffer_count as here because while
 			1000 * ((8((buffer_size/2) - buffer_count)) / sample_rate)
@@ -1027,151 +1029,6 @@ void csf_process_midi_macro(song_t *csf, uint32_t nchan, const char * macro, uin
 }
 
 
-////////////////////////////////////////////////////////////
-// Length
-
-#if MAX_CHANNELS != 64
-# error csf_get_length assumes 64 channels
-#endif
-
-unsigned int csf_get_length(song_t *csf)
-{
-	uint32_t elapsed = 0, row = 0, next_row = 0, cur_order = 0, next_order = 0, pat = csf->orderlist[0],
-		speed = csf->initial_speed, tempo = csf->initial_tempo, psize, n;
-	uint32_t patloop[MAX_CHANNELS] = {0};
-	uint8_t mem_tempo[MAX_CHANNELS] = {0};
-	uint64_t setloop = 0; // bitmask
-	const song_note_t *pdata;
-
-	for (;;) {
-		uint32_t speed_count = 0;
-		row = next_row;
-		cur_order = next_order;
-
-		// Check if pattern is valid
-		pat = csf->orderlist[cur_order];
-		while (pat >= MAX_PATTERNS) {
-			// End of song ?
-			if (pat == ORDER_LAST || cur_order >= MAX_ORDERS) {
-				pat = ORDER_LAST; // cause break from outer loop too
-				break;
-			} else {
-				cur_order++;
-				pat = (cur_order < MAX_ORDERS) ? csf->orderlist[cur_order] : ORDER_LAST;
-			}
-			next_order = cur_order;
-		}
-		// Weird stuff?
-		if (pat >= MAX_PATTERNS)
-			break;
-		pdata = csf->patterns[pat];
-		if (pdata) {
-			psize = csf->pattern_size[pat];
-		} else {
-			pdata = blank_pattern;
-			psize = 64;
-		}
-		// guard against Cxx to invalid row, etc.
-		if (row >= psize)
-			row = 0;
-		// Update next position
-		next_row = row + 1;
-		if (next_row >= psize) {
-			next_order = cur_order + 1;
-			next_row = 0;
-		}
-
-		/* muahahaha */
-		if (csf->stop_at_order > -1 && csf->stop_at_row > -1) {
-			if (csf->stop_at_order <= (signed) cur_order && csf->stop_at_row <= (signed) row)
-				break;
-			if (csf->stop_at_time > 0) {
-				/* stupid api decision */
-				if (((elapsed + 500) / 1000) >= csf->stop_at_time) {
-					csf->stop_at_order = cur_order;
-					csf->stop_at_row = row;
-					break;
-				}
-			}
-		}
-
-		/* This is nasty, but it fixes inaccuracies with SB0 SB1 SB1. (Simultaneous
-		loops in multiple channels are still wildly incorrect, though.) */
-		if (!row)
-			setloop = ~0;
-		if (setloop) {
-			for (n = 0; n < MAX_CHANNELS; n++)
-				if (setloop & (1 << n))
-					patloop[n] = elapsed;
-			setloop = 0;
-		}
-		const song_note_t *note = pdata + row * MAX_CHANNELS;
-		for (n = 0; n < MAX_CHANNELS; note++, n++) {
-			uint32_t param = note->param;
-			switch (note->effect) {
-			case FX_NONE:
-				break;
-			case FX_POSITIONJUMP:
-				next_order = param > cur_order ? param : cur_order + 1;
-				next_row = 0;
-				break;
-			case FX_PATTERNBREAK:
-				next_order = cur_order + 1;
-				next_row = param;
-				break;
-			case FX_SPEED:
-				if (param)
-					speed = param;
-				break;
-			case FX_TEMPO:
-				if (param)
-					mem_tempo[n] = param;
-				else
-					param = mem_tempo[n];
-				int d = (param & 0xf);
-				switch (param >> 4) {
-				default:
-					tempo = param;
-					break;
-				case 0:
-					d = -d;
-				case 1:
-					d = d * (speed - 1) + tempo;
-					tempo = CLAMP(d, 32, 255);
-					break;
-				}
-				break;
-			case FX_SPECIAL:
-				switch (param >> 4) {
-				case 0x6:
-					speed_count = param & 0x0F;
-					break;
-				case 0xb:
-					if (param & 0x0F) {
-						elapsed += (elapsed - patloop[n]) * (param & 0x0F);
-						patloop[n] = 0xffffffff;
-						setloop = 1;
-					} else {
-						patloop[n] = elapsed;
-					}
-					break;
-				case 0xe:
-					speed_count = (param & 0x0F) * speed;
-					break;
-				}
-				break;
-			}
-		}
-		//  sec/tick = 5 / (2 * tempo)
-		// msec/tick = 5000 / (2 * tempo)
-		//           = 2500 / tempo
-		elapsed += (speed + speed_count) * 2500 / tempo;
-	}
-
-	return (elapsed + 500) / 1000;
-}
-
-
 //////////////////////////////////////////////////////////////////////////////////////////////////
 // Effects
 
@@ -1553,10 +1410,13 @@ void csf_note_change(song_t *csf, uint32_t nchan, int note, int porta, int retri
 uint32_t csf_get_nna_channel(song_t *csf, uint32_t nchan)
 {
 	song_voice_t *chan = &csf->voices[nchan];
-	// Check for empty channel
-	song_voice_t *pi = &csf->voices[MAX_CHANNELS];
-	for (uint32_t i=MAX_CHANNELS; i<MAX_VOICES; i++, pi++) {
-		if (!pi->length) {
+	// Check for empty channel: anything without a bit in voice_active has no length
+	for (uint32_t w = MAX_CHANNELS / 32; w < csf->voice_count / 32; w++) {
+		uint32_t idle = ~csf->voice_active[w];
+		while (idle) {
+			uint32_t i = w * 32 + csf_lowest_bit(idle);
+			song_voice_t *pi = &csf->voices[i];
+			idle &= idle - 1;
 			if (pi->flags & CHN_MUTE) {
 				if (pi->flags & CHN_NNAMUTE) {
 					pi->flags &= ~(CHN_NNAMUTE|CHN_MUTE);
@@ -1574,7 +1434,7 @@ uint32_t csf_get_nna_channel(song_t *csf, uint32_t nchan)
 	uint32_t vol = 64*65536;        // 25%
 	int envpos = 0xFFFFFF;
 	const song_voice_t *pj = &csf->voices[MAX_CHANNELS];
-	for (uint32_t j=MAX_CHANNELS; j<MAX_VOICES; j++, pj++) {
+	for (uint32_t j=MAX_CHANNELS; j<csf->voice_count; j++, pj++) {
 		if (!pj->fadeout_volume) return j;
 		uint32_t v = pj->volume;
 		if (pj->flags & CHN_NOTEFADE)
@@ -1595,6 +1455,15 @@ uint32_t csf_get_nna_channel(song_t *csf, uint32_t nchan)
 	return result;
 }
 
+void csf_rebuild_active_voices(song_t *csf)
+{
+	memset(csf->voice_active, 0, csf->voice_count / 8);
+	for (uint32_t n = MAX_CHANNELS; n < csf->voice_count; n++) {
+		if (csf->voices[n].length)
+			VOICE_ACTIVE_SET(csf, n);
+	}
+}
+
 
 void csf_check_nna(song_t *csf, uint32_t nchan, uint32_t instr, int note, int force_cut)
 {
@@ -1614,6 +1483,7 @@ void csf_check_nna(song_t *csf, uint32_t nchan, uint32_t instr, int note, int fo
 		p = &csf->voices[n];
 		// Copy Channel
 		*p = *chan;
+		VOICE_ACTIVE_SET(csf, n);
 		p->flags &= ~(CHN_VIBRATO|CHN_TREMOLO|CHN_PORTAMENTO);
 		p->panbrello_delta = 0;
 		p->tremolo_delta = 0;
@@ -1628,11 +1498,11 @@ void csf_check_nna(song_t *csf, uint32_t nchan, uint32_t instr, int note, int fo
 		chan->left_volume = chan->right_volume = 0;
 		if (chan->flags & CHN_ADLIB) {
 			//Do this only if really an adlib chan. Important!
-			OPL_NoteOff(nchan);
-			OPL_Touch(nchan, 0);
+			OPL_NoteOff(csf, nchan);
+			OPL_Touch(csf, nchan, 0);
 		}
-		GM_KeyOff(nchan);
-		GM_Touch(nchan, 0);
+		GM_KeyOff(csf, nchan);
+		GM_Touch(csf, nchan, 0);
 		return;
 	}
 	if (instr >= MAX_INSTRUMENTS) instr = 0;
@@ -1651,7 +1521,7 @@ void csf_check_nna(song_t *csf, uint32_t nchan, uint32_t instr, int note, int fo
 	}
 	if (!penv) return;
 	p = chan;
-	for (uint32_t i=nchan; i<MAX_VOICES; p++, i++) {
+	for (uint32_t i=nchan; i<csf->voice_count; p++, i++) {
 		if (!((i >= MAX_CHANNELS || p == chan)
 		      && ((p->master_channel == nchan + 1 || p == chan)
 			  && p->ptr_instrument)))
@@ -1700,6 +1570,7 @@ void csf_check_nna(song_t *csf, uint32_t nchan, uint32_t instr, int note, int fo
 			p = &csf->voices[n];
 			// Copy Channel
 			*p = *chan;
+			VOICE_ACTIVE_SET(csf, n);
 			p->flags &= ~(CHN_VIBRATO|CHN_TREMOLO|CHN_PORTAMENTO);
 			p->panbrello_delta = 0;
 			p->tremolo_delta = 0;
@@ -1732,6 +1603,7 @@ void csf_check_nna(song_t *csf, uint32_t nchan, uint32_t instr, int note, int fo
 static void handle_effect(song_t *csf, uint32_t nchan, uint32_t cmd, uint32_t param, int porta, int firsttick)
 {
 	song_voice_t *chan = csf->voices + nchan;
+	song_channel_fx_t *fx = csf->channel_fx + nchan;
 
 	switch (cmd) {
 	case FX_NONE:
@@ -1748,40 +1620,40 @@ static void handle_effect(song_t *csf, uint32_t nchan, uint32_t cmd, uint32_t pa
 	case FX_PORTAMENTOUP:
 		if (firsttick) {
 			if (param)
-				chan->mem_pitchslide = param;
+				fx->mem_pitchslide = param;
 			if (!(csf->flags & SONG_COMPATGXX))
-				chan->mem_portanote = chan->mem_pitchslide;
+				fx->mem_portanote = fx->mem_pitchslide;
 		}
-		fx_portamento_up(csf->flags | (firsttick ? SONG_FIRSTTICK : 0), chan, param);
+		fx_portamento_up(csf->flags | (firsttick ? SONG_FIRSTTICK : 0), chan, fx, param);
 		break;
 
 	case FX_PORTAMENTODOWN:
 		if (firsttick) {
 			if (param)
-				chan->mem_pitchslide = param;
+				fx->mem_pitchslide = param;
 			if (!(csf->flags & SONG_COMPATGXX))
-				chan->mem_portanote = chan->mem_pitchslide;
+				fx->mem_portanote = fx->mem_pitchslide;
 		}
-		fx_portamento_down(csf->flags | (firsttick ? SONG_FIRSTTICK : 0), chan, param);
+		fx_portamento_down(csf->flags | (firsttick ? SONG_FIRSTTICK : 0), chan, fx, param);
 		break;
 
 	case FX_VOLUMESLIDE:
-		fx_volume_slide(csf->flags | (firsttick ? SONG_FIRSTTICK : 0), chan, param);
+		fx_volume_slide(csf->flags | (firsttick ? SONG_FIRSTTICK : 0), chan, fx, param);
 		break;
 
 	case FX_TONEPORTAMENTO:
 		if (firsttick) {
 			if (param)
-				chan->mem_portanote = param;
+				fx->mem_portanote = param;
 			if (!(csf->flags & SONG_COMPATGXX))
-				chan->mem_pitchslide = chan->mem_portanote;
+				fx->mem_pitchslide = fx->mem_portanote;
 		}
-		fx_tone_portamento(csf->flags | (firsttick ? SONG_FIRSTTICK : 0), chan, param);
+		fx_tone_portamento(csf->flags | (firsttick ? SONG_FIRSTTICK : 0), chan, fx, param);
 		break;
 
 	case FX_TONEPORTAVOL:
-		fx_volume_slide(csf->flags | (firsttick ? SONG_FIRSTTICK : 0), chan, param);
-		fx_tone_portamento(csf->flags | (firsttick ? SONG_FIRSTTICK : 0), chan, 0);
+		fx_volume_slide(csf->flags | (firsttick ? SONG_FIRSTTICK : 0), chan, fx, param);
+		fx_tone_portamento(csf->flags | (firsttick ? SONG_FIRSTTICK : 0), chan, fx, 0);
 		break;
 
 	case FX_VIBRATO:
@@ -1789,7 +1661,7 @@ static void handle_effect(song_t *csf, uint32_t nchan, uint32_t cmd, uint32_t pa
 		break;
 
 	case FX_VIBRATOVOL:
-		fx_volume_slide(csf->flags | (firsttick ? SONG_FIRSTTICK : 0), chan, param);
+		fx_volume_slide(csf->flags | (firsttick ? SONG_FIRSTTICK : 0), chan, fx, param);
 		fx_vibrato(chan, 0);
 		break;
 
@@ -1803,13 +1675,13 @@ static void handle_effect(song_t *csf, uint32_t nchan, uint32_t cmd, uint32_t pa
 	case FX_TEMPO:
 		if (csf->flags & SONG_FIRSTTICK) {
 			if (param)
-				chan->mem_tempo = param;
+				fx->mem_tempo = param;
 			else
-				param = chan->mem_tempo;
+				param = fx->mem_tempo;
 			if (param >= 0x20)
 				csf->current_tempo = param;
 		} else {
-			param = chan->mem_tempo; // this just got set on tick zero
+			param = fx->mem_tempo; // this just got set on tick zero
 
 			switch (param >> 4) {
 			case 0:
@@ -1849,8 +1721,8 @@ static void handle_effect(song_t *csf, uint32_t nchan, uint32_t cmd, uint32_t pa
 
 	case FX_RETRIG:
 		if (param)
-			chan->mem_retrig = param & 0xFF;
-		fx_retrig_note(csf, nchan, chan->mem_retrig);
+			fx->mem_retrig = param & 0xFF;
+		fx_retrig_note(csf, nchan, fx->mem_retrig);
 		break;
 
 	case FX_TREMOR:
@@ -1858,20 +1730,20 @@ static void handle_effect(song_t *csf, uint32_t nchan, uint32_t cmd, uint32_t pa
 		// I *sort of* understand it.
 		if (csf->flags & SONG_FIRSTTICK) {
 			if (!param)
-				param = chan->mem_tremor;
+				param = fx->mem_tremor;
 			else if (!(csf->flags & SONG_ITOLDEFFECTS)) {
 				if (param & 0xf0) param -= 0x10;
 				if (param & 0x0f) param -= 0x01;
 			}
-			chan->mem_tremor = param;
+			fx->mem_tremor = param;
 			chan->cd_tremor |= 128;
 		}
 
 		if ((chan->cd_tremor & 128) && chan->length) {
 			if (chan->cd_tremor == 128)
-				chan->cd_tremor = (chan->mem_tremor >> 4) | 192;
+				chan->cd_tremor = (fx->mem_tremor >> 4) | 192;
 			else if (chan->cd_tremor == 192)
-				chan->cd_tremor = (chan->mem_tremor & 0xf) | 128;
+				chan->cd_tremor = (fx->mem_tremor & 0xf) | 128;
 			else
 				chan->cd_tremor--;
 		}
@@ -1888,7 +1760,7 @@ static void handle_effect(song_t *csf, uint32_t nchan, uint32_t cmd, uint32_t pa
 		break;
 
 	case FX_GLOBALVOLSLIDE:
-		fx_global_vol_slide(csf, chan, param);
+		fx_global_vol_slide(csf, fx, param);
 		break;
 
 	case FX_PANNING:
@@ -1903,11 +1775,11 @@ static void handle_effect(song_t *csf, uint32_t nchan, uint32_t cmd, uint32_t pa
 		break;
 
 	case FX_PANNINGSLIDE:
-		fx_panning_slide(csf->flags | (firsttick ? SONG_FIRSTTICK : 0), chan, param);
+		fx_panning_slide(csf->flags | (firsttick ? SONG_FIRSTTICK : 0), chan, fx, param);
 		break;
 
 	case FX_TREMOLO:
-		fx_tremolo(csf->flags | (firsttick ? SONG_FIRSTTICK : 0), chan, param);
+		fx_tremolo(csf->flags | (firsttick ? SONG_FIRSTTICK : 0), chan, fx, param);
 		break;
 
 	case FX_FINEVIBRATO:
@@ -1934,11 +1806,11 @@ static void handle_effect(song_t *csf, uint32_t nchan, uint32_t cmd, uint32_t pa
 		break;
 
 	case FX_CHANNELVOLSLIDE:
-		fx_channel_vol_slide(csf->flags | (firsttick ? SONG_FIRSTTICK : 0), chan, param);
+		fx_channel_vol_slide(csf->flags | (firsttick ? SONG_FIRSTTICK : 0), chan, fx, param);
 		break;
 
 	case FX_PANBRELLO:
-		fx_panbrello(chan, param);
+		fx_panbrello(chan, fx, param);
 		break;
 
 	case FX_SETENVPOSITION:
@@ -1987,21 +1859,21 @@ static void handle_effect(song_t *csf, uint32_t nchan, uint32_t cmd, uint32_t pa
 			1 << 21);
 
 		csf_process_midi_macro(csf, nchan,
-			(param < 0x80) ? csf->midi_config.sfx[chan->active_macro] : csf->midi_config.zxx[param & 0x7F],
+			(param < 0x80) ? csf->midi_config.sfx[fx->active_macro] : csf->midi_config.zxx[param & 0x7F],
 			param, chan->note, vel, 0);
 		break;
 	}
 
 	case FX_NOTESLIDEUP:
-		fx_note_slide(csf->flags | (firsttick ? SONG_FIRSTTICK : 0), chan, param, 1);
+		fx_note_slide(csf->flags | (firsttick ? SONG_FIRSTTICK : 0), chan, fx, param, 1);
 		break;
 	case FX_NOTESLIDEDOWN:
-		fx_note_slide(csf->flags | (firsttick ? SONG_FIRSTTICK : 0), chan, param, -1);
+		fx_note_slide(csf->flags | (firsttick ? SONG_FIRSTTICK : 0), chan, fx, param, -1);
 		break;
 	}
 }
 
-static void handle_voleffect(song_t *csf, song_voice_t *chan, uint32_t volcmd, uint32_t vol,
+static void handle_voleffect(song_t *csf, song_voice_t *chan, song_channel_fx_t *fx, uint32_t volcmd, uint32_t vol,
 	int firsttick, int start_note)
 {
 	/* A few notes, paraphrased from ITTECH.TXT:
@@ -2043,60 +1915,60 @@ static void handle_voleffect(song_t *csf, song_voice_t *chan, uint32_t volcmd, u
 	case VOLFX_PORTAUP: // Fx
 		if (start_note) {
 			if (vol)
-				chan->mem_pitchslide = 4 * vol;
+				fx->mem_pitchslide = 4 * vol;
 			if (!(csf->flags & SONG_COMPATGXX))
-				chan->mem_portanote = chan->mem_pitchslide;
+				fx->mem_portanote = fx->mem_pitchslide;
 		} else {
-			fx_reg_portamento_up(csf->flags, chan, chan->mem_pitchslide);
+			fx_reg_portamento_up(csf->flags, chan, fx->mem_pitchslide);
 		}
 		break;
 
 	case VOLFX_PORTADOWN: // Ex
 		if (start_note) {
 			if (vol)
-				chan->mem_pitchslide = 4 * vol;
+				fx->mem_pitchslide = 4 * vol;
 			if (!(csf->flags & SONG_COMPATGXX))
-				chan->mem_portanote = chan->mem_pitchslide;
+				fx->mem_portanote = fx->mem_pitchslide;
 		} else {
-			fx_reg_portamento_down(csf->flags, chan, chan->mem_pitchslide);
+			fx_reg_portamento_down(csf->flags, chan, fx->mem_pitchslide);
 		}
 		break;
 
 	case VOLFX_TONEPORTAMENTO: // Gx
 		if (start_note) {
 			if (vol)
-				chan->mem_portanote = vc_portamento_table[vol & 0x0F];
+				fx->mem_portanote = vc_portamento_table[vol & 0x0F];
 			if (!(csf->flags & SONG_COMPATGXX))
-				chan->mem_pitchslide = chan->mem_portanote;
+				fx->mem_pitchslide = fx->mem_portanote;
 		} else {
-			fx_tone_portamento(csf->flags, chan, vc_portamento_table[vol & 0x0F]);
+			fx_tone_portamento(csf->flags, chan, fx, vc_portamento_table[vol & 0x0F]);
 		}
 		break;
 
 	case VOLFX_VOLSLIDEUP: // Cx
 		if (start_note) {
 			if (vol)
-				chan->mem_vc_volslide = vol;
+				fx->mem_vc_volslide = vol;
 		} else {
-			fx_volume_up(chan, chan->mem_vc_volslide);
+			fx_volume_up(chan, fx->mem_vc_volslide);
 		}
 		break;
 
 	case VOLFX_VOLSLIDEDOWN: // Dx
 		if (start_note) {
 			if (vol)
-				chan->mem_vc_volslide = vol;
+				fx->mem_vc_volslide = vol;
 		} else {
-			fx_volume_down(chan, chan->mem_vc_volslide);
+			fx_volume_down(chan, fx->mem_vc_volslide);
 		}
 		break;
 
 	case VOLFX_FINEVOLUP: // Ax
 		if (start_note) {
 			if (vol)
-				chan->mem_vc_volslide = vol;
+				fx->mem_vc_volslide = vol;
 			else
-				vol = chan->mem_vc_volslide;
+				vol = fx->mem_vc_volslide;
 			fx_volume_up(chan, vol);
 		}
 		break;
@@ -2104,9 +1976,9 @@ static void handle_voleffect(song_t *csf, song_voice_t *chan, uint32_t volcmd, u
 	case VOLFX_FINEVOLDOWN: // Bx
 		if (start_note) {
 			if (vol)
-				chan->mem_vc_volslide = vol;
+				fx->mem_vc_volslide = vol;
 			else
-				vol = chan->mem_vc_volslide;
+				vol = fx->mem_vc_volslide;
 			fx_volume_down(chan, vol);
 		}
 		break;
@@ -2146,11 +2018,11 @@ static void handle_voleffect(song_t *csf, song_voice_t *chan, uint32_t volcmd, u
 		break;
 
 	case VOLFX_PANSLIDELEFT: // <x (FT2)
-		fx_panning_slide(csf->flags, chan, vol);
+		fx_panning_slide(csf->flags, chan, fx, vol);
 		break;
 
 	case VOLFX_PANSLIDERIGHT: // >x (FT2)
-		fx_panning_slide(csf->flags, chan, vol << 4);
+		fx_panning_slide(csf->flags, chan, fx, vol << 4);
 		break;
 	}
 }
@@ -2159,7 +2031,8 @@ static void handle_voleffect(song_t *csf, song_voice_t *chan, uint32_t volcmd, u
 void csf_process_effects(song_t *csf, int firsttick)
 {
 	song_voice_t *chan = csf->voices;
-	for (uint32_t nchan=0; nchan<MAX_CHANNELS; nchan++, chan++) {
+	song_channel_fx_t *fx = csf->channel_fx;
+	for (uint32_t nchan=0; nchan<MAX_CHANNELS; nchan++, chan++, fx++) {
 		chan->n_command=0;
 
 		uint32_t instr = chan->row_instr;
@@ -2208,18 +2081,18 @@ void csf_process_effects(song_t *csf, int firsttick)
 
 		if (cmd == FX_SPECIAL) {
 			if (param)
-				chan->mem_special = param;
+				fx->mem_special = param;
 			else
-				param = chan->mem_special;
+				param = fx->mem_special;
 			if (param >> 4 == 0xd) {
 				// Ideally this would use SONG_FIRSTTICK, but Impulse Tracker has a bug here :)
 				if (firsttick) {
-					chan->cd_note_delay = (param & 0xf) ? (param & 0xf) : 1;
+					fx->cd_note_delay = (param & 0xf) ? (param & 0xf) : 1;
 					continue; // notes never play on the first tick with SDx, go away
 				}
-				if (--chan->cd_note_delay > 0)
+				if (--fx->cd_note_delay > 0)
 					continue; // not our turn yet, go away
-				start_note = (chan->cd_note_delay == 0);
+				start_note = (fx->cd_note_delay == 0);
 			}
 		}
 
@@ -2284,11 +2157,11 @@ void csf_process_effects(song_t *csf, int firsttick)
 				/* Possibly a better bugfix could be devised. --Bisqwit */
 				if (chan->flags & CHN_ADLIB) {
 					//Do this only if really an adlib chan. Important!
-					OPL_NoteOff(nchan);
-					OPL_Touch(nchan, 0);
+					OPL_NoteOff(csf, nchan);
+					OPL_Touch(csf, nchan, 0);
 				}
-				GM_KeyOff(nchan);
-				GM_Touch(nchan, 0);
+				GM_KeyOff(csf, nchan);
+				GM_Touch(csf, nchan, 0);
 			}
 
 			const int previous_new_note = chan->new_note; 
@@ -2312,11 +2185,11 @@ void csf_process_effects(song_t *csf, int firsttick)
 
 				csf_instrument_change(csf, chan, instr, porta, 1);
 				if (csf->samples[instr].flags & CHN_ADLIB) {
-					OPL_Patch(nchan, csf->samples[instr].adlib_bytes);
+					OPL_Patch(csf, nchan, csf->samples[instr].adlib_bytes);
 				}
 
 				if((csf->flags & SONG_INSTRUMENTMODE) && csf->instruments[instr])
-					GM_DPatch(nchan, csf->instruments[instr]->midi_program,
+					GM_DPatch(csf, nchan, csf->instruments[instr]->midi_program,
 						csf->instruments[instr]->midi_bank,
 						csf->instruments[instr]->midi_channel_mask);
 
@@ -2339,9 +2212,9 @@ void csf_process_effects(song_t *csf, int firsttick)
 					    && chan->new_instrument < MAX_INSTRUMENTS
 					    && csf->instruments[chan->new_instrument]) {
 						if (csf->samples[chan->new_instrument].flags & CHN_ADLIB) {
-							OPL_Patch(nchan, csf->samples[chan->new_instrument].adlib_bytes);
+							OPL_Patch(csf, nchan, csf->samples[chan->new_instrument].adlib_bytes);
 						}
-						GM_DPatch(nchan, csf->instruments[chan->new_instrument]->midi_program,
+						GM_DPatch(csf, nchan, csf->instruments[chan->new_instrument]->midi_program,
 							csf->instruments[chan->new_instrument]->midi_bank,
 							csf->instruments[chan->new_instrument]->midi_channel_mask);
 					}
@@ -2352,6 +2225,6 @@ void csf_process_effects(song_t *csf, int firsttick)
 		}
 
 		handle_effect(csf, nchan, cmd, param, porta, firsttick);
-		handle_voleffect(csf, chan, volcmd, vol, firsttick, start_note);
+		handle_voleffect(csf, chan, fx, volcmd, vol, firsttick, start_note);
 	}
 }
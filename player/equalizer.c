@@ -30,40 +30,13 @@
 #define EQ_BANDWIDTH    2.0
 #define EQ_ZERO         0.000001
 
-typedef struct {
-    float a0, a1, a2, b1, b2;
-    float x1, x2, y1, y2;
-    float gain, center_frequency;
-    int   enabled;
-} eq_band;
-
-
-
 //static REAL f2ic = (REAL)(1 << 28);
 //static REAL i2fc = (REAL)(1.0 / (1 << 28));
 
-static eq_band eq[MAX_EQ_BANDS * 2] =
-{
-    // Default: Flat EQ
-    {0, 0, 0, 0, 0, 0, 0, 0, 0, 1,   120, 0},
-    {0, 0, 0, 0, 0, 0, 0, 0, 0, 1,   600, 0},
-    {0, 0, 0, 0, 0, 0, 0, 0, 0, 1,  1200, 0},
-    {0, 0, 0, 0, 0, 0, 0, 0, 0, 1,  3000, 0},
-    {0, 0, 0, 0, 0, 0, 0, 0, 0, 1,  6000, 0},
-    {0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 10000, 0},
-    {0, 0, 0, 0, 0, 0, 0, 0, 0, 1,   120, 0},
-    {0, 0, 0, 0, 0, 0, 0, 0, 0, 1,   600, 0},
-    {0, 0, 0, 0, 0, 0, 0, 0, 0, 1,  1200, 0},
-    {0, 0, 0, 0, 0, 0, 0, 0, 0, 1,  3000, 0},
-    {0, 0, 0, 0, 0, 0, 0, 0, 0, 1,  6000, 0},
-    {0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 10000, 0},
-};
-
-
-static void eq_filter(eq_band *pbs, int *buffer, unsigned int count)
+
+static void eq_filter(eq_band_t *pbs, int *buffer, unsigned int count, unsigned int step)
 {
-	int amt = (!!(audio_settings.channels-1)+1); // if 1, amt is 1, else 2
-	for (unsigned int i = 0; i < count; i+=amt) {
+	for (unsigned int i = 0; i < count; i += step) {
 		float x = buffer[i];
 		float y = pbs->a1 * pbs->x1 +
 			  pbs->a2 * pbs->x2 +
@@ -97,32 +70,38 @@ void normalize_stereo(song_t *csf, int *buffer, unsigned int count)
 
 void eq_mono(song_t *csf, int *buffer, unsigned int count)
 {
+	eq_band_t *eq = csf->eq;
+
 	for (unsigned int b = 0; b < MAX_EQ_BANDS; b++)
 	{
 		if (eq[b].enabled && eq[b].gain != 1.0f)
-			eq_filter(&eq[b], buffer, count);
+			eq_filter(&eq[b], buffer, count, 1);
 	}
 }
 
 // XXX: I rolled the two loops into one. Make sure this works.
 void eq_stereo(song_t *csf, int *buffer, unsigned int count)
 {
+	eq_band_t *eq = csf->eq;
+
 	for (unsigned int b = 0; b < MAX_EQ_BANDS; b++) {
 		int br = b + MAX_EQ_BANDS;
 
 		// Left band
 		if (eq[b].enabled && eq[b].gain != 1.0f)
-			eq_filter(&eq[b], buffer, count << 1);
+			eq_filter(&eq[b], buffer, count << 1, 2);
 
 		// Right band
 		if (eq[br].enabled && eq[br].gain != 1.0f)
-			eq_filter(&eq[br], buffer + 1, count << 1);
+			eq_filter(&eq[br], buffer + 1, count << 1, 2);
 	}
 }
 
 
-void initialize_eq(int reset, float freq)
+void initialize_eq(song_t *csf, int reset, float freq)
 {
+	eq_band_t *eq = csf->eq;
+
 	//float fMixingFreq = (REAL)mix_frequency;
 
 	// Gain = 0.5 (-6dB) .. 2 (+6dB)
@@ -218,9 +197,11 @@ void initialize_eq(int reset, float freq)
 }
 
 
-void set_eq_gains(const unsigned int *gainbuff, unsigned int gains, const unsigned int *freqs,
+void set_eq_gains(song_t *csf, const unsigned int *gainbuff, unsigned int gains, const unsigned int *freqs,
 		  int reset, int mix_freq)
 {
+	eq_band_t *eq = csf->eq;
+
 	for (unsigned int i = 0; i < MAX_EQ_BANDS; i++) {
 		float g, f = 0;
 
@@ -256,6 +237,6 @@ void set_eq_gains(const unsigned int *gainbuff, unsigned int gains, const unsign
 		}
 	}
 
-	initialize_eq(reset, mix_freq);
+	initialize_eq(csf, reset, mix_freq);
 }
 
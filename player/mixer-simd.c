@@ -0,0 +1,1095 @@
+/*
+ * Schism Tracker - a cross-platform Impulse Tracker clone
+ * copyright (c) 2003-2005 Storlek <storlek@rigelseven.com>
+ * copyright (c) 2005-2008 Mrs. Brisby <mrs.brisby@nimh.org>
+ * copyright (c) 2009 Storlek & Mrs. Brisby
+ * copyright (c) 2010-2012 Storlek
+ * URL: http://schismtracker.org/
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/* SIMD versions of the interpolating mix loops in mixer.c.
+ *
+ * Each of these works in two passes over the span csf_create_stereo_mix
+ * hands it: first a resampler writes the interpolated value of every output
+ * frame into a small buffer on the stack (as a left/right pair; mono samples
+ * are just doubled), then a volume pass scales that into the mix buffer, with
+ * or without ramping. The arithmetic is exactly what the SNDMIX_* macros do --
+ * same 16.16 stepping, same lookup tables, same shifts, and the same 32-bit
+ * wraparound in the multiply-adds -- so the output is bit-for-bit identical
+ * to the scalar mixer, which is still used for everything not covered here
+ * (no interpolation, and the resonant filters, which are recursive).
+ *
+ * The resamplers read the same sample points the scalar code does, with one
+ * exception: the AVX2 8-bit mono linear one gathers 32 bits per frame, which
+ * picks up two bytes past the second tap. That's well inside the guard bytes
+ * csf_allocate_sample puts around the data. */
+
+#include <stdint.h>
+#include <string.h>
+
+#include "player/sndfile.h"
+#include "player/cmixer.h"
+#include "bshift.h"
+#include "util.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+# define MIX_SIMD_X86 1
+# include <immintrin.h>
+# define SSE2_TARGET __attribute__((target("sse2")))
+# define AVX2_TARGET __attribute__((target("avx2")))
+#elif defined(__GNUC__) && defined(__aarch64__)
+# define MIX_SIMD_NEON 1
+# include <arm_neon.h>
+#endif
+
+#if defined(MIX_SIMD_X86) || defined(MIX_SIMD_NEON)
+
+/* These have to agree with mixer.c. */
+#define SPLINE_FRACSHIFT        4
+#define SPLINE_FRACMASK         0xFFC
+#define SPLINE_8SHIFT           6
+#define SPLINE_16SHIFT          14
+#define WFIR_FRACSHIFT          2
+#define WFIR_FRACMASK           0x7FF8
+#define WFIR_FRACHALVE          16
+#define WFIR_8SHIFT             7
+#define WFIR_16SHIFT            15
+
+#define SPLINE_IDX(pos)         (((pos) >> SPLINE_FRACSHIFT) & SPLINE_FRACMASK)
+#define WFIR_IDX(pos)           (((((pos) & 0xFFFF) + WFIR_FRACHALVE) >> WFIR_FRACSHIFT) & WFIR_FRACMASK)
+
+// frames per resample/volume pass; this is just to keep the scratch buffer small
+#define SIMD_MIX_CHUNK          256
+
+typedef void (*simd_resample_t)(const void *, int32_t, int32_t, int32_t *, int);
+typedef void (*simd_store_t)(const int32_t *, int *, int, int32_t, int32_t);
+typedef void (*simd_ramp_t)(const int32_t *, int *, int, int32_t *, int32_t *, int32_t, int32_t);
+
+// ------------------------------------------------------------------------------------------------------------
+// Scalar versions of everything, for whatever's left over at the end of a span.
+//
+// The linear interpolation is written as a * (256 - f) + b * f rather than the
+// (a << 8) + f * (b - a) that mixer.c uses; they're the same number, and since
+// a << 8 is a multiple of 256 the 16-bit version shifts down to the same
+// result too. This form is what maps onto a 16-bit multiply-add.
+
+static inline uint32_t load32(const void *p)
+{
+	uint32_t x;
+	memcpy(&x, p, sizeof(x));
+	return x;
+}
+
+static inline uint32_t load_pair8(const int8_t *p)
+{
+	return (uint16_t)(int16_t)p[0] | ((uint32_t)(uint16_t)(int16_t)p[1] << 16);
+}
+
+static inline uint32_t load_pair16(const int16_t *p)
+{
+	return load32(p);
+}
+
+#define DEFINE_SCALAR_FRAME(bits) \
+	static inline int32_t linear_frame##bits(const int##bits##_t *p, int stride, int32_t pos) \
+	{ \
+		int32_t f = (pos >> 8) & 0xFF; \
+		p += (pos >> 16) * stride; \
+		return rshift_signed_32(p[0] * (256 - f) + p[stride] * f, bits - 8); \
+	} \
+	static inline int32_t spline_frame##bits(const int##bits##_t *p, int stride, int32_t pos) \
+	{ \
+		const signed short *c = mix_cubic_spline_lut + SPLINE_IDX(pos); \
+		p += (pos >> 16) * stride; \
+		return rshift_signed_32(c[0] * p[-stride] + c[1] * p[0] + c[2] * p[stride] + c[3] * p[2 * stride], \
+			SPLINE_##bits##SHIFT); \
+	} \
+	static inline int32_t fir_frame##bits(const int##bits##_t *p, int stride, int32_t pos) \
+	{ \
+		const signed short *c = mix_windowed_fir_lut + WFIR_IDX(pos); \
+		p += (pos >> 16) * stride; \
+		int32_t a = c[0] * p[-3 * stride] + c[1] * p[-2 * stride] + c[2] * p[-stride] + c[3] * p[0]; \
+		int32_t b = c[4] * p[stride] + c[5] * p[2 * stride] + c[6] * p[3 * stride] + c[7] * p[4 * stride]; \
+		return rshift_signed_32(rshift_signed_32(a, 1) + rshift_signed_32(b, 1), WFIR_##bits##SHIFT - 1); \
+	}
+
+DEFINE_SCALAR_FRAME(8)
+DEFINE_SCALAR_FRAME(16)
+
+/* finish frames [done, count) of a resample */
+#define DEFINE_SCALAR_TAIL(bits, resampling) \
+	static inline void mono_tail_##resampling##bits(const int##bits##_t *p, int32_t pos, int32_t inc, \
+		int32_t *out, int done, int count) \
+	{ \
+		for (pos += inc * done; done < count; done++, pos += inc) \
+			out[2 * done] = out[2 * done + 1] = resampling##_frame##bits(p, 1, pos); \
+	} \
+	static inline void stereo_tail_##resampling##bits(const int##bits##_t *p, int32_t pos, int32_t inc, \
+		int32_t *out, int done, int count) \
+	{ \
+		for (pos += inc * done; done < count; done++, pos += inc) { \
+			out[2 * done]     = resampling##_frame##bits(p, 2, pos); \
+			out[2 * done + 1] = resampling##_frame##bits(p + 1, 2, pos); \
+		} \
+	}
+
+DEFINE_SCALAR_TAIL(8, linear)
+DEFINE_SCALAR_TAIL(16, linear)
+DEFINE_SCALAR_TAIL(8, spline)
+DEFINE_SCALAR_TAIL(16, spline)
+DEFINE_SCALAR_TAIL(8, fir)
+DEFINE_SCALAR_TAIL(16, fir)
+
+static inline void store_tail(const int32_t *vol, int *pvol, int done, int count, int32_t rvol, int32_t lvol)
+{
+	for (; done < count; done++) {
+		pvol[2 * done]     += vol[2 * done] * rvol;
+		pvol[2 * done + 1] += vol[2 * done + 1] * lvol;
+	}
+}
+
+/* rv/lv are the ramp volumes *before* frame 'done' */
+static inline void ramp_tail(const int32_t *vol, int *pvol, int done, int count,
+	int32_t *rv, int32_t *lv, int32_t rramp, int32_t lramp)
+{
+	int32_t right_ramp_volume = *rv, left_ramp_volume = *lv;
+
+	for (; done < count; done++) {
+		right_ramp_volume += rramp;
+		left_ramp_volume += lramp;
+		pvol[2 * done]     += vol[2 * done] * rshift_signed_32(right_ramp_volume, VOLUMERAMPPRECISION);
+		pvol[2 * done + 1] += vol[2 * done + 1] * rshift_signed_32(left_ramp_volume, VOLUMERAMPPRECISION);
+	}
+
+	*rv = right_ramp_volume;
+	*lv = left_ramp_volume;
+}
+
+/* the ramp volume after n more frames, wrapping like the scalar loop would */
+static inline int32_t ramp_advance(int32_t v, int32_t ramp, int n)
+{
+	return (int32_t)((uint32_t)v + (uint32_t)ramp * (uint32_t)n);
+}
+
+// ------------------------------------------------------------------------------------------------------------
+// Mix interface glue; this does what SNDMIX_BEGINSAMPLELOOP / SNDMIX_ENDSAMPLELOOP
+// and the BEGIN_/END_ interface macros do for the scalar functions.
+
+static inline int simd_frame_bytes(song_voice_t *chan, int bytes)
+{
+	return (chan->flags & CHN_STEREO) ? bytes * 2 : bytes;
+}
+
+static inline const void *simd_sample_pointer(song_voice_t *chan, int bytes)
+{
+	return chan->current_sample_data + chan->position * simd_frame_bytes(chan, bytes);
+}
+
+/* The resamplers keep the position in an int32_t, counted from the sample pointer they're given, and
+at the top speed (0xFF0000, see csf_process_tick) that overflows after 128 frames. So each pass is cut
+short enough that it can't (with a few frames to spare, since the SIMD loops step past the last
+frame), and the pointer is moved up to the whole-frame part of the position between passes. */
+static inline int simd_chunk_frames(int32_t inc)
+{
+	uint32_t step = (inc < 0) ? -(uint32_t)inc : (uint32_t)inc;
+
+	if (step <= 0x7FFF0000u / (SIMD_MIX_CHUNK + 8))
+		return SIMD_MIX_CHUNK;
+	return MAX((int)(0x7FFF0000u / step) - 8, 1);
+}
+
+static inline const void *simd_rebase(const void *p, int32_t *pos, int frame_bytes)
+{
+	p = (const int8_t *)p + rshift_signed_32(*pos, 16) * frame_bytes;
+	*pos &= 0xFFFF;
+	return p;
+}
+
+static inline void simd_advance(song_voice_t *chan, int count)
+{
+	int64_t position = (int64_t)chan->position_frac + (int64_t)chan->increment * count;
+
+	chan->position += (int32_t)(position >> 16);
+	chan->position_frac = position & 0xFFFF;
+}
+
+static inline void simd_mix(song_voice_t *chan, int *pbuffer, int *pbufmax, int bytes,
+	simd_resample_t resample, simd_store_t store, int fast)
+{
+	int32_t vol[SIMD_MIX_CHUNK * 2];
+	const void *p = simd_sample_pointer(chan, bytes);
+	const int32_t right_volume = chan->right_volume;
+	const int32_t left_volume = fast ? right_volume : chan->left_volume;
+	const int frame_bytes = simd_frame_bytes(chan, bytes);
+	const int chunk = simd_chunk_frames(chan->increment);
+	int32_t pos = chan->position_frac;
+	int total = (pbufmax - pbuffer) / 2;
+
+	for (int count = total; count > 0; ) {
+		int n = MIN(count, chunk);
+
+		resample(p, pos, chan->increment, vol, n);
+		store(vol, pbuffer, n, right_volume, left_volume);
+
+		pos += chan->increment * n;
+		p = simd_rebase(p, &pos, frame_bytes);
+		pbuffer += n * 2;
+		count -= n;
+	}
+
+	simd_advance(chan, total);
+}
+
+static inline void simd_rampmix(song_voice_t *chan, int *pbuffer, int *pbufmax, int bytes,
+	simd_resample_t resample, simd_ramp_t ramp, int fast)
+{
+	int32_t vol[SIMD_MIX_CHUNK * 2];
+	const void *p = simd_sample_pointer(chan, bytes);
+	int32_t right_ramp_volume = chan->right_ramp_volume;
+	int32_t left_ramp_volume = fast ? right_ramp_volume : chan->left_ramp_volume;
+	const int32_t left_ramp = fast ? chan->right_ramp : chan->left_ramp;
+	const int frame_bytes = simd_frame_bytes(chan, bytes);
+	const int chunk = simd_chunk_frames(chan->increment);
+	int32_t pos = chan->position_frac;
+	int total = (pbufmax - pbuffer) / 2;
+
+	for (int count = total; count > 0; ) {
+		int n = MIN(count, chunk);
+
+		resample(p, pos, chan->increment, vol, n);
+		ramp(vol, pbuffer, n, &right_ramp_volume, &left_ramp_volume, chan->right_ramp, left_ramp);
+
+		pos += chan->increment * n;
+		p = simd_rebase(p, &pos, frame_bytes);
+		pbuffer += n * 2;
+		count -= n;
+	}
+
+	simd_advance(chan, total);
+
+	chan->right_ramp_volume = right_ramp_volume;
+	chan->right_volume      = rshift_signed_32(right_ramp_volume, VOLUMERAMPPRECISION);
+	if (fast) {
+		chan->left_ramp_volume = right_ramp_volume;
+		chan->left_volume      = chan->right_volume;
+	} else {
+		chan->left_ramp_volume = left_ramp_volume;
+		chan->left_volume      = rshift_signed_32(left_ramp_volume, VOLUMERAMPPRECISION);
+	}
+}
+
+/* This is the same diet-template business as in mixer.c; the names line up
+ * with the scalar ones, with the instruction set tacked on the front. */
+#define DEFINE_SIMD_MIX_FUNCS(isa, chns, chnsname, bits, resampling, resampname) \
+	static void isa##_##chnsname##bits##Bit##resampname##Mix(song_voice_t *chan, int *pbuffer, int *pbufmax) \
+	{ \
+		simd_mix(chan, pbuffer, pbufmax, bits / 8, isa##_##resampling##_##chns##bits, isa##_mix_store, 0); \
+	} \
+	static void isa##_##chnsname##bits##Bit##resampname##RampMix(song_voice_t *chan, int *pbuffer, int *pbufmax) \
+	{ \
+		simd_rampmix(chan, pbuffer, pbufmax, bits / 8, isa##_##resampling##_##chns##bits, isa##_mix_ramp, 0); \
+	}
+
+#define DEFINE_SIMD_FASTMIX_FUNCS(isa, bits, resampling, resampname) \
+	static void isa##_FastMono##bits##Bit##resampname##Mix(song_voice_t *chan, int *pbuffer, int *pbufmax) \
+	{ \
+		simd_mix(chan, pbuffer, pbufmax, bits / 8, isa##_##resampling##_mono##bits, isa##_mix_store, 1); \
+	} \
+	static void isa##_FastMono##bits##Bit##resampname##RampMix(song_voice_t *chan, int *pbuffer, int *pbufmax) \
+	{ \
+		simd_rampmix(chan, pbuffer, pbufmax, bits / 8, isa##_##resampling##_mono##bits, isa##_mix_ramp, 1); \
+	}
+
+#define DEFINE_SIMD_MIX_RESAMPLING(isa, resampling, resampname) \
+	DEFINE_SIMD_MIX_FUNCS(isa, mono, Mono, 8, resampling, resampname) \
+	DEFINE_SIMD_MIX_FUNCS(isa, mono, Mono, 16, resampling, resampname) \
+	DEFINE_SIMD_MIX_FUNCS(isa, stereo, Stereo, 8, resampling, resampname) \
+	DEFINE_SIMD_MIX_FUNCS(isa, stereo, Stereo, 16, resampling, resampname) \
+	DEFINE_SIMD_FASTMIX_FUNCS(isa, 8, resampling, resampname) \
+	DEFINE_SIMD_FASTMIX_FUNCS(isa, 16, resampling, resampname)
+
+#define DEFINE_SIMD_MIX_INTERFACE(isa) \
+	DEFINE_SIMD_MIX_RESAMPLING(isa, linear, Linear) \
+	DEFINE_SIMD_MIX_RESAMPLING(isa, spline, Spline) \
+	DEFINE_SIMD_MIX_RESAMPLING(isa, fir, FirFilter)
+
+/* Same layout as the tables in mixer.c (see MIXNDX_*); NULL means "leave the
+ * scalar function alone". */
+#define BUILD_SIMD_FUNCTION_TABLE_RAMP(isa, fast, resampling, ramp) \
+	isa##_##fast##Mono8Bit##resampling##ramp##Mix, \
+	isa##_##fast##Mono16Bit##resampling##ramp##Mix, \
+	isa##_Stereo8Bit##resampling##ramp##Mix, \
+	isa##_Stereo16Bit##resampling##ramp##Mix,
+
+#define BUILD_SIMD_FUNCTION_TABLE_NONE \
+	NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
+
+#define BUILD_SIMD_FUNCTION_TABLE(isa, fast, resampling) \
+	BUILD_SIMD_FUNCTION_TABLE_RAMP(isa, fast, resampling, /* none */) \
+	BUILD_SIMD_FUNCTION_TABLE_RAMP(isa, fast, resampling, Ramp) \
+	BUILD_SIMD_FUNCTION_TABLE_NONE /* filters */
+
+#define BUILD_SIMD_FUNCTION_TABLES(isa, isaname) \
+	static const mix_interface_t isa##_mix_functions[MIX_FUNCTION_TABLE_SIZE] = { \
+		BUILD_SIMD_FUNCTION_TABLE_NONE BUILD_SIMD_FUNCTION_TABLE_NONE /* no interpolation */ \
+		BUILD_SIMD_FUNCTION_TABLE(isa, /* none */, Linear) \
+		BUILD_SIMD_FUNCTION_TABLE(isa, /* none */, Spline) \
+		BUILD_SIMD_FUNCTION_TABLE(isa, /* none */, FirFilter) \
+	}; \
+	static const mix_interface_t isa##_fastmix_functions[MIX_FUNCTION_TABLE_SIZE] = { \
+		BUILD_SIMD_FUNCTION_TABLE_NONE BUILD_SIMD_FUNCTION_TABLE_NONE \
+		BUILD_SIMD_FUNCTION_TABLE(isa, Fast, Linear) \
+		BUILD_SIMD_FUNCTION_TABLE(isa, Fast, Spline) \
+		BUILD_SIMD_FUNCTION_TABLE(isa, Fast, FirFilter) \
+	}; \
+	static const struct mix_simd_kernels isa##_kernels = { \
+		isaname, isa##_mix_functions, isa##_fastmix_functions, \
+	};
+
+#endif /* MIX_SIMD_X86 || MIX_SIMD_NEON */
+
+// ------------------------------------------------------------------------------------------------------------
+// SSE2
+
+#ifdef MIX_SIMD_X86
+
+/* low 32 bits of a 32x32 multiply; SSE2 only has the unsigned 32x32->64 one,
+ * but the low half is the same either way */
+static inline SSE2_TARGET __m128i sse2_mullo_epi32(__m128i a, __m128i b)
+{
+	__m128i even = _mm_mul_epu32(a, b);
+	__m128i odd = _mm_mul_epu32(_mm_srli_epi64(a, 32), _mm_srli_epi64(b, 32));
+
+	return _mm_unpacklo_epi32(_mm_shuffle_epi32(even, _MM_SHUFFLE(0, 0, 2, 0)),
+		_mm_shuffle_epi32(odd, _MM_SHUFFLE(0, 0, 2, 0)));
+}
+
+/* [a0 + a1, a2 + a3, b0 + b1, b2 + b3] */
+static inline SSE2_TARGET __m128i sse2_hadd_pairs(__m128i a, __m128i b)
+{
+	__m128 x = _mm_castsi128_ps(a), y = _mm_castsi128_ps(b);
+
+	return _mm_add_epi32(_mm_castps_si128(_mm_shuffle_ps(x, y, _MM_SHUFFLE(2, 0, 2, 0))),
+		_mm_castps_si128(_mm_shuffle_ps(x, y, _MM_SHUFFLE(3, 1, 3, 1))));
+}
+
+/* L0 R0 L1 R1 ... -> L0 L1 R0 R1 within each 64-bit half */
+static inline SSE2_TARGET __m128i sse2_split_pairs(__m128i x)
+{
+	x = _mm_shufflelo_epi16(x, _MM_SHUFFLE(3, 1, 2, 0));
+	return _mm_shufflehi_epi16(x, _MM_SHUFFLE(3, 1, 2, 0));
+}
+
+/* L0 R0 L1 R1 L2 R2 L3 R3 -> L0 L1 L2 L3 R0 R1 R2 R3 */
+static inline SSE2_TARGET __m128i sse2_deinterleave(__m128i x)
+{
+	return _mm_shuffle_epi32(sse2_split_pairs(x), _MM_SHUFFLE(3, 1, 2, 0));
+}
+
+/* sample loaders; these all give sign-extended 16-bit lanes */
+static inline SSE2_TARGET __m128i sse2_extend8(__m128i x)
+{
+	return _mm_srai_epi16(_mm_unpacklo_epi8(x, x), 8);
+}
+
+static inline SSE2_TARGET __m128i sse2_load4_8(const int8_t *p)
+{
+	return sse2_extend8(_mm_cvtsi32_si128((int)load32(p)));
+}
+
+static inline SSE2_TARGET __m128i sse2_load4_16(const int16_t *p)
+{
+	return _mm_loadl_epi64((const __m128i *)p);
+}
+
+static inline SSE2_TARGET __m128i sse2_load8_8(const int8_t *p)
+{
+	return sse2_extend8(_mm_loadl_epi64((const __m128i *)p));
+}
+
+static inline SSE2_TARGET __m128i sse2_load8_16(const int16_t *p)
+{
+	return _mm_loadu_si128((const __m128i *)p);
+}
+
+/* (256 - f) | (f << 16) for the linear interpolation multiply-add */
+static inline SSE2_TARGET __m128i sse2_linear_weights(__m128i pos)
+{
+	__m128i f = _mm_and_si128(_mm_srli_epi32(pos, 8), _mm_set1_epi32(0xFF));
+
+	return _mm_or_si128(_mm_sub_epi32(_mm_set1_epi32(256), f), _mm_slli_epi32(f, 16));
+}
+
+static inline SSE2_TARGET __m128i sse2_fir_combine(__m128i a, __m128i b, int shift)
+{
+	return _mm_srai_epi32(_mm_add_epi32(_mm_srai_epi32(a, 1), _mm_srai_epi32(b, 1)), shift);
+}
+
+/* each m holds [a01, a23, b45, b67] for one frame */
+static inline SSE2_TARGET __m128i sse2_fir_sum(__m128i m0, __m128i m1, __m128i m2, __m128i m3, int shift)
+{
+	__m128i t0 = _mm_unpacklo_epi32(m0, m1), t1 = _mm_unpacklo_epi32(m2, m3);
+	__m128i t2 = _mm_unpackhi_epi32(m0, m1), t3 = _mm_unpackhi_epi32(m2, m3);
+
+	return sse2_fir_combine(_mm_add_epi32(_mm_unpacklo_epi64(t0, t1), _mm_unpackhi_epi64(t0, t1)),
+		_mm_add_epi32(_mm_unpacklo_epi64(t2, t3), _mm_unpackhi_epi64(t2, t3)), shift);
+}
+
+static inline SSE2_TARGET void sse2_store_mono(int32_t *out, __m128i v)
+{
+	_mm_storeu_si128((__m128i *)out, _mm_unpacklo_epi32(v, v));
+	_mm_storeu_si128((__m128i *)(out + 4), _mm_unpackhi_epi32(v, v));
+}
+
+static SSE2_TARGET void sse2_mix_store(const int32_t *vol, int *pvol, int count, int32_t rvol, int32_t lvol)
+{
+	const __m128i m = _mm_setr_epi32(rvol, lvol, rvol, lvol);
+	int i;
+
+	for (i = 0; i + 2 <= count; i += 2) {
+		__m128i v = _mm_loadu_si128((const __m128i *)(vol + 2 * i));
+		__m128i d = _mm_loadu_si128((const __m128i *)(pvol + 2 * i));
+		_mm_storeu_si128((__m128i *)(pvol + 2 * i), _mm_add_epi32(d, sse2_mullo_epi32(v, m)));
+	}
+
+	store_tail(vol, pvol, i, count, rvol, lvol);
+}
+
+static SSE2_TARGET void sse2_mix_ramp(const int32_t *vol, int *pvol, int count,
+	int32_t *rv, int32_t *lv, int32_t rramp, int32_t lramp)
+{
+	__m128i ramp = _mm_setr_epi32(ramp_advance(*rv, rramp, 1), ramp_advance(*lv, lramp, 1),
+		ramp_advance(*rv, rramp, 2), ramp_advance(*lv, lramp, 2));
+	const __m128i step = _mm_setr_epi32(ramp_advance(0, rramp, 2), ramp_advance(0, lramp, 2),
+		ramp_advance(0, rramp, 2), ramp_advance(0, lramp, 2));
+	int i;
+
+	for (i = 0; i + 2 <= count; i += 2) {
+		__m128i v = _mm_loadu_si128((const __m128i *)(vol + 2 * i));
+		__m128i d = _mm_loadu_si128((const __m128i *)(pvol + 2 * i));
+		__m128i m = _mm_srai_epi32(ramp, VOLUMERAMPPRECISION);
+		_mm_storeu_si128((__m128i *)(pvol + 2 * i), _mm_add_epi32(d, sse2_mullo_epi32(v, m)));
+		ramp = _mm_add_epi32(ramp, step);
+	}
+
+	*rv = ramp_advance(*rv, rramp, i);
+	*lv = ramp_advance(*lv, lramp, i);
+	ramp_tail(vol, pvol, i, count, rv, lv, rramp, lramp);
+}
+
+#define DEFINE_SSE2_RESAMPLERS(bits) \
+	static SSE2_TARGET void sse2_linear_mono##bits(const void *src, int32_t pos, int32_t inc, int32_t *out, int count) \
+	{ \
+		const int##bits##_t *p = src; \
+		int32_t x = pos; \
+		int i; \
+		for (i = 0; i + 4 <= count; i += 4, x += 4 * inc) { \
+			int32_t x1 = x + inc, x2 = x1 + inc, x3 = x2 + inc; \
+			__m128i taps = _mm_setr_epi32((int)load_pair##bits(p + (x >> 16)), (int)load_pair##bits(p + (x1 >> 16)), \
+				(int)load_pair##bits(p + (x2 >> 16)), (int)load_pair##bits(p + (x3 >> 16))); \
+			__m128i w = sse2_linear_weights(_mm_setr_epi32(x, x1, x2, x3)); \
+			sse2_store_mono(out + 2 * i, _mm_srai_epi32(_mm_madd_epi16(taps, w), bits - 8)); \
+		} \
+		mono_tail_linear##bits(p, pos, inc, out, i, count); \
+	} \
+	static SSE2_TARGET void sse2_linear_stereo##bits(const void *src, int32_t pos, int32_t inc, int32_t *out, int count) \
+	{ \
+		const int##bits##_t *p = src; \
+		int32_t x = pos; \
+		int i; \
+		for (i = 0; i + 2 <= count; i += 2, x += 2 * inc) { \
+			int32_t x1 = x + inc; \
+			__m128i taps = sse2_split_pairs(_mm_unpacklo_epi64(sse2_load4_##bits(p + 2 * (x >> 16)), \
+				sse2_load4_##bits(p + 2 * (x1 >> 16)))); \
+			__m128i w = sse2_linear_weights(_mm_setr_epi32(x, x, x1, x1)); \
+			_mm_storeu_si128((__m128i *)(out + 2 * i), _mm_srai_epi32(_mm_madd_epi16(taps, w), bits - 8)); \
+		} \
+		stereo_tail_linear##bits(p, pos, inc, out, i, count); \
+	} \
+	static SSE2_TARGET void sse2_spline_mono##bits(const void *src, int32_t pos, int32_t inc, int32_t *out, int count) \
+	{ \
+		const int##bits##_t *p = src; \
+		int32_t x = pos; \
+		int i; \
+		for (i = 0; i + 4 <= count; i += 4, x += 4 * inc) { \
+			int32_t x1 = x + inc, x2 = x1 + inc, x3 = x2 + inc; \
+			__m128i m0 = _mm_madd_epi16( \
+				_mm_unpacklo_epi64(sse2_load4_##bits(p + (x >> 16) - 1), sse2_load4_##bits(p + (x1 >> 16) - 1)), \
+				_mm_unpacklo_epi64(sse2_load4_16(mix_cubic_spline_lut + SPLINE_IDX(x)), \
+					sse2_load4_16(mix_cubic_spline_lut + SPLINE_IDX(x1)))); \
+			__m128i m1 = _mm_madd_epi16( \
+				_mm_unpacklo_epi64(sse2_load4_##bits(p + (x2 >> 16) - 1), sse2_load4_##bits(p + (x3 >> 16) - 1)), \
+				_mm_unpacklo_epi64(sse2_load4_16(mix_cubic_spline_lut + SPLINE_IDX(x2)), \
+					sse2_load4_16(mix_cubic_spline_lut + SPLINE_IDX(x3)))); \
+			sse2_store_mono(out + 2 * i, _mm_srai_epi32(sse2_hadd_pairs(m0, m1), SPLINE_##bits##SHIFT)); \
+		} \
+		mono_tail_spline##bits(p, pos, inc, out, i, count); \
+	} \
+	static SSE2_TARGET void sse2_spline_stereo##bits(const void *src, int32_t pos, int32_t inc, int32_t *out, int count) \
+	{ \
+		const int##bits##_t *p = src; \
+		int32_t x = pos; \
+		int i; \
+		for (i = 0; i + 2 <= count; i += 2, x += 2 * inc) { \
+			int32_t x1 = x + inc; \
+			__m128i c0 = sse2_load4_16(mix_cubic_spline_lut + SPLINE_IDX(x)); \
+			__m128i c1 = sse2_load4_16(mix_cubic_spline_lut + SPLINE_IDX(x1)); \
+			__m128i m0 = _mm_madd_epi16(sse2_deinterleave(sse2_load8_##bits(p + 2 * ((x >> 16) - 1))), \
+				_mm_unpacklo_epi64(c0, c0)); \
+			__m128i m1 = _mm_madd_epi16(sse2_deinterleave(sse2_load8_##bits(p + 2 * ((x1 >> 16) - 1))), \
+				_mm_unpacklo_epi64(c1, c1)); \
+			_mm_storeu_si128((__m128i *)(out + 2 * i), \
+				_mm_srai_epi32(sse2_hadd_pairs(m0, m1), SPLINE_##bits##SHIFT)); \
+		} \
+		stereo_tail_spline##bits(p, pos, inc, out, i, count); \
+	} \
+	static SSE2_TARGET void sse2_fir_mono##bits(const void *src, int32_t pos, int32_t inc, int32_t *out, int count) \
+	{ \
+		const int##bits##_t *p = src; \
+		int32_t x = pos; \
+		int i; \
+		for (i = 0; i + 4 <= count; i += 4, x += 4 * inc) { \
+			__m128i m[4]; \
+			for (int k = 0; k < 4; k++) { \
+				int32_t xk = x + k * inc; \
+				m[k] = _mm_madd_epi16(sse2_load8_##bits(p + (xk >> 16) - 3), \
+					sse2_load8_16(mix_windowed_fir_lut + WFIR_IDX(xk))); \
+			} \
+			sse2_store_mono(out + 2 * i, sse2_fir_sum(m[0], m[1], m[2], m[3], WFIR_##bits##SHIFT - 1)); \
+		} \
+		mono_tail_fir##bits(p, pos, inc, out, i, count); \
+	} \
+	static SSE2_TARGET void sse2_fir_stereo##bits(const void *src, int32_t pos, int32_t inc, int32_t *out, int count) \
+	{ \
+		const int##bits##_t *p = src; \
+		int32_t x = pos; \
+		int i; \
+		for (i = 0; i + 2 <= count; i += 2, x += 2 * inc) { \
+			__m128i lo[2], hi[2]; \
+			for (int k = 0; k < 2; k++) { \
+				int32_t xk = x + k * inc; \
+				const int##bits##_t *s = p + 2 * ((xk >> 16) - 3); \
+				__m128i c = sse2_load8_16(mix_windowed_fir_lut + WFIR_IDX(xk)); \
+				lo[k] = _mm_madd_epi16(sse2_deinterleave(sse2_load8_##bits(s)), \
+					_mm_shuffle_epi32(c, _MM_SHUFFLE(1, 0, 1, 0))); \
+				hi[k] = _mm_madd_epi16(sse2_deinterleave(sse2_load8_##bits(s + 8)), \
+					_mm_shuffle_epi32(c, _MM_SHUFFLE(3, 2, 3, 2))); \
+			} \
+			_mm_storeu_si128((__m128i *)(out + 2 * i), sse2_fir_combine(sse2_hadd_pairs(lo[0], lo[1]), \
+				sse2_hadd_pairs(hi[0], hi[1]), WFIR_##bits##SHIFT - 1)); \
+		} \
+		stereo_tail_fir##bits(p, pos, inc, out, i, count); \
+	}
+
+DEFINE_SSE2_RESAMPLERS(8)
+DEFINE_SSE2_RESAMPLERS(16)
+
+DEFINE_SIMD_MIX_INTERFACE(sse2)
+BUILD_SIMD_FUNCTION_TABLES(sse2, "SSE2")
+
+// ------------------------------------------------------------------------------------------------------------
+// AVX2
+//
+// Most 256-bit shuffles stay within their 128-bit lane, so the per-frame loads
+// below are paired up in whatever order makes the lanes come out sequential.
+
+#define AVX2_COMBINE(lo, hi) _mm256_inserti128_si256(_mm256_castsi128_si256(lo), (hi), 1)
+
+static inline AVX2_TARGET __m256i avx2_hadd_pairs(__m256i a, __m256i b)
+{
+	__m256 x = _mm256_castsi256_ps(a), y = _mm256_castsi256_ps(b);
+
+	return _mm256_add_epi32(_mm256_castps_si256(_mm256_shuffle_ps(x, y, _MM_SHUFFLE(2, 0, 2, 0))),
+		_mm256_castps_si256(_mm256_shuffle_ps(x, y, _MM_SHUFFLE(3, 1, 3, 1))));
+}
+
+static inline AVX2_TARGET __m256i avx2_split_pairs(__m256i x)
+{
+	x = _mm256_shufflelo_epi16(x, _MM_SHUFFLE(3, 1, 2, 0));
+	return _mm256_shufflehi_epi16(x, _MM_SHUFFLE(3, 1, 2, 0));
+}
+
+static inline AVX2_TARGET __m256i avx2_deinterleave(__m256i x)
+{
+	return _mm256_shuffle_epi32(avx2_split_pairs(x), _MM_SHUFFLE(3, 1, 2, 0));
+}
+
+static inline AVX2_TARGET __m256i avx2_linear_weights(__m256i pos)
+{
+	__m256i f = _mm256_and_si256(_mm256_srli_epi32(pos, 8), _mm256_set1_epi32(0xFF));
+
+	return _mm256_or_si256(_mm256_sub_epi32(_mm256_set1_epi32(256), f), _mm256_slli_epi32(f, 16));
+}
+
+static inline AVX2_TARGET __m256i avx2_fir_combine(__m256i a, __m256i b, int shift)
+{
+	return _mm256_srai_epi32(_mm256_add_epi32(_mm256_srai_epi32(a, 1), _mm256_srai_epi32(b, 1)), shift);
+}
+
+static inline AVX2_TARGET __m256i avx2_fir_sum(__m256i m0, __m256i m1, __m256i m2, __m256i m3, int shift)
+{
+	__m256i t0 = _mm256_unpacklo_epi32(m0, m1), t1 = _mm256_unpacklo_epi32(m2, m3);
+	__m256i t2 = _mm256_unpackhi_epi32(m0, m1), t3 = _mm256_unpackhi_epi32(m2, m3);
+
+	return avx2_fir_combine(_mm256_add_epi32(_mm256_unpacklo_epi64(t0, t1), _mm256_unpackhi_epi64(t0, t1)),
+		_mm256_add_epi32(_mm256_unpacklo_epi64(t2, t3), _mm256_unpackhi_epi64(t2, t3)), shift);
+}
+
+static inline AVX2_TARGET void avx2_store_mono(int32_t *out, __m256i v)
+{
+	__m256i lo = _mm256_unpacklo_epi32(v, v), hi = _mm256_unpackhi_epi32(v, v);
+
+	_mm256_storeu_si256((__m256i *)out, _mm256_permute2x128_si256(lo, hi, 0x20));
+	_mm256_storeu_si256((__m256i *)(out + 8), _mm256_permute2x128_si256(lo, hi, 0x31));
+}
+
+/* inc * [0 1 2 3 4 5 6 7], for stepping eight (or four) frames at once */
+static inline AVX2_TARGET __m256i avx2_frame_offsets(int32_t inc)
+{
+	return _mm256_mullo_epi32(_mm256_set1_epi32(inc), _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7));
+}
+
+/* gathers; the 8-bit ones sign-extend into 16-bit lanes like the SSE2 loaders */
+static inline AVX2_TARGET __m256i avx2_gather_pairs8(const int8_t *p, __m256i idx)
+{
+	// move the low two bytes of each dword to the top of its 16-bit halves,
+	// then shift them back down
+	const __m256i top = _mm256_setr_epi8(
+		-128, 0, -128, 1, -128, 4, -128, 5, -128, 8, -128, 9, -128, 12, -128, 13,
+		-128, 0, -128, 1, -128, 4, -128, 5, -128, 8, -128, 9, -128, 12, -128, 13);
+	__m256i x = _mm256_i32gather_epi32((const int *)p, idx, 1);
+	return _mm256_srai_epi16(_mm256_shuffle_epi8(x, top), 8);
+}
+
+static inline AVX2_TARGET __m256i avx2_gather_pairs16(const int16_t *p, __m256i idx)
+{
+	return _mm256_i32gather_epi32((const int *)p, idx, 2);
+}
+
+static inline AVX2_TARGET __m256i avx2_gather4_8(const int8_t *p, __m128i idx)
+{
+	return _mm256_cvtepi8_epi16(_mm_i32gather_epi32((const int *)p, idx, 1));
+}
+
+static inline AVX2_TARGET __m256i avx2_gather4_16(const int16_t *p, __m128i idx)
+{
+	return _mm256_i32gather_epi64((const long long *)p, idx, 2);
+}
+
+/* two stereo frames per index, as in L0 R0 L1 R1 */
+static inline AVX2_TARGET __m256i avx2_gather_stereo_pairs8(const int8_t *p, __m128i idx)
+{
+	return _mm256_cvtepi8_epi16(_mm_i32gather_epi32((const int *)p, idx, 2));
+}
+
+static inline AVX2_TARGET __m256i avx2_gather_stereo_pairs16(const int16_t *p, __m128i idx)
+{
+	return _mm256_i32gather_epi64((const long long *)p, idx, 4);
+}
+
+static AVX2_TARGET void avx2_mix_store(const int32_t *vol, int *pvol, int count, int32_t rvol, int32_t lvol)
+{
+	const __m256i m = _mm256_setr_epi32(rvol, lvol, rvol, lvol, rvol, lvol, rvol, lvol);
+	int i;
+
+	for (i = 0; i + 4 <= count; i += 4) {
+		__m256i v = _mm256_loadu_si256((const __m256i *)(vol + 2 * i));
+		__m256i d = _mm256_loadu_si256((const __m256i *)(pvol + 2 * i));
+		_mm256_storeu_si256((__m256i *)(pvol + 2 * i), _mm256_add_epi32(d, _mm256_mullo_epi32(v, m)));
+	}
+
+	store_tail(vol, pvol, i, count, rvol, lvol);
+}
+
+static AVX2_TARGET void avx2_mix_ramp(const int32_t *vol, int *pvol, int count,
+	int32_t *rv, int32_t *lv, int32_t rramp, int32_t lramp)
+{
+	__m256i ramp = _mm256_setr_epi32(
+		ramp_advance(*rv, rramp, 1), ramp_advance(*lv, lramp, 1),
+		ramp_advance(*rv, rramp, 2), ramp_advance(*lv, lramp, 2),
+		ramp_advance(*rv, rramp, 3), ramp_advance(*lv, lramp, 3),
+		ramp_advance(*rv, rramp, 4), ramp_advance(*lv, lramp, 4));
+	const int32_t rstep = ramp_advance(0, rramp, 4), lstep = ramp_advance(0, lramp, 4);
+	const __m256i step = _mm256_setr_epi32(rstep, lstep, rstep, lstep, rstep, lstep, rstep, lstep);
+	int i;
+
+	for (i = 0; i + 4 <= count; i += 4) {
+		__m256i v = _mm256_loadu_si256((const __m256i *)(vol + 2 * i));
+		__m256i d = _mm256_loadu_si256((const __m256i *)(pvol + 2 * i));
+		__m256i m = _mm256_srai_epi32(ramp, VOLUMERAMPPRECISION);
+		_mm256_storeu_si256((__m256i *)(pvol + 2 * i), _mm256_add_epi32(d, _mm256_mullo_epi32(v, m)));
+		ramp = _mm256_add_epi32(ramp, step);
+	}
+
+	*rv = ramp_advance(*rv, rramp, i);
+	*lv = ramp_advance(*lv, lramp, i);
+	ramp_tail(vol, pvol, i, count, rv, lv, rramp, lramp);
+}
+
+#define DEFINE_AVX2_RESAMPLERS(bits) \
+	static AVX2_TARGET void avx2_linear_mono##bits(const void *src, int32_t pos, int32_t inc, int32_t *out, int count) \
+	{ \
+		const int##bits##_t *p = src; \
+		const __m256i offsets = avx2_frame_offsets(inc); \
+		int32_t x = pos; \
+		int i; \
+		for (i = 0; i + 8 <= count; i += 8, x += 8 * inc) { \
+			__m256i posv = _mm256_add_epi32(_mm256_set1_epi32(x), offsets); \
+			__m256i taps = avx2_gather_pairs##bits(p, _mm256_srai_epi32(posv, 16)); \
+			avx2_store_mono(out + 2 * i, \
+				_mm256_srai_epi32(_mm256_madd_epi16(taps, avx2_linear_weights(posv)), bits - 8)); \
+		} \
+		mono_tail_linear##bits(p, pos, inc, out, i, count); \
+	} \
+	static AVX2_TARGET void avx2_linear_stereo##bits(const void *src, int32_t pos, int32_t inc, int32_t *out, int count) \
+	{ \
+		const int##bits##_t *p = src; \
+		const __m128i offsets = _mm256_castsi256_si128(avx2_frame_offsets(inc)); \
+		int32_t x = pos; \
+		int i; \
+		for (i = 0; i + 4 <= count; i += 4, x += 4 * inc) { \
+			__m128i posv = _mm_add_epi32(_mm_set1_epi32(x), offsets); \
+			__m256i taps = avx2_split_pairs(avx2_gather_stereo_pairs##bits(p, _mm_srai_epi32(posv, 16))); \
+			__m128i w = sse2_linear_weights(posv); \
+			__m256i w2 = AVX2_COMBINE(_mm_unpacklo_epi32(w, w), _mm_unpackhi_epi32(w, w)); \
+			_mm256_storeu_si256((__m256i *)(out + 2 * i), _mm256_srai_epi32(_mm256_madd_epi16(taps, w2), bits - 8)); \
+		} \
+		stereo_tail_linear##bits(p, pos, inc, out, i, count); \
+	} \
+	static AVX2_TARGET void avx2_spline_mono##bits(const void *src, int32_t pos, int32_t inc, int32_t *out, int count) \
+	{ \
+		const int##bits##_t *p = src; \
+		const __m256i offsets = avx2_frame_offsets(inc); \
+		int32_t x = pos; \
+		int i; \
+		for (i = 0; i + 8 <= count; i += 8, x += 8 * inc) { \
+			__m256i posv = _mm256_add_epi32(_mm256_set1_epi32(x), offsets); \
+			__m256i h = _mm256_sub_epi32(_mm256_srai_epi32(posv, 16), _mm256_set1_epi32(1)); \
+			__m256i c = _mm256_and_si256(_mm256_srai_epi32(posv, SPLINE_FRACSHIFT), _mm256_set1_epi32(SPLINE_FRACMASK)); \
+			__m256i m0 = _mm256_madd_epi16(avx2_gather4_##bits(p, _mm256_castsi256_si128(h)), \
+				avx2_gather4_16(mix_cubic_spline_lut, _mm256_castsi256_si128(c))); \
+			__m256i m1 = _mm256_madd_epi16(avx2_gather4_##bits(p, _mm256_extracti128_si256(h, 1)), \
+				avx2_gather4_16(mix_cubic_spline_lut, _mm256_extracti128_si256(c, 1))); \
+			/* the sums come out in frame order 0 1 4 5 2 3 6 7 */ \
+			__m256i v = _mm256_permute4x64_epi64(avx2_hadd_pairs(m0, m1), _MM_SHUFFLE(3, 1, 2, 0)); \
+			avx2_store_mono(out + 2 * i, _mm256_srai_epi32(v, SPLINE_##bits##SHIFT)); \
+		} \
+		mono_tail_spline##bits(p, pos, inc, out, i, count); \
+	} \
+	static AVX2_TARGET void avx2_spline_stereo##bits(const void *src, int32_t pos, int32_t inc, int32_t *out, int count) \
+	{ \
+		const int##bits##_t *p = src; \
+		int32_t x = pos; \
+		int i; \
+		for (i = 0; i + 4 <= count; i += 4, x += 4 * inc) { \
+			__m128i taps[4], c[4]; \
+			__m256i m[2]; \
+			for (int k = 0; k < 4; k++) { \
+				int32_t xk = x + k * inc; \
+				taps[k] = sse2_load8_##bits(p + 2 * ((xk >> 16) - 1)); \
+				c[k] = sse2_load4_16(mix_cubic_spline_lut + SPLINE_IDX(xk)); \
+				c[k] = _mm_unpacklo_epi64(c[k], c[k]); \
+			} \
+			/* frames 0 and 2 share a register, as do 1 and 3 */ \
+			for (int k = 0; k < 2; k++) \
+				m[k] = _mm256_madd_epi16(avx2_deinterleave(AVX2_COMBINE(taps[k], taps[k + 2])), \
+					AVX2_COMBINE(c[k], c[k + 2])); \
+			_mm256_storeu_si256((__m256i *)(out + 2 * i), \
+				_mm256_srai_epi32(avx2_hadd_pairs(m[0], m[1]), SPLINE_##bits##SHIFT)); \
+		} \
+		stereo_tail_spline##bits(p, pos, inc, out, i, count); \
+	} \
+	static AVX2_TARGET void avx2_fir_mono##bits(const void *src, int32_t pos, int32_t inc, int32_t *out, int count) \
+	{ \
+		const int##bits##_t *p = src; \
+		int32_t x = pos; \
+		int i; \
+		for (i = 0; i + 8 <= count; i += 8, x += 8 * inc) { \
+			__m256i m[4]; \
+			/* frames k and k + 4 share a register, so the transpose comes out in order */ \
+			for (int k = 0; k < 4; k++) { \
+				int32_t xa = x + k * inc, xb = x + (k + 4) * inc; \
+				m[k] = _mm256_madd_epi16( \
+					AVX2_COMBINE(sse2_load8_##bits(p + (xa >> 16) - 3), sse2_load8_##bits(p + (xb >> 16) - 3)), \
+					AVX2_COMBINE(sse2_load8_16(mix_windowed_fir_lut + WFIR_IDX(xa)), \
+						sse2_load8_16(mix_windowed_fir_lut + WFIR_IDX(xb)))); \
+			} \
+			avx2_store_mono(out + 2 * i, avx2_fir_sum(m[0], m[1], m[2], m[3], WFIR_##bits##SHIFT - 1)); \
+		} \
+		mono_tail_fir##bits(p, pos, inc, out, i, count); \
+	} \
+	static AVX2_TARGET void avx2_fir_stereo##bits(const void *src, int32_t pos, int32_t inc, int32_t *out, int count) \
+	{ \
+		const int##bits##_t *p = src; \
+		const __m256i cperm = _mm256_setr_epi32(0, 1, 0, 1, 2, 3, 2, 3); \
+		int32_t x = pos; \
+		int i; \
+		for (i = 0; i + 4 <= count; i += 4, x += 4 * inc) { \
+			__m256i m[4], h0, h1; \
+			/* low lane gets taps 0-3 of a frame, high lane taps 4-7 */ \
+			for (int k = 0; k < 4; k++) { \
+				int32_t xk = x + k * inc; \
+				const int##bits##_t *s = p + 2 * ((xk >> 16) - 3); \
+				__m256i c = _mm256_castsi128_si256(sse2_load8_16(mix_windowed_fir_lut + WFIR_IDX(xk))); \
+				m[k] = _mm256_madd_epi16(avx2_deinterleave(AVX2_COMBINE(sse2_load8_##bits(s), sse2_load8_##bits(s + 8))), \
+					_mm256_permutevar8x32_epi32(c, cperm)); \
+			} \
+			h0 = avx2_hadd_pairs(m[0], m[1]); \
+			h1 = avx2_hadd_pairs(m[2], m[3]); \
+			_mm256_storeu_si256((__m256i *)(out + 2 * i), \
+				avx2_fir_combine(_mm256_permute2x128_si256(h0, h1, 0x20), \
+					_mm256_permute2x128_si256(h0, h1, 0x31), WFIR_##bits##SHIFT - 1)); \
+		} \
+		stereo_tail_fir##bits(p, pos, inc, out, i, count); \
+	}
+
+DEFINE_AVX2_RESAMPLERS(8)
+DEFINE_AVX2_RESAMPLERS(16)
+
+DEFINE_SIMD_MIX_INTERFACE(avx2)
+BUILD_SIMD_FUNCTION_TABLES(avx2, "AVX2")
+
+#endif /* MIX_SIMD_X86 */
+
+// ------------------------------------------------------------------------------------------------------------
+// NEON (AArch64 only, where it's always there)
+
+#ifdef MIX_SIMD_NEON
+
+static inline int32x4_t neon_shr(int32x4_t v, int shift)
+{
+	return vshlq_s32(v, vdupq_n_s32(-shift));
+}
+
+static inline void neon_store_mono(int32_t *out, int32x4_t v)
+{
+	int32x4x2_t z = vzipq_s32(v, v);
+
+	vst1q_s32(out, z.val[0]);
+	vst1q_s32(out + 4, z.val[1]);
+}
+
+static inline int16x4_t neon_load4_8(const int8_t *p)
+{
+	return vget_low_s16(vmovl_s8(vreinterpret_s8_u32(vdup_n_u32(load32(p)))));
+}
+
+static inline int16x4_t neon_load4_16(const int16_t *p)
+{
+	return vld1_s16(p);
+}
+
+static inline int16x8_t neon_load8_8(const int8_t *p)
+{
+	return vmovl_s8(vld1_s8(p));
+}
+
+static inline int16x8_t neon_load8_16(const int16_t *p)
+{
+	return vld1q_s16(p);
+}
+
+/* one stereo frame of spline taps -> [l01, l23, r01, r23] */
+static inline int32x4_t neon_spline_stereo(int16x8_t t, int16x4_t c)
+{
+	return vpaddq_s32(vmull_s16(vget_low_s16(vuzp1q_s16(t, t)), c),
+		vmull_s16(vget_low_s16(vuzp2q_s16(t, t)), c));
+}
+
+/* eight fir taps -> [a01, a23, b45, b67] */
+static inline int32x4_t neon_fir_taps(int16x8_t t, int16x8_t c)
+{
+	return vpaddq_s32(vmull_s16(vget_low_s16(t), vget_low_s16(c)), vmull_high_s16(t, c));
+}
+
+static inline int32x4_t neon_fir_combine(int32x4_t a, int32x4_t b, int shift)
+{
+	return neon_shr(vaddq_s32(vshrq_n_s32(a, 1), vshrq_n_s32(b, 1)), shift);
+}
+
+static void neon_mix_store(const int32_t *vol, int *pvol, int count, int32_t rvol, int32_t lvol)
+{
+	const int32_t mv[4] = { rvol, lvol, rvol, lvol };
+	const int32x4_t m = vld1q_s32(mv);
+	int i;
+
+	for (i = 0; i + 2 <= count; i += 2)
+		vst1q_s32(pvol + 2 * i, vmlaq_s32(vld1q_s32(pvol + 2 * i), vld1q_s32(vol + 2 * i), m));
+
+	store_tail(vol, pvol, i, count, rvol, lvol);
+}
+
+static void neon_mix_ramp(const int32_t *vol, int *pvol, int count,
+	int32_t *rv, int32_t *lv, int32_t rramp, int32_t lramp)
+{
+	const int32_t rampv[4] = {
+		ramp_advance(*rv, rramp, 1), ramp_advance(*lv, lramp, 1),
+		ramp_advance(*rv, rramp, 2), ramp_advance(*lv, lramp, 2),
+	};
+	const int32_t stepv[4] = {
+		ramp_advance(0, rramp, 2), ramp_advance(0, lramp, 2),
+		ramp_advance(0, rramp, 2), ramp_advance(0, lramp, 2),
+	};
+	const int32x4_t step = vld1q_s32(stepv);
+	int32x4_t ramp = vld1q_s32(rampv);
+	int i;
+
+	for (i = 0; i + 2 <= count; i += 2) {
+		int32x4_t m = vshrq_n_s32(ramp, VOLUMERAMPPRECISION);
+		vst1q_s32(pvol + 2 * i, vmlaq_s32(vld1q_s32(pvol + 2 * i), vld1q_s32(vol + 2 * i), m));
+		ramp = vaddq_s32(ramp, step);
+	}
+
+	*rv = ramp_advance(*rv, rramp, i);
+	*lv = ramp_advance(*lv, lramp, i);
+	ramp_tail(vol, pvol, i, count, rv, lv, rramp, lramp);
+}
+
+#define DEFINE_NEON_RESAMPLERS(bits) \
+	static void neon_linear_mono##bits(const void *src, int32_t pos, int32_t inc, int32_t *out, int count) \
+	{ \
+		const int##bits##_t *p = src; \
+		int32_t x = pos; \
+		int i; \
+		for (i = 0; i + 4 <= count; i += 4, x += 4 * inc) { \
+			const int32_t xv[4] = { x, x + inc, x + 2 * inc, x + 3 * inc }; \
+			const uint32_t pairs[4] = { \
+				load_pair##bits(p + (xv[0] >> 16)), load_pair##bits(p + (xv[1] >> 16)), \
+				load_pair##bits(p + (xv[2] >> 16)), load_pair##bits(p + (xv[3] >> 16)), \
+			}; \
+			int16x8_t t = vreinterpretq_s16_u32(vld1q_u32(pairs)); \
+			int32x4_t f = vandq_s32(vshrq_n_s32(vld1q_s32(xv), 8), vdupq_n_s32(0xFF)); \
+			int32x4_t v = vmull_s16(vget_low_s16(vuzp1q_s16(t, t)), vmovn_s32(vsubq_s32(vdupq_n_s32(256), f))); \
+			v = vmlal_s16(v, vget_low_s16(vuzp2q_s16(t, t)), vmovn_s32(f)); \
+			neon_store_mono(out + 2 * i, neon_shr(v, bits - 8)); \
+		} \
+		mono_tail_linear##bits(p, pos, inc, out, i, count); \
+	} \
+	static void neon_linear_stereo##bits(const void *src, int32_t pos, int32_t inc, int32_t *out, int count) \
+	{ \
+		const int##bits##_t *p = src; \
+		int32_t x = pos; \
+		int i; \
+		for (i = 0; i + 2 <= count; i += 2, x += 2 * inc) { \
+			int32_t x1 = x + inc; \
+			int16_t f0 = (x >> 8) & 0xFF, f1 = (x1 >> 8) & 0xFF; \
+			const int16_t wa[4] = { 256 - f0, 256 - f0, 256 - f1, 256 - f1 }; \
+			const int16_t wb[4] = { f0, f0, f1, f1 }; \
+			/* [La0 Ra0 La1 Ra1] [Lb0 Rb0 Lb1 Rb1] -> [La0 Ra0 Lb0 Rb0] [La1 Ra1 Lb1 Rb1] */ \
+			int32x2_t a = vreinterpret_s32_s16(neon_load4_##bits(p + 2 * (x >> 16))); \
+			int32x2_t b = vreinterpret_s32_s16(neon_load4_##bits(p + 2 * (x1 >> 16))); \
+			int32x4_t v = vmull_s16(vreinterpret_s16_s32(vzip1_s32(a, b)), vld1_s16(wa)); \
+			v = vmlal_s16(v, vreinterpret_s16_s32(vzip2_s32(a, b)), vld1_s16(wb)); \
+			vst1q_s32(out + 2 * i, neon_shr(v, bits - 8)); \
+		} \
+		stereo_tail_linear##bits(p, pos, inc, out, i, count); \
+	} \
+	static void neon_spline_mono##bits(const void *src, int32_t pos, int32_t inc, int32_t *out, int count) \
+	{ \
+		const int##bits##_t *p = src; \
+		int32_t x = pos; \
+		int i; \
+		for (i = 0; i + 4 <= count; i += 4, x += 4 * inc) { \
+			int32x4_t m[4]; \
+			for (int k = 0; k < 4; k++) { \
+				int32_t xk = x + k * inc; \
+				m[k] = vmull_s16(neon_load4_##bits(p + (xk >> 16) - 1), \
+					vld1_s16(mix_cubic_spline_lut + SPLINE_IDX(xk))); \
+			} \
+			int32x4_t v = vpaddq_s32(vpaddq_s32(m[0], m[1]), vpaddq_s32(m[2], m[3])); \
+			neon_store_mono(out + 2 * i, neon_shr(v, SPLINE_##bits##SHIFT)); \
+		} \
+		mono_tail_spline##bits(p, pos, inc, out, i, count); \
+	} \
+	static void neon_spline_stereo##bits(const void *src, int32_t pos, int32_t inc, int32_t *out, int count) \
+	{ \
+		const int##bits##_t *p = src; \
+		int32_t x = pos; \
+		int i; \
+		for (i = 0; i + 2 <= count; i += 2, x += 2 * inc) { \
+			int32_t x1 = x + inc; \
+			int32x4_t a = neon_spline_stereo(neon_load8_##bits(p + 2 * ((x >> 16) - 1)), \
+				vld1_s16(mix_cubic_spline_lut + SPLINE_IDX(x))); \
+			int32x4_t b = neon_spline_stereo(neon_load8_##bits(p + 2 * ((x1 >> 16) - 1)), \
+				vld1_s16(mix_cubic_spline_lut + SPLINE_IDX(x1))); \
+			vst1q_s32(out + 2 * i, neon_shr(vpaddq_s32(a, b), SPLINE_##bits##SHIFT)); \
+		} \
+		stereo_tail_spline##bits(p, pos, inc, out, i, count); \
+	} \
+	static void neon_fir_mono##bits(const void *src, int32_t pos, int32_t inc, int32_t *out, int count) \
+	{ \
+		const int##bits##_t *p = src; \
+		int32_t x = pos; \
+		int i; \
+		for (i = 0; i + 4 <= count; i += 4, x += 4 * inc) { \
+			int32x4_t m[4]; \
+			for (int k = 0; k < 4; k++) { \
+				int32_t xk = x + k * inc; \
+				m[k] = neon_fir_taps(neon_load8_##bits(p + (xk >> 16) - 3), \
+					vld1q_s16(mix_windowed_fir_lut + WFIR_IDX(xk))); \
+			} \
+			/* [a0 b0 a1 b1] [a2 b2 a3 b3] */ \
+			int32x4_t r0 = vpaddq_s32(m[0], m[1]), r1 = vpaddq_s32(m[2], m[3]); \
+			neon_store_mono(out + 2 * i, \
+				neon_fir_combine(vuzp1q_s32(r0, r1), vuzp2q_s32(r0, r1), WFIR_##bits##SHIFT - 1)); \
+		} \
+		mono_tail_fir##bits(p, pos, inc, out, i, count); \
+	} \
+	static void neon_fir_stereo##bits(const void *src, int32_t pos, int32_t inc, int32_t *out, int count) \
+	{ \
+		const int##bits##_t *p = src; \
+		int32_t x = pos; \
+		int i; \
+		for (i = 0; i + 2 <= count; i += 2, x += 2 * inc) { \
+			int32x4_t s[2]; \
+			for (int k = 0; k < 2; k++) { \
+				int32_t xk = x + k * inc; \
+				const int##bits##_t *sp = p + 2 * ((xk >> 16) - 3); \
+				int16x8_t lo = neon_load8_##bits(sp), hi = neon_load8_##bits(sp + 8); \
+				int16x8_t c = vld1q_s16(mix_windowed_fir_lut + WFIR_IDX(xk)); \
+				/* [aL bL aR bR] */ \
+				s[k] = vpaddq_s32(neon_fir_taps(vuzp1q_s16(lo, hi), c), neon_fir_taps(vuzp2q_s16(lo, hi), c)); \
+			} \
+			vst1q_s32(out + 2 * i, \
+				neon_fir_combine(vuzp1q_s32(s[0], s[1]), vuzp2q_s32(s[0], s[1]), WFIR_##bits##SHIFT - 1)); \
+		} \
+		stereo_tail_fir##bits(p, pos, inc, out, i, count); \
+	}
+
+DEFINE_NEON_RESAMPLERS(8)
+DEFINE_NEON_RESAMPLERS(16)
+
+DEFINE_SIMD_MIX_INTERFACE(neon)
+BUILD_SIMD_FUNCTION_TABLES(neon, "NEON")
+
+#endif /* MIX_SIMD_NEON */
+
+// ------------------------------------------------------------------------------------------------------------
+
+const struct mix_simd_kernels *mix_simd_detect(void)
+{
+#if defined(MIX_SIMD_X86)
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2"))
+		return &avx2_kernels;
+	if (__builtin_cpu_supports("sse2"))
+		return &sse2_kernels;
+#elif defined(MIX_SIMD_NEON)
+	return &neon_kernels;
+#endif
+	return NULL;
+}
@@ -308,9 +308,6 @@
 //////////////////////////////////////////////////////////
 // Interfaces
 
-typedef void(* mix_interface_t)(song_voice_t *, int *, int *);
-
-
 #define BEGIN_MIX_INTERFACE(func) \
 	static void func(song_voice_t *channel, int *pbuffer, int *pbufmax) \
 	{ \
@@ -413,13 +410,16 @@ typedef void(* mix_interface_t)(song_voice_t *, int *, int *);
 	}
 
 #define BEGIN_RESAMPLE_INTERFACE(func, sampletype, numchannels) \
-	void func(sampletype *oldbuf, sampletype *newbuf, unsigned long oldlen, unsigned long newlen) \
+	void func(sampletype *oldbuf, sampletype *newbuf, unsigned long oldlen, unsigned long newlen, \
+		unsigned long start, unsigned long end) \
 	{ \
-	unsigned long long position = 0; \
-	const sampletype *p = oldbuf; \
-	sampletype *pvol = newbuf; \
-	const sampletype *pbufmax = &newbuf[newlen* numchannels]; \
 	unsigned long long increment = (((unsigned long long)oldlen)<<16)/((unsigned long long)newlen); \
+	unsigned long long position = start * increment; \
+	const sampletype *p = oldbuf; \
+	sampletype *pvol = &newbuf[start * numchannels]; \
+	const sampletype *pbufmax = &newbuf[end * numchannels]; \
+	if (start >= end) \
+		return; \
 	do {
 
 #define END_RESAMPLE_INTERFACE_MONO() \
@@ -483,7 +483,7 @@ DEFINE_MIX_INTERFACE(16)
 	BEGIN_RESAMPLE_INTERFACE(ResampleMono##bits##BitFirFilter, int##bits##_t, 1) \
 		SNDMIX_GETMONOVOLFIRFILTER(bits) \
 		vol  >>= (WFIR_16SHIFT-WFIR_##bits##SHIFT);  /* This is used to compensate, since the code assumes that it always outputs to 16bits */ \
-		vol = CLAMP(vol, INT ## bits ## _MIN, INT ## bits ## _MIN); \
+		vol = CLAMP(vol, INT ## bits ## _MIN, INT ## bits ## _MAX); \
 	END_RESAMPLE_INTERFACE_MONO()
 
 #define DEFINE_STEREO_RESAMPLE_INTERFACE(bits) \
@@ -491,8 +491,8 @@ DEFINE_MIX_INTERFACE(16)
 		SNDMIX_GETSTEREOVOLFIRFILTER(bits) \
 		vol_l  >>= (WFIR_16SHIFT-WFIR_##bits##SHIFT);  /* This is used to compensate, since the code assumes that it always outputs to 16bits */ \
 		vol_r  >>= (WFIR_16SHIFT-WFIR_##bits##SHIFT);  /* This is used to compensate, since the code assumes that it always outputs to 16bits */ \
-		vol_l = CLAMP(vol_l, INT ## bits ## _MIN, INT ## bits ## _MIN); \
-		vol_r = CLAMP(vol_r, INT ## bits ## _MIN, INT ## bits ## _MIN); \
+		vol_l = CLAMP(vol_l, INT ## bits ## _MIN, INT ## bits ## _MAX); \
+		vol_r = CLAMP(vol_r, INT ## bits ## _MIN, INT ## bits ## _MAX); \
 	END_RESAMPLE_INTERFACE_STEREO()
 
 DEFINE_MONO_RESAMPLE_INTERFACE(8)
@@ -503,22 +503,7 @@ DEFINE_STEREO_RESAMPLE_INTERFACE(16)
 
 /////////////////////////////////////////////////////////////////////////////////////
 //
-// Mix function tables
-//
-//
-// Index is as follows:
-//      [b1-b0] format (8-bit-mono, 16-bit-mono, 8-bit-stereo, 16-bit-stereo)
-//      [b2]    ramp
-//      [b3]    filter
-//      [b5-b4] src type
-
-#define MIXNDX_16BIT        0x01
-#define MIXNDX_STEREO       0x02
-#define MIXNDX_RAMP         0x04
-#define MIXNDX_FILTER       0x08
-#define MIXNDX_LINEARSRC    0x10
-#define MIXNDX_SPLINESRC    0x20
-#define MIXNDX_FIRSRC       0x30
+// Mix function tables (the index layout is described in cmixer.h)
 
 #define BUILD_MIX_FUNCTION_TABLE_RAMP(fast, resampling, filter, ramp) \
 	fast##filter##Mono8Bit##resampling##ramp##Mix, \
@@ -542,20 +527,72 @@ DEFINE_STEREO_RESAMPLE_INTERFACE(16)
 	BUILD_MIX_FUNCTION_TABLE_FILTER(/* none */, resampling, Filter)
 
 // mix_(bits)(m/s)[_filt]_(interp/spline/fir/whatever)[_ramp]
-static const mix_interface_t mix_functions[2 * 2 * 16] = {
+// these aren't const because csf_init_mix_functions can swap in SIMD versions
+static mix_interface_t mix_functions[MIX_FUNCTION_TABLE_SIZE] = {
+	BUILD_MIX_FUNCTION_TABLE(/* none */)
+	BUILD_MIX_FUNCTION_TABLE(Linear)
+	BUILD_MIX_FUNCTION_TABLE(Spline)
+	BUILD_MIX_FUNCTION_TABLE(FirFilter)
+};
+
+static mix_interface_t fastmix_functions[MIX_FUNCTION_TABLE_SIZE] = {
+	BUILD_MIX_FUNCTION_TABLE_FAST(/* none */)
+	BUILD_MIX_FUNCTION_TABLE_FAST(Linear)
+	BUILD_MIX_FUNCTION_TABLE_FAST(Spline)
+	BUILD_MIX_FUNCTION_TABLE_FAST(FirFilter)
+};
+
+/* and the same again, left alone, so the self-tests have something to hold the SIMD ones up against */
+static const mix_interface_t c_mix_functions[MIX_FUNCTION_TABLE_SIZE] = {
 	BUILD_MIX_FUNCTION_TABLE(/* none */)
 	BUILD_MIX_FUNCTION_TABLE(Linear)
 	BUILD_MIX_FUNCTION_TABLE(Spline)
 	BUILD_MIX_FUNCTION_TABLE(FirFilter)
 };
 
-static const mix_interface_t fastmix_functions[2 * 2 * 16] = {
+static const mix_interface_t c_fastmix_functions[MIX_FUNCTION_TABLE_SIZE] = {
 	BUILD_MIX_FUNCTION_TABLE_FAST(/* none */)
 	BUILD_MIX_FUNCTION_TABLE_FAST(Linear)
 	BUILD_MIX_FUNCTION_TABLE_FAST(Spline)
 	BUILD_MIX_FUNCTION_TABLE_FAST(FirFilter)
 };
 
+static const char *mix_functions_name = "C";
+
+/* the SIMD mixers share the lookup tables */
+const signed short *const mix_cubic_spline_lut = cubic_spline_lut;
+const signed short *const mix_windowed_fir_lut = windowed_fir_lut;
+
+/* Replace whatever mix functions we have faster versions of. This has to be
+ * called before any audio is mixed; the output doesn't change either way. */
+void csf_init_mix_functions(void)
+{
+	const struct mix_simd_kernels *simd = mix_simd_detect();
+
+	if (!simd)
+		return;
+
+	for (int i = 0; i < MIX_FUNCTION_TABLE_SIZE; i++) {
+		if (simd->mix[i])
+			mix_functions[i] = simd->mix[i];
+		if (simd->fastmix[i])
+			fastmix_functions[i] = simd->fastmix[i];
+	}
+
+	mix_functions_name = simd->name;
+}
+
+const char *csf_mix_functions_name(void)
+{
+	return mix_functions_name;
+}
+
+void csf_get_mix_function(int index, int fast, mix_interface_t *c, mix_interface_t *current)
+{
+	*c = (fast ? c_fastmix_functions : c_mix_functions)[index];
+	*current = (fast ? fastmix_functions : mix_functions)[index];
+}
+
 static int get_sample_count(song_voice_t *chan, int samples)
 {
 	int loop_start = (chan->flags & CHN_LOOP) ? chan->loop_start : 0;
@@ -701,73 +738,271 @@ static int get_sample_count(song_voice_t *chan, int samples)
 }
 
 
+/* Mix one voice into pbuffer. over_limit is set when the voice limit has already been reached,
+ * in which case the voice is only advanced. If the voice stops, its click removal goes into ofs
+ * (see stereo_fill), or if that's NULL, straight into pbuffer for the rest of the chunk.
+ * Returns 1 if anything was actually mixed. */
+static unsigned int mix_voice(song_t *csf, song_voice_t *channel, int *pbuffer, int count,
+	int over_limit, int *ofs)
+{
+	const mix_interface_t *mix_func_table;
+	unsigned int flags;
+	unsigned int nrampsamples;
+	int smpcount;
+	int nsamples;
+	unsigned int naddmix = 0;
+
+	flags = 0;
+
+	if (channel->flags & CHN_16BIT)
+		flags |= MIXNDX_16BIT;
+
+	if (channel->flags & CHN_STEREO)
+		flags |= MIXNDX_STEREO;
+
+	if (channel->flags & CHN_FILTER)
+		flags |= MIXNDX_FILTER;
+
+	if (!(channel->flags & CHN_NOIDO) &&
+		!(csf->mix_flags & SNDMIX_NORESAMPLING)) {
+		// use hq-fir mixer?
+		if ((csf->mix_flags & (SNDMIX_HQRESAMPLER | SNDMIX_ULTRAHQSRCMODE))
+					== (SNDMIX_HQRESAMPLER | SNDMIX_ULTRAHQSRCMODE))
+			flags |= MIXNDX_FIRSRC;
+		else if (csf->mix_flags & SNDMIX_HQRESAMPLER)
+			flags |= MIXNDX_SPLINESRC;
+		else
+			flags |= MIXNDX_LINEARSRC;    // use
+	}
+
+	if ((flags < 0x40) &&
+		(channel->left_volume == channel->right_volume) &&
+		((!channel->ramp_length) ||
+		(channel->left_ramp == channel->right_ramp))) {
+		mix_func_table = fastmix_functions;
+	} else {
+		mix_func_table = mix_functions;
+	}
+
+	nsamples = count;
+
+	do {
+		nrampsamples = nsamples;
+
+		if (channel->ramp_length > 0) {
+			if ((int) nrampsamples > channel->ramp_length)
+				nrampsamples = channel->ramp_length;
+		}
+
+		smpcount = 1;
+
+		/* Figure out the number of remaining samples,
+		 * unless we're in AdLib or MIDI mode (to prevent
+		 * artificial KeyOffs)
+		 */
+		if (!(channel->flags & CHN_ADLIB)) {
+			smpcount = get_sample_count(channel, nrampsamples);
+		}
+
+		if (smpcount <= 0) {
+			// Stopping the channel
+			channel->current_sample_data = NULL;
+			channel->length = 0;
+			channel->position = 0;
+			channel->position_frac = 0;
+			channel->ramp_length = 0;
+			if (ofs) {
+				ofs[(count - nsamples) * 2] += channel->rofs;
+				ofs[(count - nsamples) * 2 + 1] += channel->lofs;
+			} else {
+				end_channel_ofs(channel, pbuffer, nsamples);
+				csf->dry_rofs_vol += channel->rofs;
+				csf->dry_lofs_vol += channel->lofs;
+			}
+			channel->rofs = channel->lofs = 0;
+			channel->flags &= ~CHN_PINGPONGFLAG;
+			break;
+		}
+
+		// Should we mix this channel ?
+
+		if (over_limit
+			|| (!channel->ramp_length && !(channel->left_volume | channel->right_volume))) {
+			int delta = (channel->increment * (int) smpcount) + (int) channel->position_frac;
+			channel->position_frac = delta & 0xFFFF;
+			channel->position += (delta >> 16);
+			channel->rofs = channel->lofs = 0;
+			pbuffer += smpcount * 2;
+		} else {
+			// Do mixing
+
+			/* Mix the stream, unless we're in AdLib mode */
+			if (!(channel->flags & CHN_ADLIB)) {
+				// Choose function for mixing
+				mix_interface_t mix_func;
+				mix_func = channel->ramp_length
+					? mix_func_table[flags | MIXNDX_RAMP]
+					: mix_func_table[flags];
+				int *pbufmax = pbuffer + (smpcount * 2);
+				channel->rofs = -*(pbufmax - 2);
+				channel->lofs = -*(pbufmax - 1);
+
+				mix_func(channel, pbuffer, pbufmax);
+				channel->rofs += *(pbufmax - 2);
+				channel->lofs += *(pbufmax - 1);
+				pbuffer = pbufmax;
+				naddmix = 1;
+			}
+		}
+
+		nsamples -= smpcount;
+
+		if (channel->ramp_length) {
+			channel->ramp_length -= smpcount;
+			if (channel->ramp_length <= 0) {
+				channel->ramp_length = 0;
+				channel->right_volume = channel->right_volume_new;
+				channel->left_volume = channel->left_volume_new;
+				channel->right_ramp = channel->left_ramp = 0;
+
+				if ((channel->flags & CHN_NOTEFADE)
+					&& (!(channel->fadeout_volume))) {
+					channel->length = 0;
+					channel->current_sample_data = NULL;
+				}
+			}
+		}
+
+	} while (nsamples > 0);
+
+	return naddmix;
+}
+
+/* ------------------------------------------------------------------------ */
+/* Parallel mixing
+ *
+ * Voices are dealt out round-robin to a fixed number of jobs, and each job mixes into its own
+ * buffer (job 0 uses the song's mix buffer). Everything a voice contributes -- the mixed samples,
+ * and the click removal it leaves in mix_ofs_buffer when it stops -- is integer addition, so summing
+ * the job buffers afterwards gives exactly the same result as mixing them all in one go, whatever
+ * the number of threads happens to be.
+ *
+ * The voice limit is the only thing that depends on the order voices are mixed in. Voices below
+ * max_voices can never hit it, so only those are handed out; the rest are done afterwards, in
+ * order, the same way as the serial mixer. */
+
+unsigned int mix_threads = 1;
+unsigned int mix_thread_voices = 32;
+void (*csf_run_mix_jobs)(void (*func)(void *data, unsigned int job), void *data, unsigned int njobs) = NULL;
+
+struct mix_job_state {
+	song_t *csf;
+	int count;
+	unsigned int nvoices, njobs;
+	struct {
+		unsigned int used, mixed;
+	} job[MAX_MIX_THREADS];
+};
+
+static void mix_job(void *data, unsigned int job)
+{
+	struct mix_job_state *state = data;
+	song_t *csf = state->csf;
+	int *pbuffer = job ? csf->mix_thread_buffer[job - 1] : csf->mix_buffer;
+
+	if (job) {
+		memset(pbuffer, 0, state->count * 2 * sizeof(int));
+		memset(csf->mix_ofs_buffer[job], 0, state->count * 2 * sizeof(int));
+	}
+
+	state->job[job].used = state->job[job].mixed = 0;
+
+	for (unsigned int nchan = job; nchan < state->nvoices; nchan += state->njobs) {
+		song_voice_t *const channel = &csf->voices[csf->voice_mix[nchan]];
+
+		if (!channel->current_sample_data)
+			continue;
+
+		state->job[job].used++;
+		state->job[job].mixed += mix_voice(csf, channel, pbuffer, state->count, 0,
+			csf->mix_ofs_buffer[job]);
+	}
+}
+
+/* Returns the number of voices handed to the workers (0 if it's not worth it), and adds the
+ * voice counts from them to *nchused / *nchmixed. */
+static unsigned int create_stereo_mix_parallel(song_t *csf, int count,
+	unsigned int *nchused, unsigned int *nchmixed)
+{
+	struct mix_job_state state;
+	unsigned int njobs = MIN(mix_threads, MAX_MIX_THREADS);
+
+	if (!csf_run_mix_jobs || njobs < 2 || csf->multi_write)
+		return 0;
+
+	state.nvoices = (csf->mix_flags & SNDMIX_DIRECTTODISK)
+		? csf->num_voices
+		: MIN(csf->num_voices, csf->max_voices);
+	if (state.nvoices < 2 || state.nvoices < mix_thread_voices)
+		return 0;
+
+	state.csf = csf;
+	state.count = count;
+	state.njobs = MIN(njobs, state.nvoices);
+
+	csf_run_mix_jobs(mix_job, &state, state.njobs);
+
+	for (unsigned int job = 0; job < state.njobs; job++) {
+		*nchused += state.job[job].used;
+		*nchmixed += state.job[job].mixed;
+
+		if (job) {
+			const int *src = csf->mix_thread_buffer[job - 1];
+			const int *ofs = csf->mix_ofs_buffer[job];
+			for (int i = 0; i < count * 2; i++) {
+				csf->mix_buffer[i] += src[i];
+				csf->mix_ofs_buffer[0][i] += ofs[i];
+			}
+		}
+	}
+
+	return state.nvoices;
+}
+
+/* get a multi-write channel's buffer ready to be mixed into, if it isn't already */
+static void multi_write_touch(struct multi_write *mw, int count)
+{
+	if (mw->touched)
+		return;
+	if (!mw->buffer)
+		mw->buffer = mem_alloc(MIXBUFFERSIZE * 2 * sizeof(int));
+	memset(mw->buffer, 0, count * 2 * sizeof(int));
+	mw->touched = 1;
+}
+
 unsigned int csf_create_stereo_mix(song_t *csf, int count)
 {
-	int* ofsl, *ofsr;
 	unsigned int nchused, nchmixed;
 
 	if (!count)
 		return 0;
 
 	nchused = nchmixed = 0;
+	init_mix_buffer(csf->mix_ofs_buffer[0], count * 2);
 
-	// yuck
-	if (csf->multi_write)
-		for (unsigned int nchan = 0; nchan < MAX_CHANNELS; nchan++)
-			memset(csf->multi_write[nchan].buffer, 0, sizeof(csf->multi_write[nchan].buffer));
-
-	for (unsigned int nchan = 0; nchan < csf->num_voices; nchan++) {
-		const mix_interface_t *mix_func_table;
+	for (unsigned int nchan = create_stereo_mix_parallel(csf, count, &nchused, &nchmixed);
+	     nchan < csf->num_voices; nchan++) {
 		song_voice_t *const channel = &csf->voices[csf->voice_mix[nchan]];
-		unsigned int flags;
-		unsigned int nrampsamples;
-		int smpcount;
-		int nsamples;
 		int *pbuffer;
 
 		if (!channel->current_sample_data)
 			continue;
 
-		ofsr = &g_dry_rofs_vol;
-		ofsl = &g_dry_lofs_vol;
-		flags = 0;
-
-		if (channel->flags & CHN_16BIT)
-			flags |= MIXNDX_16BIT;
-
-		if (channel->flags & CHN_STEREO)
-			flags |= MIXNDX_STEREO;
-
-		if (channel->flags & CHN_FILTER)
-			flags |= MIXNDX_FILTER;
-
-		if (!(channel->flags & CHN_NOIDO) &&
-			!(csf->mix_flags & SNDMIX_NORESAMPLING)) {
-			// use hq-fir mixer?
-			if ((csf->mix_flags & (SNDMIX_HQRESAMPLER | SNDMIX_ULTRAHQSRCMODE))
-						== (SNDMIX_HQRESAMPLER | SNDMIX_ULTRAHQSRCMODE))
-				flags |= MIXNDX_FIRSRC;
-			else if (csf->mix_flags & SNDMIX_HQRESAMPLER)
-				flags |= MIXNDX_SPLINESRC;
-			else
-				flags |= MIXNDX_LINEARSRC;    // use
-		}
-
-		if ((flags < 0x40) &&
-			(channel->left_volume == channel->right_volume) &&
-			((!channel->ramp_length) ||
-			(channel->left_ramp == channel->right_ramp))) {
-			mix_func_table = fastmix_functions;
-		} else {
-			mix_func_table = mix_functions;
-		}
-
-		nsamples = count;
-
 		if (csf->multi_write) {
 			int master = (csf->voice_mix[nchan] < MAX_CHANNELS)
 				? csf->voice_mix[nchan]
 				: (channel->master_channel - 1);
+			multi_write_touch(csf->multi_write + master, count);
 			pbuffer = csf->multi_write[master].buffer;
 			csf->multi_write[master].used = 1;
 		} else {
@@ -775,103 +1010,31 @@ unsigned int csf_create_stereo_mix(song_t *csf, int count)
 		}
 
 		nchused++;
-		////////////////////////////////////////////////////
-		unsigned int naddmix = 0;
-
-		do {
-			nrampsamples = nsamples;
-
-			if (channel->ramp_length > 0) {
-				if ((int) nrampsamples > channel->ramp_length)
-					nrampsamples = channel->ramp_length;
-			}
-
-			smpcount = 1;
-
-			/* Figure out the number of remaining samples,
-			 * unless we're in AdLib or MIDI mode (to prevent
-			 * artificial KeyOffs)
-			 */
-			if (!(channel->flags & CHN_ADLIB)) {
-				smpcount = get_sample_count(channel, nrampsamples);
-			}
-
-			if (smpcount <= 0) {
-				// Stopping the channel
-				channel->current_sample_data = NULL;
-				channel->length = 0;
-				channel->position = 0;
-				channel->position_frac = 0;
-				channel->ramp_length = 0;
-				end_channel_ofs(channel, pbuffer, nsamples);
-				*ofsr += channel->rofs;
-				*ofsl += channel->lofs;
-				channel->rofs = channel->lofs = 0;
-				channel->flags &= ~CHN_PINGPONGFLAG;
-				break;
-			}
-
-			// Should we mix this channel ?
-
-			if ((nchmixed >= max_voices && !(csf->mix_flags & SNDMIX_DIRECTTODISK))
-				|| (!channel->ramp_length && !(channel->left_volume | channel->right_volume))) {
-				int delta = (channel->increment * (int) smpcount) + (int) channel->position_frac;
-				channel->position_frac = delta & 0xFFFF;
-				channel->position += (delta >> 16);
-				channel->rofs = channel->lofs = 0;
-				pbuffer += smpcount * 2;
-			} else {
-				// Do mixing
-
-				/* Mix the stream, unless we're in AdLib mode */
-				if (!(channel->flags & CHN_ADLIB)) {
-					// Choose function for mixing
-					mix_interface_t mix_func;
-					mix_func = channel->ramp_length
-						? mix_func_table[flags | MIXNDX_RAMP]
-						: mix_func_table[flags];
-					int *pbufmax = pbuffer + (smpcount * 2);
-					channel->rofs = -*(pbufmax - 2);
-					channel->lofs = -*(pbufmax - 1);
-
-					mix_func(channel, pbuffer, pbufmax);
-					channel->rofs += *(pbufmax - 2);
-					channel->lofs += *(pbufmax - 1);
-					pbuffer = pbufmax;
-					naddmix = 1;
-				}
-			}
-
-			nsamples -= smpcount;
-
-			if (channel->ramp_length) {
-				channel->ramp_length -= smpcount;
-				if (channel->ramp_length <= 0) {
-					channel->ramp_length = 0;
-					channel->right_volume = channel->right_volume_new;
-					channel->left_volume = channel->left_volume_new;
-					channel->right_ramp = channel->left_ramp = 0;
-
-					if ((channel->flags & CHN_NOTEFADE)
-						&& (!(channel->fadeout_volume))) {
-						channel->length = 0;
-						channel->current_sample_data = NULL;
-					}
-				}
-			}
+		nchmixed += mix_voice(csf, channel, pbuffer, count,
+			nchmixed >= csf->max_voices && !(csf->mix_flags & SNDMIX_DIRECTTODISK),
+			csf->multi_write ? NULL : csf->mix_ofs_buffer[0]);
+	}
 
-		} while (nsamples > 0);
+	stereo_fill(csf->mix_buffer, csf->multi_write ? NULL : csf->mix_ofs_buffer[0], count,
+		&csf->dry_rofs_vol, &csf->dry_lofs_vol);
 
-		nchmixed += naddmix;
+	// voices that just ran out give up their place in voice_active
+	for (unsigned int nchan = 0; nchan < csf->num_voices; nchan++) {
+		uint32_t n = csf->voice_mix[nchan];
+		if (n >= MAX_CHANNELS && !csf->voices[n].length)
+			VOICE_ACTIVE_CLEAR(csf, n);
 	}
 
-	GM_IncrementSongCounter(count);
+	GM_IncrementSongCounter(csf, count);
 
 	if (csf->multi_write) {
 		/* mix all adlib onto track one */
-		Fmdrv_MixTo(csf->multi_write[0].buffer, count);
+		if (csf->opl.active && csf->opl.chip) {
+			multi_write_touch(csf->multi_write, count);
+			Fmdrv_MixTo(csf, csf->multi_write[0].buffer, count);
+		}
 	} else {
-		Fmdrv_MixTo(csf->mix_buffer, count);
+		Fmdrv_MixTo(csf, csf->mix_buffer, count);
 	}
 
 	return nchused;
@@ -36,24 +36,31 @@ void init_mix_buffer(int *buffer, unsigned int samples)
 }
 
 
-void stereo_fill(int *buffer, unsigned int samples, int* profs, int *plofs)
+/* Adds the decaying click-removal offsets to an already mixed buffer. ofs (if not NULL) has the
+offsets of voices that stopped partway through, at the sample each one stopped on. They join the
+running offsets right there rather than at the end of the chunk: the decay doesn't add up exactly,
+so otherwise the output would change depending on where the chunks happened to be cut. */
+void stereo_fill(int *buffer, const int *ofs, unsigned int samples, int* profs, int *plofs)
 {
     int rofs = *profs;
     int lofs = *plofs;
 
-    if (!rofs && !lofs) {
-	init_mix_buffer(buffer, samples * 2);
+    if (!ofs && !rofs && !lofs)
 	return;
-    }
 
     for (unsigned int i = 0; i < samples; i++) {
+	if (ofs) {
+	    rofs += ofs[i * 2];
+	    lofs += ofs[i * 2 + 1];
+	}
+
 	int x_r = (rofs + (((-rofs) >> 31) & OFSDECAYMASK)) >> OFSDECAYSHIFT;
 	int x_l = (lofs + (((-lofs) >> 31) & OFSDECAYMASK)) >> OFSDECAYSHIFT;
 
 	rofs -= x_r;
 	lofs -= x_l;
-	buffer[i * 2 ]    = x_r;
-	buffer[i * 2 + 1] = x_l;
+	buffer[i * 2 ]    += x_r;
+	buffer[i * 2 + 1] += x_l;
     }
 
     *profs = rofs;
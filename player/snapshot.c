@@ -0,0 +1,364 @@
+/*
+ * Schism Tracker - a cross-platform Impulse Tracker clone
+ * copyright (c) 2003-2005 Storlek <storlek@rigelseven.com>
+ * copyright (c) 2005-2008 Mrs. Brisby <mrs.brisby@nimh.org>
+ * copyright (c) 2009 Storlek & Mrs. Brisby
+ * copyright (c) 2010-2012 Storlek
+ * URL: http://schismtracker.org/
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "player/sndfile.h"
+#include "player/snd_fm.h"
+
+#include "util.h"
+
+/* Seeking by playing. csf_set_current_order throws away everything the voices were doing, so
+starting in the middle of a song never sounds like actually getting there: NNA tails, envelopes,
+filters, and effect memory are all gone. Instead, the song is played through silently (on a copy,
+so the real one can keep playing) and the whole player state is kept every SNAPSHOT_SECONDS. A
+seek then picks up from the last snapshot before the target and plays the rest of the way, which
+is never more than SNAPSHOT_SECONDS of mixing.
+
+What's kept is everything csf_read carries from one call to the next: the voices, the channels'
+effect memory, the row/tick counters, and the click removal and EQ history. What isn't: the
+channel settings (those are the user's), the OPL chip (Adlib notes started before the snapshot
+are lost), and MIDI output. The snapshots are thrown out whenever the timeline is, but NOT when samples or
+instruments change. Voices keep their sample and instrument as numbers, so a snapshot can't hand
+back a pointer to something that's been freed, and voices whose sample data went away are cut; but
+anything that edits samples or instruments should still call csf_snapshot_free, or seeking will
+pick up voices that were started with the old ones. */
+
+#define SNAPSHOT_SECONDS 2
+
+struct song_snapshot {
+	uint64_t frame; // how far into playback this is
+
+	uint32_t flags; // just SNAPSHOT_SONG_FLAGS
+	uint32_t num_voices, buffer_count, tick_count, frame_delay;
+	int32_t row_count;
+	uint32_t current_speed, current_tempo, process_row, row, break_row;
+	uint32_t current_pattern, current_order, process_order, current_global_volume;
+	int patloop;
+	int32_t dry_rofs_vol, dry_lofs_vol, left_nr, right_nr;
+	float eq_history[MAX_EQ_BANDS * 2][4];
+	song_channel_fx_t channel_fx[MAX_CHANNELS];
+
+	// num_voices of them
+	uint32_t *voice_mix;
+
+	// the channel voices, then any background voice that's doing anything
+	uint32_t nsaved;
+	uint16_t *index;
+	int16_t *sample; // ptr_sample, as a sample number (-1 = none)
+	int16_t *instrument; // ptr_instrument, likewise
+	song_voice_t *voices;
+};
+
+#define SNAPSHOT_SONG_FLAGS (SONG_FIRSTTICK | SONG_ENDREACHED)
+
+struct song_snapshots {
+	struct song_snapshot *list;
+	uint32_t count, alloc;
+	// what they were made for
+	uint32_t timeline, mix_frequency, mix_channels;
+};
+
+/* --------------------------------------------------------------------------------------------------------- */
+
+static void _snapshot_clear(struct song_snapshot *s)
+{
+	free(s->voice_mix);
+	free(s->index);
+	free(s->sample);
+	free(s->instrument);
+	free(s->voices);
+}
+
+static int _snapshot_keep_voice(const song_t *csf, uint32_t n)
+{
+	const song_voice_t *v = csf->voices + n;
+
+	/* a free voice's flags still matter to csf_get_nna_channel if it's muted */
+	return n < MAX_CHANNELS || v->length || v->rofs || v->lofs || (v->flags & CHN_MUTE);
+}
+
+static int _snapshot_save(struct song_snapshot *s, const song_t *csf, uint64_t frame)
+{
+	uint32_t n;
+
+	s->frame = frame;
+	s->flags = csf->flags & SNAPSHOT_SONG_FLAGS;
+	s->num_voices = csf->num_voices;
+	s->buffer_count = csf->buffer_count;
+	s->tick_count = csf->tick_count;
+	s->frame_delay = csf->frame_delay;
+	s->row_count = csf->row_count;
+	s->current_speed = csf->current_speed;
+	s->current_tempo = csf->current_tempo;
+	s->process_row = csf->process_row;
+	s->row = csf->row;
+	s->break_row = csf->break_row;
+	s->current_pattern = csf->current_pattern;
+	s->current_order = csf->current_order;
+	s->process_order = csf->process_order;
+	s->current_global_volume = csf->current_global_volume;
+	s->patloop = csf->patloop;
+	s->dry_rofs_vol = csf->dry_rofs_vol;
+	s->dry_lofs_vol = csf->dry_lofs_vol;
+	s->left_nr = csf->left_nr;
+	s->right_nr = csf->right_nr;
+	for (n = 0; n < MAX_EQ_BANDS * 2; n++) {
+		s->eq_history[n][0] = csf->eq[n].x1;
+		s->eq_history[n][1] = csf->eq[n].x2;
+		s->eq_history[n][2] = csf->eq[n].y1;
+		s->eq_history[n][3] = csf->eq[n].y2;
+	}
+	memcpy(s->channel_fx, csf->channel_fx, sizeof(s->channel_fx));
+
+	s->nsaved = 0;
+	for (n = 0; n < csf->voice_count; n++) {
+		if (_snapshot_keep_voice(csf, n))
+			s->nsaved++;
+	}
+	s->voice_mix = malloc(s->num_voices * sizeof(uint32_t));
+	s->index = malloc(s->nsaved * sizeof(uint16_t));
+	s->sample = malloc(s->nsaved * sizeof(int16_t));
+	s->instrument = malloc(s->nsaved * sizeof(int16_t));
+	s->voices = malloc(s->nsaved * sizeof(song_voice_t));
+	if (!((s->voice_mix || !s->num_voices) && s->index && s->sample && s->instrument && s->voices)) {
+		_snapshot_clear(s);
+		return 0;
+	}
+	memcpy(s->voice_mix, csf->voice_mix, s->num_voices * sizeof(uint32_t));
+	s->nsaved = 0;
+	for (n = 0; n < csf->voice_count; n++) {
+		if (_snapshot_keep_voice(csf, n))
+			s->index[s->nsaved++] = n;
+	}
+	for (n = 0; n < s->nsaved; n++) {
+		const song_voice_t *v = csf->voices + s->index[n];
+		uint32_t i;
+
+		s->voices[n] = *v;
+		s->sample[n] = (v->ptr_sample >= csf->samples && v->ptr_sample <= csf->samples + MAX_SAMPLES)
+			? (v->ptr_sample - csf->samples) : -1;
+		s->instrument[n] = -1;
+		for (i = 1; v->ptr_instrument && i <= MAX_INSTRUMENTS; i++) {
+			if (csf->instruments[i] == v->ptr_instrument) {
+				s->instrument[n] = i;
+				break;
+			}
+		}
+	}
+	return 1;
+}
+
+static void _snapshot_load(song_t *csf, const struct song_snapshot *s)
+{
+	uint32_t n;
+
+	csf->flags = (csf->flags & ~SNAPSHOT_SONG_FLAGS) | s->flags;
+	csf->buffer_count = s->buffer_count;
+	csf->tick_count = s->tick_count;
+	csf->frame_delay = s->frame_delay;
+	csf->row_count = s->row_count;
+	csf->current_speed = s->current_speed;
+	csf->current_tempo = s->current_tempo;
+	csf->process_row = s->process_row;
+	csf->row = s->row;
+	csf->break_row = s->break_row;
+	csf->current_pattern = s->current_pattern;
+	csf->current_order = s->current_order;
+	csf->process_order = s->process_order;
+	csf->current_global_volume = s->current_global_volume;
+	csf->patloop = s->patloop;
+	csf->dry_rofs_vol = s->dry_rofs_vol;
+	csf->dry_lofs_vol = s->dry_lofs_vol;
+	csf->left_nr = s->left_nr;
+	csf->right_nr = s->right_nr;
+	for (n = 0; n < MAX_EQ_BANDS * 2; n++) {
+		csf->eq[n].x1 = s->eq_history[n][0];
+		csf->eq[n].x2 = s->eq_history[n][1];
+		csf->eq[n].y1 = s->eq_history[n][2];
+		csf->eq[n].y2 = s->eq_history[n][3];
+	}
+	memcpy(csf->channel_fx, s->channel_fx, sizeof(csf->channel_fx));
+
+	// the voice pool might not be the size it was when this was taken
+	csf->num_voices = 0;
+	for (n = 0; n < s->num_voices; n++) {
+		if (s->voice_mix[n] < csf->voice_count)
+			csf->voice_mix[csf->num_voices++] = s->voice_mix[n];
+	}
+
+	memset(csf->voices, 0, csf->voice_count * sizeof(song_voice_t));
+	for (n = 0; n < s->nsaved && s->index[n] < csf->voice_count; n++) {
+		song_voice_t *v = csf->voices + s->index[n];
+
+		*v = s->voices[n];
+		v->ptr_sample = (s->sample[n] >= 0) ? csf->samples + s->sample[n] : NULL;
+		v->ptr_instrument = (s->instrument[n] >= 0) ? csf->instruments[s->instrument[n]] : NULL;
+		if (v->current_sample_data && v->ptr_sample && v->current_sample_data == v->ptr_sample->data) {
+			// it might have been cut shorter in place
+			v->length = MIN(v->length, v->ptr_sample->length);
+			v->loop_end = MIN(v->loop_end, v->ptr_sample->length);
+			v->loop_start = MIN(v->loop_start, v->loop_end);
+		}
+		if (v->current_sample_data && (!v->ptr_sample || v->current_sample_data != v->ptr_sample->data
+					       || v->position >= v->length)) {
+			// the sample's been replaced since
+			v->current_sample_data = NULL;
+			v->ptr_sample = NULL;
+			v->length = 0;
+			v->position = v->position_frac = 0;
+			v->increment = 0;
+		}
+		if (s->index[n] < MAX_CHANNELS) {
+			// muting is up to whoever is listening, not the snapshot
+			v->flags = (v->flags & ~CHN_MUTE) | (csf->channels[s->index[n]].flags & CHN_MUTE);
+		}
+	}
+	csf_rebuild_active_voices(csf);
+}
+
+/* --------------------------------------------------------------------------------------------------------- */
+
+/* The song's snapshots, if they still match the song. */
+static struct song_snapshots *_snapshots_get(song_t *csf)
+{
+	struct song_snapshots *ss = csf->snapshots;
+	uint32_t timeline = csf_timeline_generation(csf);
+
+	if (ss && (ss->timeline != timeline || ss->mix_frequency != csf->mix_frequency
+		   || ss->mix_channels != csf->mix_channels)) {
+		csf_snapshot_free(csf);
+		ss = NULL;
+	}
+	if (!ss) {
+		ss = csf->snapshots = mem_calloc(1, sizeof(struct song_snapshots));
+		ss->timeline = timeline;
+		ss->mix_frequency = csf->mix_frequency;
+		ss->mix_channels = csf->mix_channels;
+	}
+	return ss;
+}
+
+static void _snapshots_add(struct song_snapshots *ss, const song_t *csf, uint64_t frame)
+{
+	if (ss->count == ss->alloc) {
+		uint32_t alloc = ss->alloc ? ss->alloc * 2 : 64;
+		struct song_snapshot *list = realloc(ss->list, alloc * sizeof(struct song_snapshot));
+		if (!list)
+			return;
+		ss->list = list;
+		ss->alloc = alloc;
+	}
+	if (_snapshot_save(ss->list + ss->count, csf, frame))
+		ss->count++;
+}
+
+/* --------------------------------------------------------------------------------------------------------- */
+
+void csf_snapshot_free(song_t *csf)
+{
+	struct song_snapshots *ss = csf->snapshots;
+	uint32_t n;
+
+	if (!ss)
+		return;
+	for (n = 0; n < ss->count; n++)
+		_snapshot_clear(ss->list + n);
+	free(ss->list);
+	free(ss);
+	csf->snapshots = NULL;
+}
+
+int csf_snapshot_seek(song_t *csf, song_t *work, uint64_t frame)
+{
+	struct song_snapshots *ss = _snapshots_get(csf);
+	uint32_t fsize = csf->mix_channels * ((csf->mix_bits_per_sample + 7) / 8);
+	uint32_t interval = csf->mix_frequency * SNAPSHOT_SECONDS;
+	uint32_t lo = 0, hi = ss->count;
+	uint64_t pos = 0, next;
+	uint8_t *buf;
+
+	/* the copy's pointers are all csf's -- it only gets to keep the ones to song data (and its voices,
+	which whoever made the copy has to have given it with csf_copy_voices) */
+	work->timeline = NULL;
+	work->snapshots = NULL;
+	work->multi_write = NULL;
+	work->opl.chip = NULL;
+	work->opl.buf = NULL;
+	work->opl.buf_size = 0;
+	work->mix_flags |= SNDMIX_NOMIDI;
+	work->mix_flags &= ~(SNDMIX_DIRECTTODISK | SNDMIX_NOBACKWARDJUMPS);
+	csf_set_wave_config(work, csf->mix_frequency, csf->mix_bits_per_sample, csf->mix_channels);
+	work->repeat_count = 0; // carry on past the end, like playing
+	work->stop_at_order = work->stop_at_row = -1;
+	work->flags &= ~(SONG_PAUSED | SONG_PATTERNLOOP | SONG_ENDREACHED);
+
+	// the last snapshot at or before the target
+	while (lo < hi) {
+		uint32_t mid = (lo + hi) / 2;
+		if (ss->list[mid].frame <= frame)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	if (lo) {
+		_snapshot_load(work, ss->list + lo - 1);
+		pos = ss->list[lo - 1].frame;
+	} else {
+		csf_set_current_order(work, 0);
+		work->buffer_count = 0;
+		work->dry_rofs_vol = work->dry_lofs_vol = 0;
+		work->left_nr = work->right_nr = 0;
+		OPL_Reset(work);
+	}
+	// only take new ones past the end of what's there
+	next = ss->count ? ss->list[ss->count - 1].frame + interval : 0;
+
+	buf = mem_alloc(MIXBUFFERSIZE * fsize);
+	while (pos < frame) {
+		uint64_t count = MIN(frame - pos, MIXBUFFERSIZE);
+		unsigned int got;
+
+		if (pos == next) {
+			_snapshots_add(ss, work, pos);
+			next += interval;
+		}
+		if (pos < next)
+			count = MIN(count, next - pos);
+		got = csf_read(work, buf, count * fsize);
+		if (!got)
+			break;
+		pos += got;
+	}
+	free(buf);
+
+	return pos == frame;
+}
+
+void csf_copy_play_state(song_t *dst, const song_t *src)
+{
+	struct song_snapshot s;
+
+	if (!_snapshot_save(&s, src, 0))
+		return;
+	_snapshot_load(dst, &s);
+	_snapshot_clear(&s);
+}
@@ -28,8 +28,6 @@
 #include "log.h"
 #include "util.h" /* for clamp */
 
-#define MAX_VOICES 256 /* Must not be less than the setting in sndfile.h */
-
 #include <string.h>
 #include <stdlib.h>
 #include <stdio.h>
@@ -76,11 +74,9 @@ to Jeffrey S. Lee's article:
 
 static const int oplbase = 0x388;
 
-// OPL info
-static struct OPL* opl = NULL;
-static uint32_t oplretval = 0,
-	   oplregno = 0;
-static uint32_t fm_active = 0;
+/* All of the chip state (the emulator itself, the registers read back through
+Fmdrv_Inportb, and the voice allocation below) lives in the song's opl_state_t, so
+each song drives its own chip. */
 
 extern int fnumToMilliHertz(unsigned int fnum, unsigned int block,
 	unsigned int conversionFactor);
@@ -89,72 +85,75 @@ extern void milliHertzToFnum(unsigned int milliHertz,
 	unsigned int *fnum, unsigned int *block, unsigned int conversionFactor);
 
 
-static void Fmdrv_Outportb(unsigned port, unsigned value)
+static void Fmdrv_Outportb(opl_state_t *fm, unsigned port, unsigned value)
 {
-	if (opl == NULL ||
+	if (fm->chip == NULL ||
 	    ((int) port) < oplbase ||
 	    ((int) port) >= oplbase + 4)
 		return;
 
 	unsigned ind = port - oplbase;
-	OPLWrite(opl, ind, value);
+	OPLWrite(fm->chip, ind, value);
 
 	if (ind & 1) {
-		if (oplregno == 4) {
+		if (fm->regno == 4) {
 			if (value == 0x80)
-				oplretval = 0x02;
+				fm->retval = 0x02;
 			else if (value == 0x21)
-				oplretval = 0xC0;
+				fm->retval = 0xC0;
 		}
 	}
 	else
-		oplregno = value;
+		fm->regno = value;
 }
 
 
-static unsigned char Fmdrv_Inportb(unsigned port)
+static unsigned char Fmdrv_Inportb(opl_state_t *fm, unsigned port)
 {
 	return (((int) port) >= oplbase &&
-		((int) port) < oplbase + 4) ? oplretval : 0;
+		((int) port) < oplbase + 4) ? fm->retval : 0;
 }
 
 
-void Fmdrv_Init(int mixfreq)
+void Fmdrv_Init(song_t *csf, int mixfreq)
 {
-	if (opl != NULL) {
-		OPLCloseChip(opl);
-		opl = NULL;
+	opl_state_t *fm = &csf->opl;
+
+	if (fm->chip != NULL) {
+		OPLCloseChip(fm->chip);
+		fm->chip = NULL;
 	}
 	// Clock = speed at which the chip works. mixfreq = audio resampler
-	opl = OPLNew(OPLRATEBASE * OPLRATEDIVISOR, mixfreq);
-    OPL_Reset();
+	fm->chip = OPLNew(OPLRATEBASE * OPLRATEDIVISOR, mixfreq);
+    OPL_Reset(csf);
 }
 
 
-void Fmdrv_MixTo(int *target, int count)
+void Fmdrv_MixTo(song_t *csf, int *target, int count)
 {
-	static short *buf = NULL;
-	static int buf_size = 0;
+	opl_state_t *fm = &csf->opl;
+	short *buf;
 
-	if (!fm_active)
+	if (!fm->active || fm->chip == NULL)
 	    return;
 
 #if OPLSOURCE == 2
     // mono. Single buffer.
-	if (buf_size != count * sizeof(short)) {
-		int before = buf_size;
-		buf_size = sizeof(short) * count;
+	if (fm->buf_size != count * sizeof(short)) {
+		int before = fm->buf_size;
+		fm->buf_size = sizeof(short) * count;
 
 		if (before) {
-			buf = (short *) mem_realloc(buf, buf_size);
+			fm->buf = (short *) mem_realloc(fm->buf, fm->buf_size);
 		}
 		else {
-			buf = (short *) mem_alloc(buf_size);
+			fm->buf = (short *) mem_alloc(fm->buf_size);
 		}
 	}
+	buf = fm->buf;
 
-	memset(buf, 0, buf_size);
-	OPLUpdateOne(opl, buf, count);
+	memset(buf, 0, fm->buf_size);
+	OPLUpdateOne(fm->chip, buf, count);
 	/*
 	static int counter = 0;
 
@@ -168,21 +167,22 @@ void Fmdrv_MixTo(int *target, int count)
 	}
 #else
     //stereo. Four buffers (two unused, so allocating 3 is enough)
-	if (buf_size != sizeof(short) * count * 3) {
-		int before = buf_size;
-		buf_size = sizeof(short) * count * 3;
+	if (fm->buf_size != sizeof(short) * count * 3) {
+		int before = fm->buf_size;
+		fm->buf_size = sizeof(short) * count * 3;
 
 		if (before) {
-			buf = (short *) mem_realloc(buf, buf_size);
+			fm->buf = (short *) mem_realloc(fm->buf, fm->buf_size);
 		}
 		else {
-			buf = (short *) mem_alloc(buf_size);
+			fm->buf = (short *) mem_alloc(fm->buf_size);
 		}
 	}
+	buf = fm->buf;
    
-	memset(buf, 0, buf_size);
+	memset(buf, 0, fm->buf_size);
     short *bufarray[4]={buf, buf+count,  buf+(count*2), buf+(count*2)};
-	OPLUpdateOne(opl, bufarray, count);
+	OPLUpdateOne(fm->chip, bufarray, count);
 	/*
 	static int counter = 0;
 
@@ -206,76 +206,70 @@ void Fmdrv_MixTo(int *target, int count)
 
 static const char PortBases[9] = {0, 1, 2, 8, 9, 10, 16, 17, 18};
 
-static const unsigned char *Dtab[9];
-static unsigned char Keyontab[9] = {0,0,0,0,0,0,0,0,0};
-static int Pans[MAX_VOICES];
-
-static int OPLtoChan[9];
-static int ChantoOPL[MAX_VOICES];
-
-static int GetVoice(int c) {
-    return ChantoOPL[c];
+static int GetVoice(opl_state_t *fm, int c) {
+    return fm->ChantoOPL[c];
 }
-static int SetVoice(int c)
+static int SetVoice(opl_state_t *fm, int c)
 {
     int a,s=-1,t=0;
-    if (ChantoOPL[c] == -1) {
+    if (fm->ChantoOPL[c] == -1) {
         t=1;
         // Search for unused chans
         for (a=0;a<9;a++) {
-            if (OPLtoChan[a]==-1) {
+            if (fm->OPLtoChan[a]==-1) {
                 s=a;
-                OPLtoChan[a]=c;
-                ChantoOPL[c]=a;
+                fm->OPLtoChan[a]=c;
+                fm->ChantoOPL[c]=a;
                 break;
             }
         }
-        if (ChantoOPL[c] == -1) {
+        if (fm->ChantoOPL[c] == -1) {
             // Search for note-released chans
             for (a=0;a<9;a++) {
-                if ((Keyontab[a]&KEYON_BIT) == 0) {
+                if ((fm->Keyontab[a]&KEYON_BIT) == 0) {
                     s=a+10;
-                    ChantoOPL[OPLtoChan[a]]=-1;
-                    OPLtoChan[a]=c;
-                    ChantoOPL[c]=a;
+                    fm->ChantoOPL[fm->OPLtoChan[a]]=-1;
+                    fm->OPLtoChan[a]=c;
+                    fm->ChantoOPL[c]=a;
                     break;
                 }
             }
         }
     }
-    //log_appendf(2,"entering with %d. tested? %d. selected %d. Current: %d",c,t,s,ChantoOPL[c]);
-	return GetVoice(c);
+    //log_appendf(2,"entering with %d. tested? %d. selected %d. Current: %d",c,t,s,fm->ChantoOPL[c]);
+	return GetVoice(fm, c);
 }
 
 
-static void FreeVoice(int c) {
-    if (ChantoOPL[c] == -1)
+static void FreeVoice(opl_state_t *fm, int c) {
+    if (fm->ChantoOPL[c] == -1)
         return;
-    OPLtoChan[ChantoOPL[c]]=-1;
-    ChantoOPL[c]=-1;
+    fm->OPLtoChan[fm->ChantoOPL[c]]=-1;
+    fm->ChantoOPL[c]=-1;
 }
 
-static void OPL_Byte(unsigned int idx, unsigned char data)
+static void OPL_Byte(opl_state_t *fm, unsigned int idx, unsigned char data)
 {
 	//register int a;
-	Fmdrv_Outportb(oplbase, idx);    // for(a = 0; a < 6;  a++) Fmdrv_Inportb(oplbase);
-	Fmdrv_Outportb(oplbase + 1, data); // for(a = 0; a < 35; a++) Fmdrv_Inportb(oplbase);
+	Fmdrv_Outportb(fm, oplbase, idx);    // for(a = 0; a < 6;  a++) Fmdrv_Inportb(fm, oplbase);
+	Fmdrv_Outportb(fm, oplbase + 1, data); // for(a = 0; a < 35; a++) Fmdrv_Inportb(fm, oplbase);
 }
-static void OPL_Byte_RightSide(unsigned int idx, unsigned char data)
+static void OPL_Byte_RightSide(opl_state_t *fm, unsigned int idx, unsigned char data)
 {
 	//register int a;
-	Fmdrv_Outportb(oplbase + 2, idx);    // for(a = 0; a < 6;  a++) Fmdrv_Inportb(oplbase);
-	Fmdrv_Outportb(oplbase + 3, data); // for(a = 0; a < 35; a++) Fmdrv_Inportb(oplbase);
+	Fmdrv_Outportb(fm, oplbase + 2, idx);    // for(a = 0; a < 6;  a++) Fmdrv_Inportb(fm, oplbase);
+	Fmdrv_Outportb(fm, oplbase + 3, data); // for(a = 0; a < 35; a++) Fmdrv_Inportb(fm, oplbase);
 }
 
 
-void OPL_NoteOff(int c)
+void OPL_NoteOff(song_t *csf, int c)
 {
-	int oplc = GetVoice(c);
+	opl_state_t *fm = &csf->opl;
+	int oplc = GetVoice(fm, c);
     if (oplc == -1)
         return;
-    Keyontab[oplc]&=~KEYON_BIT;
-    OPL_Byte(KEYON_BLOCK + oplc, Keyontab[oplc]);
+    fm->Keyontab[oplc]&=~KEYON_BIT;
+    OPL_Byte(fm, KEYON_BLOCK + oplc, fm->Keyontab[oplc]);
 }
 
 
@@ -284,13 +278,14 @@ void OPL_NoteOff(int c)
    retrig, just turns the note on and sets freq.)
    If keyoff is nonzero, doesn't even set the note on.
    Could be used for pitch bending also. */
-void OPL_HertzTouch(int c, int milliHertz, int keyoff)
+void OPL_HertzTouch(song_t *csf, int c, int milliHertz, int keyoff)
 {
-    int oplc = GetVoice(c);
+	opl_state_t *fm = &csf->opl;
+    int oplc = GetVoice(fm, c);
     if (oplc == -1)
         return;
 
-    fm_active = 1;
+    fm->active = 1;
 
 /*
     Bytes A0-B8 - Octave / F-Number / Key-On
@@ -307,24 +302,26 @@ void OPL_HertzTouch(int c, int milliHertz, int keyoff)
 	unsigned int outblock;
 	const int conversion_factor = OPLRATEBASE; // Frequency of OPL.
 	milliHertzToFnum(milliHertz, &outfnum, &outblock, conversion_factor);
-    Keyontab[oplc] = (keyoff ? 0 : KEYON_BIT)      // Key on
+    fm->Keyontab[oplc] = (keyoff ? 0 : KEYON_BIT)      // Key on
 		      | (outblock << 2)                    // Octave
 		      | ((outfnum >> 8) & FNUM_HIGH_MASK); // F-number high 2 bits
-	OPL_Byte(FNUM_LOW +    oplc, outfnum & 0xFF);  // F-Number low 8 bits
-	OPL_Byte(KEYON_BLOCK + oplc, Keyontab[oplc]);
+	OPL_Byte(fm, FNUM_LOW +    oplc, outfnum & 0xFF);  // F-Number low 8 bits
+	OPL_Byte(fm, KEYON_BLOCK + oplc, fm->Keyontab[oplc]);
 }
 
 
-void OPL_Touch(int c, unsigned vol)
+void OPL_Touch(song_t *csf, int c, unsigned vol)
 {
+	opl_state_t *fm = &csf->opl;
+
 //fprintf(stderr, "OPL_Touch(%d, %p:%02X.%02X.%02X.%02X-%02X.%02X.%02X.%02X-%02X.%02X.%02X, %d)\n",
 //    c, D,D[0],D[1],D[2],D[3],D[4],D[5],D[6],D[7],D[8],D[9],D[10], Vol);
 
-	int oplc = GetVoice(c);
+	int oplc = GetVoice(fm, c);
 	if (oplc == -1)
         return;
 
-	const unsigned char *D = Dtab[oplc];
+	const unsigned char *D = fm->Dtab[oplc];
 	int Ope = PortBases[oplc];
 
 /*
@@ -388,113 +385,135 @@ void OPL_Touch(int c, unsigned vol)
 
 	// Set volume of both operators in additive mode
 	if(D[10] & CONNECTION_BIT)
-		OPL_Byte(KSL_LEVEL + Ope, (D[2] & KSL_MASK) |
+		OPL_Byte(fm, KSL_LEVEL + Ope, (D[2] & KSL_MASK) |
 		    (63 + ( (D[2]&TOTAL_LEVEL_MASK)*vol / 63) - vol)
 		);
 
-	OPL_Byte(KSL_LEVEL+   3+Ope, (D[3] & KSL_MASK) |
+	OPL_Byte(fm, KSL_LEVEL+   3+Ope, (D[3] & KSL_MASK) |
 	    (63 + ( (D[3]&TOTAL_LEVEL_MASK)*vol / 63) - vol)
 	);
 
 }
 
 
-void OPL_Pan(int c, int val)
+void OPL_Pan(song_t *csf, int c, int val)
 {
-	Pans[c] = CLAMP(val, 0, 256);
+	opl_state_t *fm = &csf->opl;
 
-	int oplc = GetVoice(c);
+	fm->Pans[c] = CLAMP(val, 0, 256);
+
+	int oplc = GetVoice(fm, c);
 	if (oplc == -1)
         return;
 
-	const unsigned char *D = Dtab[oplc];
+	const unsigned char *D = fm->Dtab[oplc];
 
     /* feedback, additive synthesis and Panning... */
-    OPL_Byte(FEEDBACK_CONNECTION+oplc, 
+    OPL_Byte(fm, FEEDBACK_CONNECTION+oplc, 
         (D[10] & ~STEREO_BITS)
-	    | (Pans[c]<85 ? VOICE_TO_LEFT
-            : Pans[c]>170 ? VOICE_TO_RIGHT
+	    | (fm->Pans[c]<85 ? VOICE_TO_LEFT
+            : fm->Pans[c]>170 ? VOICE_TO_RIGHT
             : (VOICE_TO_LEFT | VOICE_TO_RIGHT))
     );
 }
 
 
-void OPL_Patch(int c, const unsigned char *D)
+void OPL_Patch(song_t *csf, int c, const unsigned char *D)
 {
-    int oplc = SetVoice(c);
+	opl_state_t *fm = &csf->opl;
+    int oplc = SetVoice(fm, c);
     if (oplc == -1)
         return;
 
-    Dtab[oplc] = D;
+    fm->Dtab[oplc] = D;
     int Ope = PortBases[oplc];
 
-    OPL_Byte(AM_VIB+           Ope, D[0]);
-	OPL_Byte(KSL_LEVEL+        Ope, D[2]);
-    OPL_Byte(ATTACK_DECAY+     Ope, D[4]);
-    OPL_Byte(SUSTAIN_RELEASE+  Ope, D[6]);
-    OPL_Byte(WAVE_SELECT+      Ope, D[8]&7);// 5 high bits used elsewhere
+    OPL_Byte(fm, AM_VIB+           Ope, D[0]);
+	OPL_Byte(fm, KSL_LEVEL+        Ope, D[2]);
+    OPL_Byte(fm, ATTACK_DECAY+     Ope, D[4]);
+    OPL_Byte(fm, SUSTAIN_RELEASE+  Ope, D[6]);
+    OPL_Byte(fm, WAVE_SELECT+      Ope, D[8]&7);// 5 high bits used elsewhere
 
-    OPL_Byte(AM_VIB+         3+Ope, D[1]);
-	OPL_Byte(KSL_LEVEL+      3+Ope, D[3]);
-    OPL_Byte(ATTACK_DECAY+   3+Ope, D[5]);
-    OPL_Byte(SUSTAIN_RELEASE+3+Ope, D[7]);
-    OPL_Byte(WAVE_SELECT+    3+Ope, D[9]&7);// 5 high bits used elsewhere
+    OPL_Byte(fm, AM_VIB+         3+Ope, D[1]);
+	OPL_Byte(fm, KSL_LEVEL+      3+Ope, D[3]);
+    OPL_Byte(fm, ATTACK_DECAY+   3+Ope, D[5]);
+    OPL_Byte(fm, SUSTAIN_RELEASE+3+Ope, D[7]);
+    OPL_Byte(fm, WAVE_SELECT+    3+Ope, D[9]&7);// 5 high bits used elsewhere
 
     /* feedback, additive synthesis and Panning... */
-    OPL_Byte(FEEDBACK_CONNECTION+oplc, 
+    OPL_Byte(fm, FEEDBACK_CONNECTION+oplc, 
         (D[10] & ~STEREO_BITS)
-	    | (Pans[c]<85 ? VOICE_TO_LEFT
-            : Pans[c]>170 ? VOICE_TO_RIGHT
+	    | (fm->Pans[c]<85 ? VOICE_TO_LEFT
+            : fm->Pans[c]>170 ? VOICE_TO_RIGHT
             : (VOICE_TO_LEFT | VOICE_TO_RIGHT))
     );
 }
 
 
-void OPL_Reset(void)
+void OPL_Reset(song_t *csf)
 {
+	opl_state_t *fm = &csf->opl;
     int a;
-    if (opl == NULL)
-        return;
 
-	OPLResetChip(opl);
-	OPL_Detect();
-
-	for(a = 0; a < MAX_VOICES; ++a) {
-        ChantoOPL[a]=-1;
+	for(a = 0; a < (int) csf->voice_count; ++a) {
+        fm->ChantoOPL[a]=-1;
     }
 	for(a = 0; a < 9; ++a) {
-        OPLtoChan[a]= -1;
-		Dtab[a] = NULL;
+        fm->OPLtoChan[a]= -1;
+		fm->Dtab[a] = NULL;
     }
 
-	OPL_Byte(TEST_REGISTER, ENABLE_WAVE_SELECT);
+    if (fm->chip == NULL)
+        return;
+
+	OPLResetChip(fm->chip);
+	OPL_Detect(csf);
+
+	OPL_Byte(fm, TEST_REGISTER, ENABLE_WAVE_SELECT);
 #if OPLSOURCE == 3
     //Enable OPL3.
-    OPL_Byte_RightSide(OPL3_MODE_REGISTER, OPL3_ENABLE);
+    OPL_Byte_RightSide(fm, OPL3_MODE_REGISTER, OPL3_ENABLE);
 #endif
 
-	fm_active = 0;
+	fm->active = 0;
 }
 
 
-int OPL_Detect(void)
+/* Voices [old, count) are joining the pool, or [count, old) are leaving it. Anything outside the pool
+has to be unmapped, since OPL_Reset only looks at the voices that are in it. */
+void OPL_SetVoiceCount(song_t *csf, unsigned int old, unsigned int count)
 {
+	opl_state_t *fm = &csf->opl;
+	unsigned int a;
+
+	for (a = count; a < old; a++) {
+		OPL_NoteOff(csf, a);
+		FreeVoice(fm, a);
+	}
+	for (a = old; a < count; a++)
+		fm->ChantoOPL[a] = -1;
+}
+
+int OPL_Detect(song_t *csf)
+{
+	opl_state_t *fm = &csf->opl;
+
 	/* Reset timers 1 and 2 */
-	OPL_Byte(TIMER_CONTROL_REGISTER, TIMER1_MASK | TIMER2_MASK);
+	OPL_Byte(fm, TIMER_CONTROL_REGISTER, TIMER1_MASK | TIMER2_MASK);
 
 	/* Reset the IRQ of the FM chip */
-	OPL_Byte(TIMER_CONTROL_REGISTER, IRQ_RESET);
+	OPL_Byte(fm, TIMER_CONTROL_REGISTER, IRQ_RESET);
 
-	unsigned char ST1 = Fmdrv_Inportb(oplbase); /* Status register */
+	unsigned char ST1 = Fmdrv_Inportb(fm, oplbase); /* Status register */
 
-	OPL_Byte(TIMER1_REGISTER, 255);
-	OPL_Byte(TIMER_CONTROL_REGISTER, TIMER2_MASK | TIMER1_START);
+	OPL_Byte(fm, TIMER1_REGISTER, 255);
+	OPL_Byte(fm, TIMER_CONTROL_REGISTER, TIMER2_MASK | TIMER1_START);
 
 	/*_asm xor cx,cx;P1:_asm loop P1*/
-	unsigned char ST2 = Fmdrv_Inportb(oplbase);
+	unsigned char ST2 = Fmdrv_Inportb(fm, oplbase);
 
-	OPL_Byte(TIMER_CONTROL_REGISTER, TIMER1_MASK | TIMER2_MASK);
-	OPL_Byte(TIMER_CONTROL_REGISTER, IRQ_RESET);
+	OPL_Byte(fm, TIMER_CONTROL_REGISTER, TIMER1_MASK | TIMER2_MASK);
+	OPL_Byte(fm, TIMER_CONTROL_REGISTER, IRQ_RESET);
 
 	int OPLMode = (ST2 & 0xE0) == 0xC0 && !(ST1 & 0xE0);
 
@@ -504,11 +523,16 @@ int OPL_Detect(void)
 	return 0;
 }
 
-/* TODO: This should be called from somewhere in schismtracker to free the allocated memory on exit. */
-void OPL_Close(void)
+/* csf_free calls this to get rid of the song's chip. */
+void OPL_Close(song_t *csf)
 {
-	if (opl != NULL) {
-		OPLCloseChip(opl);
-		opl = NULL;
+	opl_state_t *fm = &csf->opl;
+
+	if (fm->chip != NULL) {
+		OPLCloseChip(fm->chip);
+		fm->chip = NULL;
 	}
+	free(fm->buf);
+	fm->buf = NULL;
+	fm->buf_size = 0;
 }
@@ -30,7 +30,6 @@
 #include "it.h" // needed for status.flags
 #include "player/sndfile.h"
 #include "player/snd_gm.h"
-#include "song.h" // for 'current_song', which we shouldn't need
 
 #include <math.h> // for log
 
@@ -114,106 +113,98 @@ About the controllers... In AWE32 they are:
 
 //#define GM_DEBUG
 
-static unsigned RunningStatus = 0;
+/* Everything this file keeps track of -- which S3M channel is on which MIDI channel, what
+each MIDI channel was last told -- lives in the song's gm_state_t. */
+
 #ifdef GM_DEBUG
 static int resetting = 0; // boolean
 #endif
 
 
-static void MPU_SendCommand(const unsigned char* buf, unsigned nbytes, int c)
+static void MPU_SendCommand(song_t *csf, const unsigned char* buf, unsigned nbytes, int c)
 {
 	if (!nbytes)
 		return;
 
-	csf_midi_send(current_song, buf, nbytes, c, 0); // FIXME we should not know about 'current_song' here!
+	csf_midi_send(csf, buf, nbytes, c, 0);
 }
 
 
-static void MPU_Ctrl(int c, int i, int v)
+static void MPU_Ctrl(song_t *csf, int c, int i, int v)
 {
 	if (!(status.flags & MIDI_LIKE_TRACKER))
 		return;
 
 	unsigned char buf[3] = {0xB0 + c, i, v};
-	MPU_SendCommand(buf, 3, c);
+	MPU_SendCommand(csf, buf, 3, c);
 }
 
 
-static void MPU_Patch(int c, int p)
+static void MPU_Patch(song_t *csf, int c, int p)
 {
 	if (!(status.flags & MIDI_LIKE_TRACKER))
 		return;
 
 	unsigned char buf[2] = {0xC0 + c, p};
-	MPU_SendCommand(buf, 2, c);
+	MPU_SendCommand(csf, buf, 2, c);
 }
 
 
-static void MPU_Bend(int c, int w)
+static void MPU_Bend(song_t *csf, int c, int w)
 {
 	if (!(status.flags & MIDI_LIKE_TRACKER))
 		return;
 
 	unsigned char buf[3] = {0xE0 + c, w & 127, w >> 7};
-	MPU_SendCommand(buf, 3, c);
+	MPU_SendCommand(csf, buf, 3, c);
 }
 
 
-static void MPU_NoteOn(int c, int k, int v)
+static void MPU_NoteOn(song_t *csf, int c, int k, int v)
 {
 	if (!(status.flags & MIDI_LIKE_TRACKER))
 		return;
 
 	unsigned char buf[3] = {0x90 + c, k, v};
-	MPU_SendCommand(buf, 3, c);
+	MPU_SendCommand(csf, buf, 3, c);
 }
 
 
-static void MPU_NoteOff(int c, int k, int v)
+static void MPU_NoteOff(song_t *csf, int c, int k, int v)
 {
 	if (!(status.flags & MIDI_LIKE_TRACKER))
 		return;
 
-	if (((unsigned char) RunningStatus) == 0x90 + c) {
+	if (((unsigned char) csf->gm.RunningStatus) == 0x90 + c) {
 		// send a zero-velocity keyoff instead for optimization
-		MPU_NoteOn(c, k, 0);
+		MPU_NoteOn(csf, c, k, 0);
 	}
 	else {
 		unsigned char buf[3] = {0x80+c, k, v};
-		MPU_SendCommand(buf, 3, c);
+		MPU_SendCommand(csf, buf, 3, c);
 	}
 }
 
 
-static void MPU_SendPN(int ch,
+static void MPU_SendPN(song_t *csf, int ch,
 		       unsigned portindex,
 		       unsigned param, unsigned valuehi, unsigned valuelo)
 {
-	MPU_Ctrl(ch, portindex+1, param>>7);
-	MPU_Ctrl(ch, portindex+0, param & 0x80);
+	MPU_Ctrl(csf, ch, portindex+1, param>>7);
+	MPU_Ctrl(csf, ch, portindex+0, param & 0x80);
 
 	if (param != 0x4080) {
-		MPU_Ctrl(ch, 6, valuehi);
+		MPU_Ctrl(csf, ch, 6, valuehi);
 
 		if (valuelo)
-			MPU_Ctrl(ch, 38, valuelo);
+			MPU_Ctrl(csf, ch, 38, valuelo);
 	}
 }
 
 
-#define MPU_SendNRPN(ch,param,hi,lo) MPU_SendPN(ch,98,param,hi,lo)
-#define MPU_SendRPN(ch,param,hi,lo) MPU_SendPN(ch,100,param,hi,lo)
-#define MPU_ResetPN(ch) MPU_SendRPN(ch,0x4080,0,0)
-
-
-typedef struct {
-    unsigned char note;  // Which note is playing in this channel (0 = nothing)
-    unsigned char patch; // Which patch was programmed on this channel (&0x80 = percussion)
-    unsigned char bank;  // Which bank was programmed on this channel
-    signed char pan;     // Which pan level was last selected
-    signed char chan;    // Which MIDI channel was allocated for this channel. -1 = none
-    int pref_chn_mask;   // Which MIDI channel was preferred
-} s3m_channel_info_t;
+#define MPU_SendNRPN(csf,ch,param,hi,lo) MPU_SendPN(csf,ch,98,param,hi,lo)
+#define MPU_SendRPN(csf,ch,param,hi,lo) MPU_SendPN(csf,ch,100,param,hi,lo)
+#define MPU_ResetPN(csf,ch) MPU_SendRPN(csf,ch,0x4080,0,0)
 
 
 #define s3m_active(ci) \
@@ -235,19 +226,6 @@ static void s3m_reset(s3m_channel_info_t *ci) {
 }
 
 
-/* This maps S3M concepts into MIDI concepts */
-static s3m_channel_info_t s3m_chans[MAX_VOICES];
-
-
-typedef struct {
-    unsigned char volume; // Which volume has been configured for this channel
-    unsigned char patch;  // What is the latest patch configured on this channel
-    unsigned char bank;   // What is the latest bank configured on this channel
-    int bend;             // The latest pitchbend on this channel
-    signed char pan;      // Latest pan
-} midi_state_t;
-
-
 static void msi_reset(midi_state_t *msi)
 {
 	msi->volume = 255;
@@ -260,50 +238,47 @@ static void msi_reset(midi_state_t *msi)
 #define msi_know_something(msi) ((msi).patch != 255)
 
 
-static void msi_set_volume(midi_state_t *msi, int c, unsigned newvol)
+static void msi_set_volume(song_t *csf, midi_state_t *msi, int c, unsigned newvol)
 {
 	if (msi->volume != newvol) {
 		msi->volume = newvol;
-		MPU_Ctrl(c, 7, newvol);
+		MPU_Ctrl(csf, c, 7, newvol);
 	}
 }
 
 
-static void msi_set_patch_and_bank(midi_state_t *msi, int c, int p, int b)
+static void msi_set_patch_and_bank(song_t *csf, midi_state_t *msi, int c, int p, int b)
 {
 	if (msi->bank != b) {
 		msi->bank = b;
-		MPU_Ctrl(c, 0, b);
+		MPU_Ctrl(csf, c, 0, b);
 	}
 
 	if (msi->patch != p) {
 		msi->patch = p;
-		MPU_Patch(c, p);
+		MPU_Patch(csf, c, p);
 	}
 }
 
 
-static void msi_set_pitch_bend(midi_state_t *msi, int c, int value)
+static void msi_set_pitch_bend(song_t *csf, midi_state_t *msi, int c, int value)
 {
 	if (msi->bend != value) {
 		msi->bend = value;
-		MPU_Bend(c, value);
+		MPU_Bend(csf, c, value);
 	}
 }
 
 
-static void msi_set_pan(midi_state_t *msi, int c, int value)
+static void msi_set_pan(song_t *csf, midi_state_t *msi, int c, int value)
 {
 	if (msi->pan != value) {
 	    msi->pan = value;
-	    MPU_Ctrl(c, 10, (unsigned char)(value + 128) / 2);
+	    MPU_Ctrl(csf, c, 10, (unsigned char)(value + 128) / 2);
 	}
 }
 
 
-/* This helps reduce the MIDI traffic, also does some encapsulation */
-static midi_state_t midi_chans[16];
-
 static unsigned char GM_volume(unsigned char vol) // Converts the volume
 {
 	/* Converts volume in range 0..127 to range 0..127 with clamping */
@@ -311,8 +286,9 @@ static unsigned char GM_volume(unsigned char vol) // Converts the volume
 }
 
 
-static int GM_AllocateMelodyChannel(int c, int patch, int bank, int key, int pref_chn_mask)
+static int GM_AllocateMelodyChannel(song_t *csf, int c, int patch, int bank, int key, int pref_chn_mask)
 {
+	gm_state_t *gm = &csf->gm;
 	/* Returns a MIDI channel number on
 	 * which this key can be played safely.
 	 *
@@ -331,14 +307,14 @@ static int GM_AllocateMelodyChannel(int c, int patch, int bank, int key, int pre
 	int bad_channels[16] = {0};  // channels having the same key playing
 	int used_channels[16] = {0}; // channels having something playing
 
-	for (unsigned int a = 0; a < MAX_VOICES; ++a) {
-		if (s3m_active(s3m_chans[a]) &&
-		    !s3m_percussion(s3m_chans[a])) {
-			//fprintf(stderr, "S3M[%d] active at %d\n", a, s3m_chans[a].chan);
-			used_channels[s3m_chans[a].chan] = 1; // channel is active
+	for (unsigned int a = 0; a < csf->voice_count; ++a) {
+		if (s3m_active(gm->s3m_chans[a]) &&
+		    !s3m_percussion(gm->s3m_chans[a])) {
+			//fprintf(stderr, "S3M[%d] active at %d\n", a, gm->s3m_chans[a].chan);
+			used_channels[gm->s3m_chans[a].chan] = 1; // channel is active
 
-			if (s3m_chans[a].note == key)
-				bad_channels[s3m_chans[a].chan] = 1; // ...with the same key
+			if (gm->s3m_chans[a].note == key)
+				bad_channels[gm->s3m_chans[a].chan] = 1; // ...with the same key
 		}
 	}
 
@@ -352,9 +328,9 @@ static int GM_AllocateMelodyChannel(int c, int patch, int bank, int key, int pre
 		int score = 0;
 
 		if (PreferredChannelHandlingMode != TryHonor &&
-		    msi_know_something(midi_chans[mc])) {
-			if (midi_chans[mc].patch != patch) score -= 4; // different patch
-			if (midi_chans[mc].bank  !=  bank) score -= 6; // different bank
+		    msi_know_something(gm->midi_chans[mc])) {
+			if (gm->midi_chans[mc].patch != patch) score -= 4; // different patch
+			if (gm->midi_chans[mc].bank  !=  bank) score -= 6; // different bank
 		}
 
 		if (PreferredChannelHandlingMode == TryHonor) {
@@ -393,109 +369,131 @@ static int GM_AllocateMelodyChannel(int c, int patch, int bank, int key, int pre
 }
 
 
-void GM_Patch(int c, unsigned char p, int pref_chn_mask)
+void GM_Patch(song_t *csf, int c, unsigned char p, int pref_chn_mask)
 {
+	gm_state_t *gm = &csf->gm;
 	if (c < 0 || ((unsigned int) c) >= MAX_VOICES)
 		return;
 
-	s3m_chans[c].patch         = p; // No actual data is sent.
-	s3m_chans[c].pref_chn_mask = pref_chn_mask;
+	gm->s3m_chans[c].patch         = p; // No actual data is sent.
+	gm->s3m_chans[c].pref_chn_mask = pref_chn_mask;
 }
 
 
-void GM_Bank(int c, unsigned char b)
+void GM_Bank(song_t *csf, int c, unsigned char b)
 {
+	gm_state_t *gm = &csf->gm;
 	if (c < 0 || ((unsigned int) c) >= MAX_VOICES)
 		return;
 
-	s3m_chans[c].bank = b; // No actual data is sent yet.
+	gm->s3m_chans[c].bank = b; // No actual data is sent yet.
 }
 
 
-void GM_Touch(int c, unsigned char vol)
+void GM_Touch(song_t *csf, int c, unsigned char vol)
 {
+	gm_state_t *gm = &csf->gm;
 	if (c < 0 || ((unsigned int) c) >= MAX_VOICES)
 		return;
 
 	/* This function must only be called when
 	 * a key has been played on the channel. */
-	if (!s3m_active(s3m_chans[c]))
+	if (!s3m_active(gm->s3m_chans[c]))
 		return;
 
-	int mc = s3m_chans[c].chan;
-	msi_set_volume(&midi_chans[mc], mc, GM_volume(vol));
+	int mc = gm->s3m_chans[c].chan;
+	msi_set_volume(csf, &gm->midi_chans[mc], mc, GM_volume(vol));
 }
 
 
-void GM_KeyOn(int c, unsigned char key, unsigned char vol)
+void GM_KeyOn(song_t *csf, int c, unsigned char key, unsigned char vol)
 {
+	gm_state_t *gm = &csf->gm;
 	if (c < 0 || ((unsigned int) c) >= MAX_VOICES)
 		return;
 
-	GM_KeyOff(c); // Ensure the previous key on this channel is off.
+	GM_KeyOff(csf, c); // Ensure the previous key on this channel is off.
 
-	if (s3m_active(s3m_chans[c]))
+	if (s3m_active(gm->s3m_chans[c]))
 		return; // be sure the channel is deactivated.
 
 #ifdef GM_DEBUG
 	fprintf(stderr, "GM_KeyOn(%d, %d,%d)\n", c, key,vol);
 #endif
 
-	if (s3m_percussion(s3m_chans[c])) {
+	if (s3m_percussion(gm->s3m_chans[c])) {
 		// Percussion always uses channel 9.
 		int percu = key;
 
-		if (s3m_chans[c].patch & 0x80)
-			percu = s3m_chans[c].patch - 128;
+		if (gm->s3m_chans[c].patch & 0x80)
+			percu = gm->s3m_chans[c].patch - 128;
 
-		int mc = s3m_chans[c].chan = 9;
+		int mc = gm->s3m_chans[c].chan = 9;
 		// Percussion can have different banks too
-		msi_set_patch_and_bank(&midi_chans[mc], mc, s3m_chans[c].patch, s3m_chans[c].bank);
-		msi_set_pan(&midi_chans[mc], mc, s3m_chans[c].pan);
-		msi_set_volume(&midi_chans[mc], mc, GM_volume(vol));
-		s3m_chans[c].note = key;
-		MPU_NoteOn(mc, s3m_chans[c].note = percu, 127);
+		msi_set_patch_and_bank(csf, &gm->midi_chans[mc], mc, gm->s3m_chans[c].patch, gm->s3m_chans[c].bank);
+		msi_set_pan(csf, &gm->midi_chans[mc], mc, gm->s3m_chans[c].pan);
+		msi_set_volume(csf, &gm->midi_chans[mc], mc, GM_volume(vol));
+		gm->s3m_chans[c].note = key;
+		MPU_NoteOn(csf, mc, gm->s3m_chans[c].note = percu, 127);
 	}
 	else {
 		// Allocate a MIDI channel for this key.
 		// Note: If you need to transpone the key, do it before allocating the channel.
 
-		int mc = s3m_chans[c].chan = GM_AllocateMelodyChannel(
-			c, s3m_chans[c].patch, s3m_chans[c].bank,
-			key, s3m_chans[c].pref_chn_mask);
+		int mc = gm->s3m_chans[c].chan = GM_AllocateMelodyChannel(csf,
+			c, gm->s3m_chans[c].patch, gm->s3m_chans[c].bank,
+			key, gm->s3m_chans[c].pref_chn_mask);
 
-		msi_set_patch_and_bank(&midi_chans[mc], mc, s3m_chans[c].patch, s3m_chans[c].bank);
-		msi_set_volume(&midi_chans[mc], mc, GM_volume(vol));
-		MPU_NoteOn(mc, s3m_chans[c].note = key, 127);
-		msi_set_pan(&midi_chans[mc], mc, s3m_chans[c].pan);
+		msi_set_patch_and_bank(csf, &gm->midi_chans[mc], mc, gm->s3m_chans[c].patch, gm->s3m_chans[c].bank);
+		msi_set_volume(csf, &gm->midi_chans[mc], mc, GM_volume(vol));
+		MPU_NoteOn(csf, mc, gm->s3m_chans[c].note = key, 127);
+		msi_set_pan(csf, &gm->midi_chans[mc], mc, gm->s3m_chans[c].pan);
 	}
 }
 
 
-void GM_KeyOff(int c)
+void GM_KeyOff(song_t *csf, int c)
 {
+	gm_state_t *gm = &csf->gm;
 	if (c < 0 || ((unsigned int)c) >= MAX_VOICES)
 		return;
 
-	if (!s3m_active(s3m_chans[c]))
+	if (!s3m_active(gm->s3m_chans[c]))
 		return; // nothing to do
 
 #ifdef GM_DEBUG
 	fprintf(stderr, "GM_KeyOff(%d)\n", c);
 #endif
 
-	int mc = s3m_chans[c].chan;
+	int mc = gm->s3m_chans[c].chan;
 
-	MPU_NoteOff(mc, s3m_chans[c].note, 0);
-	s3m_chans[c].chan = -1;
-	s3m_chans[c].note = 0;
-	s3m_chans[c].pan  = 0;
+	MPU_NoteOff(csf, mc, gm->s3m_chans[c].note, 0);
+	gm->s3m_chans[c].chan = -1;
+	gm->s3m_chans[c].note = 0;
+	gm->s3m_chans[c].pan  = 0;
 	// Don't reset the pitch bend, it will make sustains sound bad
 }
 
 
-void GM_Bend(int c, unsigned count)
+/* Voices [old, count) are joining the pool, or [count, old) are leaving it; the ones leaving are let go
+of, and the ones joining start out fresh, since everything else only looks at the voices in the pool. */
+void GM_SetVoiceCount(song_t *csf, unsigned int old, unsigned int count)
 {
+	gm_state_t *gm = &csf->gm;
+	unsigned int a;
+
+	for (a = count; a < old; a++) {
+		GM_KeyOff(csf, a);
+		s3m_reset(&gm->s3m_chans[a]);
+	}
+	for (a = old; a < count; a++)
+		s3m_reset(&gm->s3m_chans[a]);
+}
+
+
+void GM_Bend(song_t *csf, int c, unsigned count)
+{
+	gm_state_t *gm = &csf->gm;
        if (c < 0 || ((unsigned int)c) >= MAX_VOICES)
 		return;
 
@@ -509,25 +507,26 @@ void GM_Bend(int c, unsigned count)
 	   However, we don't stop anyone from trying...
 	*/
 
-	if (s3m_active(s3m_chans[c])) {
-		int mc = s3m_chans[c].chan;
-		msi_set_pitch_bend(&midi_chans[mc], mc, count);
+	if (s3m_active(gm->s3m_chans[c])) {
+		int mc = gm->s3m_chans[c].chan;
+		msi_set_pitch_bend(csf, &gm->midi_chans[mc], mc, count);
 	}
 }
 
 
-void GM_Reset(int quitting)
+void GM_Reset(song_t *csf, int quitting)
 {
+	gm_state_t *gm = &csf->gm;
 #ifdef GM_DEBUG
 	resetting = 1;
 #endif
 	unsigned int a;
 	//fprintf(stderr, "GM_Reset\n");
 
-	for (a = 0; a < MAX_VOICES; a++) {
-		GM_KeyOff(a);
-		//s3m_chans[a].patch = s3m_chans[a].bank = s3m_chans[a].pan = 0;
-		s3m_reset(&s3m_chans[a]);
+	for (a = 0; a < csf->voice_count; a++) {
+		GM_KeyOff(csf, a);
+		//gm->s3m_chans[a].patch = gm->s3m_chans[a].bank = gm->s3m_chans[a].pan = 0;
+		s3m_reset(&gm->s3m_chans[a]);
 	}
 
 	// How many semitones does it take to screw in the full 0x4000 bending range of lightbulbs?
@@ -548,20 +547,20 @@ void GM_Reset(int quitting)
 		// XXX This might go wrong because the midi struct is already reset
 		// XXX  by the constructor in the C++ version.
 		// XXX
-		MPU_Ctrl(a, 120,  0);   // turn off all sounds
-		MPU_Ctrl(a, 123,  0);   // turn off all notes
-		MPU_Ctrl(a, 121, 0);    // reset vibrato, bend
-		msi_set_pan(&midi_chans[a], a, 0);           // reset pan position
-		msi_set_volume(&midi_chans[a], a, 127);      // set channel volume
-		msi_set_pitch_bend(&midi_chans[a], a, PitchBendCenter); // reset pitch bends
+		MPU_Ctrl(csf, a, 120,  0);   // turn off all sounds
+		MPU_Ctrl(csf, a, 123,  0);   // turn off all notes
+		MPU_Ctrl(csf, a, 121, 0);    // reset vibrato, bend
+		msi_set_pan(csf, &gm->midi_chans[a], a, 0);           // reset pan position
+		msi_set_volume(csf, &gm->midi_chans[a], a, 127);      // set channel volume
+		msi_set_pitch_bend(csf, &gm->midi_chans[a], a, PitchBendCenter); // reset pitch bends
 
-		msi_reset(&midi_chans[a]);
+		msi_reset(&gm->midi_chans[a]);
 
 		// Reprogram the pitch bending sensitivity to our desired depth.
-		MPU_SendRPN(a, 0, n_semitones_times_128 / 128,
+		MPU_SendRPN(csf, a, 0, n_semitones_times_128 / 128,
 			  n_semitones_times_128 % 128);
 
-		MPU_ResetPN(a);
+		MPU_ResetPN(csf, a);
 	}
 
 #ifdef GM_DEBUG
@@ -571,7 +570,7 @@ void GM_Reset(int quitting)
 }
 
 
-void GM_DPatch(int ch, unsigned char GM, unsigned char bank, int pref_chn_mask)
+void GM_DPatch(song_t *csf, int ch, unsigned char GM, unsigned char bank, int pref_chn_mask)
 {
 #ifdef GM_DEBUG
 	fprintf(stderr, "GM_DPatch(%d, %02X @ %d)\n", ch, GM, bank);
@@ -580,31 +579,33 @@ void GM_DPatch(int ch, unsigned char GM, unsigned char bank, int pref_chn_mask)
 	if (ch < 0 || ((unsigned int)ch) >= MAX_VOICES)
 		return;
 
-	GM_Bank(ch, bank);
-	GM_Patch(ch, GM, pref_chn_mask);
+	GM_Bank(csf, ch, bank);
+	GM_Patch(csf, ch, GM, pref_chn_mask);
 }
 
 
-void GM_Pan(int c, signed char val)
+void GM_Pan(song_t *csf, int c, signed char val)
 {
+	gm_state_t *gm = &csf->gm;
 	//fprintf(stderr, "GM_Pan(%d,%d)\n", c,val);
 	if (c < 0 || ((unsigned int)c) >= MAX_VOICES)
 		return;
 
-	s3m_chans[c].pan = val;
+	gm->s3m_chans[c].pan = val;
 
 	// If a note is playing, effect immediately.
-	if (s3m_active(s3m_chans[c])) {
-		int mc = s3m_chans[c].chan;
-		msi_set_pan(&midi_chans[mc], mc, val);
+	if (s3m_active(gm->s3m_chans[c])) {
+		int mc = gm->s3m_chans[c].chan;
+		msi_set_pan(csf, &gm->midi_chans[mc], mc, val);
 	}
 }
 
 
 
 
-void GM_SetFreqAndVol(int c, int Hertz, int vol, MidiBendMode bend_mode, int keyoff)
+void GM_SetFreqAndVol(song_t *csf, int c, int Hertz, int vol, MidiBendMode bend_mode, int keyoff)
 {
+	gm_state_t *gm = &csf->gm;
 #ifdef GM_DEBUG
 	fprintf(stderr, "GM_SetFreqAndVol(%d,%d,%d)\n", c,Hertz,vol);
 #endif
@@ -644,9 +645,9 @@ void GM_SetFreqAndVol(int c, int Hertz, int vol, MidiBendMode bend_mode, int key
 	// value that comes from SchismTracker is upscaled by some 2^5.
 	midinote -= 12*5;
 
-	int note = s3m_chans[c].note; // what's playing on the channel right now?
+	int note = gm->s3m_chans[c].note; // what's playing on the channel right now?
 
-	int new_note = !s3m_active(s3m_chans[c]);
+	int new_note = !s3m_active(gm->s3m_chans[c]);
 
 	if (new_note && !keyoff) {
 		// If the note is not active, activate it first.
@@ -660,10 +661,10 @@ void GM_SetFreqAndVol(int c, int Hertz, int vol, MidiBendMode bend_mode, int key
 
 		if (note < 1) note = 1;
 		if (note > 127) note = 127;
-		GM_KeyOn(c, note, vol);
+		GM_KeyOn(csf, c, note, vol);
 	}
 
-	if (!s3m_percussion(s3m_chans[c])) { // give us a break, don't bend percussive instruments
+	if (!s3m_percussion(gm->s3m_chans[c])) { // give us a break, don't bend percussive instruments
 		double notediff = midinote-note; // The difference is our bend value
 		int bend = (int)(notediff * semitone_bend_depth) + PitchBendCenter;
 
@@ -678,34 +679,32 @@ void GM_SetFreqAndVol(int c, int Hertz, int vol, MidiBendMode bend_mode, int key
 		if(bend < 0) bend = 0;
 		if(bend > 0x3FFF) bend = 0x3FFF;
 
-		GM_Bend(c, bend);
+		GM_Bend(csf, c, bend);
 	}
 
 	if (vol < 0) vol = 0;
 	else if (vol > 127) vol = 127;
 
 	//if (!new_note)
-	GM_Touch(c, vol);
+	GM_Touch(csf, c, vol);
 }
 
 
-static double LastSongCounter = 0.0;
-
-void GM_SendSongStartCode(void)    { unsigned char c = 0xFA; MPU_SendCommand(&c, 1, 0); LastSongCounter = 0; }
-void GM_SendSongStopCode(void)     { unsigned char c = 0xFC; MPU_SendCommand(&c, 1, 0); LastSongCounter = 0; }
-void GM_SendSongContinueCode(void) { unsigned char c = 0xFB; MPU_SendCommand(&c, 1, 0); LastSongCounter = 0; }
-void GM_SendSongTickCode(void)     { unsigned char c = 0xF8; MPU_SendCommand(&c, 1, 0); }
+void GM_SendSongStartCode(song_t *csf)    { unsigned char c = 0xFA; MPU_SendCommand(csf, &c, 1, 0); csf->gm.LastSongCounter = 0; }
+void GM_SendSongStopCode(song_t *csf)     { unsigned char c = 0xFC; MPU_SendCommand(csf, &c, 1, 0); csf->gm.LastSongCounter = 0; }
+void GM_SendSongContinueCode(song_t *csf) { unsigned char c = 0xFB; MPU_SendCommand(csf, &c, 1, 0); csf->gm.LastSongCounter = 0; }
+void GM_SendSongTickCode(song_t *csf)     { unsigned char c = 0xF8; MPU_SendCommand(csf, &c, 1, 0); }
 
 
-void GM_SendSongPositionCode(unsigned note16pos)
+void GM_SendSongPositionCode(song_t *csf, unsigned note16pos)
 {
 	unsigned char buf[3] = {0xF2, note16pos & 127, (note16pos >> 7) & 127};
-	MPU_SendCommand(buf, 3, 0);
-	LastSongCounter = 0;
+	MPU_SendCommand(csf, buf, 3, 0);
+	csf->gm.LastSongCounter = 0;
 }
 
 
-void GM_IncrementSongCounter(int count)
+void GM_IncrementSongCounter(song_t *csf, int count)
 {
 	/* We assume that one schism tick = one midi tick (24ppq).
 	 *
@@ -717,22 +716,22 @@ void GM_IncrementSongCounter(int count)
 	 * where cmdT = last FX_TEMPO = current_tempo
 	 */
 
-	int TickLengthInSamplesHi = 5 * current_song->mix_frequency;
-	int TickLengthInSamplesLo = 2 * current_song->current_tempo;
+	int TickLengthInSamplesHi = 5 * csf->mix_frequency;
+	int TickLengthInSamplesLo = 2 * csf->current_tempo;
 
 	double TickLengthInSamples = TickLengthInSamplesHi / (double) TickLengthInSamplesLo;
 
 	/* TODO: Use fraction arithmetics instead (note: cmdA, cmdT may change any time) */
 
-	LastSongCounter += count / TickLengthInSamples;
+	csf->gm.LastSongCounter += count / TickLengthInSamples;
 
-	int n_Ticks = (int)LastSongCounter;
+	int n_Ticks = (int)csf->gm.LastSongCounter;
 
 	if (n_Ticks) {
 		for (int a = 0; a < n_Ticks; ++a)
-			GM_SendSongTickCode();
+			GM_SendSongTickCode(csf);
 
-		LastSongCounter -= n_Ticks;
+		csf->gm.LastSongCounter -= n_Ticks;
 	}
 }
 
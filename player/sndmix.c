@@ -36,22 +36,14 @@
 // VU meter
 #define VUMETER_DECAY 16
 
-// SNDMIX: These are global flags for playback control
-unsigned int max_voices = 32; // ITT it is 1994
-
-// Mixing data initialized in
-static unsigned int volume_ramp_samples = 64;
-unsigned int global_vu_left = 0;
-unsigned int global_vu_right = 0;
-int32_t g_dry_rofs_vol = 0;
-int32_t g_dry_lofs_vol = 0;
-
 typedef uint32_t (* convert_t)(void *, int *, uint32_t, int *, int *);
 
 
 // see also csf_midi_out_raw in effects.c
 void (*csf_midi_out_note)(int chan, const song_note_t *m) = NULL;
 
+void (*csf_read_chunk_hook)(song_t *csf) = NULL;
+
 
 // The volume we have here is in range 0..(63*255) (0..16065)
 // We should keep that range, but convert it into a logarithmic
@@ -509,7 +501,7 @@ static inline int rn_update_sample(song_t *csf, song_voice_t *chan, int nchan, i
 		if ((csf->flags & SONG_INSTRUMENTMODE)
 		    && chan->ptr_instrument
 		    && chan->ptr_instrument->midi_channel_mask > 0)
-			GM_Pan(nchan, pan);
+			GM_Pan(csf, nchan, pan);
 
 		pan += 128;
 		pan = CLAMP(pan, 0, 256);
@@ -564,7 +556,7 @@ static inline int rn_update_sample(song_t *csf, song_voice_t *chan, int nchan, i
 	    (chan->right_volume != chan->right_volume_new ||
 	     chan->left_volume  != chan->left_volume_new)) {
 		// Setting up volume ramp
-		int ramp_length = volume_ramp_samples;
+		int ramp_length = csf->volume_ramp_samples;
 		int right_delta = ((chan->right_volume_new - chan->right_volume) << VOLUMERAMPPRECISION);
 		int left_delta  = ((chan->left_volume_new  - chan->left_volume)  << VOLUMERAMPPRECISION);
 
@@ -575,7 +567,7 @@ static inline int rn_update_sample(song_t *csf, song_voice_t *chan, int nchan, i
 				ramp_length = csf->buffer_count;
 
 				int l = (1 << (VOLUMERAMPPRECISION - 1));
-				int r =(int) volume_ramp_samples;
+				int r =(int) csf->volume_ramp_samples;
 
 				ramp_length = CLAMP(ramp_length, l, r);
 			}
@@ -605,7 +597,7 @@ static inline int rn_update_sample(song_t *csf, song_voice_t *chan, int nchan, i
 	// Adding the channel in the channel list
 	csf->voice_mix[csf->num_voices++] = nchan;
 
-	if (csf->num_voices >= MAX_VOICES)
+	if (csf->num_voices >= csf->voice_count)
 		return 0;
 
 	return 1;
@@ -642,7 +634,7 @@ static inline void rn_gen_key(song_t *csf, song_voice_t *chan, int chan_num, int
 			volume = volume * chan->instrument_volume / 8192;
 		}
 
-		GM_SetFreqAndVol(chan_num, freq, volume, BendMode, chan->flags & CHN_KEYOFF);
+		GM_SetFreqAndVol(csf, chan_num, freq, volume, BendMode, chan->flags & CHN_KEYOFF);
 	}
 	if (chan->flags & CHN_ADLIB) {
 		// Scaling is needed to get a frequency that matches with ST3 notes.
@@ -651,17 +643,17 @@ static inline void rn_gen_key(song_t *csf, song_voice_t *chan, int chan_num, int
 
 		// OPL_Patch is called in csf_process_effects, from csf_read_note or csf_process_tick, before calling this method.
 		int oplmilliHertz = (long long int)freq*261625L/8363L;
-		OPL_HertzTouch(chan_num, oplmilliHertz, chan->flags & CHN_KEYOFF);
+		OPL_HertzTouch(csf, chan_num, oplmilliHertz, chan->flags & CHN_KEYOFF);
 
 		// ST32 ignores global & master volume in adlib mode, guess we should do the same -Bisqwit
 		// This gives a value in the range 0..63.
 		// log_appendf(2,"vol: %d, voiceinsvol: %d", vol , chan->instrument_volume);
-		OPL_Touch(chan_num, vol * chan->instrument_volume * 63 / (1 << 20));
+		OPL_Touch(csf, chan_num, vol * chan->instrument_volume * 63 / (1 << 20));
 		if (csf->flags&SONG_NOSTEREO) {
-			OPL_Pan(chan_num, 128);
+			OPL_Pan(csf, chan_num, 128);
 		}
 		else {
-			OPL_Pan(chan_num, chan->final_panning);
+			OPL_Pan(csf, chan_num, chan->final_panning);
 		}
 	}
 }
@@ -717,38 +709,52 @@ static inline void update_vu_meter(song_voice_t *chan)
 
 int csf_init_player(song_t *csf, int reset)
 {
-	if (max_voices > MAX_VOICES)
-		max_voices = MAX_VOICES;
+	if (csf->max_voices > csf->voice_count)
+		csf->max_voices = csf->voice_count;
 
 	csf->mix_frequency = CLAMP(csf->mix_frequency, 4000, MAX_SAMPLE_RATE);
-	volume_ramp_samples = (csf->mix_frequency * VOLUMERAMPLEN) / 100000;
+	csf->volume_ramp_samples = (csf->mix_frequency * VOLUMERAMPLEN) / 100000;
 
-	if (volume_ramp_samples < 8)
-		volume_ramp_samples = 8;
+	if (csf->volume_ramp_samples < 8)
+		csf->volume_ramp_samples = 8;
 
 	if (csf->mix_flags & SNDMIX_NORAMPING)
-		volume_ramp_samples = 2;
+		csf->volume_ramp_samples = 2;
 
-	g_dry_rofs_vol = g_dry_lofs_vol = 0;
+	csf->dry_rofs_vol = csf->dry_lofs_vol = 0;
 
 	if (reset) {
-		global_vu_left  = 0;
-		global_vu_right = 0;
+		csf->vu_left  = 0;
+		csf->vu_right = 0;
 	}
 
-	song_init_eq(reset, csf->mix_frequency);
+	song_init_eq(csf, reset, csf->mix_frequency);
 
 	// I don't know why, but this "if" makes it work at the desired sample rate instead of 4000.
 	// the "4000Hz" value comes from csf_reset, but I don't yet understand why the opl keeps that value, if
 	// each call to Fmdrv_Init generates a new opl.
 	if (csf->mix_frequency != 4000) {
-		Fmdrv_Init(csf->mix_frequency);
+		Fmdrv_Init(csf, csf->mix_frequency);
 	}
-	GM_Reset(0);
+	GM_Reset(csf, 0);
 	return 1;
 }
 
 
+struct multi_write *csf_multi_write_alloc(void)
+{
+	return mem_calloc(MAX_CHANNELS, sizeof(struct multi_write));
+}
+
+void csf_multi_write_free(struct multi_write *mw)
+{
+	if (!mw)
+		return;
+	for (int n = 0; n < MAX_CHANNELS; n++)
+		free(mw[n].buffer);
+	free(mw);
+}
+
 unsigned int csf_read(song_t *csf, void * v_buffer, unsigned int bufsize)
 {
 	uint8_t * buffer = (uint8_t *)v_buffer;
@@ -780,6 +786,9 @@ unsigned int csf_read(song_t *csf, void * v_buffer, unsigned int bufsize)
 		bufleft = 0; // skip the loop
 
 	while (bufleft > 0) {
+		if (csf_read_chunk_hook)
+			csf_read_chunk_hook(csf);
+
 		// Update Channel Data
 
 		if (!csf->buffer_count) {
@@ -817,7 +826,7 @@ unsigned int csf_read(song_t *csf, void * v_buffer, unsigned int bufsize)
 		smpcount = count;
 
 		// Resetting sound buffer
-		stereo_fill(csf->mix_buffer, smpcount, &g_dry_rofs_vol, &g_dry_lofs_vol);
+		init_mix_buffer(csf->mix_buffer, smpcount * 2);
 
 		if (csf->mix_channels >= 2) {
 			smpcount *= 2;
@@ -842,17 +851,26 @@ unsigned int csf_read(song_t *csf, void * v_buffer, unsigned int bufsize)
 		if (csf->multi_write) {
 			/* multi doesn't actually write meaningful data into 'buffer', so we can use that
 			as temp space for converting */
-			for (unsigned int n = 0; n < 64; n++) {
-				if (csf->multi_write[n].used) {
+			unsigned int silence = smpcount * ((csf->mix_bits_per_sample + 7) / 8);
+			unsigned int most = silence / count * MIXBUFFERSIZE;
+			for (unsigned int n = 0; n < MAX_CHANNELS; n++) {
+				struct multi_write *mw = csf->multi_write + n;
+				if (mw->used) {
+					/* catch up on the silence before it first played, at most a full chunk's
+					worth at a time (the writer might have to make that much silence to write it) */
+					for (; mw->pending; mw->pending -= MIN(mw->pending, most))
+						mw->silence(mw->data, MIN(mw->pending, most));
+					if (!mw->touched)
+						memset(mw->buffer, 0, count * 2 * sizeof(int));
 					if (csf->mix_channels < 2)
-						mono_from_stereo(csf->multi_write[n].buffer, count);
-					unsigned int bytes = convert_func(buffer, csf->multi_write[n].buffer,
+						mono_from_stereo(mw->buffer, count);
+					unsigned int bytes = convert_func(buffer, mw->buffer,
 						smpcount, vu_min, vu_max);
-					csf->multi_write[n].write(csf->multi_write[n].data, buffer, bytes);
+					mw->write(mw->data, buffer, bytes);
 				} else {
-					csf->multi_write[n].silence(csf->multi_write[n].data,
-						smpcount * ((csf->mix_bits_per_sample + 7) / 8));
+					mw->pending += silence;
 				}
+				mw->touched = 0;
 			}
 		} else {
 			// Perform clipping + VU-Meter
@@ -880,9 +898,9 @@ unsigned int csf_read(song_t *csf, void * v_buffer, unsigned int bufsize)
 	if (vu_max[1] < vu_min[1])
 		vu_max[1] = vu_min[1];
 
-	global_vu_left = (unsigned int)(vu_max[0] - vu_min[0]);
+	csf->vu_left = (unsigned int)(vu_max[0] - vu_min[0]);
 
-	global_vu_right = (unsigned int)(vu_max[1] - vu_min[1]);
+	csf->vu_right = (unsigned int)(vu_max[1] - vu_min[1]);
 
 	if (mix_stat) {
 		csf->mix_stat += mix_stat - 1;
@@ -1018,7 +1036,7 @@ int csf_process_tick(song_t *csf)
 			// commands... ALL WE DO is dump raw midi data to
 			// our super-secret "midi buffer"
 			// -mrsb
-			if (csf_midi_out_note)
+			if (csf_midi_out_note && !(csf->mix_flags & SNDMIX_NOMIDI))
 				csf_midi_out_note(nchan, m);
 
 			chan->row_note = m->note;
@@ -1043,7 +1061,7 @@ int csf_process_tick(song_t *csf)
 		/* [-- No --] */
 		/* [Update effects for each channel as required.] */
 
-		if (csf_midi_out_note) {
+		if (csf_midi_out_note && !(csf->mix_flags & SNDMIX_NOMIDI)) {
 			song_note_t *m = csf->patterns[csf->current_pattern] + csf->row * MAX_CHANNELS;
 
 			for (unsigned int nchan=0; nchan<MAX_CHANNELS; nchan++, m++) {
@@ -1065,6 +1083,28 @@ int csf_process_tick(song_t *csf)
 ////////////////////////////////////////////////////////////////////////////////////////////
 // Handles envelopes & mixer setup
 
+// The voice to look at after 'cn': every channel, and then only the background voices that are in
+// play. A background voice that's stopped by the time we're done with it comes out of voice_active.
+static inline uint32_t rn_next_voice(song_t *csf, uint32_t cn)
+{
+	uint32_t w, bits;
+
+	if (cn + 1 < MAX_CHANNELS)
+		return cn + 1;
+	if (cn >= MAX_CHANNELS && !csf->voices[cn].length)
+		VOICE_ACTIVE_CLEAR(csf, cn);
+
+	cn++;
+	for (w = cn >> 5; w < csf->voice_count / 32; w++) {
+		bits = csf->voice_active[w];
+		if (w == cn >> 5)
+			bits &= ~UINT32_C(0) << (cn & 31);
+		if (bits)
+			return w * 32 + csf_lowest_bit(bits);
+	}
+	return csf->voice_count;
+}
+
 int csf_read_note(song_t *csf)
 {
 	song_voice_t *chan;
@@ -1124,7 +1164,9 @@ int csf_read_note(song_t *csf)
 
 	csf->num_voices = 0;
 
-	for (cn = 0, chan = csf->voices; cn < MAX_VOICES; cn++, chan++) {
+	for (cn = 0; cn < csf->voice_count; cn = rn_next_voice(csf, cn)) {
+		chan = csf->voices + cn;
+
 		/*if(cn == 0 || cn == 1)
 		fprintf(stderr, "considering channel %d (per %d, pos %d/%d, flags %X)\n",
 			(int)cn, chan->frequency, chan->position, chan->length, chan->flags);*/
@@ -1292,7 +1334,7 @@ int csf_read_note(song_t *csf)
 	}
 
 	// Checking Max Mix Channels reached: ordering by volume
-	if (csf->num_voices >= max_voices && (!(csf->mix_flags & SNDMIX_DIRECTTODISK))) {
+	if (csf->num_voices >= csf->max_voices && (!(csf->mix_flags & SNDMIX_DIRECTTODISK))) {
 		for (unsigned int i = 0; i < csf->num_voices; i++) {
 			unsigned int j = i;
 
@@ -0,0 +1,390 @@
+/*
+ * Schism Tracker - a cross-platform Impulse Tracker clone
+ * copyright (c) 2003-2005 Storlek <storlek@rigelseven.com>
+ * copyright (c) 2005-2008 Mrs. Brisby <mrs.brisby@nimh.org>
+ * copyright (c) 2009 Storlek & Mrs. Brisby
+ * copyright (c) 2010-2012 Storlek
+ * URL: http://schismtracker.org/
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "player/sndfile.h"
+
+#include "util.h" /* for clamp/min */
+
+/* The song's timeline: when each row is reached, in playback order, as worked out by skimming
+through the patterns (only the speed, tempo, jump, and loop effects count). It's worked out once
+and kept; editing a pattern only throws away the part from where that pattern is first played,
+and things like the orderlist and pattern lengths are checked against a copy each time, so the
+index never has to be told about those.
+
+Every time playback moves to a different order, the whole skimming state is saved, and that's
+where the rest of the timeline is picked up from after an edit. Jumps only ever go forward, so each
+order is played at most once, and the rows come out sorted by order and then row -- which is what
+makes the lookups below binary searches. */
+
+#if MAX_CHANNELS != 64
+# error csf_get_length assumes 64 channels
+#endif
+
+struct timeline_state {
+	uint32_t elapsed, next_row, next_order, speed, tempo;
+	uint32_t patloop[MAX_CHANNELS];
+	uint8_t mem_tempo[MAX_CHANNELS];
+	uint64_t setloop; // bitmask
+};
+
+struct timeline_row {
+	uint32_t msec; // when the row starts
+	uint8_t order, row;
+};
+
+struct timeline_checkpoint {
+	uint32_t first_row; // index in rows[] of the first row played from here
+	struct timeline_state state;
+};
+
+struct song_timeline {
+	struct timeline_row *rows;
+	uint32_t num_rows, alloc_rows;
+	struct timeline_checkpoint checkpoints[MAX_ORDERS + 1]; // +1 for the end of the song
+	uint32_t num_checkpoints;
+	int complete;
+	uint32_t length; // msec, once it's complete
+	uint32_t generation; // goes up every time any of it is thrown away
+
+	// what the rows were worked out from
+	uint8_t orderlist[MAX_ORDERS + 1];
+	uint16_t pattern_size[MAX_PATTERNS];
+	uint32_t initial_speed, initial_tempo;
+};
+
+/* --------------------------------------------------------------------------------------------------------- */
+
+static void _timeline_reset(struct song_timeline *tl)
+{
+	tl->num_rows = 0;
+	tl->num_checkpoints = 0;
+	tl->complete = 0;
+	tl->generation++;
+}
+
+/* Forget everything from the checkpoint that covers rows[index] onwards, except the checkpoint
+itself: that's where _timeline_run picks up again. */
+static void _timeline_truncate(struct song_timeline *tl, uint32_t index)
+{
+	uint32_t n = tl->num_checkpoints;
+
+	while (n > 1 && tl->checkpoints[n - 1].first_row > index)
+		n--;
+	tl->num_checkpoints = n;
+	tl->num_rows = n ? tl->checkpoints[n - 1].first_row : 0;
+	tl->complete = 0;
+	tl->generation++;
+}
+
+/* Throw away whatever was worked out from an orderlist/pattern length/initial speed or tempo that
+doesn't match the song anymore. */
+static void _timeline_check(song_t *csf, struct song_timeline *tl)
+{
+	uint32_t n;
+
+	if (tl->initial_speed != csf->initial_speed || tl->initial_tempo != csf->initial_tempo) {
+		_timeline_reset(tl);
+	} else {
+		// anything that got as far as a changed order was played differently from there on
+		for (n = 0; n <= MAX_ORDERS; n++)
+			if (tl->orderlist[n] != csf->orderlist[n])
+				break;
+		if (n <= MAX_ORDERS) {
+			uint32_t r;
+			for (r = 0; r < tl->num_rows; r++)
+				if (tl->rows[r].order >= n)
+					break;
+			_timeline_truncate(tl, r);
+		}
+		for (n = 0; n < MAX_PATTERNS; n++)
+			if (tl->pattern_size[n] != csf->pattern_size[n])
+				csf_timeline_invalidate(csf, n);
+	}
+
+	memcpy(tl->orderlist, csf->orderlist, sizeof(tl->orderlist));
+	memcpy(tl->pattern_size, csf->pattern_size, sizeof(tl->pattern_size));
+	tl->initial_speed = csf->initial_speed;
+	tl->initial_tempo = csf->initial_tempo;
+}
+
+static int _timeline_add_row(struct song_timeline *tl, uint32_t msec, uint32_t order, uint32_t row)
+{
+	if (tl->num_rows == tl->alloc_rows) {
+		uint32_t alloc = tl->alloc_rows ? tl->alloc_rows * 2 : 1024;
+		struct timeline_row *rows = realloc(tl->rows, alloc * sizeof(struct timeline_row));
+		if (!rows)
+			return 0;
+		tl->rows = rows;
+		tl->alloc_rows = alloc;
+	}
+	tl->rows[tl->num_rows].msec = msec;
+	tl->rows[tl->num_rows].order = order;
+	tl->rows[tl->num_rows].row = row;
+	tl->num_rows++;
+	return 1;
+}
+
+/* Carry on from the last checkpoint to the end of the song. This is what csf_get_length used to
+do every time it was called. */
+static void _timeline_run(song_t *csf, struct song_timeline *tl)
+{
+	struct timeline_state st;
+	uint32_t row = 0, cur_order = 0, pat, psize, n;
+	const song_note_t *pdata;
+
+	if (tl->num_checkpoints) {
+		// (it gets saved again straight away)
+		tl->num_checkpoints--;
+		st = tl->checkpoints[tl->num_checkpoints].state;
+		tl->num_rows = tl->checkpoints[tl->num_checkpoints].first_row;
+	} else {
+		memset(&st, 0, sizeof(st));
+		st.speed = csf->initial_speed;
+		st.tempo = csf->initial_tempo;
+		tl->num_rows = 0;
+	}
+
+	for (;;) {
+		uint32_t speed_count = 0;
+
+		// the previous row was in some other order, so this is where a new stretch begins
+		if (!tl->num_rows || st.next_order != tl->rows[tl->num_rows - 1].order) {
+			tl->checkpoints[tl->num_checkpoints].first_row = tl->num_rows;
+			tl->checkpoints[tl->num_checkpoints].state = st;
+			tl->num_checkpoints++;
+		}
+
+		row = st.next_row;
+		cur_order = st.next_order;
+
+		// Check if pattern is valid
+		pat = csf->orderlist[cur_order];
+		while (pat >= MAX_PATTERNS) {
+			// End of song ?
+			if (pat == ORDER_LAST || cur_order >= MAX_ORDERS) {
+				pat = ORDER_LAST; // cause break from outer loop too
+				break;
+			} else {
+				cur_order++;
+				pat = (cur_order < MAX_ORDERS) ? csf->orderlist[cur_order] : ORDER_LAST;
+			}
+			st.next_order = cur_order;
+		}
+		// Weird stuff?
+		if (pat >= MAX_PATTERNS)
+			break;
+		pdata = csf->patterns[pat];
+		if (pdata) {
+			psize = csf->pattern_size[pat];
+		} else {
+			pdata = blank_pattern;
+			psize = 64;
+		}
+		// guard against Cxx to invalid row, etc.
+		if (row >= psize)
+			row = 0;
+		// Update next position
+		st.next_row = row + 1;
+		if (st.next_row >= psize) {
+			st.next_order = cur_order + 1;
+			st.next_row = 0;
+		}
+
+		if (!_timeline_add_row(tl, st.elapsed, cur_order, row))
+			break;
+
+		/* This is nasty, but it fixes inaccuracies with SB0 SB1 SB1. (Simultaneous
+		loops in multiple channels are still wildly incorrect, though.) */
+		if (!row)
+			st.setloop = ~0;
+		if (st.setloop) {
+			for (n = 0; n < MAX_CHANNELS; n++)
+				if (st.setloop & (1 << n))
+					st.patloop[n] = st.elapsed;
+			st.setloop = 0;
+		}
+		const song_note_t *note = pdata + row * MAX_CHANNELS;
+		for (n = 0; n < MAX_CHANNELS; note++, n++) {
+			uint32_t param = note->param;
+			switch (note->effect) {
+			case FX_NONE:
+				break;
+			case FX_POSITIONJUMP:
+				st.next_order = param > cur_order ? param : cur_order + 1;
+				st.next_row = 0;
+				break;
+			case FX_PATTERNBREAK:
+				st.next_order = cur_order + 1;
+				st.next_row = param;
+				break;
+			case FX_SPEED:
+				if (param)
+					st.speed = param;
+				break;
+			case FX_TEMPO:
+				if (param)
+					st.mem_tempo[n] = param;
+				else
+					param = st.mem_tempo[n];
+				int d = (param & 0xf);
+				switch (param >> 4) {
+				default:
+					st.tempo = param;
+					break;
+				case 0:
+					d = -d;
+				case 1:
+					d = d * (st.speed - 1) + st.tempo;
+					st.tempo = CLAMP(d, 32, 255);
+					break;
+				}
+				break;
+			case FX_SPECIAL:
+				switch (param >> 4) {
+				case 0x6:
+					speed_count = param & 0x0F;
+					break;
+				case 0xb:
+					if (param & 0x0F) {
+						st.elapsed += (st.elapsed - st.patloop[n]) * (param & 0x0F);
+						st.patloop[n] = 0xffffffff;
+						st.setloop = 1;
+					} else {
+						st.patloop[n] = st.elapsed;
+					}
+					break;
+				case 0xe:
+					speed_count = (param & 0x0F) * st.speed;
+					break;
+				}
+				break;
+			}
+		}
+		//  sec/tick = 5 / (2 * tempo)
+		// msec/tick = 5000 / (2 * tempo)
+		//           = 2500 / tempo
+		st.elapsed += (st.speed + speed_count) * 2500 / st.tempo;
+	}
+
+	tl->length = st.elapsed;
+	tl->complete = 1;
+}
+
+/* Get the song's timeline up to date, making it if it doesn't exist yet. */
+static struct song_timeline *_timeline_get(song_t *csf)
+{
+	struct song_timeline *tl = csf->timeline;
+
+	if (!tl) {
+		tl = csf->timeline = mem_calloc(1, sizeof(struct song_timeline));
+		memcpy(tl->orderlist, csf->orderlist, sizeof(tl->orderlist));
+		memcpy(tl->pattern_size, csf->pattern_size, sizeof(tl->pattern_size));
+		tl->initial_speed = csf->initial_speed;
+		tl->initial_tempo = csf->initial_tempo;
+	} else {
+		_timeline_check(csf, tl);
+	}
+	if (!tl->complete)
+		_timeline_run(csf, tl);
+	return tl;
+}
+
+/* --------------------------------------------------------------------------------------------------------- */
+
+void csf_timeline_invalidate(song_t *csf, int pattern)
+{
+	struct song_timeline *tl = csf->timeline;
+	uint32_t r;
+
+	if (!tl)
+		return;
+	if (pattern < 0) {
+		_timeline_reset(tl);
+		return;
+	}
+	for (r = 0; r < tl->num_rows; r++)
+		if (tl->orderlist[tl->rows[r].order] == pattern)
+			break;
+	if (r < tl->num_rows)
+		_timeline_truncate(tl, r);
+}
+
+void csf_timeline_free(song_t *csf)
+{
+	if (csf->timeline) {
+		free(csf->timeline->rows);
+		free(csf->timeline);
+		csf->timeline = NULL;
+	}
+}
+
+unsigned int csf_timeline_generation(song_t *csf)
+{
+	return _timeline_get(csf)->generation;
+}
+
+unsigned int csf_get_length(song_t *csf)
+{
+	return (_timeline_get(csf)->length + 500) / 1000;
+}
+
+unsigned int csf_get_length_to(song_t *csf, int order, int row)
+{
+	struct song_timeline *tl = _timeline_get(csf);
+	uint32_t lo = 0, hi = tl->num_rows;
+
+	// find where (order, row) is, or would be...
+	while (lo < hi) {
+		uint32_t mid = (lo + hi) / 2;
+		if (tl->rows[mid].order < order || (tl->rows[mid].order == order && tl->rows[mid].row < row))
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	// ... and then the first row played from there on that's at least that far down its pattern.
+	// (nearly always that same row, unless a pattern break skipped past it)
+	for (; lo < tl->num_rows; lo++)
+		if (tl->rows[lo].row >= row)
+			return (tl->rows[lo].msec + 500) / 1000;
+	return (tl->length + 500) / 1000;
+}
+
+int csf_get_position_at(song_t *csf, unsigned int seconds, int *order, int *row)
+{
+	struct song_timeline *tl = _timeline_get(csf);
+	uint32_t lo = 0, hi = tl->num_rows;
+
+	// the first row that starts at (or rounds up to) that second
+	while (lo < hi) {
+		uint32_t mid = (lo + hi) / 2;
+		if ((tl->rows[mid].msec + 500) / 1000 < seconds)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	if (lo == tl->num_rows)
+		return 0;
+	*order = tl->rows[lo].order;
+	*row = tl->rows[lo].row;
+	return 1;
+}
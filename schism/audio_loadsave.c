@@ -107,6 +107,7 @@ void song_new(int flags)
 	song_lock_audio();
 
 	song_stop_unlocked(0);
+	csf_snapshot_free(current_song);
 
 	if ((flags & KEEP_PATTERNS) == 0) {
 		song_set_filename(NULL);
@@ -120,6 +121,7 @@ void song_new(int flags)
 			current_song->pattern_size[i] = 64;
 			current_song->pattern_alloc_size[i] = 64;
 		}
+		csf_timeline_invalidate(current_song, -1);
 	}
 	if ((flags & KEEP_SAMPLES) == 0) {
 		for (i = 1; i < MAX_SAMPLES; i++) {
@@ -213,6 +215,8 @@ song_t *song_create_load(const char *file)
 
 	if (current_song) {
 		newsong->mix_flags = current_song->mix_flags;
+		csf_set_voice_count(newsong, current_song->voice_count);
+		newsong->max_voices = current_song->max_voices;
 		csf_set_wave_config(newsong,
 			current_song->mix_frequency,
 			current_song->mix_bits_per_sample,
@@ -260,7 +264,6 @@ song_t *song_create_load(const char *file)
 
 	newsong->stop_at_order = newsong->stop_at_row = -1;
 	message_convert_newlines(newsong);
-	message_reset_selection();
 
 	return newsong;
 }
@@ -291,6 +294,7 @@ int song_load_unchecked(const char *file)
 	}
 
 	song_set_filename(file);
+	message_reset_selection();
 
 	song_lock_audio();
 	csf_free(current_song);
@@ -337,6 +341,7 @@ int song_load_unchecked(const char *file)
 
 const struct save_format song_save_formats[] = {
 	{"IT", "Impulse Tracker", ".it", {.save_song = fmt_it_save_song}},
+	{"ITC", "Impulse Tracker (compressed)", ".it", {.save_song = fmt_it215_save_song}},
 	{"S3M", "Scream Tracker 3", ".s3m", {.save_song = fmt_s3m_save_song}},
 	{"MOD", "Amiga ProTracker", ".mod", {.save_song = fmt_mod_save_song}},
 	{.label = NULL}
@@ -361,6 +366,7 @@ const struct save_format song_export_formats[] = {
 
 const struct save_format sample_save_formats[] = {
 	{"ITS", "Impulse Tracker", ".its", {.save_sample = fmt_its_save_sample}},
+	{"ITSC", "Impulse Tracker (compressed)", ".its", {.save_sample = fmt_its215_save_sample}},
 	//{"S3I", "Scream Tracker", ".s3i", {.save_sample = fmt_s3i_save_sample}},
 	{"AIFF", "Audio IFF", ".aiff", {.save_sample = fmt_aiff_save_sample}},
 	{"AU", "Sun/NeXT", ".au", {.save_sample = fmt_au_save_sample}},
@@ -458,6 +464,61 @@ int song_export(const char *filename, const char *type)
 }
 
 
+int song_export_batch(char *const *files, int count, const char *dir, const char *type, int threads)
+{
+	const struct save_format *format = get_save_format(song_export_formats, type);
+	char **outputs;
+	int n, failed;
+
+	if (!format)
+		return count;
+	if (format->f.export.multi) {
+		log_appendf(4, "Can't batch export to %s", format->name);
+		return count;
+	}
+
+	/* keep the whole name (foo.it => foo.it.wav) so that foo.it and foo.xm don't collide */
+	outputs = mem_calloc(count, sizeof(char *));
+	for (n = 0; n < count; n++) {
+		if (dir) {
+			char *name = dmoz_path_concat(dir, get_basename(files[n]));
+			outputs[n] = str_concat(name, format->ext, NULL);
+			free(name);
+		} else {
+			outputs[n] = str_concat(files[n], format->ext, NULL);
+		}
+	}
+
+	failed = disko_export_batch((const char *const *) files, (const char *const *) outputs, count,
+		format, threads);
+
+	for (n = 0; n < count; n++)
+		free(outputs[n]);
+	free(outputs);
+
+	return failed;
+}
+
+int song_export_file(const char *file, const char *out, const char *type)
+{
+	const struct save_format *format = get_save_format(song_export_formats, type);
+	char *mangle;
+	int failed;
+
+	if (!format)
+		return 1;
+	if (format->f.export.multi) {
+		log_appendf(4, "Can't batch export to %s", format->name);
+		return 1;
+	}
+
+	mangle = mangle_filename(out, NULL, format->ext);
+	failed = disko_export_batch(&file, (const char *const *) &mangle, 1, format, 1);
+	free(mangle);
+
+	return failed;
+}
+
 int song_save(const char *filename, const char *type)
 {
 	int ret, backup;
@@ -634,6 +695,7 @@ int song_load_instrument_ex(int target, const char *file, const char *libf, int
 	int r, x;
 
 	song_lock_audio();
+	csf_snapshot_free(current_song);
 
 	/* 0. delete old samples */
 	if (current_song->instruments[target]) {
@@ -31,6 +31,7 @@
 
 #include "disko.h"
 #include "event.h"
+#include "thread-pool.h"
 
 #include <assert.h>
 
@@ -97,6 +98,12 @@ static char *device_name = NULL;
 static char cfg_audio_driver[256] = { 0 };
 static char cfg_audio_device[256] = { 0 };
 
+/* Same for the voice count and mixer threads: --voices, --mix-threads and --mix-thread-voices change
+audio_settings for this run only, and these are what get saved. */
+static int cfg_voices = DEFAULT_VOICES;
+static int cfg_mix_threads = 1;
+static int cfg_mix_thread_voices = 32;
+
 // ------------------------------------------------------------------------
 
 struct audio_device* audio_device_list = NULL;
@@ -108,11 +115,105 @@ static SDL_AudioDeviceID current_audio_device = 0;
 // playback
 
 extern int midi_bend_hit[64], midi_last_bend_hit[64];
+/* these just queue the data for the visualizations; the FFT is done on the main thread */
 extern void vis_work_16s(short *in, int inlen);
 extern void vis_work_16m(short *in, int inlen);
 extern void vis_work_8s(char *in, int inlen);
 extern void vis_work_8m(char *in, int inlen);
 
+// ------------------------------------------------------------------------
+// commands for the audio thread
+
+/* Keyjazz, seeking, muting, and speed/tempo/volume changes are sent to the audio thread through
+this ring rather than locking the audio. The main thread is the only writer. The reader is whoever
+is mixing current_song -- the audio callback, and csf_read between chunks -- or whoever has the
+audio locked, since song_lock_audio runs anything still queued first (so queued and locked changes
+still happen in the order they were made). */
+#define AUDIO_CMD_RING_SIZE 256
+#define AUDIO_CMD_RING_MASK (AUDIO_CMD_RING_SIZE - 1)
+
+enum audio_cmd_type {
+	AUDIO_CMD_KEYDOWN,
+	AUDIO_CMD_MUTE,
+	AUDIO_CMD_SET_ORDER,
+	AUDIO_CMD_NEXT_ORDER,
+	AUDIO_CMD_SPEED,
+	AUDIO_CMD_TEMPO,
+	AUDIO_CMD_GLOBAL_VOLUME,
+
+	AUDIO_CMD_TYPES,
+};
+
+struct audio_cmd {
+	enum audio_cmd_type type;
+	int chan; // zero-based
+	int value; // mute flag, order, speed, tempo, or global volume
+	int samp, ins, note, vol, effect, param; // keydown
+};
+
+static struct audio_cmd audio_cmd_ring[AUDIO_CMD_RING_SIZE];
+static SDL_atomic_t audio_cmd_head, audio_cmd_tail;
+
+/* The last value queued for each setting and where it went in the ring. Until the audio thread
+gets that far, the song_get_* functions return this, so that e.g. pressing + twice in a row moves
+two orders instead of setting the same one twice. (main thread only) */
+static int audio_cmd_value[AUDIO_CMD_TYPES];
+static unsigned int audio_cmd_pos[AUDIO_CMD_TYPES];
+static int audio_cmd_queued[AUDIO_CMD_TYPES];
+
+static void _audio_cmd_run(const struct audio_cmd *cmd);
+
+static void _audio_cmd_drain(void)
+{
+	unsigned int tail = SDL_AtomicGet(&audio_cmd_tail);
+	unsigned int head = SDL_AtomicGet(&audio_cmd_head);
+
+	if (tail == head)
+		return;
+	for (; tail != head; tail++)
+		_audio_cmd_run(&audio_cmd_ring[tail & AUDIO_CMD_RING_MASK]);
+	SDL_AtomicSet(&audio_cmd_tail, tail);
+}
+
+static void _audio_cmd_chunk_hook(song_t *csf)
+{
+	// disk writer and such have their own songs, and nothing to do with this
+	if (csf == current_song)
+		_audio_cmd_drain();
+}
+
+static void _audio_cmd_push(const struct audio_cmd *cmd)
+{
+	unsigned int head = SDL_AtomicGet(&audio_cmd_head);
+
+	if (!current_audio_device || SDL_GetAudioDeviceStatus(current_audio_device) != SDL_AUDIO_PLAYING
+	    || head - (unsigned int) SDL_AtomicGet(&audio_cmd_tail) >= AUDIO_CMD_RING_SIZE) {
+		// nothing's going to read it anytime soon (or it's full), so just do it here
+		song_lock_audio();
+		_audio_cmd_run(cmd);
+		song_unlock_audio();
+		return;
+	}
+
+	audio_cmd_ring[head & AUDIO_CMD_RING_MASK] = *cmd;
+	audio_cmd_value[cmd->type] = cmd->value;
+	audio_cmd_pos[cmd->type] = head;
+	audio_cmd_queued[cmd->type] = 1;
+	/* SDL_AtomicAdd is a full barrier, so the command is visible first */
+	SDL_AtomicAdd(&audio_cmd_head, 1);
+}
+
+/* 'current', unless there's a newer value on its way to the audio thread */
+static int _audio_cmd_pending(enum audio_cmd_type type, int current)
+{
+	if (audio_cmd_queued[type]) {
+		if ((int) (audio_cmd_pos[type] - (unsigned int) SDL_AtomicGet(&audio_cmd_tail)) >= 0)
+			return audio_cmd_value[type];
+		audio_cmd_queued[type] = 0;
+	}
+	return current;
+}
+
 // this gets called from sdl
 static void audio_callback(UNUSED void *qq, uint8_t * stream, int len)
 {
@@ -136,6 +237,11 @@ static void audio_callback(UNUSED void *qq, uint8_t * stream, int len)
 		return;
 	}
 
+	midi_queue_mark(len / audio_sample_size);
+
+	// a keyjazz note might be waiting to un-stop the song
+	_audio_cmd_drain();
+
 	if (current_song->flags & SONG_ENDREACHED) {
 		n = 0;
 	} else {
@@ -179,7 +285,7 @@ static void audio_callback(UNUSED void *qq, uint8_t * stream, int len)
 	}
 
 	if (current_song->num_voices > max_channels_used)
-		max_channels_used = MIN(current_song->num_voices, max_voices);
+		max_channels_used = MIN(current_song->num_voices, current_song->max_voices);
 POST_EVENT:
 	audio_writeout_count++;
 	if (audio_writeout_count > audio_buffers_per_second) {
@@ -292,40 +398,24 @@ static int keyjazz_note_to_chan[NOTE_LAST + 1];
 /* last note played by channel tracking */
 static int keyjazz_chan_to_note[MAX_CHANNELS + 1];
 
-/* **** chan ranges from 1 to 64   */
-static int song_keydown_ex(int samp, int ins, int note, int vol, int chan, int effect, int param)
+/* the part of song_keydown_ex that touches the voices; runs on the audio thread */
+static void _keydown_run(const struct audio_cmd *cmd)
 {
 	int ins_mode;
+	int samp = cmd->samp, ins = cmd->ins, note = cmd->note, vol = cmd->vol;
+	int effect = cmd->effect, param = cmd->param;
+	int chan_internal = cmd->chan;
 	int midi_note = note; /* note gets overwritten, possibly NOTE_NONE */
 	song_voice_t *c;
 	song_note_t mc;
 	song_sample_t *s = NULL;
 	song_instrument_t *i = NULL;
 
-	if (chan == KEYJAZZ_CHAN_CURRENT) {
-		chan = current_play_channel;
-		if (multichannel_mode)
-			song_change_current_play_channel(1, 1);
-	}
-    // back to the 0..63 range
-    int chan_internal = chan -1;
-
-	song_lock_audio();
-
 	c = current_song->voices + chan_internal;
 
 	ins_mode = song_is_instrument_mode();
 
 	if (NOTE_IS_NOTE(note)) {
-		// keep track of what channel this note was played in so we can note-off properly later
-		if (keyjazz_chan_to_note[chan]) {
-			// reset note-off pending state for last note in channel
-			keyjazz_note_to_chan[keyjazz_chan_to_note[chan]] = 0;
-		}
-
-		keyjazz_note_to_chan[note] = chan;
-		keyjazz_chan_to_note[chan] = note;
-
 		// handle blank instrument values and "fake" sample #0 (used by sample loader)
 		if (samp == 0)
 			samp = c->last_instrument;
@@ -339,7 +429,8 @@ static int song_keydown_ex(int samp, int ins, int note, int vol, int chan, int e
 
 		// give the channel a sample, and maybe an instrument
 		s = (samp == KEYJAZZ_NOINST) ? NULL : current_song->samples + samp;
-		i = (ins == KEYJAZZ_NOINST) ? NULL : song_get_instrument(ins); // blah
+		// (song_keydown_ex already made the instrument if it was asked for by number)
+		i = (ins == KEYJAZZ_NOINST || ins >= MAX_INSTRUMENTS) ? NULL : current_song->instruments[ins];
 
 		if (i && samp == KEYJAZZ_NOINST) {
 			// we're playing an instrument and don't know what sample! WHAT WILL WE EVER DO?!
@@ -359,8 +450,8 @@ static int song_keydown_ex(int samp, int ins, int note, int vol, int chan, int e
 		csf_check_nna(current_song, chan_internal, ins, note, 0);
 	if (s) {
 		if (c->flags & CHN_ADLIB) {
-			OPL_NoteOff(chan_internal);
-			OPL_Patch(chan_internal, s->adlib_bytes);
+			OPL_NoteOff(current_song, chan_internal);
+			OPL_Patch(current_song, chan_internal, s->adlib_bytes);
 		}
 
 		c->flags = (s->flags & CHN_SAMPLE_FLAGS) | (c->flags & CHN_MUTE);
@@ -384,8 +475,8 @@ static int song_keydown_ex(int samp, int ins, int note, int vol, int chan, int e
 
 			if ((status.flags & MIDI_LIKE_TRACKER) && i) {
 				if (i->midi_channel_mask) {
-					GM_KeyOff(chan_internal);
-					GM_DPatch(chan_internal, i->midi_program, i->midi_bank, i->midi_channel_mask);
+					GM_KeyOff(current_song, chan_internal);
+					GM_DPatch(current_song, chan_internal, i->midi_program, i->midi_bank, i->midi_channel_mask);
 				}
 			}
 
@@ -457,8 +548,45 @@ static int song_keydown_ex(int samp, int ins, int note, int vol, int chan, int e
 		current_song->flags &= ~SONG_ENDREACHED;
 		current_song->flags |= SONG_PAUSED;
 	}
+}
 
-	song_unlock_audio();
+/* **** chan ranges from 1 to 64   */
+static int song_keydown_ex(int samp, int ins, int note, int vol, int chan, int effect, int param)
+{
+	struct audio_cmd cmd = {0};
+
+	if (chan == KEYJAZZ_CHAN_CURRENT) {
+		chan = current_play_channel;
+		if (multichannel_mode)
+			song_change_current_play_channel(1, 1);
+	}
+
+	if (NOTE_IS_NOTE(note)) {
+		// keep track of what channel this note was played in so we can note-off properly later
+		if (keyjazz_chan_to_note[chan]) {
+			// reset note-off pending state for last note in channel
+			keyjazz_note_to_chan[keyjazz_chan_to_note[chan]] = 0;
+		}
+
+		keyjazz_note_to_chan[note] = chan;
+		keyjazz_chan_to_note[chan] = note;
+
+		// allocating isn't something to do on the audio thread
+		if (ins > 0)
+			song_get_instrument(ins);
+		else if (ins == KEYJAZZ_INST_FAKE)
+			song_get_instrument(0);
+	}
+
+	cmd.type = AUDIO_CMD_KEYDOWN;
+	cmd.chan = chan - 1; // back to the 0..63 range
+	cmd.samp = samp;
+	cmd.ins = ins;
+	cmd.note = note;
+	cmd.vol = vol;
+	cmd.effect = effect;
+	cmd.param = param;
+	_audio_cmd_push(&cmd);
 
 	return chan;
 }
@@ -543,7 +671,7 @@ static void song_reset_play_state(void)
 	// turn this crap off
 	current_song->mix_flags &= ~(SNDMIX_NOBACKWARDJUMPS | SNDMIX_DIRECTTODISK);
 
-	OPL_Reset(); /* gruh? */
+	OPL_Reset(current_song); /* gruh? */
 
 	csf_set_current_order(current_song, 0);
 
@@ -565,7 +693,7 @@ void song_start_once(void)
 	max_channels_used = 0;
 	current_song->repeat_count = -1; // FIXME do this right
 
-	GM_SendSongStartCode();
+	GM_SendSongStartCode(current_song);
 	song_unlock_audio();
 	main_song_mode_changed_cb();
 
@@ -579,7 +707,7 @@ void song_start(void)
 	song_reset_play_state();
 	max_channels_used = 0;
 
-	GM_SendSongStartCode();
+	GM_SendSongStartCode(current_song);
 	song_unlock_audio();
 	main_song_mode_changed_cb();
 
@@ -602,6 +730,7 @@ void song_stop(void)
 	song_stop_unlocked(0);
 	song_unlock_audio();
 	main_song_mode_changed_cb();
+	midi_queue_report();
 }
 
 /* for midi translation */
@@ -658,9 +787,9 @@ void song_stop_unlocked(int quitting)
 		midi_playing = 0;
 	}
 
-	OPL_Reset(); /* Also stop all OPL sounds */
-	GM_Reset(quitting);
-	GM_SendSongStopCode();
+	OPL_Reset(current_song); /* Also stop all OPL sounds */
+	GM_Reset(current_song, quitting);
+	GM_SendSongStopCode(current_song);
 
 	memset(last_row,0,sizeof(last_row));
 	last_row_number = -1;
@@ -678,8 +807,8 @@ void song_stop_unlocked(int quitting)
 	// Modplug doesn't actually have a "stop" mode, but if SONG_ENDREACHED is set, current_song->Read just returns.
 	current_song->flags |= SONG_PAUSED | SONG_ENDREACHED;
 
-	global_vu_left = 0;
-	global_vu_right = 0;
+	current_song->vu_left = 0;
+	current_song->vu_right = 0;
 	memset(audio_buffer, 0, audio_buffer_samples * audio_sample_size);
 }
 
@@ -695,7 +824,7 @@ void song_loop_pattern(int pattern, int row)
 	max_channels_used = 0;
 	csf_loop_pattern(current_song, pattern, row);
 
-	GM_SendSongStartCode();
+	GM_SendSongStartCode(current_song);
 
 	song_unlock_audio();
 	main_song_mode_changed_cb();
@@ -713,7 +842,7 @@ void song_start_at_order(int order, int row)
 	current_song->break_row = row;
 	max_channels_used = 0;
 
-	GM_SendSongStartCode();
+	GM_SendSongStartCode(current_song);
 	/* TODO: GM_SendSongPositionCode(calculate the number of 1/16 notes) */
 	song_unlock_audio();
 	main_song_mode_changed_cb();
@@ -721,6 +850,41 @@ void song_start_at_order(int order, int row)
 	csf_reset_playmarks(current_song);
 }
 
+/* Unlike starting at an order, this actually plays the song up to that point (silently, on a
+copy of it, with the audio unlocked) so everything that would be going on by then is. The first
+trip into a long song takes a moment; after that it's never more than a couple of seconds of
+mixing. Returns 0 if the song isn't that long. */
+int song_start_at_time(unsigned int msec)
+{
+	uint64_t frame;
+	song_t *work;
+	int ok;
+
+	work = mem_alloc(sizeof(song_t));
+	song_lock_audio();
+	memcpy(work, current_song, sizeof(song_t));
+	csf_copy_voices(work, current_song);
+	frame = (uint64_t) msec * current_song->mix_frequency / 1000;
+	song_unlock_audio();
+
+	ok = csf_snapshot_seek(current_song, work, frame);
+	if (ok) {
+		song_lock_audio();
+		song_reset_play_state();
+		csf_copy_play_state(current_song, work);
+		samples_played = frame;
+		max_channels_used = 0;
+		GM_SendSongStartCode(current_song);
+		song_unlock_audio();
+		main_song_mode_changed_cb();
+	}
+
+	OPL_Close(work);
+	csf_free_voices(work);
+	free(work);
+	return ok;
+}
+
 void song_start_at_pattern(int pattern, int row)
 {
 	if (pattern < 0 || pattern > 199)
@@ -762,28 +926,30 @@ int song_get_current_tick(void)
 }
 int song_get_current_speed(void)
 {
-	return current_song->current_speed;
+	return _audio_cmd_pending(AUDIO_CMD_SPEED, current_song->current_speed);
 }
 
 void song_set_current_tempo(int new_tempo)
 {
-	song_lock_audio();
-	current_song->current_tempo = CLAMP(new_tempo, 31, 255);
-	song_unlock_audio();
+	struct audio_cmd cmd = {0};
+
+	cmd.type = AUDIO_CMD_TEMPO;
+	cmd.value = CLAMP(new_tempo, 31, 255);
+	_audio_cmd_push(&cmd);
 }
 int song_get_current_tempo(void)
 {
-	return current_song->current_tempo;
+	return _audio_cmd_pending(AUDIO_CMD_TEMPO, current_song->current_tempo);
 }
 
 int song_get_current_global_volume(void)
 {
-	return current_song->current_global_volume;
+	return _audio_cmd_pending(AUDIO_CMD_GLOBAL_VOLUME, current_song->current_global_volume);
 }
 
 int song_get_current_order(void)
 {
-	return current_song->current_order;
+	return _audio_cmd_pending(AUDIO_CMD_SET_ORDER, current_song->current_order);
 }
 
 int song_get_playing_pattern(void)
@@ -798,7 +964,7 @@ int song_get_current_row(void)
 
 int song_get_playing_channels(void)
 {
-	return MIN(current_song->num_voices, max_voices);
+	return MIN(current_song->num_voices, current_song->max_voices);
 }
 
 int song_get_max_channels(void)
@@ -808,8 +974,8 @@ int song_get_max_channels(void)
 // Returns the max value in dBs, scaled as 0 = -40dB and 128 = 0dB.
 void song_get_vu_meter(int *left, int *right)
 {
-	*left = dB_s(40, global_vu_left/256.f, 0.f);
-	*right = dB_s(40, global_vu_right/256.f, 0.f);
+	*left = dB_s(40, current_song->vu_left/256.f, 0.f);
+	*right = dB_s(40, current_song->vu_right/256.f, 0.f);
 }
 
 void song_update_playing_instrument(int i_changed)
@@ -818,7 +984,7 @@ void song_update_playing_instrument(int i_changed)
 	song_instrument_t *inst;
 
 	song_lock_audio();
-	int n = MIN(current_song->num_voices, max_voices);
+	int n = MIN(current_song->num_voices, current_song->max_voices);
 	while (n--) {
 		channel = current_song->voices + current_song->voice_mix[n];
 		if (channel->ptr_instrument && channel->ptr_instrument == current_song->instruments[i_changed]) {
@@ -857,7 +1023,7 @@ void song_update_playing_sample(int s_changed)
 	song_sample_t *inst;
 
 	song_lock_audio();
-	int n = MIN(current_song->num_voices, max_voices);
+	int n = MIN(current_song->num_voices, current_song->max_voices);
 	while (n--) {
 		channel = current_song->voices + current_song->voice_mix[n];
 		if (channel->ptr_sample && channel->current_sample_data) {
@@ -894,6 +1060,9 @@ void song_update_playing_sample(int s_changed)
 					| CHN_SUSTAINLOOP
 					| CHN_LOOP);
 			channel->instrument_volume = inst->global_volume;
+			// it might have run out since, and just been given a loop to play again
+			if (channel->length && current_song->voice_mix[n] >= MAX_CHANNELS)
+				VOICE_ACTIVE_SET(current_song, current_song->voice_mix[n]);
 		}
 	}
 	song_unlock_audio();
@@ -906,7 +1075,7 @@ void song_get_playing_samples(int samples[])
 	memset(samples, 0, MAX_SAMPLES * sizeof(int));
 
 	song_lock_audio();
-	int n = MIN(current_song->num_voices, max_voices);
+	int n = MIN(current_song->num_voices, current_song->max_voices);
 	while (n--) {
 		channel = current_song->voices + current_song->voice_mix[n];
 		if (channel->ptr_sample && channel->current_sample_data) {
@@ -929,7 +1098,7 @@ void song_get_playing_instruments(int instruments[])
 	memset(instruments, 0, MAX_INSTRUMENTS * sizeof(int));
 
 	song_lock_audio();
-	int n = MIN(current_song->num_voices, max_voices);
+	int n = MIN(current_song->num_voices, current_song->max_voices);
 	while (n--) {
 		channel = current_song->voices + current_song->voice_mix[n];
 		int ins = song_get_instrument_number((song_instrument_t *) channel->ptr_instrument);
@@ -945,37 +1114,96 @@ void song_get_playing_instruments(int instruments[])
 
 void song_set_current_speed(int speed)
 {
+	struct audio_cmd cmd = {0};
+
 	if (speed < 1 || speed > 255)
 		return;
 
-	song_lock_audio();
-	current_song->current_speed = speed;
-	song_unlock_audio();
+	cmd.type = AUDIO_CMD_SPEED;
+	cmd.value = speed;
+	_audio_cmd_push(&cmd);
 }
 
 void song_set_current_global_volume(int volume)
 {
+	struct audio_cmd cmd = {0};
+
 	if (volume < 0 || volume > 128)
 		return;
 
-	song_lock_audio();
-	current_song->current_global_volume = volume;
-	song_unlock_audio();
+	cmd.type = AUDIO_CMD_GLOBAL_VOLUME;
+	cmd.value = volume;
+	_audio_cmd_push(&cmd);
 }
 
 void song_set_current_order(int order)
 {
-	song_lock_audio();
-	csf_set_current_order(current_song, order);
-	song_unlock_audio();
+	struct audio_cmd cmd = {0};
+
+	cmd.type = AUDIO_CMD_SET_ORDER;
+	cmd.value = order;
+	_audio_cmd_push(&cmd);
 }
 
 // Ctrl-F7
 void song_set_next_order(int order)
 {
-	song_lock_audio();
-	current_song->process_order = order - 1;
-	song_unlock_audio();
+	struct audio_cmd cmd = {0};
+
+	cmd.type = AUDIO_CMD_NEXT_ORDER;
+	cmd.value = order;
+	_audio_cmd_push(&cmd);
+}
+
+// the voice side of song_set_channel_mute
+void song_set_voice_mute(int channel, int muted)
+{
+	struct audio_cmd cmd = {0};
+
+	cmd.type = AUDIO_CMD_MUTE;
+	cmd.chan = channel;
+	cmd.value = muted;
+	_audio_cmd_push(&cmd);
+}
+
+static void _audio_cmd_run(const struct audio_cmd *cmd)
+{
+	int n;
+
+	switch (cmd->type) {
+	case AUDIO_CMD_KEYDOWN:
+		_keydown_run(cmd);
+		break;
+	case AUDIO_CMD_MUTE:
+		// background voices that came from this channel go along with it
+		for (n = 0; n < (int) current_song->voice_count; n++) {
+			song_voice_t *v = current_song->voices + n;
+			if (n != cmd->chan && (int) v->master_channel != cmd->chan + 1)
+				continue;
+			if (cmd->value)
+				v->flags |= CHN_MUTE;
+			else
+				v->flags &= ~CHN_MUTE;
+		}
+		break;
+	case AUDIO_CMD_SET_ORDER:
+		csf_set_current_order(current_song, cmd->value);
+		break;
+	case AUDIO_CMD_NEXT_ORDER:
+		current_song->process_order = cmd->value - 1;
+		break;
+	case AUDIO_CMD_SPEED:
+		current_song->current_speed = cmd->value;
+		break;
+	case AUDIO_CMD_TEMPO:
+		current_song->current_tempo = cmd->value;
+		break;
+	case AUDIO_CMD_GLOBAL_VOLUME:
+		current_song->current_global_volume = cmd->value;
+		break;
+	case AUDIO_CMD_TYPES:
+		break;
+	}
 }
 
 // Alt-F11
@@ -1044,16 +1272,25 @@ void cfg_load_audio(cfg_file_t *cfg)
 	}
 
 	CFG_GET_M(channel_limit, DEF_CHANNEL_LIMIT);
+	CFG_GET_M(voices, DEFAULT_VOICES);
 	CFG_GET_M(interpolation_mode, SRCMODE_LINEAR);
 	CFG_GET_M(no_ramping, 0);
 	CFG_GET_M(surround_effect, 1);
+	CFG_GET_M(mix_threads, 1);
+	CFG_GET_M(mix_thread_voices, 32);
 
 	if (audio_settings.channels != 1 && audio_settings.channels != 2)
 		audio_settings.channels = 2;
 	if (audio_settings.bits != 8 && audio_settings.bits != 16)
 		audio_settings.bits = 16;
 	audio_settings.channel_limit = CLAMP(audio_settings.channel_limit, 4, MAX_VOICES);
+	audio_settings.voices = CLAMP(audio_settings.voices, MAX_CHANNELS + 32, MAX_VOICES);
 	audio_settings.interpolation_mode = CLAMP(audio_settings.interpolation_mode, 0, 3);
+	audio_settings.mix_threads = CLAMP(audio_settings.mix_threads, 0, MAX_MIX_THREADS);
+	audio_settings.mix_thread_voices = CLAMP(audio_settings.mix_thread_voices, 2, MAX_VOICES);
+	cfg_voices = audio_settings.voices;
+	cfg_mix_threads = audio_settings.mix_threads;
+	cfg_mix_thread_voices = audio_settings.mix_thread_voices;
 
 	audio_settings.eq_freq[0] = cfg_get_number(cfg, "EQ Low Band", "freq", 0);
 	audio_settings.eq_freq[1] = cfg_get_number(cfg, "EQ Med Low Band", "freq", 16);
@@ -1084,8 +1321,11 @@ void cfg_atexit_save_audio(cfg_file_t *cfg)
 	CFG_SET_A(master.right);
 
 	CFG_SET_M(channel_limit);
+	cfg_set_number(cfg, "Mixer Settings", "voices", cfg_voices);
 	CFG_SET_M(interpolation_mode);
 	CFG_SET_M(no_ramping);
+	cfg_set_number(cfg, "Mixer Settings", "mix_threads", cfg_mix_threads);
+	cfg_set_number(cfg, "Mixer Settings", "mix_thread_voices", cfg_mix_thread_voices);
 
 	// Say, what happened to the switch for this in the gui?
 	CFG_SET_M(surround_effect);
@@ -1299,6 +1539,8 @@ static void _schism_midi_out_raw(const unsigned char *data, unsigned int len, un
 void song_lock_audio(void)
 {
 	SDL_LockAudioDevice(current_audio_device);
+	// whatever this is for has to see everything that was queued before it
+	_audio_cmd_drain();
 }
 void song_unlock_audio(void)
 {
@@ -1472,6 +1714,7 @@ success:
 		log_appendf(5, " %d Hz, %d bit, %s", obtained.freq, SDL_AUDIO_BITSIZE(obtained.format),
 			obtained.channels == 1 ? "mono" : "stereo");
 		log_appendf(5, " Buffer size: %d samples", obtained.samples);
+		log_appendf(5, " Mixer: %s", csf_mix_functions_name());
 	}
 
 	return 1;
@@ -1569,7 +1812,7 @@ int audio_reinit(const char *device)
 
 /* --------------------------------------------------------------------------------------------------------- */
 
-void song_init_eq(int do_reset, uint32_t mix_freq)
+void song_init_eq(song_t *csf, int do_reset, uint32_t mix_freq)
 {
 	uint32_t pg[4];
 	uint32_t pf[4];
@@ -1581,15 +1824,77 @@ void song_init_eq(int do_reset, uint32_t mix_freq)
 			* (mix_freq / 128) / 1024);
 	}
 
-	set_eq_gains(pg, 4, pf, do_reset, mix_freq);
+	set_eq_gains(csf, pg, 4, pf, do_reset, mix_freq);
+}
+
+
+static thread_pool_t *mix_pool = NULL;
+
+static void _schism_run_mix_jobs(void (*func)(void *data, unsigned int job), void *data, unsigned int njobs)
+{
+	thread_pool_run(mix_pool, func, data, njobs);
 }
 
+/* (re)start the mixer threads if the setting changed; called with the audio locked */
+static void _mix_threads_update(void)
+{
+	int n = audio_settings.mix_threads ? audio_settings.mix_threads : SDL_GetCPUCount();
+
+	n = CLAMP(n, 1, MAX_MIX_THREADS);
+	mix_thread_voices = MAX(audio_settings.mix_thread_voices, 2);
+
+	if ((int) thread_pool_size(mix_pool) == n)
+		return;
+
+	csf_run_mix_jobs = NULL;
+	mix_threads = 1;
+	thread_pool_destroy(mix_pool);
+	mix_pool = NULL;
+
+	if (n < 2)
+		return;
+
+	mix_pool = thread_pool_create(n);
+	if (!mix_pool) {
+		log_appendf(4, "Couldn't start mixer threads; mixing on one thread");
+		return;
+	}
+
+	mix_threads = n;
+	csf_run_mix_jobs = _schism_run_mix_jobs;
+	log_appendf(5, " Mixing on %d threads (%u+ voices)", n, mix_thread_voices);
+}
+
+/* Sample decoding for csf_read_samples. There's no setting for this one: it's one thread per core, and
+they're not started until the first song that has more than one sample is loaded. Songs can be loaded
+from a disk writer thread while the main thread is loading something else, hence the lock. */
+static thread_pool_t *load_pool = NULL;
+static SDL_SpinLock load_pool_lock = 0;
+static int load_pool_failed = 0;
+
+static void _schism_run_load_jobs(void (*func)(void *data, unsigned int job), void *data, unsigned int njobs)
+{
+	SDL_AtomicLock(&load_pool_lock);
+	if (!load_pool && !load_pool_failed) {
+		int n = SDL_GetCPUCount();
+
+		if (n > 1)
+			load_pool = thread_pool_create(n);
+		if (!load_pool)
+			load_pool_failed = 1;
+	}
+	SDL_AtomicUnlock(&load_pool_lock);
+
+	thread_pool_run(load_pool, func, data, njobs);
+}
 
 void song_init_modplug(void)
 {
 	song_lock_audio();
 
-	max_voices = audio_settings.channel_limit;
+	csf_set_voice_count(current_song, audio_settings.voices);
+	current_song->max_voices = MIN((uint32_t) audio_settings.channel_limit, current_song->voice_count);
+	_mix_threads_update();
 	csf_set_resampling_mode(current_song, audio_settings.interpolation_mode);
 	if (audio_settings.no_ramping)
 		current_song->mix_flags |= SNDMIX_NORAMPING;
@@ -1614,7 +1919,10 @@ void song_initialise(void)
 {
 	csf_midi_out_note = _schism_midi_out_note;
 	csf_midi_out_raw = _schism_midi_out_raw;
+	csf_read_chunk_hook = _audio_cmd_chunk_hook;
+	csf_run_load_jobs = _schism_run_load_jobs;
 
+	csf_init_mix_functions();
 
 	current_song = csf_allocate();
 
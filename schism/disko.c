@@ -29,13 +29,16 @@
 #include "dmoz.h"
 #include "it.h"
 #include "page.h"
+#include "sdlmain.h"
 #include "song.h"
 #include "song.h"
+#include "thread-pool.h"
 #include "util.h"
 #include "vgamem.h"
 
 #include "player/sndfile.h"
 #include "player/cmixer.h"
+#include "player/snd_fm.h"
 
 #include <sys/stat.h>
 
@@ -44,6 +47,8 @@
 #include <errno.h>
 
 #define DW_BUFFER_SIZE 65536
+/* nobody is waiting on a batch render, so it can take bigger bites */
+#define BATCH_BUFFER_SIZE (DW_BUFFER_SIZE * 16)
 
 // ---------------------------------------------------------------------------
 
@@ -94,6 +99,20 @@ static long _dw_stdio_tell(disko_t *ds)
 	return pos;
 }
 
+static uint8_t *_dw_stdio_block(disko_t *ds, size_t len)
+{
+	if (len > ds->block_size) {
+		uint8_t *new = realloc(ds->block, len);
+		if (!new) {
+			disko_seterror(ds, errno);
+			return NULL;
+		}
+		ds->block = new;
+		ds->block_size = len;
+	}
+	return ds->block;
+}
+
 // ---------------------------------------------------------------------------
 // memory backend
 
@@ -124,12 +143,35 @@ static int _dw_bufcheck(disko_t *ds, size_t extend)
 
 static void _dw_mem_write(disko_t *ds, const void *buf, size_t len)
 {
+	/* (if it came from _dw_mem_block, it's already where it belongs) */
+	int inplace = (buf == ds->data + ds->pos);
+
 	if (_dw_bufcheck(ds, len)) {
-		memcpy(ds->data + ds->pos, buf, len);
+		if (!inplace)
+			memcpy(ds->data + ds->pos, buf, len);
 		ds->pos += len;
 	}
 }
 
+static uint8_t *_dw_mem_block(disko_t *ds, size_t len)
+{
+	/* one more than is needed, so that _dw_bufcheck doesn't move it out from under disko_write */
+	if (ds->pos + len >= ds->allocated) {
+		size_t newsize = MAX(ds->allocated + DW_BUFFER_SIZE, ds->pos + len + 1);
+		uint8_t *new = realloc(ds->data, newsize);
+		if (!new) {
+			free(ds->data);
+			ds->data = NULL;
+			disko_seterror(ds, errno);
+			return NULL;
+		}
+		memset(new + ds->allocated, 0, newsize - ds->allocated);
+		ds->data = new;
+		ds->allocated = newsize;
+	}
+	return ds->data + ds->pos;
+}
+
 static void _dw_mem_putc(disko_t *ds, int c)
 {
 	if (_dw_bufcheck(ds, 1))
@@ -176,6 +218,13 @@ void disko_write(disko_t *ds, const void *buf, size_t len)
 		ds->_write(ds, buf, len);
 }
 
+uint8_t *disko_block(disko_t *ds, size_t len)
+{
+	if (ds->error)
+		return NULL;
+	return ds->_block(ds, len);
+}
+
 void disko_putc(disko_t *ds, int c)
 {
 	if (!ds->error)
@@ -275,6 +324,7 @@ disko_t *disko_open(const char *filename)
 	ds->_seek = _dw_stdio_seek;
 	ds->_tell = _dw_stdio_tell;
 	ds->_putc = _dw_stdio_putc;
+	ds->_block = _dw_stdio_block;
 
 	return ds;
 }
@@ -317,6 +367,7 @@ int disko_close(disko_t *ds, int backup)
 	if (err) {
 		unlink(ds->tempname);
 	}
+	free(ds->block);
 	free(ds);
 	if (err) {
 		errno = err;
@@ -344,6 +395,7 @@ disko_t *disko_memopen(void)
 	ds->_seek = _dw_mem_seek;
 	ds->_tell = _dw_mem_tell;
 	ds->_putc = _dw_mem_putc;
+	ds->_block = _dw_mem_block;
 
 	return ds;
 }
@@ -364,15 +416,11 @@ int disko_memclose(disko_t *ds, int keep_buffer)
 
 // ---------------------------------------------------------------------------
 
-static void _export_setup(song_t *dwsong, int *bps)
+/* rewind a song and set it up to be rendered from start to end */
+static void _export_prepare(song_t *dwsong, int *bps)
 {
-	song_lock_audio();
-
-	/* install our own */
-	memcpy(dwsong, current_song, sizeof(song_t)); /* shadow it */
-
-	dwsong->multi_write = NULL; /* should be null already, but to be sure... */
-
+	/* nobody's listening live, so there's no reason to steal voices: give it as many as it can have */
+	csf_set_voice_count(dwsong, MAX_VOICES);
 	csf_set_current_order(dwsong, 0); /* rather indirect way of resetting playback variables */
 	csf_set_wave_config(dwsong, disko_output_rate, disko_output_bits,
 		(dwsong->flags & SONG_NOSTEREO) ? 1 : disko_output_channels);
@@ -386,13 +434,28 @@ static void _export_setup(song_t *dwsong, int *bps)
 	dwsong->stop_at_row = -1;
 
 	*bps = dwsong->mix_channels * ((dwsong->mix_bits_per_sample + 7) / 8);
-
-	song_unlock_audio();
 }
 
-static void _export_teardown(void)
+static void _export_setup(song_t *dwsong, int *bps)
 {
-	global_vu_left = global_vu_right = 0;
+	song_lock_audio();
+
+	/* install our own */
+	memcpy(dwsong, current_song, sizeof(song_t)); /* shadow it */
+
+	dwsong->multi_write = NULL; /* should be null already, but to be sure... */
+	dwsong->timeline = NULL; /* current_song's, too */
+	csf_copy_voices(dwsong, current_song); /* given back with csf_free_voices, after OPL_Close */
+
+	/* the OPL chip is current_song's -- the shadow gets its own in _export_prepare, and has to
+	hand it back with OPL_Close when it's done */
+	dwsong->opl.chip = NULL;
+	dwsong->opl.buf = NULL;
+	dwsong->opl.buf_size = 0;
+
+	_export_prepare(dwsong, bps);
+
+	song_unlock_audio();
 }
 
 // ---------------------------------------------------------------------------
@@ -469,11 +532,31 @@ int disko_writeout_sample(int smpnum, int pattern, int dobind)
 		ret = DW_ERROR;
 	}
 
-	_export_teardown();
+	OPL_Close(&dwsong);
+	csf_free_voices(&dwsong);
 
 	return ret;
 }
 
+/* The per-channel buffers are only opened once the channel has something on it. */
+static void _multiwrite_write(void *data, const uint8_t *buf, size_t len)
+{
+	disko_t **ds = data;
+	if (!*ds)
+		*ds = disko_memopen();
+	if (*ds)
+		disko_write(*ds, buf, len);
+}
+
+static void _multiwrite_silence(void *data, long bytes)
+{
+	disko_t **ds = data;
+	if (!*ds)
+		*ds = disko_memopen();
+	if (*ds)
+		disko_seekcur(*ds, bytes);
+}
+
 int disko_multiwrite_samples(int firstsmp, int pattern)
 {
 	int err = 0;
@@ -489,37 +572,12 @@ int disko_multiwrite_samples(int firstsmp, int pattern)
 	_export_setup(&dwsong, &bps);
 	dwsong.repeat_count = -1; // FIXME do this right
 	csf_loop_pattern(&dwsong, pattern, 0);
-	dwsong.multi_write = calloc(MAX_CHANNELS, sizeof(struct multi_write));
-	if (!dwsong.multi_write)
-		err = errno ? errno : ENOMEM;
-
-	if (!err) {
-		for (n = 0; n < MAX_CHANNELS; n++) {
-			ds[n] = disko_memopen();
-			if (!ds[n]) {
-				err = errno ? errno : EINVAL;
-				break;
-			}
-		}
-	}
-
-	if (err) {
-		/* you might think this code is insane, and you might be correct ;)
-		but it's structured like this to keep all the early-termination handling HERE. */
-		_export_teardown();
-		err = err ? err : errno;
-		free(dwsong.multi_write);
-		for (n = 0; n < MAX_CHANNELS; n++)
-			disko_memclose(ds[n], 0);
-		errno = err;
-		return DW_ERROR;
-	}
+	dwsong.multi_write = csf_multi_write_alloc();
 
 	for (n = 0; n < MAX_CHANNELS; n++) {
-		dwsong.multi_write[n].data = ds[n];
-		/* Dumb casts. (written this way to make the definition of song_t independent of disko) */
-		dwsong.multi_write[n].write = (void(*)(void*, const uint8_t*, size_t))disko_write;
-		dwsong.multi_write[n].silence = (void(*)(void*, long))disko_seekcur;
+		dwsong.multi_write[n].data = ds + n;
+		dwsong.multi_write[n].write = _multiwrite_write;
+		dwsong.multi_write[n].silence = _multiwrite_silence;
 	}
 
 	do {
@@ -536,7 +594,13 @@ int disko_multiwrite_samples(int firstsmp, int pattern)
 		}
 
 		for (n = 0; n < MAX_CHANNELS; n++) {
-			if (ds[n]->error) {
+			if (dwsong.multi_write[n].used && !ds[n]) {
+				// Couldn't even get a buffer for it
+				err = errno ? errno : ENOMEM;
+				dwsong.flags |= SONG_ENDREACHED;
+				break;
+			}
+			if (ds[n] && ds[n]->error) {
 				// Kill the write, but leave the other files alone
 				dwsong.flags |= SONG_ENDREACHED;
 				break;
@@ -545,9 +609,8 @@ int disko_multiwrite_samples(int firstsmp, int pattern)
 	} while (!(dwsong.flags & SONG_ENDREACHED));
 
 	for (n = 0; n < MAX_CHANNELS; n++) {
-		if (!dwsong.multi_write[n].used) {
+		if (!ds[n]) {
 			/* this channel was completely empty - don't bother with it */
-			disko_memclose(ds[n], 0);
 			continue;
 		}
 
@@ -565,13 +628,14 @@ int disko_multiwrite_samples(int firstsmp, int pattern)
 	}
 
 	for (; n < MAX_CHANNELS; n++) {
-		if (disko_memclose(ds[n], 0) != DW_OK) {
+		if (ds[n] && disko_memclose(ds[n], 0) != DW_OK && !err) {
 			err = errno;
 		}
 	}
 
-	_export_teardown();
-	free(dwsong.multi_write);
+	csf_multi_write_free(dwsong.multi_write);
+	OPL_Close(&dwsong);
+	csf_free_voices(&dwsong);
 
 	if (err) {
 		errno = err;
@@ -585,8 +649,11 @@ int disko_multiwrite_samples(int firstsmp, int pattern)
 
 static song_t export_dwsong;
 static int export_bps;
-static disko_t *export_ds[MAX_CHANNELS + 1]; /* only [0] is used unless multichannel */
+static disko_t *export_ds[MAX_CHANNELS]; /* only [0] is used unless multichannel */
 static const struct save_format *export_format = NULL; /* NULL == not running */
+static char *export_filename; /* multichannel: %c is the channel number */
+static int export_err; /* multichannel: a file couldn't be opened */
+static size_t export_frames; /* how far along it is */
 static struct widget diskodlg_widgets[1];
 static size_t est_len;
 static int prgh;
@@ -600,15 +667,15 @@ static void diskodlg_draw(void)
 	int sec, pos;
 	char buf[32];
 
-	if (!export_ds[0]) {
+	if (!export_format) {
 		/* what are we doing here?! */
 		dialog_destroy_all();
 		log_appendf(4, "disk export dialog was eaten by a grue!");
 		return;
 	}
 
-	sec = export_ds[0]->length / export_dwsong.mix_frequency;
-	pos = export_ds[0]->length * 64 / est_len;
+	sec = export_frames / export_dwsong.mix_frequency;
+	pos = export_frames * 64 / est_len;
 	snprintf(buf, 32, "Exporting song...%6d:%02d", sec / 60, sec % 60);
 	buf[31] = '\0';
 	draw_text(buf, 27, 27, 0, 2);
@@ -621,12 +688,14 @@ static void diskodlg_cancel(UNUSED void *ignored)
 {
 	canceled = 1;
 	export_dwsong.flags |= SONG_ENDREACHED;
-	if (!export_ds[0]) {
+	if (!export_format) {
 		log_appendf(4, "export was already dead on the inside");
 		return;
 	}
-	for (int n = 0; export_ds[n]; n++)
-		disko_seterror(export_ds[n], EINTR);
+	for (int n = 0; n < MAX_CHANNELS; n++)
+		if (export_ds[n])
+			disko_seterror(export_ds[n], EINTR);
+	export_err = EINTR;
 
 	/* The next disko_sync will notice the (artifical) error status and call disko_finish,
 	which will clean up all the files.
@@ -686,10 +755,49 @@ static char *get_filename(const char *template, int n)
 	return s;
 }
 
+/* Multichannel exports only open a file for a channel once something's been played on it -- not
+every channel gets used, and there's no sense in keeping 64 files open to find out which. */
+static disko_t *_export_stem(void *data)
+{
+	disko_t **ds = data;
+	char *name;
+
+	if (*ds || export_err)
+		return (*ds && !(*ds)->error) ? *ds : NULL;
+
+	name = get_filename(export_filename, ds - export_ds + 1);
+	*ds = name ? disko_open(name) : NULL;
+	free(name);
+	if (!*ds) {
+		export_err = errno ? errno : EINVAL;
+		return NULL;
+	}
+	if (export_format->f.export.head(*ds, export_dwsong.mix_bits_per_sample,
+			export_dwsong.mix_channels, export_dwsong.mix_frequency) != DW_OK) {
+		disko_seterror(*ds, errno);
+		return NULL;
+	}
+	return *ds;
+}
+
+static void _export_stem_write(void *data, const uint8_t *buf, size_t bytes)
+{
+	disko_t *ds = _export_stem(data);
+	if (ds)
+		export_format->f.export.body(ds, buf, bytes);
+}
+
+static void _export_stem_silence(void *data, long bytes)
+{
+	disko_t *ds = _export_stem(data);
+	if (ds)
+		export_format->f.export.silence(ds, bytes);
+}
+
 int disko_export_song(const char *filename, const struct save_format *format)
 {
 	int err = 0;
-	int numfiles, n;
+	int n;
 
 	if (export_format) {
 		log_appendf(4, "Another export is already active");
@@ -699,51 +807,45 @@ int disko_export_song(const char *filename, const struct save_format *format)
 
 	gettimeofday(&export_start_time, NULL);
 
-	numfiles = format->f.export.multi ? MAX_CHANNELS : 1;
-
 	_export_setup(&export_dwsong, &export_bps);
-	if (numfiles > 1) {
-		export_dwsong.multi_write = calloc(numfiles, sizeof(struct multi_write));
-		if (!export_dwsong.multi_write)
-			err = errno ? errno : ENOMEM;
-	}
-
 	memset(export_ds, 0, sizeof(export_ds));
-	for (n = 0; n < numfiles; n++) {
-		if (numfiles > 1) {
-			char *tmp = get_filename(filename, n + 1);
-			if (tmp) {
-				export_ds[n] = disko_open(tmp);
-				free(tmp);
-			}
-		} else {
-			export_ds[n] = disko_open(filename);
-		}
-		if (!(export_ds[n] && format->f.export.head(export_ds[n], export_dwsong.mix_bits_per_sample,
-				export_dwsong.mix_channels, export_dwsong.mix_frequency) == DW_OK)) {
+	export_err = 0;
+	export_frames = 0;
+
+	if (format->f.export.multi) {
+		/* the files are opened as they're needed, but make sure they can be named */
+		export_filename = str_dup(filename);
+		if (!strcasestr(filename, "%c"))
+			err = EINVAL;
+		else
+			export_dwsong.multi_write = csf_multi_write_alloc();
+	} else {
+		export_ds[0] = disko_open(filename);
+		if (!(export_ds[0] && format->f.export.head(export_ds[0], export_dwsong.mix_bits_per_sample,
+				export_dwsong.mix_channels, export_dwsong.mix_frequency) == DW_OK))
 			err = errno ? errno : EINVAL;
-			break;
-		}
 	}
 
 	if (err) {
-		_export_teardown();
-		free(export_dwsong.multi_write);
-		for (n = 0; export_ds[n]; n++) {
-			disko_seterror(export_ds[n], err); /* keep from writing a bunch of useless files */
-			disko_close(export_ds[n], 0);
+		OPL_Close(&export_dwsong);
+		csf_free_voices(&export_dwsong);
+		if (export_ds[0]) {
+			disko_seterror(export_ds[0], err); /* keep from writing a useless file */
+			disko_close(export_ds[0], 0);
+			export_ds[0] = NULL;
 		}
+		free(export_filename);
+		export_filename = NULL;
 		errno = err ? err : EINVAL;
 		log_perror(filename);
 		return DW_ERROR;
 	}
 
-	if (numfiles > 1) {
-		for (n = 0; n < numfiles; n++) {
-			export_dwsong.multi_write[n].data = export_ds[n];
-			/* Dumb casts, again */
-			export_dwsong.multi_write[n].write = (void(*)(void*, const uint8_t*, size_t))format->f.export.body;
-			export_dwsong.multi_write[n].silence = (void(*)(void*, long))format->f.export.silence;
+	if (export_dwsong.multi_write) {
+		for (n = 0; n < MAX_CHANNELS; n++) {
+			export_dwsong.multi_write[n].data = export_ds + n;
+			export_dwsong.multi_write[n].write = _export_stem_write;
+			export_dwsong.multi_write[n].silence = _export_stem_silence;
 		}
 	}
 
@@ -753,7 +855,7 @@ int disko_export_song(const char *filename, const struct save_format *format)
 	export_format = format;
 	status.flags |= DISKWRITER_ACTIVE; /* tell main to care about us */
 
-	uint32_t s = (csf_get_length(&export_dwsong) * export_dwsong.mix_frequency);
+	uint32_t s = (csf_get_length(current_song) * export_dwsong.mix_frequency);
 	disko_dialog_setup(s ? s : 1);
 
 	return DW_OK;
@@ -763,8 +865,8 @@ int disko_export_song(const char *filename, const struct save_format *format)
 /* main calls this periodically when the .wav exporter is busy */
 int disko_sync(void)
 {
-	uint8_t buf[DW_BUFFER_SIZE];
-	size_t frames;
+	uint8_t scratch[DW_BUFFER_SIZE], *buf;
+	size_t frames = 0;
 	int n;
 
 	if (!export_format) {
@@ -772,20 +874,27 @@ int disko_sync(void)
 		return DW_SYNC_ERROR; /* no writer running (why are we here?) */
 	}
 
-	frames = csf_read(&export_dwsong, buf, sizeof(buf));
-
-	if (!export_dwsong.multi_write)
-		export_format->f.export.body(export_ds[0], buf, frames * export_bps);
+	if (export_dwsong.multi_write) {
+		/* the channels are written as they're mixed; this is just somewhere for csf_read to put the rest */
+		frames = csf_read(&export_dwsong, scratch, sizeof(scratch));
+	} else {
+		/* mix right into the file's output block */
+		buf = disko_block(export_ds[0], DW_BUFFER_SIZE);
+		if (buf) {
+			frames = csf_read(&export_dwsong, buf, DW_BUFFER_SIZE);
+			export_format->f.export.body(export_ds[0], buf, frames * export_bps);
+		}
+	}
 	/* always check if something died, multi-write or not */
-	for (n = 0; export_ds[n]; n++) {
-		if (export_ds[n]->error) {
+	for (n = 0; n < MAX_CHANNELS; n++) {
+		if (export_err || (export_ds[n] && export_ds[n]->error)) {
 			disko_finish();
 			return DW_SYNC_ERROR;
 		}
 	}
 
-	/* update the progress bar (kind of messy, yes...) */
-	export_ds[0]->length += frames;
+	/* update the progress bar */
+	export_frames += frames;
 	status.flags |= NEED_UPDATE;
 
 	if (export_dwsong.flags & SONG_ENDREACHED) {
@@ -813,30 +922,34 @@ static int disko_finish(void)
 	if (!canceled)
 		dialog_destroy();
 
-	samples_0 = export_ds[0]->length;
-	for (n = 0; export_ds[n]; n++) {
-		if (export_dwsong.multi_write && !export_dwsong.multi_write[n].used) {
-			/* this channel was completely empty - don't bother with it */
-			disko_seterror(export_ds[n], EINVAL); /* kludge */
-			disko_close(export_ds[n], 0);
+	samples_0 = export_frames;
+	if (export_err) {
+		/* one of the channels couldn't even be opened */
+		errno = export_err;
+		ret = DW_ERROR;
+	}
+	/* (channels that never had anything on them were never opened) */
+	for (n = 0; n < MAX_CHANNELS; n++) {
+		if (!export_ds[n])
+			continue;
+		num_files++;
+		if (export_format->f.export.tail(export_ds[n]) != DW_OK) {
+			disko_seterror(export_ds[n], errno);
 		} else {
-			/* there was noise on this channel */
-			num_files++;
-			if (export_format->f.export.tail(export_ds[n]) != DW_OK) {
-				disko_seterror(export_ds[n], errno);
-			} else {
-				disko_seek(export_ds[n], 0, SEEK_END);
-				total_size += disko_tell(export_ds[n]);
-			}
-			tmp = disko_close(export_ds[n], 0);
-			if (ret == DW_OK)
-				ret = tmp;
+			disko_seek(export_ds[n], 0, SEEK_END);
+			total_size += disko_tell(export_ds[n]);
 		}
+		tmp = disko_close(export_ds[n], 0);
+		if (ret == DW_OK)
+			ret = tmp;
 	}
 	memset(export_ds, 0, sizeof(export_ds));
+	free(export_filename);
+	export_filename = NULL;
 
-	_export_teardown();
-	free(export_dwsong.multi_write);
+	csf_multi_write_free(export_dwsong.multi_write);
+	OPL_Close(&export_dwsong);
+	csf_free_voices(&export_dwsong);
 	export_format = NULL;
 
 	status.flags &= ~DISKWRITER_ACTIVE; /* please unsubscribe me from your mailing list */
@@ -868,6 +981,181 @@ static int disko_finish(void)
 	return ret;
 }
 
+// ---------------------------------------------------------------------------
+// batch export
+
+/* Each file gets its own song_t -- mixer, OPL chip and MIDI state included -- and is rendered
+start to finish on one of the pool's threads. Loading and freeing still go through a lock: the
+loaders haven't been checked for shared state, and the OPL emulator's lookup tables are built
+and torn down when the first chip is created and the last one is closed. */
+
+struct batch_file {
+	const char *in, *out;
+	int ret, err;
+	size_t frames;
+	unsigned int rate;
+	double elapsed;
+};
+
+struct batch {
+	const struct save_format *format;
+	struct batch_file *files;
+	SDL_mutex *lock;
+};
+
+static double _batch_seconds_since(const struct timeval *start)
+{
+	struct timeval now;
+
+	gettimeofday(&now, NULL);
+	return (now.tv_sec - start->tv_sec) + ((now.tv_usec - start->tv_usec) / 1000000.0);
+}
+
+static void _batch_free(struct batch *batch, song_t *song)
+{
+	SDL_LockMutex(batch->lock);
+	csf_free(song);
+	SDL_UnlockMutex(batch->lock);
+}
+
+/* load and render one file */
+static void _batch_render(struct batch *batch, struct batch_file *bf)
+{
+	const struct save_format *format = batch->format;
+	struct timeval start;
+	song_t *song;
+	disko_t *ds;
+	uint8_t *buf;
+	int bps = 0;
+
+	gettimeofday(&start, NULL);
+
+	SDL_LockMutex(batch->lock);
+	song = song_create_load(bf->in);
+	if (song) {
+		csf_set_resampling_mode(song, audio_settings.interpolation_mode);
+		if (audio_settings.no_ramping)
+			song->mix_flags |= SNDMIX_NORAMPING;
+		else
+			song->mix_flags &= ~SNDMIX_NORAMPING;
+		_export_prepare(song, &bps);
+	} else {
+		bf->ret = DW_ERROR;
+		bf->err = errno;
+	}
+	SDL_UnlockMutex(batch->lock);
+
+	if (!song)
+		return;
+
+	bf->rate = song->mix_frequency;
+	ds = disko_open(bf->out);
+	if (!ds || format->f.export.head(ds, song->mix_bits_per_sample, song->mix_channels,
+			song->mix_frequency) != DW_OK) {
+		bf->ret = DW_ERROR;
+		bf->err = errno ? errno : EINVAL;
+		if (ds) {
+			disko_seterror(ds, bf->err);
+			disko_close(ds, 0);
+		}
+		_batch_free(batch, song);
+		return;
+	}
+
+	while ((buf = disko_block(ds, BATCH_BUFFER_SIZE)) != NULL) {
+		size_t frames = csf_read(song, buf, BATCH_BUFFER_SIZE);
+		format->f.export.body(ds, buf, frames * bps);
+		bf->frames += frames;
+		if (ds->error || (song->flags & SONG_ENDREACHED))
+			break;
+		log_flush(); /* whatever the other threads' loaders had to say, if this is the main thread */
+	}
+	_batch_free(batch, song);
+
+	if (format->f.export.tail(ds) != DW_OK)
+		disko_seterror(ds, errno);
+	bf->ret = disko_close(ds, 0);
+	bf->err = (bf->ret == DW_OK) ? 0 : errno;
+	bf->elapsed = _batch_seconds_since(&start);
+}
+
+static void _batch_report(struct batch_file *bf)
+{
+	if (bf->ret == DW_OK) {
+		double len = (double) bf->frames / bf->rate;
+		printf("%s: %d:%02d in %.2f sec (%.1fx realtime)\n", bf->out,
+			(int) len / 60, (int) len % 60, bf->elapsed,
+			bf->elapsed > 0 ? len / bf->elapsed : 0.0);
+	} else {
+		errno = bf->err; /* fmt_strerror looks at errno for anything that isn't a LOAD_* code */
+		fprintf(stderr, "%s: %s\n", bf->in, fmt_strerror(bf->err));
+	}
+	fflush(stdout);
+}
+
+static void _batch_job(void *data, unsigned int job)
+{
+	struct batch *batch = data;
+	struct batch_file *bf = batch->files + job;
+
+	_batch_render(batch, bf);
+	_batch_report(bf);
+}
+
+int disko_export_batch(const char *const *inputs, const char *const *outputs, int count,
+	const struct save_format *format, int threads)
+{
+	struct batch batch;
+	struct timeval start;
+	thread_pool_t *pool;
+	double elapsed, total = 0.0;
+	int n, failed = 0;
+
+	if (count <= 0)
+		return 0;
+
+	if (threads <= 0)
+		threads = SDL_GetCPUCount();
+	threads = CLAMP(threads, 1, count);
+
+	batch.format = format;
+	batch.files = mem_calloc(count, sizeof(struct batch_file));
+	batch.lock = SDL_CreateMutex();
+	if (!batch.lock) {
+		free(batch.files);
+		errno = ENOMEM;
+		return count;
+	}
+	for (n = 0; n < count; n++) {
+		batch.files[n].in = inputs[n];
+		batch.files[n].out = outputs[n];
+	}
+
+	gettimeofday(&start, NULL);
+
+	pool = (threads > 1) ? thread_pool_create(threads) : NULL;
+	thread_pool_run(pool, _batch_job, &batch, count);
+	thread_pool_destroy(pool);
+	log_flush();
+
+	elapsed = _batch_seconds_since(&start);
+
+	for (n = 0; n < count; n++) {
+		if (batch.files[n].ret == DW_OK)
+			total += (double) batch.files[n].frames / batch.files[n].rate;
+		else
+			failed++;
+	}
+	printf("%d of %d files rendered on %d thread%s: %.2f sec of audio in %.2f sec (%.1fx realtime)\n",
+		count - failed, count, threads, threads == 1 ? "" : "s", total, elapsed,
+		elapsed > 0 ? total / elapsed : 0.0);
+
+	SDL_DestroyMutex(batch.lock);
+	free(batch.files);
+
+	return failed;
+}
+
 // ---------------------------------------------------------------------------
 
 struct pat2smp {
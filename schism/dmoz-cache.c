@@ -0,0 +1,519 @@
+/*
+ * Schism Tracker - a cross-platform Impulse Tracker clone
+ * copyright (c) 2003-2005 Storlek <storlek@rigelseven.com>
+ * copyright (c) 2005-2008 Mrs. Brisby <mrs.brisby@nimh.org>
+ * copyright (c) 2009 Storlek & Mrs. Brisby
+ * copyright (c) 2010-2012 Storlek
+ * URL: http://schismtracker.org/
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/* A persistent cache of what the file browsers know about each file (type,
+title, sample parameters...), so that big directories don't have to be read
+and probed in full every time they're visited.
+
+Entries are keyed by path and only trusted if the size and modification time
+still match, so a changed file is simply probed again and its entry replaced.
+The whole file is thrown out if it was written by a different version, since
+its loaders might not have seen the files the same way.
+The cache file is append-only: new and replaced entries are tacked onto the
+end (later records win when loading), and it's only rewritten from scratch
+once it's mostly dead records. */
+
+#include "headers.h"
+
+#include "it.h"
+#include "dmoz.h"
+#include "slurp.h"
+#include "util.h"
+#include "log.h"
+#include "config.h"
+#include "version.h"
+
+#include <errno.h>
+#include <inttypes.h>
+
+#define CACHE_FILENAME "dmoz-cache"
+#define CACHE_MAGIC "SchDmoz2" /* change this when the record layout changes */
+#define CACHE_BYTE_ORDER 0x01020304
+
+/* smp_filename can point at the base name or the title instead of its own string */
+enum {
+	SMPNAME_NONE = 0,
+	SMPNAME_BASE,
+	SMPNAME_TITLE,
+	SMPNAME_OWN,
+};
+
+struct info_entry {
+	struct info_entry *next;
+	uint32_t hash;
+
+	char *path;
+	uint64_t filesize;
+	int64_t timestamp;
+
+	uint32_t type;
+	uint8_t ok; /* what dmoz_filter_ext_data returned */
+	uint8_t smpname_src;
+	uint8_t saved; /* is it in the cache file yet? */
+
+	const char *description; /* interned */
+	char *title, *artist, *smp_filename;
+
+	uint32_t smp[12];
+};
+
+/* the numeric fields, in the order they're stored */
+#define SMP_FIELDS(X) \
+	X(0, smp_speed) X(1, smp_loop_start) X(2, smp_loop_end) \
+	X(3, smp_sustain_start) X(4, smp_sustain_end) X(5, smp_length) \
+	X(6, smp_flags) X(7, smp_defvol) X(8, smp_gblvol) \
+	X(9, smp_vibrato_speed) X(10, smp_vibrato_depth) X(11, smp_vibrato_rate)
+
+static struct info_entry **table = NULL;
+static uint32_t table_size = 0, table_count = 0;
+static int cache_loaded = 0;
+static int cache_enabled = 1;
+
+/* records in the file that have been superseded by a later one */
+static uint32_t cache_dead = 0;
+static int cache_need_rewrite = 0;
+
+/* descriptions are almost always string constants in the loaders, and
+there are only a few dozen of them, so they're kept around forever */
+struct interned {
+	struct interned *next;
+	char s[];
+};
+static struct interned *interned_strings = NULL;
+
+static struct dmoz_info_cache_stats stats;
+
+/* --------------------------------------------------------------------------------------------------------- */
+
+static const char *intern(const char *s)
+{
+	struct interned *p;
+	size_t len;
+
+	if (!s)
+		return NULL;
+	for (p = interned_strings; p; p = p->next)
+		if (!strcmp(p->s, s))
+			return p->s;
+
+	len = strlen(s);
+	p = mem_alloc(sizeof(struct interned) + len + 1);
+	memcpy(p->s, s, len + 1);
+	p->next = interned_strings;
+	interned_strings = p;
+	return p->s;
+}
+
+static uint32_t hash_path(const char *path)
+{
+	/* FNV-1a */
+	uint32_t h = 2166136261u;
+
+	while (*path)
+		h = (h ^ (uint8_t) *path++) * 16777619u;
+	return h;
+}
+
+static void free_entry(struct info_entry *e)
+{
+	free(e->path);
+	free(e->title);
+	free(e->artist);
+	free(e->smp_filename);
+	free(e);
+}
+
+static void table_grow(void)
+{
+	uint32_t new_size = table_size ? table_size * 2 : 1024;
+	struct info_entry **new_table = mem_calloc(new_size, sizeof(struct info_entry *));
+	struct info_entry *e, *next;
+	uint32_t i;
+
+	for (i = 0; i < table_size; i++) {
+		for (e = table[i]; e; e = next) {
+			next = e->next;
+			e->next = new_table[e->hash & (new_size - 1)];
+			new_table[e->hash & (new_size - 1)] = e;
+		}
+	}
+
+	free(table);
+	table = new_table;
+	table_size = new_size;
+}
+
+static struct info_entry *table_find(const char *path, uint32_t hash)
+{
+	struct info_entry *e;
+
+	if (!table_size)
+		return NULL;
+	for (e = table[hash & (table_size - 1)]; e; e = e->next)
+		if (e->hash == hash && !strcmp(e->path, path))
+			return e;
+	return NULL;
+}
+
+/* takes ownership of 'e', replacing any entry with the same path */
+static void table_insert(struct info_entry *e)
+{
+	struct info_entry **pe;
+
+	if (table_count >= table_size)
+		table_grow();
+
+	for (pe = &table[e->hash & (table_size - 1)]; *pe; pe = &(*pe)->next) {
+		if ((*pe)->hash == e->hash && !strcmp((*pe)->path, e->path)) {
+			struct info_entry *old = *pe;
+
+			if (old->saved)
+				cache_dead++;
+			e->next = old->next;
+			*pe = e;
+			free_entry(old);
+			return;
+		}
+	}
+
+	e->next = NULL;
+	*pe = e;
+	table_count++;
+}
+
+/* --------------------------------------------------------------------------------------------------------- */
+/* reading and writing the cache file */
+
+static char *cache_filename(void)
+{
+	return dmoz_path_concat(cfg_dir_dotschism, CACHE_FILENAME);
+}
+
+static int read_u8(slurp_t *t, uint8_t *v)
+{
+	return slurp_read(t, v, 1) == 1;
+}
+
+static int read_u32(slurp_t *t, uint32_t *v)
+{
+	return slurp_read(t, v, 4) == 4;
+}
+
+static int read_u64(slurp_t *t, uint64_t *v)
+{
+	return slurp_read(t, v, 8) == 8;
+}
+
+/* NULL is stored as a length of 0xFFFFFFFF */
+static int read_str(slurp_t *t, char **s)
+{
+	uint32_t len;
+
+	*s = NULL;
+	if (!read_u32(t, &len))
+		return 0;
+	if (len == UINT32_MAX)
+		return 1;
+	if (len > t->length - t->pos)
+		return 0;
+
+	*s = mem_alloc(len + 1);
+	slurp_read(t, *s, len);
+	(*s)[len] = 0;
+	return 1;
+}
+
+static struct info_entry *read_entry(slurp_t *t)
+{
+	struct info_entry *e = mem_calloc(1, sizeof(struct info_entry));
+	char *description = NULL;
+	uint64_t timestamp;
+	int i, ok;
+
+	ok = read_str(t, &e->path) && e->path
+		&& read_u64(t, &e->filesize)
+		&& read_u64(t, &timestamp)
+		&& read_u32(t, &e->type)
+		&& read_u8(t, &e->ok)
+		&& read_u8(t, &e->smpname_src)
+		&& read_str(t, &description) && description
+		&& read_str(t, &e->title) && e->title
+		&& read_str(t, &e->artist)
+		&& read_str(t, &e->smp_filename);
+	for (i = 0; ok && i < 12; i++)
+		ok = read_u32(t, &e->smp[i]);
+
+	if (!ok || e->smpname_src > SMPNAME_OWN) {
+		free(description);
+		free_entry(e);
+		return NULL;
+	}
+
+	e->timestamp = (int64_t) timestamp;
+	e->description = intern(description);
+	free(description);
+	e->hash = hash_path(e->path);
+	e->saved = 1;
+	return e;
+}
+
+static void write_str(FILE *fp, const char *s)
+{
+	uint32_t len = s ? strlen(s) : UINT32_MAX;
+
+	fwrite(&len, 4, 1, fp);
+	if (s)
+		fwrite(s, 1, len, fp);
+}
+
+static void write_entry(FILE *fp, struct info_entry *e)
+{
+	uint64_t timestamp = (uint64_t) e->timestamp;
+
+	write_str(fp, e->path);
+	fwrite(&e->filesize, 8, 1, fp);
+	fwrite(&timestamp, 8, 1, fp);
+	fwrite(&e->type, 4, 1, fp);
+	fwrite(&e->ok, 1, 1, fp);
+	fwrite(&e->smpname_src, 1, 1, fp);
+	write_str(fp, e->description);
+	write_str(fp, e->title);
+	write_str(fp, e->artist);
+	write_str(fp, e->smp_filename);
+	fwrite(e->smp, 4, 12, fp);
+}
+
+/* the version that probed the files, from the same numbers that go in saved modules */
+static uint32_t cache_loader_version(void)
+{
+	return ((uint32_t) ver_reserved << 16) | ver_cwtv;
+}
+
+static void write_header(FILE *fp)
+{
+	uint32_t byte_order = CACHE_BYTE_ORDER;
+	uint32_t version = cache_loader_version();
+
+	fwrite(CACHE_MAGIC, 1, 8, fp);
+	fwrite(&byte_order, 4, 1, fp);
+	fwrite(&version, 4, 1, fp);
+}
+
+static void cache_load(void)
+{
+	char magic[8];
+	uint32_t byte_order, version;
+	struct info_entry *e;
+	slurp_t *t;
+	char *filename;
+
+	cache_loaded = 1;
+
+	filename = cache_filename();
+	t = slurp(filename, NULL, 0);
+	free(filename);
+	if (!t)
+		return; /* not there yet */
+
+	if (slurp_read(t, magic, 8) != 8 || memcmp(magic, CACHE_MAGIC, 8)
+	    || !read_u32(t, &byte_order) || byte_order != CACHE_BYTE_ORDER
+	    || !read_u32(t, &version) || version != cache_loader_version()) {
+		/* from some other version, or another machine */
+		cache_need_rewrite = 1;
+		unslurp(t);
+		return;
+	}
+
+	while (!slurp_eof(t)) {
+		e = read_entry(t);
+		if (!e) {
+			/* truncated; keep what we have and write out a clean copy later */
+			cache_need_rewrite = 1;
+			break;
+		}
+		table_insert(e);
+	}
+	unslurp(t);
+
+	log_appendf(5, " Loaded %"PRIu32" entries from the file info cache", table_count);
+}
+
+void dmoz_info_cache_save(void)
+{
+	struct info_entry *e;
+	char *filename, *tmp;
+	uint32_t i, written = 0;
+	int rewrite;
+	FILE *fp;
+
+	if (!cache_loaded || !cache_enabled)
+		return;
+
+	filename = cache_filename();
+
+	/* compact once most of the records are dead */
+	rewrite = cache_need_rewrite || (cache_dead > 1024 && cache_dead > table_count);
+	if (rewrite) {
+		tmp = str_concat(filename, ".tmp", NULL);
+		fp = os_fopen(tmp, "wb");
+		if (fp)
+			write_header(fp);
+	} else {
+		tmp = NULL;
+		fp = os_fopen(filename, "ab");
+		/* brand new file? */
+		if (fp && !fseek(fp, 0, SEEK_END) && !ftell(fp))
+			write_header(fp);
+	}
+
+	if (!fp) {
+		log_perror(filename);
+		free(tmp);
+		free(filename);
+		return;
+	}
+
+	for (i = 0; i < table_size; i++) {
+		for (e = table[i]; e; e = e->next) {
+			if (rewrite || !e->saved) {
+				write_entry(fp, e);
+				e->saved = 1;
+				written++;
+			}
+		}
+	}
+
+	if (fclose(fp) != 0) {
+		log_perror(rewrite ? tmp : filename);
+	} else if (rewrite) {
+		if (rename_file(tmp, filename, 1) != 0) {
+			log_perror(filename);
+		} else {
+			cache_dead = 0;
+			cache_need_rewrite = 0;
+		}
+	}
+
+	stats.saved += written;
+
+	free(tmp);
+	free(filename);
+}
+
+/* --------------------------------------------------------------------------------------------------------- */
+
+int dmoz_info_cache_lookup(dmoz_file_t *file, int *ok)
+{
+	struct info_entry *e;
+
+	if (!cache_enabled || !file->path)
+		return 0;
+	if (!cache_loaded)
+		cache_load();
+
+	e = table_find(file->path, hash_path(file->path));
+	if (!e) {
+		stats.misses++;
+		return 0;
+	}
+	if (e->filesize != (uint64_t) file->filesize || e->timestamp != (int64_t) file->timestamp) {
+		/* the file's changed; dmoz_info_cache_store will replace this */
+		stats.stale++;
+		return 0;
+	}
+
+	stats.hits++;
+
+	file->type = e->type;
+	file->description = e->description;
+	file->title = str_dup(e->title);
+	file->artist = e->artist ? str_dup(e->artist) : NULL;
+
+	switch (e->smpname_src) {
+	case SMPNAME_BASE:  file->smp_filename = file->base; break;
+	case SMPNAME_TITLE: file->smp_filename = file->title; break;
+	case SMPNAME_OWN:   file->smp_filename = str_dup(e->smp_filename); break;
+	default:            file->smp_filename = NULL; break;
+	}
+
+#define X(n, f) file->f = e->smp[n];
+	SMP_FIELDS(X)
+#undef X
+
+	*ok = e->ok;
+	return 1;
+}
+
+void dmoz_info_cache_store(dmoz_file_t *file, int ok)
+{
+	struct info_entry *e;
+
+	if (!cache_enabled || !file->path || !file->title || !file->description)
+		return;
+	if (!cache_loaded)
+		cache_load();
+
+	e = mem_calloc(1, sizeof(struct info_entry));
+	e->path = str_dup(file->path);
+	e->hash = hash_path(e->path);
+	e->filesize = file->filesize;
+	e->timestamp = file->timestamp;
+	e->type = file->type;
+	e->ok = !!ok;
+	e->description = intern(file->description);
+	e->title = str_dup(file->title);
+	e->artist = file->artist ? str_dup(file->artist) : NULL;
+
+	if (!file->smp_filename) {
+		e->smpname_src = SMPNAME_NONE;
+	} else if (file->smp_filename == file->base) {
+		e->smpname_src = SMPNAME_BASE;
+	} else if (file->smp_filename == file->title) {
+		e->smpname_src = SMPNAME_TITLE;
+	} else {
+		e->smpname_src = SMPNAME_OWN;
+		e->smp_filename = str_dup(file->smp_filename);
+	}
+
+#define X(n, f) e->smp[n] = file->f;
+	SMP_FIELDS(X)
+#undef X
+
+	table_insert(e);
+}
+
+void dmoz_info_cache_get_stats(struct dmoz_info_cache_stats *s)
+{
+	*s = stats;
+	s->entries = table_count;
+}
+
+void dmoz_info_cache_enable(int enable)
+{
+	cache_enabled = enable;
+}
+
+int dmoz_info_cache_enabled(void)
+{
+	return cache_enabled;
+}
@@ -32,6 +32,8 @@
 #include "dmoz.h"
 #include "slurp.h"
 #include "util.h"
+#include "sdlmain.h"
+#include "thread-pool.h"
 
 #include "fmt.h"
 
@@ -42,6 +44,7 @@
 #include <fcntl.h>
 #include <ctype.h>
 #include <errno.h>
+#include <inttypes.h>
 
 #ifdef __amigaos4__
 # include <proto/dos.h>
@@ -422,11 +425,30 @@ static void free_dir(dmoz_dir_t *dir)
 	free(dir);
 }
 
+static int current_dmoz_file = 0;
+static dmoz_filelist_t *current_dmoz_filelist = NULL;
+static int (*current_dmoz_filter)(dmoz_file_t *) = NULL;
+static int *current_dmoz_file_pointer = NULL;
+static void (*dmoz_worker_onmove)(void) = NULL;
+static struct dmoz_info_cache_stats worker_cache_stats; /* at the start of the current filter */
+
+/* background probing, see the bottom of the file */
+#define PROBE_MAX_THREADS 16
+static int probe_threads = 0; /* 0 = one per CPU (up to 8), 1 = don't use any extra threads */
+static int probe_active = 0; /* set once the current filter turns out to want the extended data */
+static int probe_next = 0; /* the first file past the current one that probe_wait hasn't looked at yet */
+static int probe_start(void);
+static void probe_cancel(void);
+static int probe_wait(dmoz_file_t *file);
+
 void dmoz_free(dmoz_filelist_t *flist, dmoz_dirlist_t *dlist)
 {
 	int n;
 
 	if (flist) {
+		/* don't leave the probing threads holding on to any of these */
+		if (flist == current_dmoz_filelist)
+			probe_cancel();
 		for (n = 0; n < flist->num_files; n++)
 			free_file(flist->files[n]);
 		free(flist->files);
@@ -445,11 +467,31 @@ void dmoz_free(dmoz_filelist_t *flist, dmoz_dirlist_t *dlist)
 	}
 }
 
-static int current_dmoz_file = 0;
-static dmoz_filelist_t *current_dmoz_filelist = NULL;
-static int (*current_dmoz_filter)(dmoz_file_t *) = NULL;
-static int *current_dmoz_file_pointer = NULL;
-static void (*dmoz_worker_onmove)(void) = NULL;
+/* called when the filter has been through the whole list */
+static void dmoz_worker_done(void)
+{
+	struct dmoz_info_cache_stats st;
+
+	current_dmoz_filelist = NULL;
+	current_dmoz_filter = NULL;
+	probe_active = 0;
+	probe_cancel();
+	if (dmoz_worker_onmove)
+		dmoz_worker_onmove();
+
+	if (!dmoz_info_cache_enabled())
+		return;
+
+	/* only bother if anything actually had to be read */
+	dmoz_info_cache_get_stats(&st);
+	if (st.misses + st.stale == worker_cache_stats.misses + worker_cache_stats.stale)
+		return;
+
+	dmoz_info_cache_save();
+	log_appendf(5, " File info cache: %"PRIu32" hits, %"PRIu32" new, %"PRIu32" changed (%"PRIu32" files total)",
+		st.hits - worker_cache_stats.hits, st.misses - worker_cache_stats.misses,
+		st.stale - worker_cache_stats.stale, st.entries);
+}
 
 int dmoz_worker(void)
 {
@@ -458,20 +500,18 @@ int dmoz_worker(void)
 	if (!current_dmoz_filelist || !current_dmoz_filter)
 		return 0;
 	if (current_dmoz_file >= current_dmoz_filelist->num_files) {
-		current_dmoz_filelist = NULL;
-		current_dmoz_filter = NULL;
-		if (dmoz_worker_onmove)
-			dmoz_worker_onmove();
+		dmoz_worker_done();
 		return 0;
 	}
 
+	/* if it's still being read, come back later */
+	if (probe_active && !probe_wait(current_dmoz_filelist->files[ current_dmoz_file ]))
+		return 1;
+
 	if (!current_dmoz_filter(current_dmoz_filelist->files[ current_dmoz_file ])) {
 		if (current_dmoz_filelist->num_files == current_dmoz_file+1) {
 			current_dmoz_filelist->num_files--;
-			current_dmoz_filelist = NULL;
-			current_dmoz_filter = NULL;
-			if (dmoz_worker_onmove)
-				dmoz_worker_onmove();
+			dmoz_worker_done();
 			return 0;
 		}
 
@@ -482,6 +522,8 @@ int dmoz_worker(void)
 						- current_dmoz_file));
 		free_file(nf);
 		current_dmoz_filelist->num_files--;
+		if (probe_next > current_dmoz_file)
+			probe_next--;
 		if (current_dmoz_file_pointer && *current_dmoz_file_pointer >=
 					current_dmoz_file) {
 			(*current_dmoz_file_pointer) = (*current_dmoz_file_pointer) - 1;
@@ -504,11 +546,15 @@ int dmoz_worker(void)
 so it can't generate error conditions. */
 void dmoz_filter_filelist(dmoz_filelist_t *flist, int (*grep)(dmoz_file_t *f), int *pointer, void (*fn)(void))
 {
+	probe_cancel();
+	probe_active = 0;
+	probe_next = 0;
 	current_dmoz_filelist = flist;
 	current_dmoz_filter = grep;
 	current_dmoz_file = 0;
 	current_dmoz_file_pointer = pointer;
 	dmoz_worker_onmove = fn;
+	dmoz_info_cache_get_stats(&worker_cache_stats);
 }
 
 /* TODO:
@@ -661,6 +707,9 @@ void cfg_load_dmoz(cfg_file_t *cfg)
 			}
 		}
 	}
+
+	dmoz_info_cache_enable(cfg_get_number(cfg, "Directories", "info_cache", 1));
+	probe_threads = CLAMP(cfg_get_number(cfg, "Directories", "info_threads", 0), 0, PROBE_MAX_THREADS);
 }
 
 void cfg_save_dmoz(cfg_file_t *cfg)
@@ -673,6 +722,9 @@ void cfg_save_dmoz(cfg_file_t *cfg)
 			break;
 		}
 	}
+
+	cfg_set_number(cfg, "Directories", "info_cache", dmoz_info_cache_enabled());
+	cfg_set_number(cfg, "Directories", "info_threads", probe_threads);
 }
 
 /* --------------------------------------------------------------------------------------------------------- */
@@ -934,51 +986,70 @@ enum {
 	FINF_ERRNO = (-1),      /* check errno */
 };
 
+/* this gets called from the probing threads, so it mustn't touch anything but 'file' */
 static int file_info_get(dmoz_file_t *file)
 {
 	slurp_t *t;
 	const fmt_read_info_func *func;
+	size_t length;
+	int more, r = 0;
 
 	if (file->filesize == 0)
 		return FINF_EMPTY;
-	t = slurp(file->path, NULL, file->filesize);
-	if (t == NULL)
-		return FINF_ERRNO;
-	file->artist = NULL;
-	file->title = NULL;
-	file->smp_defvol = 64;
-	file->smp_gblvol = 64;
-	for (func = read_info_funcs; *func; func++) {
-		if ((*func) (file, t->data, t->length)) {
-			if (file->artist)
-				trim_string(file->artist);
-			if (file->title == NULL)
-				file->title = str_dup(""); /* or the basename? */
-			trim_string(file->title);
-			break;
+	/* almost everything can be identified from the header, so start off with just that */
+	length = MIN(file->filesize, FMT_INFO_PREFIX);
+	do {
+		t = slurp(file->path, NULL, length);
+		if (t == NULL)
+			return FINF_ERRNO;
+		if (length < file->filesize && t->length >= 8 && memcmp(t->data, "ziRCONia", 8) == 0) {
+			/* an MMCMP file that slurp couldn't unpack from just the start of it */
+			unslurp(t);
+			length = file->filesize;
+			more = 1;
+			continue;
 		}
-	}
-	unslurp(t);
+		more = 0;
+		file->artist = NULL;
+		file->title = NULL;
+		file->smp_defvol = 64;
+		file->smp_gblvol = 64;
+		for (func = read_info_funcs; *func; func++) {
+			r = (*func) (file, t->data, t->length);
+			if (r == READ_INFO_MORE) {
+				if (length < file->filesize) {
+					more = 1;
+					break;
+				}
+				continue; /* it's all there already, so whatever it wanted isn't */
+			} else if (r) {
+				if (file->artist)
+					trim_string(file->artist);
+				if (file->title == NULL)
+					file->title = str_dup(""); /* or the basename? */
+				trim_string(file->title);
+				break;
+			}
+		}
+		unslurp(t);
+		length = file->filesize;
+	} while (more);
 	return file->title ? FINF_SUCCESS : FINF_UNSUPPORTED;
 }
 
-/* return: 1 on success, 0 on error. in either case, it fills the data in with *something*. */
-int dmoz_filter_ext_data(dmoz_file_t *file)
+/* the main thread's half of dmoz_filter_ext_data, once file_info_get has returned 'ret' */
+static int file_info_finish(dmoz_file_t *file, int ret)
 {
-	int ret;
-
-	if ((file->type & TYPE_EXT_DATA_MASK)
-	|| (file->type == TYPE_DIRECTORY)) {
-		/* nothing to do */
-		return 1;
-	}
-	ret = file_info_get(file);
 	switch (ret) {
 	case FINF_SUCCESS:
+		dmoz_info_cache_store(file, 1);
 		return 1;
 	case FINF_UNSUPPORTED:
 		file->description = "Unsupported file format"; /* used to be "Unsupported module format" */
-		break;
+		file->type = TYPE_UNKNOWN;
+		file->title = str_dup("");
+		dmoz_info_cache_store(file, 0);
+		return 0;
 	case FINF_EMPTY:
 		file->description = "Empty file";
 		break;
@@ -999,6 +1070,26 @@ int dmoz_filter_ext_data(dmoz_file_t *file)
 	return 0;
 }
 
+/* return: 1 on success, 0 on error. in either case, it fills the data in with *something*. */
+int dmoz_filter_ext_data(dmoz_file_t *file)
+{
+	int ret;
+
+	if ((file->type & TYPE_EXT_DATA_MASK)
+	|| (file->type == TYPE_DIRECTORY)) {
+		/* nothing to do */
+		return 1;
+	}
+	if (dmoz_info_cache_lookup(file, &ret))
+		return ret;
+	/* if this is the filter working its way through the list, the rest of it can be read in the
+	background while this one's being done */
+	if (!probe_active && current_dmoz_filelist && current_dmoz_file < current_dmoz_filelist->num_files
+	    && current_dmoz_filelist->files[current_dmoz_file] == file)
+		probe_active = probe_start();
+	return file_info_finish(file, file_info_get(file));
+}
+
 /* same as dmoz_filter_ext_data, except without the filtering effect when used with dmoz_filter_filelist */
 int dmoz_fill_ext_data(dmoz_file_t *file)
 {
@@ -1006,3 +1097,305 @@ int dmoz_fill_ext_data(dmoz_file_t *file)
 	return 1;
 }
 
+
+/* --------------------------------------------------------------------------------------------------------- */
+/* background probing
+
+While a filter that wants the extended data is running, the files coming up after the current one are
+read by a few threads in the background, so by the time dmoz_worker gets to a file it's usually just a
+matter of picking up the result. The list itself is only ever touched on the main thread: the threads get
+their own copy of the path and a scratch dmoz_file_t to fill in, which is copied over when it comes back.
+Anything left over from a filter that has since been cancelled is recognized by its generation number. */
+
+#define PROBE_AHEAD 64 /* how far past the current file to read */
+
+struct probe_job {
+	dmoz_file_t *file; /* the one in the list -- main thread only! */
+	dmoz_file_t info; /* what the probe fills in */
+	int result, err;
+	unsigned int gen;
+	struct probe_job *next;
+};
+
+static struct {
+	SDL_Thread *thread;
+	SDL_mutex *mutex;
+	SDL_cond *wake; /* something was added to the queue */
+	SDL_cond *done; /* something was added to the finished list */
+	thread_pool_t *pool;
+	struct probe_job *queue, **queue_tail, *finished;
+	int failed, quit;
+} probe = { .queue_tail = &probe.queue };
+
+/* main thread only */
+static unsigned int probe_gen = 0;
+static dmoz_file_t *probe_pending[PROBE_AHEAD]; /* submitted and not picked up yet */
+static int probe_num_pending = 0;
+
+static void probe_run(void *data, unsigned int n)
+{
+	struct probe_job *job = ((struct probe_job **) data)[n];
+
+	job->result = file_info_get(&job->info);
+	job->err = errno;
+}
+
+/* takes whatever is in the queue and runs it on the pool, until dmoz_shutdown */
+static int probe_thread(UNUSED void *data)
+{
+	struct probe_job *batch[PROBE_AHEAD];
+	unsigned int n, i, max = MIN(thread_pool_size(probe.pool) * 4, PROBE_AHEAD);
+
+	SDL_LockMutex(probe.mutex);
+	while (!probe.quit) {
+		if (!probe.queue) {
+			SDL_CondWait(probe.wake, probe.mutex);
+			continue;
+		}
+		for (n = 0; probe.queue && n < max; n++) {
+			batch[n] = probe.queue;
+			probe.queue = probe.queue->next;
+		}
+		if (!probe.queue)
+			probe.queue_tail = &probe.queue;
+		SDL_UnlockMutex(probe.mutex);
+
+		thread_pool_run(probe.pool, probe_run, batch, n);
+
+		SDL_LockMutex(probe.mutex);
+		for (i = 0; i < n; i++) {
+			batch[i]->next = probe.finished;
+			probe.finished = batch[i];
+		}
+		SDL_CondSignal(probe.done);
+	}
+	SDL_UnlockMutex(probe.mutex);
+
+	return 0;
+}
+
+/* returns 1 if the threads are up (starting them the first time), 0 to do everything the old way */
+static int probe_start(void)
+{
+	int n;
+
+	if (probe.thread)
+		return 1;
+	if (probe.failed)
+		return 0;
+
+	n = probe_threads ? probe_threads : CLAMP(SDL_GetCPUCount(), 2, 8);
+	if (n < 2) {
+		probe.failed = 1;
+		return 0;
+	}
+
+	probe.mutex = SDL_CreateMutex();
+	probe.wake = SDL_CreateCond();
+	probe.done = SDL_CreateCond();
+	if (probe.mutex && probe.wake && probe.done)
+		probe.pool = thread_pool_create(n);
+	if (probe.pool)
+		probe.thread = SDL_CreateThread(probe_thread, "File info", NULL);
+	if (!probe.thread) {
+		log_appendf(4, "Couldn't start the file info threads: %s", SDL_GetError());
+		thread_pool_destroy(probe.pool);
+		if (probe.done)
+			SDL_DestroyCond(probe.done);
+		if (probe.wake)
+			SDL_DestroyCond(probe.wake);
+		if (probe.mutex)
+			SDL_DestroyMutex(probe.mutex);
+		probe.failed = 1;
+		return 0;
+	}
+	return 1;
+}
+
+static int probe_is_pending(dmoz_file_t *file)
+{
+	int n;
+
+	for (n = 0; n < probe_num_pending; n++)
+		if (probe_pending[n] == file)
+			return 1;
+	return 0;
+}
+
+static void probe_free_job(struct probe_job *job)
+{
+	dmoz_file_t *info = &job->info;
+
+	if (info->smp_filename != info->base && info->smp_filename != info->title)
+		free(info->smp_filename);
+	free(info->path);
+	free(info->base);
+	free(info->artist);
+	free(info->title);
+	free(job);
+}
+
+static void probe_submit(dmoz_file_t *file)
+{
+	struct probe_job *job = mem_calloc(1, sizeof(struct probe_job));
+
+	job->file = file;
+	job->gen = probe_gen;
+	job->info.path = str_dup(file->path);
+	job->info.base = str_dup(file->base);
+	job->info.type = file->type;
+	job->info.timestamp = file->timestamp;
+	job->info.filesize = file->filesize;
+	probe_pending[probe_num_pending++] = file;
+
+	SDL_LockMutex(probe.mutex);
+	*probe.queue_tail = job;
+	probe.queue_tail = &job->next;
+	SDL_CondSignal(probe.wake);
+	SDL_UnlockMutex(probe.mutex);
+}
+
+/* copy a finished probe over to the file in the list, and do the rest of dmoz_filter_ext_data */
+static void probe_apply(struct probe_job *job)
+{
+	dmoz_file_t *file = job->file, *info = &job->info;
+
+	if (file->type & TYPE_EXT_DATA_MASK) {
+		/* the main thread already filled this one in itself (dmoz_fill_ext_data), so keep that */
+		probe_free_job(job);
+		return;
+	}
+	file->description = info->description;
+	file->artist = info->artist;
+	file->title = info->title;
+	if (info->smp_filename == info->base)
+		file->smp_filename = file->base;
+	else
+		file->smp_filename = info->smp_filename;
+	file->smp_speed = info->smp_speed;
+	file->smp_loop_start = info->smp_loop_start;
+	file->smp_loop_end = info->smp_loop_end;
+	file->smp_sustain_start = info->smp_sustain_start;
+	file->smp_sustain_end = info->smp_sustain_end;
+	file->smp_length = info->smp_length;
+	file->smp_flags = info->smp_flags;
+	file->smp_defvol = info->smp_defvol;
+	file->smp_gblvol = info->smp_gblvol;
+	file->smp_vibrato_speed = info->smp_vibrato_speed;
+	file->smp_vibrato_depth = info->smp_vibrato_depth;
+	file->smp_vibrato_rate = info->smp_vibrato_rate;
+	/* last, since this is what says the rest is there */
+	file->type = info->type;
+
+	errno = job->err;
+	file_info_finish(file, job->result);
+
+	free(info->path);
+	free(info->base);
+	free(job);
+}
+
+static void probe_collect(void)
+{
+	struct probe_job *job, *next;
+	int n;
+
+	SDL_LockMutex(probe.mutex);
+	job = probe.finished;
+	probe.finished = NULL;
+	SDL_UnlockMutex(probe.mutex);
+
+	for (; job; job = next) {
+		next = job->next;
+		if (job->gen != probe_gen) {
+			probe_free_job(job);
+			continue;
+		}
+		for (n = 0; probe_pending[n] != job->file; n++)
+			;
+		probe_pending[n] = probe_pending[--probe_num_pending];
+		probe_apply(job);
+	}
+}
+
+/* forget about everything that's been submitted so far */
+static void probe_cancel(void)
+{
+	struct probe_job *job, *next;
+
+	if (!probe.thread)
+		return;
+
+	probe_gen++;
+	probe_num_pending = 0;
+	probe_next = 0;
+
+	SDL_LockMutex(probe.mutex);
+	job = probe.queue;
+	probe.queue = NULL;
+	probe.queue_tail = &probe.queue;
+	SDL_UnlockMutex(probe.mutex);
+
+	for (; job; job = next) {
+		next = job->next;
+		probe_free_job(job);
+	}
+	/* anything that's running right now will be thrown out by probe_collect later */
+	probe_collect();
+}
+
+/* pick up whatever is done, queue up the next few files, and see if 'file' is ready.
+returns 0 if it's still being read, 1 if the filter can go ahead with it */
+static int probe_wait(dmoz_file_t *file)
+{
+	dmoz_file_t *f;
+	int n, ok;
+
+	probe_collect();
+
+	/* each file only gets looked up in the cache once, not every time through here */
+	for (n = MAX(probe_next, current_dmoz_file); n < current_dmoz_filelist->num_files
+	     && n < current_dmoz_file + PROBE_AHEAD && probe_num_pending < PROBE_AHEAD; n++) {
+		f = current_dmoz_filelist->files[n];
+		/* empty files are dealt with on the spot */
+		if ((f->type & TYPE_EXT_DATA_MASK) || f->type == TYPE_DIRECTORY || f->filesize == 0
+		    || probe_is_pending(f) || dmoz_info_cache_lookup(f, &ok))
+			continue;
+		probe_submit(f);
+	}
+	probe_next = n;
+
+	if (!probe_is_pending(file))
+		return 1;
+
+	/* don't hold up the main loop for long */
+	SDL_LockMutex(probe.mutex);
+	if (!probe.finished)
+		SDL_CondWaitTimeout(probe.done, probe.mutex, 10);
+	SDL_UnlockMutex(probe.mutex);
+
+	probe_collect();
+	return !probe_is_pending(file);
+}
+
+void dmoz_shutdown(void)
+{
+	if (!probe.thread)
+		return;
+
+	probe_cancel();
+	SDL_LockMutex(probe.mutex);
+	probe.quit = 1;
+	SDL_CondSignal(probe.wake);
+	SDL_UnlockMutex(probe.mutex);
+	SDL_WaitThread(probe.thread, NULL);
+	probe.thread = NULL;
+	probe.failed = 1; /* don't start them again */
+
+	/* throw out whatever was still running */
+	probe_collect();
+	thread_pool_destroy(probe.pool);
+	SDL_DestroyCond(probe.done);
+	SDL_DestroyCond(probe.wake);
+	SDL_DestroyMutex(probe.mutex);
+}
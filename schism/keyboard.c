@@ -604,6 +604,17 @@ void kbd_handle_key_repeat(void)
 	}
 }
 
+int kbd_key_repeat_wait(void)
+{
+	schism_ticks_t now;
+
+	if (!key_repeat_next_tick)
+		return -1;
+
+	now = SCHISM_GET_TICKS();
+	return SCHISM_TICKS_PASSED(now, key_repeat_next_tick) ? 0 : (int) (key_repeat_next_tick - now);
+}
+
 void kbd_cache_key_repeat(struct key_event* kk)
 {
 	if (cached_key_event.text)
@@ -34,6 +34,7 @@
 #include "clippy.h"
 #include "disko.h"
 #include "fakemem.h"
+#include "mixbench.h"
 
 #include "config.h"
 #include "version.h"
@@ -46,6 +47,7 @@
 #include "fonts.h"
 #include "dialog.h"
 #include "widget.h"
+#include "sample-edit.h"
 
 #include "osdefs.h"
 
@@ -90,6 +92,9 @@ static const char *audio_driver = NULL;
 static const char *audio_device = NULL;
 static int did_fullscreen = 0;
 static int did_classic = 0;
+static int cli_mix_threads = -1;
+static int cli_mix_thread_voices = -1;
+static int cli_voices = -1;
 
 /* --------------------------------------------------------------------- */
 
@@ -127,7 +132,7 @@ static void display_init(void)
 	SDL_StartTextInput();
 }
 
-static void check_update(void);
+static int check_update(void);
 
 void toggle_display_fullscreen(void)
 {
@@ -153,6 +158,8 @@ static void handle_window_event(SDL_WindowEvent *w)
 		video_update();
 		/* fallthrough */
 	case SDL_WINDOWEVENT_EXPOSED:
+		/* the window contents are gone; everything has to be presented again */
+		video_invalidate();
 		status.flags |= (NEED_UPDATE);
 		break;
 	default:
@@ -209,6 +216,33 @@ static char *initial_dir = NULL;
 /* diskwrite? */
 static char *diskwrite_to = NULL;
 
+/* make a guess? */
+static const char *diskwrite_driver(const char *filename)
+{
+	const char *multi = strcasestr(filename, "%c");
+
+	return (strcasestr(filename, ".aif")
+		? (multi ? "MAIFF" : "AIFF")
+		: (multi ? "MWAV" : "WAV"));
+}
+
+/* batch render (--render-batch): every file on the command line, no video or audio */
+static char *render_batch_to = NULL;
+static const char *render_format = "WAV";
+static int render_threads = 0;
+static char **render_files = NULL;
+static int render_count = 0;
+
+/* benchmarks (--bench, --bench-decompress): seconds per run; the files are collected in render_files too */
+static int bench_seconds = 0;
+static int bench_decompress = 0;
+
+/* self-tests (--check), on the same files */
+static int run_checks = 0;
+
+/* decompressor fuzzing (--check-decompress): broken copies per file; the files are in render_files */
+static int fuzz_rounds = 0;
+
 /* startup flags */
 enum {
 	SF_PLAY = 1, /* -p: start playing after loading initial_song */
@@ -242,6 +276,12 @@ enum {
 	O_HOOKS, O_NO_HOOKS,
 #endif
 	O_DISKWRITE,
+	O_RENDER_BATCH, O_RENDER_FORMAT, O_RENDER_THREADS,
+	O_MIX_THREADS, O_MIX_THREAD_VOICES,
+	O_VOICES,
+	O_BENCH, O_BENCH_DECOMPRESS,
+	O_CHECK,
+	O_CHECK_DECOMPRESS,
 	O_DEBUG,
 	O_VERSION,
 };
@@ -267,6 +307,16 @@ static void parse_options(int argc, char **argv)
 		{"play", 0, NULL, O_PLAY},
 		{"no-play", 0, NULL, O_NO_PLAY},
 		{"diskwrite", 1, NULL, O_DISKWRITE},
+		{"render-batch", 1, NULL, O_RENDER_BATCH},
+		{"render-format", 1, NULL, O_RENDER_FORMAT},
+		{"render-threads", 1, NULL, O_RENDER_THREADS},
+		{"mix-threads", 1, NULL, O_MIX_THREADS},
+		{"mix-thread-voices", 1, NULL, O_MIX_THREAD_VOICES},
+		{"voices", 1, NULL, O_VOICES},
+		{"bench", 2, NULL, O_BENCH},
+		{"bench-decompress", 2, NULL, O_BENCH_DECOMPRESS},
+		{"check", 0, NULL, O_CHECK},
+		{"check-decompress", 2, NULL, O_CHECK_DECOMPRESS},
 		{"font-editor", 0, NULL, O_FONTEDIT},
 		{"no-font-editor", 0, NULL, O_NO_FONTEDIT},
 #if ENABLE_HOOKS
@@ -326,6 +376,39 @@ static void parse_options(int argc, char **argv)
 		case O_DISKWRITE:
 			diskwrite_to = optarg;
 			break;
+		case O_RENDER_BATCH:
+			render_batch_to = optarg;
+			break;
+		case O_RENDER_FORMAT:
+			render_format = optarg;
+			break;
+		case O_RENDER_THREADS:
+			render_threads = atoi(optarg);
+			break;
+		case O_MIX_THREADS:
+			cli_mix_threads = atoi(optarg);
+			break;
+		case O_MIX_THREAD_VOICES:
+			cli_mix_thread_voices = atoi(optarg);
+			break;
+		case O_VOICES:
+			cli_voices = atoi(optarg);
+			break;
+		case O_BENCH:
+		case O_BENCH_DECOMPRESS:
+			bench_decompress = (opt == O_BENCH_DECOMPRESS);
+			bench_seconds = optarg ? atoi(optarg) : 0;
+			if (bench_seconds <= 0)
+				bench_seconds = 10;
+			break;
+		case O_CHECK:
+			run_checks = 1;
+			break;
+		case O_CHECK_DECOMPRESS:
+			fuzz_rounds = optarg ? atoi(optarg) : 0;
+			if (fuzz_rounds <= 0)
+				fuzz_rounds = 100;
+			break;
 #if ENABLE_HOOKS
 		case O_HOOKS:
 			startup_flags |= SF_HOOKS;
@@ -348,6 +431,16 @@ static void parse_options(int argc, char **argv)
 				"  -f, --fullscreen (-F, --no-fullscreen)\n"
 				"  -p, --play (-P, --no-play)\n"
 				"      --diskwrite=FILENAME\n"
+				"      --render-batch=DIRECTORY FILE...\n"
+				"      --render-format=TYPE (WAV, AIFF, FLAC)\n"
+				"      --render-threads=N (0 = one per CPU)\n"
+				"      --mix-threads=N (0 = one per CPU)\n"
+				"      --mix-thread-voices=N\n"
+				"      --voices=N (up to 4096, counting the 64 channels)\n"
+				"      --bench[=SECONDS] [FILE...]\n"
+				"      --bench-decompress[=SECONDS] [FILE...]\n"
+				"      --check [FILE...]\n"
+				"      --check-decompress[=ROUNDS] FILE...\n"
 				"      --font-editor (--no-font-editor)\n"
 #if ENABLE_HOOKS
 				"      --hooks (--no-hooks)\n"
@@ -376,7 +469,10 @@ static void parse_options(int argc, char **argv)
 		}
 		char *norm = dmoz_path_normal(tmp);
 		free(tmp);
-		if (is_directory(arg)) {
+		if (render_batch_to || bench_seconds || run_checks || fuzz_rounds) {
+			render_files = mem_realloc(render_files, (render_count + 1) * sizeof(char *));
+			render_files[render_count++] = norm;
+		} else if (is_directory(arg)) {
 			free(initial_dir);
 			initial_dir = norm;
 		} else {
@@ -389,28 +485,42 @@ static void parse_options(int argc, char **argv)
 
 /* --------------------------------------------------------------------- */
 
-static void check_update(void)
+extern void vis_update(void);
+extern int vis_update_wait(void);
+
+/* Redraws the screen if it needs it. Returns how many milliseconds until a redraw that was put off
+(to keep an unfocused window or the disk writer from hogging the CPU) is due, or -1 if none is. */
+static int check_update(void)
 {
 	static schism_ticks_t next = 0;
+	static int deferred = 0;
 	schism_ticks_t now = SCHISM_GET_TICKS();
 
+	/* the fft visualizations are fed by the audio thread, but crunched here */
+	vis_update();
+
 	/* is there any reason why we'd want to redraw
 	   the screen when it's not even visible? */
-	if (video_is_visible() && (status.flags & NEED_UPDATE)) {
+	if (video_is_visible() && ((status.flags & NEED_UPDATE) || deferred)) {
 		status.flags &= ~NEED_UPDATE;
 
 		if (!video_is_focused() && (status.flags & LAZY_REDRAW)) {
-			if (!SCHISM_TICKS_PASSED(now, next))
-				return;
+			if (!SCHISM_TICKS_PASSED(now, next)) {
+				deferred = 1;
+				return (int) (next - now);
+			}
 
 			next = now + 500;
 		} else if (status.flags & (DISKWRITER_ACTIVE | DISKWRITER_ACTIVE_PATTERN)) {
-			if (!SCHISM_TICKS_PASSED(now, next))
-				return;
+			if (!SCHISM_TICKS_PASSED(now, next)) {
+				deferred = 1;
+				return (int) (next - now);
+			}
 
 			next = now + 100;
 		}
 
+		deferred = 0;
 		redraw_screen();
 		video_refresh();
 		video_blit();
@@ -418,6 +528,14 @@ static void check_update(void)
 		video_blit();
 		status.flags &= ~(SOFTWARE_MOUSE_MOVED);
 	}
+
+	return -1;
+}
+
+/* the sooner of two timeouts, where -1 is never */
+static int wait_min(int a, int b)
+{
+	return (a < 0) ? b : (b < 0) ? a : MIN(a, b);
 }
 
 static void _do_clipboard_paste_op(SDL_Event *e)
@@ -463,6 +581,7 @@ static void event_loop(void)
 	int sawrep;
 	int fix_numlock_key;
 	int screensaver;
+	int wait, busy;
 	struct key_event kk;
 
 	fix_numlock_key = status.fix_numlock_setting;
@@ -771,6 +890,10 @@ static void event_loop(void)
 				if (!(status.flags & (DISKWRITER_ACTIVE | DISKWRITER_ACTIVE_PATTERN)))
 					playback_update();
 				break;
+			case SCHISM_EVENT_WAKEUP:
+				/* another thread changed something that's on the screen */
+				status.flags |= NEED_UPDATE;
+				break;
 			case SCHISM_EVENT_PASTE:
 				/* handle clipboard events */
 				_do_clipboard_paste_op(&event);
@@ -878,7 +1001,7 @@ static void event_loop(void)
 			status.flags &= ~(CLIPPY_PASTE_BUFFER|CLIPPY_PASTE_SELECTION);
 		}
 
-		check_update();
+		wait = check_update();
 
 		switch (song_get_mode()) {
 		case MODE_PLAYING:
@@ -913,15 +1036,32 @@ static void event_loop(void)
 			}
 		}
 
+		/* put in any sample edit that was running on its own thread */
+		sample_edit_poll();
+
 		/* let dmoz build directory lists, etc
 		 *
 		 * as long as there's no user-event going on... */
-		while (!(status.flags & NEED_UPDATE) && dmoz_worker() && !SDL_PollEvent(NULL));
-
-		/* delay until there's an event OR 10 ms have passed */
-		int t;
-		for (t = 0; t < 10 && !SDL_PollEvent(NULL); t++)
-			SDL_Delay(1);
+		busy = 0;
+		while (!(status.flags & NEED_UPDATE) && (busy = dmoz_worker()) && !SDL_PollEvent(NULL));
+
+		/* Sleep until something happens. Everything that runs on another thread (audio, MIDI
+		input, the clipboard, log lines) sends an event when the screen needs to change, so the
+		only other reasons to wake up are the ones in here that go by the clock, including the
+		FFT, which the audio thread feeds much more often than it sends events. */
+		if (busy || (status.flags & DISKWRITER_ACTIVE)
+		    || ((status.flags & NEED_UPDATE) && video_is_visible()))
+			wait = 0;
+		wait = wait_min(wait, kbd_key_repeat_wait());
+		if (video_is_visible())
+			wait = wait_min(wait, vis_update_wait()); /* check_update runs vis_update */
+		if (startdown)
+			wait = wait_min(wait, 100); /* time() only has whole seconds anyway */
+
+		if (wait < 0)
+			SDL_WaitEvent(NULL);
+		else if (wait > 0)
+			SDL_WaitEventTimeout(NULL, wait);
 	}
 	schism_exit(0);
 }
@@ -935,9 +1075,13 @@ void schism_exit(int status)
 #endif
 
 	free_audio_device_list();
+	dmoz_shutdown();
+	log_flush(); /* the browser's threads are done with it now */
 
-	if (shutdown_process & EXIT_SAVECFG)
+	if (shutdown_process & EXIT_SAVECFG) {
 		cfg_atexit_save();
+		dmoz_info_cache_save();
+	}
 
 	if (shutdown_process & EXIT_SDLQUIT) {
 		song_lock_audio();
@@ -1005,14 +1149,64 @@ int main(int argc, char **argv)
 		if (startup_flags & SF_CLASSIC) status.flags |= CLASSIC_MODE;
 	}
 
-	if (!did_fullscreen) {
-		video_fullscreen(cfg_video_fullscreen);
-	}
+	if (cli_mix_threads >= 0)
+		audio_settings.mix_threads = cli_mix_threads;
+	if (cli_mix_thread_voices >= 0)
+		audio_settings.mix_thread_voices = cli_mix_thread_voices;
+	if (cli_voices >= 0)
+		audio_settings.voices = cli_voices;
 
 	if (!(startup_flags & SF_NETWORK)) {
 		status.flags |= NO_NETWORK;
 	}
 
+	/* None of these open a window, so the log goes to stderr. (Except --check-decompress: the decoder
+	complaining about the broken data it's being fed is the whole point, and there'd be a lot of it.) */
+	if (bench_seconds || run_checks || render_batch_to)
+		log_set_headless(1);
+
+	if (bench_seconds) {
+		int failed = bench_decompress
+			? mixbench_decompress_run(render_files, render_count, bench_seconds)
+			: mixbench_run(render_files, render_count, bench_seconds);
+		schism_exit(failed ? 1 : 0);
+	}
+
+	if (run_checks) {
+		int failed = mixbench_check_run(render_files, render_count);
+		schism_exit(failed ? 1 : 0);
+	}
+
+	if (fuzz_rounds) {
+		int failed = mixbench_fuzz_decompress_run(render_files, render_count, fuzz_rounds);
+		schism_exit(failed ? 1 : 0);
+	}
+
+	if (render_batch_to) {
+		/* nothing to draw or play; just render everything and leave */
+		int failed = song_export_batch(render_files, render_count, render_batch_to,
+			render_format, render_threads);
+		schism_exit(failed ? 1 : 0);
+	}
+
+	if (diskwrite_to && initial_song && !strcasestr(diskwrite_to, "%c")) {
+		/* the same thing with one file, except it gets the name it was given.
+		(writing each channel separately still has to go the long way around) */
+		int failed;
+
+		log_set_headless(1);
+		failed = song_export_file(initial_song, diskwrite_to, diskwrite_driver(diskwrite_to));
+#ifdef ENABLE_HOOKS
+		if (!failed)
+			run_disko_complete_hook();
+#endif
+		schism_exit(failed ? 1 : 0);
+	}
+
+	if (!did_fullscreen) {
+		video_fullscreen(cfg_video_fullscreen);
+	}
+
 	shutdown_process |= EXIT_SAVECFG;
 
 	sdl_init();
@@ -1065,12 +1259,7 @@ int main(int argc, char **argv)
 		set_page(PAGE_LOG);
 		if (song_load_unchecked(initial_song)) {
 			if (diskwrite_to) {
-				// make a guess?
-				const char *multi = strcasestr(diskwrite_to, "%c");
-				const char *driver = (strcasestr(diskwrite_to, ".aif")
-						      ? (multi ? "MAIFF" : "AIFF")
-						      : (multi ? "MWAV" : "WAV"));
-				if (song_export(diskwrite_to, driver) != SAVE_SUCCESS) {
+				if (song_export(diskwrite_to, diskwrite_driver(diskwrite_to)) != SAVE_SUCCESS) {
 					schism_exit(1);
 				}
 			} else if (startup_flags & SF_PLAY) {
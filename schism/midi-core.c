@@ -37,6 +37,7 @@
 
 #include <ctype.h>
 #include <assert.h>
+#include <math.h>
 
 static int _connected = 0;
 /* midi_mutex is locked by the main thread,
@@ -46,8 +47,8 @@ and midi_record_mutex is by the event/sound thread
 static SDL_mutex *midi_mutex = NULL;
 static SDL_mutex *midi_port_mutex = NULL;
 static SDL_mutex *midi_record_mutex = NULL;
-static SDL_mutex *midi_play_mutex = NULL;
-static SDL_cond *midi_play_cond = NULL;
+static SDL_mutex *midi_play_mutex = NULL; /* anything that calls send_now */
+static SDL_sem *midi_queue_sem = NULL; /* posted when there's something for the queue thread */
 
 static struct midi_provider *port_providers = NULL;
 
@@ -311,16 +312,16 @@ int midi_engine_start(void)
 	midi_record_mutex = SDL_CreateMutex();
 	midi_play_mutex   = SDL_CreateMutex();
 	midi_port_mutex   = SDL_CreateMutex();
-	midi_play_cond    = SDL_CreateCond();
+	midi_queue_sem    = SDL_CreateSemaphore(0);
 
-	if (!(midi_mutex && midi_record_mutex && midi_play_mutex && midi_port_mutex && midi_play_cond)) {
+	if (!(midi_mutex && midi_record_mutex && midi_play_mutex && midi_port_mutex && midi_queue_sem)) {
 		if (midi_mutex)        SDL_DestroyMutex(midi_mutex);
 		if (midi_record_mutex) SDL_DestroyMutex(midi_record_mutex);
 		if (midi_play_mutex)   SDL_DestroyMutex(midi_play_mutex);
 		if (midi_port_mutex)   SDL_DestroyMutex(midi_port_mutex);
-		if (midi_play_cond)    SDL_DestroyCond(midi_play_cond);
+		if (midi_queue_sem)    SDL_DestroySemaphore(midi_queue_sem);
 		midi_mutex = midi_record_mutex = midi_play_mutex = midi_port_mutex = NULL;
-		midi_play_cond = NULL;
+		midi_queue_sem = NULL;
 		return 0;
 	}
 
@@ -574,94 +575,178 @@ void midi_send_now(const unsigned char *seq, unsigned int len)
 	if (!midi_record_mutex) return;
 
 	SDL_LockMutex(midi_record_mutex);
+	SDL_LockMutex(midi_play_mutex);
 	_midi_send_unlocked(seq, len, 0, 0);
+	SDL_UnlockMutex(midi_play_mutex);
 	SDL_UnlockMutex(midi_record_mutex);
 }
 
 /*----------------------------------------------------------------------------------*/
 
-/* okay, our local queue is a little confusing,
- * but it works on the premise that the people who need it (oss)
- * also have systems with high-speed context switches.
- *
- * this sucks for freebsd/386 users as they've got a high-latency
- * audio system (oss) and slow context switches (x86). someone should
- * port alsa to freebsd. maybe someone else will solve this problem,
- * or maybe the computers that are slow enough to matter simply won't
- * be bothered.
- *
- * midi, that is, real midi, is 31250bps. that's 3125 bits per msec,
- * or 391 bytes per msec. i use a fixed buffer here because access needs
- * to be fast, and attempting to handle more will simply help people
- * using software/only setups.
- *
- * really, software-only midi, without kernel assistance sucks.
- */
-struct qent {
-	int used;
-	unsigned char b[391];
+/* The MIDI out queue, for ports that can't schedule anything themselves.
+
+The player hands over each message as it comes up in the mix, along with how far into the audio
+buffer that happened. That's turned into a time on the performance counter -- when the callback
+started, plus one buffer for the one the device is still playing, plus the offset -- and the
+message goes into a ring for the queue thread, which sleeps until then and sends it. The audio
+thread never waits on the queue thread: it only ever writes to the ring and posts a semaphore.
+
+Messages are variable length (Zxx macros can make SysEx), and packed into the ring back to back.
+If one doesn't fit, it's dropped and counted, rather than holding up the mixer. */
+
+#define MIDI_QUEUE_SIZE 65536 /* bytes; must be a power of two */
+#define MIDI_QUEUE_MASK (MIDI_QUEUE_SIZE - 1)
+#define MIDI_QUEUE_SKIP 0xffff /* 'len' of a record that just pads out the end of the ring */
+
+struct midi_qent {
+	Uint64 due; /* performance counter */
+	unsigned int len;
+	/* and then 'len' bytes of message, padded out to the size of this struct */
 };
-static struct qent *qq = NULL;
-static unsigned int midims = 0, ms10s = 0, qlen = 0;
 
-void midi_queue_alloc(int my_audio_buffer_samples, int sample_size, int samples_per_second)
+static unsigned char midi_queue[MIDI_QUEUE_SIZE];
+static SDL_atomic_t midi_queue_head, midi_queue_tail; /* in bytes, never wrapped */
+
+/* set up by midi_queue_alloc; only the producers touch these */
+static unsigned int midi_queue_rate = 0, midi_queue_latency = 0; /* frames */
+static unsigned int midi_queue_frames = 0; /* size of the buffer being mixed right now */
+static Uint64 midi_queue_start = 0; /* when that buffer was started */
+
+/* how far off the queue thread was; updated with midi_play_mutex held */
+static struct {
+	unsigned int count;
+	int64_t sum, sum_sq; /* microseconds late (negative = early) */
+	int min, max;
+} midi_queue_stats;
+
+/* messages that didn't fit; counted by the producers, which can't take midi_play_mutex (the audio
+thread mustn't wait on the queue thread), so midi_queue_report reads and clears it in one go */
+static SDL_atomic_t midi_queue_dropped;
+
+static unsigned int _midi_qent_size(unsigned int len)
 {
-	int buffer_size = (my_audio_buffer_samples * sample_size);
+	return (sizeof(struct midi_qent) + len + sizeof(struct midi_qent) - 1)
+		/ sizeof(struct midi_qent) * sizeof(struct midi_qent);
+}
 
-	if (qq) {
-		free(qq);
-		qq = NULL;
+/* only called with midi_record_mutex held, so there's only ever one of these at a time */
+static int _midi_queue_push(const unsigned char *data, unsigned int len, Uint64 due)
+{
+	unsigned int head = SDL_AtomicGet(&midi_queue_head);
+	unsigned int free_space = MIDI_QUEUE_SIZE - (head - (unsigned int) SDL_AtomicGet(&midi_queue_tail));
+	unsigned int size = _midi_qent_size(len), pad = 0;
+	struct midi_qent *q;
+
+	/* records never wrap around the end of the ring */
+	if ((head & MIDI_QUEUE_MASK) + size > MIDI_QUEUE_SIZE)
+		pad = MIDI_QUEUE_SIZE - (head & MIDI_QUEUE_MASK);
+	if (len >= MIDI_QUEUE_SKIP || pad + size > free_space) {
+		SDL_AtomicAdd(&midi_queue_dropped, 1);
+		return 0;
+	}
+	if (pad) {
+		q = (struct midi_qent *) (midi_queue + (head & MIDI_QUEUE_MASK));
+		q->len = MIDI_QUEUE_SKIP;
+		head += pad;
 	}
+	q = (struct midi_qent *) (midi_queue + (head & MIDI_QUEUE_MASK));
+	q->due = due;
+	q->len = len;
+	memcpy(q + 1, data, len);
+	/* SDL_AtomicSet is a full barrier, so the record is there before the queue thread can see it */
+	SDL_AtomicSet(&midi_queue_head, head + size);
+	return 1;
+}
 
-	/* how long is the audio buffer in 10 msec?
-	 * well, (sample_size*samples_per_second)/80 is the number of bytes per msec
-	 */
-	midims = sample_size * samples_per_second;
-	if ((midims % 80) != 0) midims += (80 - (midims % 80));
-	ms10s = midims / 80;
-	midims /= 8;
+void midi_queue_alloc(int my_audio_buffer_samples, UNUSED int sample_size, int samples_per_second)
+{
+	/* the buffer being mixed is heard once the one before it is done */
+	midi_queue_latency = my_audio_buffer_samples;
+	midi_queue_rate = samples_per_second;
+}
 
-	if (ms10s > buffer_size) {
-		/* okay, there's not even 10msec of audio data; midi queueing will be impossible */
-		log_nl();
-		log_append(4, 0, "WARNING: Not enough space to queue MIDI data!");
-		log_append(4, 0, "Hint: Increase the audio buffer size or lower your mixing rate.");
-		qlen = 0;
+void midi_queue_mark(unsigned int frames)
+{
+	midi_queue_start = SDL_GetPerformanceCounter();
+	midi_queue_frames = frames;
+}
+
+void midi_queue_report(void)
+{
+	unsigned int n, dropped;
+	double mean, var;
+
+	if (!midi_play_mutex)
 		return;
-	}
 
-	if ((buffer_size % ms10s) != 0) {
-		buffer_size += (ms10s - (buffer_size % ms10s));
+	SDL_LockMutex(midi_play_mutex);
+	n = midi_queue_stats.count;
+	dropped = SDL_AtomicSet(&midi_queue_dropped, 0);
+	if (n || dropped) {
+		mean = n ? (double) midi_queue_stats.sum / n : 0.0;
+		var = n ? (double) midi_queue_stats.sum_sq / n - mean * mean : 0.0;
+		log_appendf(5, " MIDI out: %u messages, %.0f us late on average, %.0f us jitter,"
+			" %d..%d us, %u dropped", n, mean, sqrt(MAX(var, 0.0)),
+			n ? midi_queue_stats.min : 0, n ? midi_queue_stats.max : 0, dropped);
 	}
-	qlen = buffer_size / ms10s;
-	/* now qlen is the number of msec in digital output buffer */
-
-	qq = mem_calloc(qlen, sizeof(struct qent));
+	memset(&midi_queue_stats, 0, sizeof(midi_queue_stats));
+	SDL_UnlockMutex(midi_play_mutex);
 }
 
 static SDL_Thread *midi_queue_thread = NULL;
 
 static int _midi_queue_run(UNUSED void *xtop)
 {
-	int i;
+	Uint64 freq = SDL_GetPerformanceFrequency();
+	unsigned int tail = SDL_AtomicGet(&midi_queue_tail);
 
 #ifdef SCHISM_WIN32
 	SetPriorityClass(GetCurrentProcess(),HIGH_PRIORITY_CLASS);
 	SetThreadPriority(GetCurrentThread(),THREAD_PRIORITY_TIME_CRITICAL);
 	/*SetThreadPriority(GetCurrentThread(),THREAD_PRIORITY_HIGHEST);*/
+#else
+	SDL_SetThreadPriority(SDL_THREAD_PRIORITY_HIGH);
 #endif
 
-	SDL_LockMutex(midi_play_mutex);
 	for (;;) {
-		SDL_CondWait(midi_play_cond, midi_play_mutex);
-
-		for (i = 0; i < qlen; i++) {
-			SDL_LockMutex(midi_record_mutex);
-			_midi_send_unlocked(qq[i].b, qq[i].used, 0, 1);
-			SDL_UnlockMutex(midi_record_mutex);
-			SLEEP_FUNC(10000); /* 10msec */
-			qq[i].used = 0;
+		struct midi_qent *q;
+		Uint64 now;
+		int64_t late;
+
+		if (tail == (unsigned int) SDL_AtomicGet(&midi_queue_head)) {
+			SDL_SemWait(midi_queue_sem);
+			continue;
+		}
+
+		q = (struct midi_qent *) (midi_queue + (tail & MIDI_QUEUE_MASK));
+		if (q->len == MIDI_QUEUE_SKIP) {
+			tail += MIDI_QUEUE_SIZE - (tail & MIDI_QUEUE_MASK);
+			SDL_AtomicSet(&midi_queue_tail, tail);
+			continue;
+		}
+
+		/* sleep until it's time; usleep and friends can oversleep, so check again after */
+		now = SDL_GetPerformanceCounter();
+		late = (int64_t) (now - q->due) * 1000000 / (int64_t) freq;
+		if (late < -100) {
+			SLEEP_FUNC(MIN(-late, 100000));
+			continue;
 		}
+
+		SDL_LockMutex(midi_play_mutex);
+		_midi_send_unlocked((const unsigned char *) (q + 1), q->len, 0, 1);
+		late = CLAMP(late, -1000000, 1000000);
+		if (!midi_queue_stats.count || late < midi_queue_stats.min)
+			midi_queue_stats.min = late;
+		if (!midi_queue_stats.count || late > midi_queue_stats.max)
+			midi_queue_stats.max = late;
+		midi_queue_stats.count++;
+		midi_queue_stats.sum += late;
+		midi_queue_stats.sum_sq += late * late;
+		SDL_UnlockMutex(midi_play_mutex);
+
+		tail += _midi_qent_size(q->len);
+		SDL_AtomicSet(&midi_queue_tail, tail);
 	}
 
 	return 0; /* never happens */
@@ -669,27 +754,12 @@ static int _midi_queue_run(UNUSED void *xtop)
 
 int midi_need_flush(void)
 {
-	struct midi_port *ptr;
-	int need_explicit_flush = 0;
-	int i;
-
-	if (!midi_record_mutex || !midi_play_mutex) return 0;
-
-	ptr = NULL;
-
-	while (midi_port_foreach(NULL, &ptr)) {
-		if ((ptr->io & MIDI_OUTPUT)) {
-			if (!ptr->drain && ptr->send_now)
-				need_explicit_flush = 1;
-		}
-	}
-	if (!need_explicit_flush) return 0;
-
-	for (i = 0; i < qlen; i++) {
-		if (qq[i].used) return 1;
-	}
+	/* the queue thread is woken up by the audio thread itself; it's only the first flush that
+	has to come from the main thread, to get it started */
+	if (!midi_record_mutex || midi_queue_thread)
+		return 0;
 
-	return 0;
+	return SDL_AtomicGet(&midi_queue_head) != SDL_AtomicGet(&midi_queue_tail);
 }
 
 void midi_send_flush(void)
@@ -710,7 +780,7 @@ void midi_send_flush(void)
 	if (!need_explicit_flush) return;
 
 	if (!midi_queue_thread) {
-		midi_queue_thread = SDL_CreateThread(_midi_queue_run, NULL, NULL);
+		midi_queue_thread = SDL_CreateThread(_midi_queue_run, "MIDI queue", NULL);
 		if (midi_queue_thread) {
 			log_appendf(3, "Started MIDI queue thread");
 		} else {
@@ -718,13 +788,13 @@ void midi_send_flush(void)
 		}
 	}
 
-	SDL_LockMutex(midi_play_mutex);
-	SDL_CondSignal(midi_play_cond);
-	SDL_UnlockMutex(midi_play_mutex);
+	SDL_SemPost(midi_queue_sem);
 }
 
 void midi_send_buffer(const unsigned char *data, unsigned int len, unsigned int pos)
 {
+	unsigned int frames;
+
 	if (!midi_record_mutex) return;
 
 	SDL_LockMutex(midi_record_mutex);
@@ -744,28 +814,15 @@ void midi_send_buffer(const unsigned char *data, unsigned int len, unsigned int
 		status.flags |= NEED_UPDATE;
 	}
 
-	/* pos is still in milliseconds */
-	if (midims != 0 && _midi_send_unlocked(data, len, pos/midims, 2)) {
-		/* grr, we need a timer */
-
-		/* calculate pos in buffer */
-		pos /= ms10s;
+	/* pos is how much of the buffer was left to mix, so this is how far away it is */
+	frames = midi_queue_latency + midi_queue_frames - MIN(pos, midi_queue_frames);
 
-		/* what? we don't have anything to do?
-		 * do nothing then! */
-		if (pos < qlen) {
-			if ((len + qq[pos].used) > sizeof(qq[pos].b)) {
-				len = sizeof(qq[pos].b) - qq[pos].used;
-				/* okay, we're going to lose data here */
-			}
-			memcpy(qq[pos].b+qq[pos].used, data, len);
-			qq[pos].used += len;
-		}
-#ifdef SCHISM_MIDI_DEBUG
-		else {
-			printf("MIDI: midi_send_buffer with pos %d and qlen %d out of bounds!\n", pos, qlen);
-		}
-#endif
+	if (midi_queue_rate && _midi_send_unlocked(data, len, frames * 1000 / midi_queue_rate, 2)) {
+		/* grr, we need a timer */
+		if (_midi_queue_push(data, len, midi_queue_start
+				+ (Uint64) frames * SDL_GetPerformanceFrequency() / midi_queue_rate)
+		    && midi_queue_thread)
+			SDL_SemPost(midi_queue_sem);
 	}
 
 	SDL_UnlockMutex(midi_record_mutex);
@@ -0,0 +1,923 @@
+/*
+ * Schism Tracker - a cross-platform Impulse Tracker clone
+ * copyright (c) 2003-2005 Storlek <storlek@rigelseven.com>
+ * copyright (c) 2005-2008 Mrs. Brisby <mrs.brisby@nimh.org>
+ * copyright (c) 2009 Storlek & Mrs. Brisby
+ * copyright (c) 2010-2012 Storlek
+ * URL: http://schismtracker.org/
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/* Mixer benchmark (--bench) and self-tests (--check). Everything here runs before SDL is up, the same
+way as --render-batch: songs are mixed straight through csf_read into a scratch buffer that nobody
+listens to. */
+
+#include "headers.h"
+
+#include "disko.h"
+#include "fmt.h"
+#include "mixbench.h"
+#include "slurp.h"
+#include "song.h"
+#include "thread-pool.h"
+#include "util.h"
+
+#include "player/sndfile.h"
+#include "player/cmixer.h"
+
+#include <errno.h>
+#include <inttypes.h>
+
+#define BENCH_RATE 44100
+#define BENCH_FRAMES 1024 /* per csf_read, roughly what the audio callback asks for */
+
+static const char *const bench_mode_names[NUM_SRC_MODES] = {
+	"nearest", "linear", "spline", "polyphase",
+};
+
+/* --------------------------------------------------------------------------------------------------------- */
+/* stress songs */
+
+/* the generated songs have to come out the same every time, or the numbers can't be compared */
+static uint32_t _bench_rand(uint32_t *seed)
+{
+	*seed = *seed * 1103515245 + 12345;
+	return (*seed >> 16) & 0x7fff;
+}
+
+/* sawtooth with some noise on it, so the interpolators have something to chew on */
+static void _bench_sample(song_sample_t *smp, uint32_t flags, uint32_t *seed)
+{
+	int chans = (flags & CHN_STEREO) ? 2 : 1;
+	uint32_t len = 4096 + _bench_rand(seed) % 28672, n;
+	int c;
+
+	smp->data = csf_allocate_sample(len * chans * ((flags & CHN_16BIT) ? 2 : 1));
+	for (n = 0; n < len; n++) {
+		for (c = 0; c < chans; c++) {
+			int v = (int) ((n * (3 + c)) & 0xff) - 128 + (int) (_bench_rand(seed) & 0x1f) - 16;
+			v = CLAMP(v, -128, 127);
+			if (flags & CHN_16BIT)
+				((int16_t *) smp->data)[n * chans + c] = v * 256;
+			else
+				smp->data[n * chans + c] = v;
+		}
+	}
+	smp->length = len;
+	smp->loop_start = len / 4;
+	smp->loop_end = len;
+	smp->flags = flags | CHN_LOOP;
+	smp->c5speed = 8363 + _bench_rand(seed) % 24000;
+	smp->volume = 64 * 4;
+	smp->global_volume = 64;
+}
+
+static song_note_t *_bench_pattern(song_t *song, int pat)
+{
+	song->patterns[pat] = csf_allocate_pattern(64);
+	song->pattern_size[pat] = song->pattern_alloc_size[pat] = 64;
+	song->orderlist[pat] = pat;
+	return song->patterns[pat];
+}
+
+/* Lots of short notes with note-fade NNA: every channel leaves a tail behind, so the voice count
+sits at (or pushes against) the limit. Half the instruments have a resonant filter on them. */
+static song_t *_bench_gen_nna(void)
+{
+	song_t *song = csf_allocate();
+	uint32_t seed = 1;
+	int n, pat, row, chan;
+
+	strcpy(song->title, "generated:nna");
+	song->flags = SONG_INSTRUMENTMODE;
+	song->initial_speed = 3;
+	song->initial_tempo = 150;
+
+	for (n = 1; n <= 8; n++) {
+		song_instrument_t *ins = song->instruments[n] = csf_allocate_instrument();
+
+		_bench_sample(&song->samples[n], (n & 2) ? CHN_16BIT : 0, &seed);
+		csf_init_instrument(ins, n);
+		ins->nna = NNA_NOTEFADE;
+		ins->fadeout = 8 << 5;
+		if (n & 1) {
+			ins->ifc = 0x80 | (32 + _bench_rand(&seed) % 80);
+			ins->ifr = 0x80 | (_bench_rand(&seed) % 100);
+		}
+	}
+
+	for (pat = 0; pat < 4; pat++) {
+		song_note_t *note = _bench_pattern(song, pat);
+		for (row = 0; row < 64; row++) {
+			for (chan = 0; chan < 64; chan++, note++) {
+				if (_bench_rand(&seed) % 3)
+					continue;
+				note->note = NOTE_FIRST + 36 + _bench_rand(&seed) % 36;
+				note->instrument = 1 + _bench_rand(&seed) % 8;
+				note->voleffect = VOLFX_PANNING;
+				note->volparam = _bench_rand(&seed) % 65;
+			}
+			note += MAX_CHANNELS - 64;
+		}
+	}
+
+	return song;
+}
+
+/* Sample mode, 16-bit stereo samples only, with effects that change the volume, panning, or pitch
+on every tick -- so the ramping and the per-tick bookkeeping get a workout too. */
+static song_t *_bench_gen_stereo16(void)
+{
+	static const uint8_t fx[][2] = {
+		{FX_VOLUMESLIDE, 0x04}, {FX_VOLUMESLIDE, 0x40},
+		{FX_PANNINGSLIDE, 0x08}, {FX_PANNINGSLIDE, 0x80},
+		{FX_VIBRATO, 0x48}, {FX_TONEPORTAMENTO, 0x20},
+	};
+	song_t *song = csf_allocate();
+	uint32_t seed = 2;
+	int n, pat, row, chan;
+
+	strcpy(song->title, "generated:stereo16");
+	song->initial_speed = 4;
+	song->initial_tempo = 140;
+
+	for (n = 1; n <= 8; n++)
+		_bench_sample(&song->samples[n], CHN_16BIT | CHN_STEREO, &seed);
+
+	for (pat = 0; pat < 4; pat++) {
+		song_note_t *note = _bench_pattern(song, pat);
+		for (row = 0; row < 64; row++) {
+			for (chan = 0; chan < 32; chan++, note++) {
+				if (_bench_rand(&seed) % 4 == 0) {
+					note->note = NOTE_FIRST + 36 + _bench_rand(&seed) % 36;
+					note->instrument = 1 + _bench_rand(&seed) % 8;
+				}
+				n = _bench_rand(&seed) % ARRAY_SIZE(fx);
+				note->effect = fx[n][0];
+				note->param = fx[n][1];
+			}
+			note += MAX_CHANNELS - 32;
+		}
+	}
+
+	return song;
+}
+
+/* Nine AdLib channels, for the self-test: the OPL chip has state of its own that has to follow the
+song around. (Saved as an S3M, since that's the only format that keeps AdLib samples.) */
+static song_t *_bench_gen_adlib(void)
+{
+	song_t *song = csf_allocate();
+	uint32_t seed = 3;
+	int n, pat, row, chan;
+
+	strcpy(song->title, "generated:adlib");
+	song->initial_speed = 3;
+	song->initial_tempo = 125;
+
+	for (n = 1; n <= 4; n++) {
+		song_sample_t *smp = song->samples + n;
+
+		/* any old patch, except that the carrier is loud and comes in fast enough to hear */
+		for (int b = 0; b < 11; b++)
+			smp->adlib_bytes[b] = _bench_rand(&seed);
+		smp->adlib_bytes[3] &= 0xc0; /* level */
+		smp->adlib_bytes[5] |= 0xc0; /* attack */
+		smp->adlib_bytes[7] &= 0x0f; /* sustain */
+		smp->flags = CHN_ADLIB;
+		smp->length = 1;
+		smp->data = csf_allocate_sample(1);
+		smp->c5speed = 8363;
+		smp->volume = 64 * 4;
+		smp->global_volume = 64;
+	}
+
+	for (pat = 0; pat < 2; pat++) {
+		song_note_t *note = _bench_pattern(song, pat);
+		for (row = 0; row < 64; row++) {
+			for (chan = 0; chan < 9; chan++, note++) {
+				if (_bench_rand(&seed) % 3)
+					continue;
+				note->note = (_bench_rand(&seed) % 8) ? NOTE_FIRST + 36 + _bench_rand(&seed) % 36 : NOTE_OFF;
+				note->instrument = 1 + _bench_rand(&seed) % 4;
+				note->voleffect = VOLFX_VOLUME;
+				note->volparam = _bench_rand(&seed) % 65;
+			}
+			note += MAX_CHANNELS - 9;
+		}
+	}
+
+	return song;
+}
+
+static const struct {
+	const char *name;
+	song_t *(*generate)(void);
+} bench_songs[] = {
+	{"generated:nna", _bench_gen_nna},
+	{"generated:stereo16", _bench_gen_stereo16},
+};
+
+/* Write the song out as an IT (or S3M) and read it back in, so it goes through the same loader (and
+the same sample/loop setup) as a real file. 'gen' is freed either way. */
+static song_t *_bench_reload_as(song_t *gen, int s3m)
+{
+	disko_t *ds = disko_memopen();
+	slurp_t fp = {0};
+	song_t *song = NULL;
+
+	if (ds && (s3m ? fmt_s3m_save_song : fmt_it_save_song)(ds, gen) == SAVE_SUCCESS && !ds->error) {
+		fp.data = ds->data;
+		fp.length = ds->length;
+		song = csf_allocate();
+		if ((s3m ? fmt_s3m_load_song : fmt_it_load_song)(song, &fp, 0) != LOAD_SUCCESS) {
+			csf_free(song);
+			song = NULL;
+		}
+	}
+	if (ds)
+		disko_memclose(ds, 0);
+	csf_free(gen);
+	return song;
+}
+
+static song_t *_bench_reload(song_t *gen)
+{
+	return _bench_reload_as(gen, 0);
+}
+
+/* --------------------------------------------------------------------------------------------------------- */
+
+static void _bench_strip_filters(song_t *song)
+{
+	int n;
+
+	for (n = 1; n <= MAX_INSTRUMENTS; n++) {
+		song_instrument_t *ins = song->instruments[n];
+		if (ins) {
+			ins->ifc &= ~0x80;
+			ins->ifr &= ~0x80;
+			ins->flags &= ~ENV_FILTER;
+		}
+	}
+	/* no Zxx filter macros either */
+	memset(song->midi_config.sfx, 0, sizeof(song->midi_config.sfx));
+	memset(song->midi_config.zxx, 0, sizeof(song->midi_config.zxx));
+}
+
+static void _bench_run(const char *name, song_t *song, int mode, int filters, int ramping, int seconds)
+{
+	int16_t buf[BENCH_FRAMES * 2];
+	uint64_t frames = 0, target = (uint64_t) seconds * BENCH_RATE, voices = 0;
+	uint32_t reads = 0, peak = 0;
+	struct timeval start, end;
+	double elapsed;
+
+	csf_set_wave_config(song, BENCH_RATE, 16, 2);
+	csf_set_resampling_mode(song, mode);
+	if (ramping)
+		song->mix_flags &= ~SNDMIX_NORAMPING;
+	else
+		song->mix_flags |= SNDMIX_NORAMPING;
+	/* time it like it's playing, not like it's being written to disk */
+	song->mix_flags &= ~SNDMIX_DIRECTTODISK;
+	song->max_voices = song->voice_count;
+	song->repeat_count = 0;
+	song->stop_at_order = song->stop_at_row = -1;
+	csf_set_current_order(song, 0);
+
+	gettimeofday(&start, NULL);
+	while (frames < target) {
+		unsigned int got = csf_read(song, buf, sizeof(buf));
+		if (!got) {
+			if (!frames)
+				break; /* nothing to play at all */
+			/* ran off the end; start it over */
+			csf_set_current_order(song, 0);
+			continue;
+		}
+		frames += got;
+		voices += song->mix_stat;
+		peak = MAX(peak, song->mix_stat);
+		reads++;
+	}
+	gettimeofday(&end, NULL);
+
+	elapsed = (end.tv_sec - start.tv_sec) + (end.tv_usec - start.tv_usec) / 1000000.0;
+	printf("%s\t%s\t%s\t%s\t%" PRIu64 "\t%.1f\t%.1f\t%" PRIu32 "\t%.2f\n",
+		name, bench_mode_names[mode], filters ? "on" : "off", ramping ? "on" : "off", frames,
+		frames ? elapsed * 1e9 / frames : 0.0,
+		reads ? (double) voices / reads : 0.0, peak,
+		elapsed > 0 ? (frames / (double) BENCH_RATE) / elapsed : 0.0);
+	fflush(stdout);
+}
+
+static void _bench_song(const char *name, song_t *song, int seconds)
+{
+	int filters, mode, ramping;
+
+	for (filters = 1; filters >= 0; filters--) {
+		if (!filters)
+			_bench_strip_filters(song);
+		for (mode = 0; mode < NUM_SRC_MODES; mode++)
+			for (ramping = 1; ramping >= 0; ramping--)
+				_bench_run(name, song, mode, filters, ramping, seconds);
+	}
+}
+
+/* --------------------------------------------------------------------------------------------------------- */
+/* sample decompression */
+
+struct bench_packed {
+	uint8_t *data;
+	size_t length;
+	uint32_t frames;
+	int is16, stereo;
+};
+
+/* Every sample in the song is compressed once up front, and then the whole lot is decompressed over and
+over (straight through it_decompress8/16, the same way csf_read_sample calls them) until the time's up. */
+static void _bench_decompress(const char *name, song_t *song, int it215, int seconds)
+{
+	struct bench_packed packed[MAX_SAMPLES];
+	uint64_t frames = 0, target = (uint64_t) seconds * 1000000, elapsed = 0;
+	uint32_t most = 0, per_pass = 0;
+	size_t compressed = 0;
+	int npacked = 0, n;
+	struct timeval start, end;
+	uint8_t *out;
+
+	for (n = 1; n <= MAX_SAMPLES; n++) {
+		song_sample_t *smp = song->samples + n;
+		struct bench_packed *p = packed + npacked;
+		disko_t *ds;
+
+		if (!smp->data || !smp->length || (smp->flags & CHN_ADLIB))
+			continue;
+		ds = disko_memopen();
+		if (!ds)
+			continue;
+		p->is16 = !!(smp->flags & CHN_16BIT);
+		p->stereo = !!(smp->flags & CHN_STEREO);
+		csf_write_sample(ds, smp, SF_LE | (it215 ? SF_IT215 : SF_IT214)
+			| (p->is16 ? SF_16 : SF_8) | (p->stereo ? SF_SS : SF_M), UINT32_MAX);
+		p->data = ds->data;
+		p->length = ds->length;
+		p->frames = smp->length;
+		if (disko_memclose(ds, 1) != DW_OK)
+			continue;
+		compressed += p->length;
+		per_pass += p->frames;
+		most = MAX(most, p->frames);
+		npacked++;
+	}
+	if (!npacked)
+		return;
+
+	out = mem_alloc(most * 4);
+	gettimeofday(&start, NULL);
+	while (elapsed < target) {
+		for (n = 0; n < npacked; n++) {
+			struct bench_packed *p = packed + n;
+			uint32_t used;
+
+			if (p->is16) {
+				used = it_decompress16(out, p->frames, p->data, p->length, it215, p->stereo ? 2 : 1);
+				if (p->stereo)
+					it_decompress16((int16_t *) out + 1, p->frames, p->data + used, p->length - used,
+						it215, 2);
+			} else {
+				used = it_decompress8(out, p->frames, p->data, p->length, it215, p->stereo ? 2 : 1);
+				if (p->stereo)
+					it_decompress8(out + 1, p->frames, p->data + used, p->length - used, it215, 2);
+			}
+		}
+		frames += per_pass;
+		gettimeofday(&end, NULL);
+		elapsed = (end.tv_sec - start.tv_sec) * (uint64_t) 1000000 + end.tv_usec - start.tv_usec;
+	}
+	free(out);
+	for (n = 0; n < npacked; n++)
+		free(packed[n].data);
+
+	printf("%s\t%s\t%d\t%zu\t%" PRIu32 "\t%.2f\t%.1f\n",
+		name, it215 ? "it215" : "it214", npacked, compressed, per_pass,
+		elapsed * 1000.0 / frames, frames / (elapsed / 1000000.0) / 1e6);
+	fflush(stdout);
+}
+
+typedef void (*bench_song_func)(const char *name, song_t *song, int seconds);
+
+/* the generated songs, then the files */
+static int _bench_all(char *const *files, int count, int seconds, bench_song_func func)
+{
+	int failed = 0, n;
+
+	for (n = 0; n < ARRAY_SIZE(bench_songs); n++) {
+		song_t *song = _bench_reload(bench_songs[n].generate());
+		if (!song) {
+			fprintf(stderr, "%s: couldn't generate song\n", bench_songs[n].name);
+			failed++;
+			continue;
+		}
+		func(bench_songs[n].name, song, seconds);
+		csf_free(song);
+	}
+
+	for (n = 0; n < count; n++) {
+		song_t *song = song_create_load(files[n]);
+		if (!song) {
+			int err = errno;
+			fprintf(stderr, "%s: %s\n", files[n], fmt_strerror(err));
+			failed++;
+			continue;
+		}
+		func(get_basename(files[n]), song, seconds);
+		csf_free(song);
+	}
+
+	return failed;
+}
+
+static void _bench_decompress_song(const char *name, song_t *song, int seconds)
+{
+	_bench_decompress(name, song, 0, seconds);
+	_bench_decompress(name, song, 1, seconds);
+}
+
+int mixbench_run(char *const *files, int count, int seconds)
+{
+	if (seconds <= 0)
+		seconds = 10;
+
+	printf("module\tinterpolation\tfilters\tramping\tframes\tns_per_frame"
+		"\tvoices_avg\tvoices_peak\trealtime\n");
+
+	return _bench_all(files, count, seconds, _bench_song);
+}
+
+int mixbench_decompress_run(char *const *files, int count, int seconds)
+{
+	if (seconds <= 0)
+		seconds = 10;
+
+	printf("module\tencoding\tsamples\tcompressed\tframes\tns_per_frame\tmframes_per_sec\n");
+
+	return _bench_all(files, count, seconds, _bench_decompress_song);
+}
+
+/* --------------------------------------------------------------------------------------------------------- */
+/* self-tests */
+
+#define CHECK_RATE 44100
+#define CHECK_MAX_SECONDS 60 /* nobody's going to sit through a file that loops forever */
+
+struct check_render {
+	const char *name;
+	song_t *song;
+	int16_t *data;
+	size_t frames;
+};
+
+static void _check_render(void *data, unsigned int job)
+{
+	struct check_render *r = (struct check_render *) data + job;
+	size_t alloc = CHECK_RATE * 4, most = (size_t) CHECK_RATE * CHECK_MAX_SECONDS;
+	song_t *song = r->song;
+
+	/* the same setup as a disk write */
+	song->mix_flags |= SNDMIX_DIRECTTODISK | SNDMIX_NOBACKWARDJUMPS;
+	song->repeat_count = -1;
+	song->buffer_count = 0;
+	song->flags &= ~(SONG_PAUSED | SONG_PATTERNLOOP | SONG_ENDREACHED);
+	song->stop_at_order = song->stop_at_row = -1;
+	csf_set_current_order(song, 0);
+
+	r->frames = 0;
+	r->data = mem_alloc(alloc * 2 * sizeof(int16_t));
+	while (r->frames < most && !(song->flags & SONG_ENDREACHED)) {
+		if (r->frames + BENCH_FRAMES > alloc) {
+			alloc *= 2;
+			r->data = mem_realloc(r->data, alloc * 2 * sizeof(int16_t));
+		}
+		r->frames += csf_read(song, r->data + 2 * r->frames, BENCH_FRAMES * 2 * sizeof(int16_t));
+	}
+}
+
+/* load everything (again), for one pass of the render test */
+static int _check_load(struct check_render *r, char *const *files, int count)
+{
+	int failed = 0, n, nr = 0;
+
+	for (n = 0; n < ARRAY_SIZE(bench_songs); n++, nr++) {
+		r[nr].name = bench_songs[n].name;
+		r[nr].song = _bench_reload(bench_songs[n].generate());
+	}
+	r[nr].name = "generated:adlib";
+	r[nr++].song = _bench_reload_as(_bench_gen_adlib(), 1);
+	for (n = 0; n < count; n++, nr++) {
+		r[nr].name = get_basename(files[n]);
+		r[nr].song = song_create_load(files[n]);
+	}
+
+	for (n = 0; n < nr; n++) {
+		if (r[n].song) {
+			/* the OPL chip gets made here, and that isn't safe to do on more than one thread */
+			csf_set_wave_config(r[n].song, CHECK_RATE, 16, 2);
+		} else {
+			failed++;
+		}
+		r[n].data = NULL;
+		r[n].frames = 0;
+	}
+	return failed;
+}
+
+static void _check_free(struct check_render *r, int nr)
+{
+	for (int n = 0; n < nr; n++) {
+		csf_free(r[n].song);
+		free(r[n].data);
+	}
+}
+
+/* Every song is rendered one at a time, and then all at once on as many threads as there are songs.
+Nothing a song plays with is supposed to be shared with any other song any more, so the output has to
+come out the same either way. (Songs that use random waveforms or instrument swing will differ anyway:
+those still use rand().) */
+static int _check_parallel(char *const *files, int count)
+{
+	int nr = ARRAY_SIZE(bench_songs) + 1 + count, failed = 0, n;
+	struct check_render *serial = mem_calloc(nr, sizeof(*serial));
+	struct check_render *parallel = mem_calloc(nr, sizeof(*parallel));
+	thread_pool_t *pool;
+
+	if (_check_load(serial, files, count) || _check_load(parallel, files, count)) {
+		for (n = 0; n < nr; n++) {
+			if (!serial[n].song)
+				fprintf(stderr, "%s: couldn't load song\n", serial[n].name);
+		}
+		_check_free(serial, nr);
+		_check_free(parallel, nr);
+		free(serial);
+		free(parallel);
+		return 1;
+	}
+
+	for (n = 0; n < nr; n++)
+		_check_render(serial, n);
+
+	pool = thread_pool_create(nr);
+	if (!pool) {
+		fprintf(stderr, "render: couldn't start threads\n");
+		failed++;
+	}
+	thread_pool_run(pool, _check_render, parallel, nr);
+	thread_pool_destroy(pool);
+
+	for (n = 0; n < nr; n++) {
+		size_t frame = 0, frames = MIN(serial[n].frames, parallel[n].frames);
+
+		while (frame < frames && !memcmp(serial[n].data + 2 * frame, parallel[n].data + 2 * frame,
+				2 * sizeof(int16_t)))
+			frame++;
+		if (frame < frames || serial[n].frames != parallel[n].frames) {
+			fprintf(stderr, "%s: parallel render differs from serial at frame %zu\n",
+				serial[n].name, frame);
+			failed++;
+		} else {
+			printf("render\t%s\t%zu\tok\n", serial[n].name, frame);
+		}
+	}
+	fflush(stdout);
+
+	_check_free(serial, nr);
+	_check_free(parallel, nr);
+	free(serial);
+	free(parallel);
+	return failed;
+}
+
+/* IT sample compression has to give back exactly what went in, going through csf_write_sample and
+csf_read_sample the same as a saved and loaded sample would. Lengths are picked around the block sizes
+(0x8000 frames for 8-bit data, 0x4000 for 16-bit), and the data is noise, a sawtooth that wraps around,
+a full-scale square wave, and silence. */
+static const char *const check_shapes[] = {"noise", "sawtooth", "square", "silence"};
+
+/* one sample value, 16-bit */
+static int _check_shape(int shape, uint32_t i, uint32_t *seed)
+{
+	switch (shape) {
+	case 0: return (int16_t) ((_bench_rand(seed) << 1) ^ _bench_rand(seed));
+	case 1: return (int16_t) (i * 97);
+	case 2: return ((i / 37) & 1) ? 0x7fff : -0x8000;
+	default: return 0;
+	}
+}
+
+static int _check_compress(void)
+{
+	static const uint32_t lengths[] = {
+		1, 2, 3, 0x3fff, 0x4000, 0x4001, 0x7fff, 0x8000, 0x8001, 0x10001,
+	};
+	int failed = 0, it215, is16, stereo, shape;
+	uint32_t seed = 4;
+
+	for (it215 = 0; it215 < 2; it215++)
+	for (is16 = 0; is16 < 2; is16++)
+	for (stereo = 0; stereo < 2; stereo++) {
+		uint32_t flags = (it215 ? SF_IT215 : SF_IT214) | (is16 ? SF_16 : SF_8)
+			| (stereo ? SF_SS : SF_M) | SF_LE;
+		uint64_t frames = 0;
+		int bad = 0, n;
+		char name[32];
+
+		snprintf(name, sizeof(name), "%s/%d-bit/%s", it215 ? "it215" : "it214", is16 ? 16 : 8,
+			stereo ? "stereo" : "mono");
+
+		for (n = 0; n < ARRAY_SIZE(lengths); n++)
+		for (shape = 0; shape < ARRAY_SIZE(check_shapes); shape++) {
+			song_sample_t in = {0}, out = {0};
+			uint32_t count = lengths[n] * (stereo ? 2 : 1), i;
+			size_t bytes = count * (is16 ? 2 : 1);
+			disko_t *ds;
+
+			in.length = out.length = lengths[n];
+			in.flags = (is16 ? CHN_16BIT : 0) | (stereo ? CHN_STEREO : 0);
+			in.data = csf_allocate_sample(bytes);
+			for (i = 0; i < count; i++) {
+				int v = _check_shape(shape, i, &seed);
+				if (is16)
+					((int16_t *) in.data)[i] = v;
+				else
+					in.data[i] = (shape == 2) ? v >> 8 : (int8_t) v;
+			}
+
+			ds = disko_memopen();
+			if (!ds) {
+				csf_free_sample(in.data);
+				bad++;
+				continue;
+			}
+			csf_write_sample(ds, &in, flags, UINT32_MAX);
+			if (ds->error || !csf_read_sample(&out, flags, ds->data, ds->length)
+					|| memcmp(in.data, out.data, bytes)) {
+				fprintf(stderr, "compress: %s, %s, %" PRIu32 " frames: round trip differs\n",
+					name, check_shapes[shape], lengths[n]);
+				bad++;
+			}
+			disko_memclose(ds, 0);
+			csf_free_sample(in.data);
+			csf_free_sample(out.data);
+			frames += lengths[n];
+		}
+
+		if (bad)
+			failed += bad;
+		else
+			printf("compress\t%s\t%" PRIu64 "\tok\n", name, frames);
+	}
+	fflush(stdout);
+
+	return failed;
+}
+
+/* The SIMD mixers have to give exactly what the C ones do, including at the top speed csf_process_tick
+allows (0xFF0000), where a whole mix buffer covers more of the sample than a 32-bit 16.16 position can
+reach. Each mixer does one MIXBUFFERSIZE buffer, forwards and backwards, at that speed and at a couple
+of ordinary ones; the mixed frames, the new position and the ramped volumes all have to match. */
+#define CHECK_MIX_LENGTH (MIXBUFFERSIZE * 0x100 + 64) /* frames, enough for a buffer at 0xFF0000 */
+
+static const char *const check_mix_modes[] = {"linear", "spline", "fir"};
+
+static int _check_simd_mix(void)
+{
+	static const int32_t increments[] = {0xFF0000, -0xFF0000, 0x12345, -0x9876};
+	static int mixa[MIXBUFFERSIZE * 2], mixb[MIXBUFFERSIZE * 2];
+	const size_t bytes = CHECK_MIX_LENGTH * 4; /* 16-bit stereo; the 8-bit and mono mixers use less */
+	signed char *data = csf_allocate_sample(bytes);
+	uint32_t seed = 5;
+	int failed = 0, mode, index, fast, n;
+	size_t i;
+
+	for (i = 0; i < bytes; i++)
+		data[i] = _bench_rand(&seed);
+
+	for (mode = 0; mode < ARRAY_SIZE(check_mix_modes); mode++) {
+		uint64_t frames = 0;
+		int bad = 0;
+
+		for (index = 0; index < MIXNDX_FILTER; index++)
+		for (fast = 0; fast < 2; fast++)
+		for (n = 0; n < ARRAY_SIZE(increments); n++) {
+			song_voice_t a = {0}, b;
+			mix_interface_t c_mix, simd_mix;
+
+			csf_get_mix_function((MIXNDX_LINEARSRC * (mode + 1)) | index, fast, &c_mix, &simd_mix);
+			if (c_mix == simd_mix)
+				continue; /* nothing to compare it to */
+
+			a.current_sample_data = data;
+			a.flags = ((index & MIXNDX_16BIT) ? CHN_16BIT : 0) | ((index & MIXNDX_STEREO) ? CHN_STEREO : 0);
+			a.position = (increments[n] < 0) ? CHECK_MIX_LENGTH - 16 : 16;
+			a.position_frac = 0x1234;
+			a.increment = increments[n];
+			a.right_volume = 0x800;
+			a.left_volume = 0x5ff;
+			a.right_ramp_volume = a.right_volume << VOLUMERAMPPRECISION;
+			a.left_ramp_volume = a.left_volume << VOLUMERAMPPRECISION;
+			a.right_ramp = 37;
+			a.left_ramp = -53;
+			b = a;
+
+			memset(mixa, 0, sizeof(mixa));
+			memset(mixb, 0, sizeof(mixb));
+			c_mix(&a, mixa, mixa + MIXBUFFERSIZE * 2);
+			simd_mix(&b, mixb, mixb + MIXBUFFERSIZE * 2);
+			frames += MIXBUFFERSIZE;
+
+			if (memcmp(mixa, mixb, sizeof(mixa)) || a.position != b.position
+			    || a.position_frac != b.position_frac
+			    || a.right_volume != b.right_volume || a.left_volume != b.left_volume
+			    || a.right_ramp_volume != b.right_ramp_volume || a.left_ramp_volume != b.left_ramp_volume) {
+				fprintf(stderr, "simd: %s, %s, %d-bit %s%s%s, increment %s0x%" PRIX32 ": differs from C\n",
+					csf_mix_functions_name(), check_mix_modes[mode], (index & MIXNDX_16BIT) ? 16 : 8,
+					(index & MIXNDX_STEREO) ? "stereo" : "mono", (index & MIXNDX_RAMP) ? ", ramp" : "",
+					fast ? ", fast" : "", (increments[n] < 0) ? "-" : "",
+					(uint32_t) ((increments[n] < 0) ? -increments[n] : increments[n]));
+				bad++;
+			}
+		}
+
+		if (bad)
+			failed += bad;
+		else if (frames)
+			printf("simd\t%s/%s\t%" PRIu64 "\tok\n", csf_mix_functions_name(), check_mix_modes[mode], frames);
+	}
+	fflush(stdout);
+
+	csf_free_sample(data);
+	return failed;
+}
+
+int mixbench_check_run(char *const *files, int count)
+{
+	int failed = 0;
+
+	printf("test\tname\tframes\tresult\n");
+	failed += _check_parallel(files, count);
+	failed += _check_compress();
+	failed += _check_simd_mix();
+
+	return failed;
+}
+
+/* --------------------------------------------------------------------------------------------------------- */
+/* decompressor fuzzing */
+
+/* Each file is taken to be compressed sample data, and decoded every way csf_read_sample could ask for it:
+8- and 16-bit, IT 2.14 and 2.15, mono and stereo (the right channel starting where the left one stopped).
+Then the same again for 'rounds' broken copies, with bits flipped, bytes or block sizes overwritten, junk
+added on, or the end cut off. Bad data is allowed to decode to garbage or stop early, but nothing may be
+read past the end of the input or written past the end of the output. The copies come from a fixed seed,
+so a failure can be repeated by running the same file again. */
+
+#define FUZZ_FRAMES 0x10001 /* past the end of the first block for both widths */
+#define FUZZ_SLACK 256 /* how much a broken copy can grow */
+#define FUZZ_GUARD 64
+
+/* 'data' has room for 'max' bytes */
+static void _fuzz_mutate(uint8_t *data, uint32_t *len, uint32_t max, uint32_t *seed)
+{
+	int edits = 1 + _bench_rand(seed) % 4;
+
+	while (edits--) {
+		uint32_t pos = *len ? _bench_rand(seed) % *len : 0;
+
+		switch (_bench_rand(seed) % 5) {
+		case 0:
+			if (*len)
+				data[pos] ^= 1 << (_bench_rand(seed) & 7);
+			break;
+		case 1:
+			if (*len)
+				data[pos] = _bench_rand(seed);
+			break;
+		case 2:
+			// a block size, or two bytes that could be taken for one
+			if (*len >= 2) {
+				pos = MIN(pos, *len - 2);
+				data[pos] = _bench_rand(seed);
+				data[pos + 1] = (_bench_rand(seed) & 1) ? 0xff : 0;
+			}
+			break;
+		case 3:
+			*len = *len ? _bench_rand(seed) % *len : 0;
+			break;
+		default: {
+			uint32_t add = _bench_rand(seed) % 32;
+			while (add-- && *len < max)
+				data[(*len)++] = _bench_rand(seed);
+			break;
+		}
+		}
+	}
+}
+
+/* Returns how many of the eight ways of decoding it went wrong. 'out' has room for FUZZ_FRAMES of 16-bit
+stereo and the guard after it. */
+static int _fuzz_decode(const char *name, uint32_t round, const uint8_t *data, uint32_t len, uint8_t *out)
+{
+	const size_t size = FUZZ_FRAMES * 2 * sizeof(int16_t);
+	int failed = 0, it215, is16, stereo;
+	uint8_t *copy;
+
+	// exactly as big as the data, so a memory checker notices anything read past the end
+	copy = mem_alloc(len ? len : 1);
+	memcpy(copy, data, len);
+
+	for (it215 = 0; it215 < 2; it215++)
+	for (is16 = 0; is16 < 2; is16++)
+	for (stereo = 0; stereo < 2; stereo++) {
+		size_t end = FUZZ_FRAMES * (stereo ? 2 : 1) * (is16 ? 2 : 1), i;
+		uint32_t used;
+
+		memset(out + end, 0xa5, size + FUZZ_GUARD - end);
+		if (is16) {
+			used = it_decompress16(out, FUZZ_FRAMES, copy, len, it215, stereo ? 2 : 1);
+			if (stereo && used <= len)
+				used += it_decompress16((int16_t *) out + 1, FUZZ_FRAMES, copy + used, len - used, it215, 2);
+		} else {
+			used = it_decompress8(out, FUZZ_FRAMES, copy, len, it215, stereo ? 2 : 1);
+			if (stereo && used <= len)
+				used += it_decompress8(out + 1, FUZZ_FRAMES, copy + used, len - used, it215, 2);
+		}
+
+		for (i = end; i < size + FUZZ_GUARD && out[i] == 0xa5; i++);
+		if (used > len || i < size + FUZZ_GUARD) {
+			fprintf(stderr, "decompress: %s, round %" PRIu32 ", %s/%d-bit/%s: %s\n", name, round,
+				it215 ? "it215" : "it214", is16 ? 16 : 8, stereo ? "stereo" : "mono",
+				(used > len) ? "used more data than there was" : "wrote past the end");
+			failed++;
+		}
+	}
+
+	free(copy);
+	return failed;
+}
+
+int mixbench_fuzz_decompress_run(char *const *files, int count, int rounds)
+{
+	uint8_t *out = mem_alloc(FUZZ_FRAMES * 2 * sizeof(int16_t) + FUZZ_GUARD);
+	uint8_t *data = NULL;
+	int failed = 0, n;
+
+	printf("test\tname\tinputs\tresult\n");
+	for (n = 0; n < count; n++) {
+		const char *name = get_basename(files[n]);
+		slurp_t *s = slurp(files[n], NULL, 0);
+		uint32_t seed = 1, len, round;
+		int bad;
+
+		if (!s) {
+			fprintf(stderr, "%s: %s\n", files[n], strerror(errno));
+			failed++;
+			continue;
+		}
+		data = mem_realloc(data, s->length + FUZZ_SLACK);
+
+		// round 0 is the file as it is
+		bad = 0;
+		for (round = 0; round <= (uint32_t) rounds; round++) {
+			len = MIN(s->length, UINT32_MAX - FUZZ_SLACK);
+			memcpy(data, s->data, len);
+			if (round)
+				_fuzz_mutate(data, &len, len + FUZZ_SLACK, &seed);
+			bad += _fuzz_decode(name, round, data, len, out);
+		}
+		unslurp(s);
+
+		if (bad)
+			failed += bad;
+		else
+			printf("decompress\t%s\t%d\tok\n", name, rounds + 1);
+		fflush(stdout);
+	}
+
+	free(data);
+	free(out);
+	return failed;
+}
@@ -41,33 +41,18 @@ song_t *current_song = NULL;
 
 unsigned int song_get_length_to(int order, int row)
 {
-	unsigned int t;
-
-	song_lock_audio();
-	current_song->stop_at_order = order;
-	current_song->stop_at_row = row;
-	t = csf_get_length(current_song);
-	current_song->stop_at_order = current_song->stop_at_row = -1;
-	song_unlock_audio();
-	return t;
+	return csf_get_length_to(current_song, order, row);
 }
 void song_get_at_time(unsigned int seconds, int *order, int *row)
 {
-	if (!seconds) {
-		if (order) *order = 0;
-		if (row) *row = 0;
-	} else {
-		song_lock_audio();
-		current_song->stop_at_order = MAX_ORDERS;
-		current_song->stop_at_row = 255; /* unpossible */
-		current_song->stop_at_time = seconds;
-		csf_get_length(current_song);
-		if (order) *order = current_song->stop_at_order;
-		if (row) *row = current_song->stop_at_row;
-		current_song->stop_at_order = current_song->stop_at_row = -1;
-		current_song->stop_at_time = 0;
-		song_unlock_audio();
+	int o = 0, r = 0;
+
+	if (seconds && !csf_get_position_at(current_song, seconds, &o, &r)) {
+		o = MAX_ORDERS;
+		r = 255; /* unpossible */
 	}
+	if (order) *order = o;
+	if (row) *row = r;
 }
 
 song_sample_t *song_get_sample(int n)
@@ -109,7 +94,7 @@ song_channel_t *song_get_channel(int n)
 
 song_voice_t *song_get_mix_channel(int n)
 {
-	if (n >= MAX_VOICES)
+	if (n >= (int) current_song->voice_count)
 		return NULL;
 	return (song_voice_t *) current_song->voices + n;
 }
@@ -118,7 +103,7 @@ int song_get_mix_state(unsigned int **channel_list)
 {
 	if (channel_list)
 		*channel_list = current_song->voice_mix;
-	return MIN(current_song->num_voices, max_voices);
+	return MIN(current_song->num_voices, current_song->max_voices);
 }
 
 // ------------------------------------------------------------------------
@@ -129,7 +114,7 @@ static int channel_states[64];  // saved ("real") mute settings; nonzero = muted
 
 static inline void _save_state(int channel)
 {
-	channel_states[channel] = current_song->voices[channel].flags & CHN_MUTE;
+	channel_states[channel] = current_song->channels[channel].flags & CHN_MUTE;
 }
 
 void song_save_channel_states(void)
@@ -139,28 +124,16 @@ void song_save_channel_states(void)
 	while (n-- > 0)
 		_save_state(n);
 }
-static inline void _fix_mutes_like(int chan)
-{
-	int i;
-	for (i = 0; i < MAX_VOICES; i++) {
-		if (i == chan) continue;
-		if (((int)current_song->voices[i].master_channel) != (chan+1)) continue;
-		current_song->voices[i].flags = (current_song->voices[i].flags & (~(CHN_MUTE)))
-				| (current_song->voices[chan].flags &   (CHN_MUTE));
-	}
-}
-
 void song_set_channel_mute(int channel, int muted)
 {
 	if (muted) {
 		current_song->channels[channel].flags |= CHN_MUTE;
-		current_song->voices[channel].flags |= CHN_MUTE;
 	} else {
 		current_song->channels[channel].flags &= ~CHN_MUTE;
-		current_song->voices[channel].flags &= ~CHN_MUTE;
 		_save_state(channel);
 	}
-	_fix_mutes_like(channel);
+	// the voices belong to the audio thread; they'll catch up in a moment
+	song_set_voice_mute(channel, muted);
 }
 
 // I don't think this is useful besides undoing a channel solo (a few lines
@@ -175,21 +148,20 @@ void song_restore_channel_states(void)
 
 void song_toggle_channel_mute(int channel)
 {
-	// i'm just going by the playing channel's state...
-	// if the actual channel is muted but not the playing one,
-	// tough luck :)
-	song_set_channel_mute(channel, (current_song->voices[channel].flags & CHN_MUTE) == 0);
+	// going by the channel setting rather than the playing voice, since
+	// the voice might not have caught up with the last toggle yet
+	song_set_channel_mute(channel, (current_song->channels[channel].flags & CHN_MUTE) == 0);
 }
 
 static int _soloed(int channel) {
 	int n = 64;
 	// if this channel is muted, it obviously isn't soloed
-	if (current_song->voices[channel].flags & CHN_MUTE)
+	if (current_song->channels[channel].flags & CHN_MUTE)
 		return 0;
 	while (n-- > 0) {
 		if (n == channel)
 			continue;
-		if (!(current_song->voices[n].flags & CHN_MUTE))
+		if (!(current_song->channels[n].flags & CHN_MUTE))
 			return 0;
 	}
 	return 1;
@@ -292,6 +264,7 @@ void song_pattern_install(int patno, song_note_t *n, int rows)
 	current_song->patterns[patno] = n;
 	current_song->pattern_alloc_size[patno] = rows;
 	current_song->pattern_size[patno] = rows;
+	csf_timeline_invalidate(current_song, patno);
 
 	song_unlock_audio();
 }
@@ -483,6 +456,7 @@ void song_exchange_samples(int a, int b)
 		return;
 
 	song_lock_audio();
+	csf_snapshot_free(current_song);
 	song_sample_t tmp;
 	memcpy(&tmp, current_song->samples + a, sizeof(song_sample_t));
 	memcpy(current_song->samples + a, current_song->samples + b, sizeof(song_sample_t));
@@ -496,6 +470,7 @@ void song_copy_instrument(int dst, int src)
 	if (src == dst) return;
 
 	song_lock_audio();
+	csf_snapshot_free(current_song);
 	song_get_instrument(dst);
 	song_get_instrument(src);
 	*(current_song->instruments[dst]) = *(current_song->instruments[src]);
@@ -511,6 +486,7 @@ void song_exchange_instruments(int a, int b)
 	song_instrument_t *tmp;
 
 	song_lock_audio();
+	csf_snapshot_free(current_song);
 	tmp = current_song->instruments[a];
 	current_song->instruments[a] = current_song->instruments[b];
 	current_song->instruments[b] = tmp;
@@ -640,6 +616,7 @@ void song_insert_sample_slot(int n)
 
 	status.flags |= SONG_NEEDS_SAVE;
 	song_lock_audio();
+	csf_snapshot_free(current_song);
 
 	memmove(current_song->samples + n + 1, current_song->samples + n, (MAX_SAMPLES - n - 1) * sizeof(song_sample_t));
 	memset(current_song->samples + n, 0, sizeof(song_sample_t));
@@ -660,6 +637,7 @@ void song_remove_sample_slot(int n)
 		return;
 
 	song_lock_audio();
+	csf_snapshot_free(current_song);
 
 	status.flags |= SONG_NEEDS_SAVE;
 	memmove(current_song->samples + n, current_song->samples + n + 1, (MAX_SAMPLES - n - 1) * sizeof(song_sample_t));
@@ -685,6 +663,7 @@ void song_insert_instrument_slot(int n)
 
 	status.flags |= SONG_NEEDS_SAVE;
 	song_lock_audio();
+	csf_snapshot_free(current_song);
 	for (i = MAX_INSTRUMENTS - 1; i > n; i--)
 		current_song->instruments[i] = current_song->instruments[i-1];
 	current_song->instruments[n] = NULL;
@@ -700,6 +679,7 @@ void song_remove_instrument_slot(int n)
 		return;
 
 	song_lock_audio();
+	csf_snapshot_free(current_song);
 	for (i = n; i < MAX_INSTRUMENTS; i++)
 		current_song->instruments[i] = current_song->instruments[i+1];
 	current_song->instruments[MAX_INSTRUMENTS - 1] = NULL;
@@ -717,6 +697,7 @@ void song_wipe_instrument(int n)
 
 	status.flags |= SONG_NEEDS_SAVE;
 	song_lock_audio();
+	csf_snapshot_free(current_song);
 	csf_free_instrument(current_song->instruments[n]);
 	current_song->instruments[n] = NULL;
 	song_unlock_audio();
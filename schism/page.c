@@ -1809,6 +1809,9 @@ static void _timejump_ok(UNUSED void *ign)
 	int no, np, nr;
 	sec = (_timejump_widgets[0].d.numentry.value * 60)
 		+ _timejump_widgets[1].d.numentry.value;
+	/* if it's playing, take the playback there too -- the real way, not just from that row */
+	if (song_get_mode() == MODE_PLAYING)
+		song_start_at_time(sec * 1000);
 	song_get_at_time(sec, &no, &nr);
 	set_current_order(no);
 	np = current_song->orderlist[no];
@@ -103,7 +103,9 @@ static void change_ui_settings(void)
 		? KBD_SHARP_FLAT_FLATS
 		: KBD_SHARP_FLAT_SHARPS);
 
-	GM_Reset(0);
+	song_lock_audio();
+	GM_Reset(current_song, 0);
+	song_unlock_audio();
 	if (widgets_config[8].d.toggle.state) {
 		status.flags |= MIDI_LIKE_TRACKER;
 	} else {
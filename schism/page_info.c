@@ -163,7 +163,7 @@ static void info_draw_technical(int base, int height, int active, int first_chan
 
 			/* count how many voices claim this channel */
 			int nv, tot;
-			for (nv = tot = 0; nv < MAX_VOICES; nv++) {
+			for (nv = tot = 0; nv < (int) current_song->voice_count; nv++) {
 				song_voice_t *v = current_song->voices + nv;
 				if (v->master_channel == (unsigned int) c && v->current_sample_data && v->length)
 					tot++;
@@ -32,6 +32,7 @@
 #include "vgamem.h"
 
 #include "sdlmain.h"
+#include "event.h"
 
 #include <stdarg.h>
 #include <errno.h>
@@ -59,6 +60,19 @@ static struct log_line lines[NUM_LINES];
 static int top_line = 0;
 static int last_line = -1;
 
+/* Lines logged from any thread but the main one (e.g. by a format probe running in the file browser's
+worker threads) wait here until the main thread gets around to them. */
+struct log_pending {
+	struct log_line line;
+	struct log_pending *next;
+};
+static SDL_threadID log_main_thread;
+static SDL_mutex *log_pending_mutex = NULL;
+static struct log_pending *log_pending_head = NULL, **log_pending_tail = &log_pending_head;
+
+/* no window to show the log in, so the lines go to stderr as well */
+static int log_headless = 0;
+
 /* --------------------------------------------------------------------- */
 
 static void log_draw_const(void)
@@ -123,6 +137,8 @@ static void log_redraw(void)
 {
 	int n, i;
 
+	log_flush();
+
 	i = top_line;
 	for (n = 0; n <= last_line && n < 33; n++, i++) {
 		if (!lines[i].text) continue;
@@ -153,8 +169,65 @@ void log_load_page(struct page *page)
 
 /* --------------------------------------------------------------------- */
 
+void log_flush(void)
+{
+	struct log_pending *p, *next;
+
+	if (!log_pending_mutex || SDL_ThreadID() != log_main_thread)
+		return;
+
+	SDL_LockMutex(log_pending_mutex);
+	p = log_pending_head;
+	log_pending_head = NULL;
+	log_pending_tail = &log_pending_head;
+	SDL_UnlockMutex(log_pending_mutex);
+
+	for (; p; p = next) {
+		next = p->next;
+		log_append2(p->line.bios_font, p->line.color, p->line.must_free, p->line.text);
+		free(p);
+	}
+}
+
+/* --------------------------------------------------------------------- */
+
 void log_append2(int bios_font, int color, int must_free, const char *text)
 {
+	if (!log_pending_mutex) {
+		/* the first line (the banner, from main) is logged before any other threads exist */
+		log_main_thread = SDL_ThreadID();
+		log_pending_mutex = SDL_CreateMutex();
+	} else if (SDL_ThreadID() != log_main_thread) {
+		struct log_pending *p = mem_alloc(sizeof(struct log_pending));
+
+		p->line.text = text;
+		p->line.color = color;
+		p->line.must_free = must_free;
+		p->line.bios_font = bios_font;
+		p->next = NULL;
+
+		SDL_LockMutex(log_pending_mutex);
+		*log_pending_tail = p;
+		log_pending_tail = &p->next;
+		SDL_UnlockMutex(log_pending_mutex);
+
+		/* the main loop could be asleep; poke it so the line shows up */
+		if (status.current_page == PAGE_LOG) {
+			SDL_Event e = { .user = { .type = SCHISM_EVENT_WAKEUP } };
+			SDL_PushEvent(&e);
+		}
+		return;
+	}
+	log_flush();
+
+	if (log_headless) {
+		const char *s;
+
+		for (s = text; *s; s++)
+			fputc(((unsigned char) *s == 0x81) ? '-' : *s, stderr); /* 0x81 is log_underline's */
+		fputc('\n', stderr);
+	}
+
 	if (last_line < NUM_LINES - 1) {
 		last_line++;
 	} else {
@@ -171,6 +244,11 @@ void log_append2(int bios_font, int color, int must_free, const char *text)
 	if (status.current_page == PAGE_LOG)
 		status.flags |= NEED_UPDATE;
 }
+void log_set_headless(int headless)
+{
+	log_headless = headless;
+}
+
 void log_append(int color, int must_free, const char *text)
 {
 	log_append2(0, color, must_free, text);
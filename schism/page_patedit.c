@@ -270,6 +270,16 @@ static void recalculate_visible_area(void);
 static void set_view_scheme(int scheme);
 static void pattern_editor_reposition(void);
 
+/* --------------------------------------------------------------------------------------------------------- */
+
+/* The song's timeline (the clock in the corner, the length dialog) caches where each pattern gets
+played, so anything that writes into a pattern has to throw that away too. */
+static void pattern_modified(int pattern)
+{
+	status.flags |= SONG_NEEDS_SAVE;
+	csf_timeline_invalidate(current_song, pattern);
+}
+
 /* --------------------------------------------------------------------------------------------------------- */
 /* options dialog */
 
@@ -563,7 +573,8 @@ static void copyin_addnote(song_note_t *note, int *copyin_x, int *copyin_y)
 	song_note_t *pattern, *p_note;
 	int num_rows;
 
-	status.flags |= (SONG_NEEDS_SAVE|NEED_UPDATE);
+	status.flags |= NEED_UPDATE;
+	pattern_modified(current_pattern);
 	num_rows = song_get_pattern(current_pattern, &pattern);
 	if ((*copyin_x + (current_channel-1)) >= 64) return;
 	if ((*copyin_y + current_row) >= num_rows) return;
@@ -1211,7 +1222,7 @@ static void block_length_double(void)
 	if (!SELECTION_EXISTS)
 		return;
 
-	status.flags |= SONG_NEEDS_SAVE;
+	pattern_modified(current_pattern);
 	total_rows = song_get_pattern(current_pattern, &pattern);
 
 	if (selection.last_row >= total_rows)
@@ -1253,7 +1264,7 @@ static void block_length_halve(void)
 	if (!SELECTION_EXISTS)
 		return;
 
-	status.flags |= SONG_NEEDS_SAVE;
+	pattern_modified(current_pattern);
 	total_rows = song_get_pattern(current_pattern, &pattern);
 
 	if (selection.last_row >= total_rows)
@@ -1291,7 +1302,7 @@ static void selection_erase(void)
 	if (!SELECTION_EXISTS)
 		return;
 
-	status.flags |= SONG_NEEDS_SAVE;
+	pattern_modified(current_pattern);
 	total_rows = song_get_pattern(current_pattern, &pattern);
 	if (selection.last_row >= total_rows)selection.last_row = total_rows-1;
 	if (selection.first_row > selection.last_row) selection.first_row = selection.last_row;
@@ -1325,7 +1336,7 @@ static void selection_set_sample(void)
 	if (selection.last_row >= total_rows)selection.last_row = total_rows-1;
 	if (selection.first_row > selection.last_row) selection.first_row = selection.last_row;
 
-	status.flags |= SONG_NEEDS_SAVE;
+	pattern_modified(current_pattern);
 	pated_history_add("Undo set sample/instrument     (Alt-S)",
 		selection.first_channel - 1,
 		selection.first_row,
@@ -1359,7 +1370,7 @@ static void selection_swap(void)
 
 	CHECK_FOR_SELECTION(return);
 
-	status.flags |= SONG_NEEDS_SAVE;
+	pattern_modified(current_pattern);
 	total_rows = song_get_pattern(current_pattern, &pattern);
 	if (selection.last_row >= total_rows)selection.last_row = total_rows-1;
 	if (selection.first_row > selection.last_row) selection.first_row = selection.last_row;
@@ -1409,7 +1420,7 @@ static void selection_set_volume(void)
 
 	CHECK_FOR_SELECTION(return);
 
-	status.flags |= SONG_NEEDS_SAVE;
+	pattern_modified(current_pattern);
 	total_rows = song_get_pattern(current_pattern, &pattern);
 	if (selection.last_row >= total_rows)selection.last_row = total_rows-1;
 	if (selection.first_row > selection.last_row) selection.first_row = selection.last_row;
@@ -1449,7 +1460,7 @@ static void selection_slide_volume(void)
 	if (selection.first_row == selection.last_row)
 		return;
 
-	status.flags |= SONG_NEEDS_SAVE;
+	pattern_modified(current_pattern);
 
 	pated_history_add("Undo volume or panning slide   (Alt-K)",
 		selection.first_channel - 1,
@@ -1521,7 +1532,7 @@ static void selection_wipe_volume(int reckless)
 	if (selection.last_row >= total_rows)selection.last_row = total_rows-1;
 	if (selection.first_row > selection.last_row) selection.first_row = selection.last_row;
 
-	status.flags |= SONG_NEEDS_SAVE;
+	pattern_modified(current_pattern);
 
 	pated_history_add((reckless
 				? "Recover volumes/pannings     (2*Alt-K)"
@@ -1605,7 +1616,7 @@ static void selection_vary(int fast, int depth, int how)
 
 	CHECK_FOR_SELECTION(return);
 
-	status.flags |= SONG_NEEDS_SAVE;
+	pattern_modified(current_pattern);
 	switch (how) {
 	case FX_CHANNELVOLUME:
 	case FX_CHANNELVOLSLIDE:
@@ -1719,7 +1730,7 @@ static void selection_amplify(int percentage)
 	if (!SELECTION_EXISTS)
 		return;
 
-	status.flags |= SONG_NEEDS_SAVE;
+	pattern_modified(current_pattern);
 	total_rows = song_get_pattern(current_pattern, &pattern);
 	if (selection.last_row >= total_rows)selection.last_row = total_rows-1;
 	if (selection.first_row > selection.last_row) selection.first_row = selection.last_row;
@@ -1771,7 +1782,7 @@ static void selection_slide_effect(void)
 	if (selection.first_row == selection.last_row)
 		return;
 
-	status.flags |= SONG_NEEDS_SAVE;
+	pattern_modified(current_pattern);
 
 	pated_history_add("Undo effect data slide         (Alt-X)",
 		selection.first_channel - 1,
@@ -1805,7 +1816,7 @@ static void selection_wipe_effect(void)
 	if (selection.last_row >= total_rows)selection.last_row = total_rows-1;
 	if (selection.first_row > selection.last_row) selection.first_row = selection.last_row;
 
-	status.flags |= SONG_NEEDS_SAVE;
+	pattern_modified(current_pattern);
 
 	pated_history_add("Recover effects/effect data  (2*Alt-X)",
 		selection.first_channel - 1,
@@ -1848,7 +1859,7 @@ static void selection_roll(enum roll_dir direction)
 	}
 	memcpy(seldata + 64 * row, temp, copy_bytes);
 
-	status.flags |= SONG_NEEDS_SAVE;
+	pattern_modified(current_pattern);
 }
 
 /* --------------------------------------------------------------------------------------------------------- */
@@ -1862,7 +1873,7 @@ static void pattern_insert_rows(int what_row, int num_rows, int first_channel, i
 	song_note_t *pattern;
 	int row, total_rows = song_get_pattern(current_pattern, &pattern);
 
-	status.flags |= SONG_NEEDS_SAVE;
+	pattern_modified(current_pattern);
 	if (first_channel < 1)
 		first_channel = 1;
 	if (chan_width + first_channel - 1 > 64)
@@ -1895,7 +1906,7 @@ static void pattern_delete_rows(int what_row, int num_rows, int first_channel, i
 	song_note_t *pattern;
 	int row, total_rows = song_get_pattern(current_pattern, &pattern);
 
-	status.flags |= SONG_NEEDS_SAVE;
+	pattern_modified(current_pattern);
 	if (first_channel < 1)
 		first_channel = 1;
 	if (chan_width + first_channel - 1 > 64)
@@ -1958,7 +1969,7 @@ static void snap_paste(struct pattern_snap *s, int x, int y, int xlate)
 	int chan;
 
 
-	status.flags |= SONG_NEEDS_SAVE;
+	pattern_modified(current_pattern);
 	if (x < 0) x = s->x;
 	if (y < 0) y = s->y;
 
@@ -2211,7 +2222,7 @@ static void clipboard_paste_mix_notes(int clip, int xlate)
 		return;
 	}
 
-	status.flags |= SONG_NEEDS_SAVE;
+	pattern_modified(current_pattern);
 	num_rows = song_get_pattern(current_pattern, &pattern);
 	num_rows -= current_row;
 	if (clipboard.rows < num_rows)
@@ -2269,7 +2280,7 @@ static void clipboard_paste_mix_fields(int prec, int xlate)
 		return;
 	}
 
-	status.flags |= SONG_NEEDS_SAVE;
+	pattern_modified(current_pattern);
 	num_rows = song_get_pattern(current_pattern, &pattern);
 	num_rows -= current_row;
 	if (clipboard.rows < num_rows)
@@ -2715,7 +2726,7 @@ static void transpose_notes(int amount)
 	int row, chan;
 	song_note_t *pattern, *note;
 
-	status.flags |= SONG_NEEDS_SAVE;
+	pattern_modified(current_pattern);
 	song_get_pattern(current_pattern, &pattern);
 
 	pated_history_add_grouped(((amount > 0)
@@ -2979,8 +2990,6 @@ static int pattern_editor_insert_midi(struct key_event *k)
 		smp = sample_get_current();
 	}
 
-	status.flags |= SONG_NEEDS_SAVE;
-
 	speed = song_get_current_speed();
 	tick = song_get_current_tick();
 
@@ -3011,6 +3020,7 @@ static int pattern_editor_insert_midi(struct key_event *k)
 	}
 
 	song_get_pattern_offset(&p, &pattern, &r, offset);
+	pattern_modified(p);
 
 	if (k->midi_note == -1) {
 		/* nada */
@@ -3230,6 +3240,8 @@ static int pattern_editor_insert(struct key_event *k)
 
 
 		int writenote = (keyjazz_capslock) ? !(k->mod & KMOD_CAPS) : !(status.flags & CAPS_PRESSED);
+		if (writenote)
+			csf_timeline_invalidate(current_song, current_pattern);
 		if (writenote && !patedit_record_note(cur_note, current_channel, current_row, n, 1)) {
 			// there was a template error, don't advance the cursor and so on
 			writenote = 0;
@@ -3295,7 +3307,7 @@ static int pattern_editor_insert(struct key_event *k)
 			cur_note->note = n;
 		}
 		advance_cursor(1, 0);
-		status.flags |= SONG_NEEDS_SAVE;
+		pattern_modified(current_pattern);
 		pattern_selection_system_copyout();
 		break;
 	case 2:                 /* instrument, first digit */
@@ -3309,7 +3321,7 @@ static int pattern_editor_insert(struct key_event *k)
 				current_song->voices[current_channel - 1].last_instrument = n;
 			cur_note->instrument = n;
 			advance_cursor(1, 0);
-			status.flags |= SONG_NEEDS_SAVE;
+			pattern_modified(current_pattern);
 			break;
 		}
 		if (kbd_get_note(k) == 0) {
@@ -3319,7 +3331,7 @@ static int pattern_editor_insert(struct key_event *k)
 			else
 				sample_set(0);
 			advance_cursor(1, 0);
-			status.flags |= SONG_NEEDS_SAVE;
+			pattern_modified(current_pattern);
 			break;
 		}
 
@@ -3361,7 +3373,7 @@ static int pattern_editor_insert(struct key_event *k)
 			instrument_set(n);
 		else
 			sample_set(n);
-		status.flags |= SONG_NEEDS_SAVE;
+		pattern_modified(current_pattern);
 		pattern_selection_system_copyout();
 		break;
 	case 4:
@@ -3370,14 +3382,14 @@ static int pattern_editor_insert(struct key_event *k)
 			cur_note->volparam = mask_note.volparam;
 			cur_note->voleffect = mask_note.voleffect;
 			advance_cursor(1, 0);
-			status.flags |= SONG_NEEDS_SAVE;
+			pattern_modified(current_pattern);
 			break;
 		}
 		if (kbd_get_note(k) == 0) {
 			cur_note->volparam = mask_note.volparam = 0;
 			cur_note->voleffect = mask_note.voleffect = VOLFX_NONE;
 			advance_cursor(1, 0);
-			status.flags |= SONG_NEEDS_SAVE;
+			pattern_modified(current_pattern);
 			break;
 		}
 		if (k->scancode == SDL_SCANCODE_GRAVE) {
@@ -3395,7 +3407,7 @@ static int pattern_editor_insert(struct key_event *k)
 			current_position = 4;
 			advance_cursor(1, 0);
 		}
-		status.flags |= SONG_NEEDS_SAVE;
+		pattern_modified(current_pattern);
 		pattern_selection_system_copyout();
 		break;
 	case 6:                 /* effect */
@@ -3407,7 +3419,7 @@ static int pattern_editor_insert(struct key_event *k)
 				return 0;
 			cur_note->effect = mask_note.effect = n;
 		}
-		status.flags |= SONG_NEEDS_SAVE;
+		pattern_modified(current_pattern);
 		if (link_effect_column)
 			current_position++;
 		else
@@ -3420,14 +3432,14 @@ static int pattern_editor_insert(struct key_event *k)
 			cur_note->param = mask_note.param;
 			current_position = link_effect_column ? 6 : 7;
 			advance_cursor(1, 0);
-			status.flags |= SONG_NEEDS_SAVE;
+			pattern_modified(current_pattern);
 			pattern_selection_system_copyout();
 			break;
 		} else if (kbd_get_note(k) == 0) {
 			cur_note->param = mask_note.param = 0;
 			current_position = link_effect_column ? 6 : 7;
 			advance_cursor(1, 0);
-			status.flags |= SONG_NEEDS_SAVE;
+			pattern_modified(current_pattern);
 			pattern_selection_system_copyout();
 			break;
 		}
@@ -3445,7 +3457,7 @@ static int pattern_editor_insert(struct key_event *k)
 			current_position = link_effect_column ? 6 : 7;
 			advance_cursor(1, 0);
 		}
-		status.flags |= SONG_NEEDS_SAVE;
+		pattern_modified(current_pattern);
 		mask_note.param = cur_note->param;
 		pattern_selection_system_copyout();
 		break;
@@ -4438,7 +4450,7 @@ static int pattern_editor_handle_key(struct key_event * k)
  * called from the main key handler.
  * pattern_editor_handle_*_key above do the actual work. */
 
-static int pattern_editor_handle_key_cb(struct key_event * k)
+static int pattern_editor_handle_key_main(struct key_event * k)
 {
 	int ret;
 	int total_rows = song_get_rows_in_pattern(current_pattern);
@@ -4566,6 +4578,6 @@ void pattern_editor_load_page(struct page *page)
 	page->widgets = widgets_pattern;
 	page->help_index = HELP_PATTERN_EDITOR;
 
-	widget_create_other(widgets_pattern + 0, 0, pattern_editor_handle_key_cb, NULL, pattern_editor_redraw);
+	widget_create_other(widgets_pattern + 0, 0, pattern_editor_handle_key_main, NULL, pattern_editor_redraw);
 }
 
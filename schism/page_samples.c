@@ -31,6 +31,7 @@
 #include "keyboard.h"
 #include "page.h"
 #include "sample-edit.h"
+#include "sample-view.h"
 #include "song.h"
 #include "vgamem.h"
 #include "widget.h"
@@ -645,6 +646,7 @@ static void do_post_loop_cut(UNUSED void *bweh) /* I'm already using 'data'. */
 
 	song_lock_audio();
 	csf_stop_sample(current_song, sample);
+	csf_snapshot_free(current_song);
 	if (sample->loop_end > pos) sample->loop_end = pos;
 	if (sample->sustain_end > pos) sample->sustain_end = pos;
 
@@ -671,7 +673,9 @@ static void do_pre_loop_cut(UNUSED void *bweh)
 
 	song_lock_audio();
 	csf_stop_sample(current_song, sample);
+	csf_snapshot_free(current_song);
 	memmove(sample->data, sample->data + start_byte, bytes);
+	sample_view_invalidate(sample->data);
 	sample->length -= pos;
 
 	if (sample->loop_start > pos)
@@ -28,6 +28,7 @@
 #include "song.h"
 #include "widget.h"
 #include "vgamem.h"
+#include "sdlmain.h"
 
 #include <math.h>
 
@@ -42,6 +43,7 @@
 #define FFT_BUFFER_SIZE         2048 /*(1 << FFT_BUFFER_SIZE_LOG)*/
 #define FFT_OUTPUT_SIZE         1024 /* FFT_BUFFER_SIZE/2 */  /*WARNING: Hardcoded in page.c when declaring current_fft_data*/
 #define FFT_BANDS_SIZE          256    /*WARNING: Hardcoded in page.c when declaring fftlog and when using it in vis_fft*/
+#define VIS_REFRESH_MS          16     /* how often the FFT is redone while playing, about 60 fps */
 #define PI      ((double)3.14159265358979323846)
 /*This value is used internally to scale the power output of the FFT to decibells.*/
 static const float fft_inv_bufsize = 1.0f/(FFT_BUFFER_SIZE>>2);
@@ -53,6 +55,8 @@ short current_fft_data[2][FFT_OUTPUT_SIZE];
 short fftlog[FFT_BANDS_SIZE];
 
 void vis_init(void);
+void vis_update(void);
+int vis_update_wait(void);
 void vis_work_16s(short *in, int inlen);
 void vis_work_16m(short *in, int inlen);
 void vis_work_8s(char *in, int inlen);
@@ -77,6 +81,22 @@ static float presin[FFT_OUTPUT_SIZE];
 static float state_real[FFT_BUFFER_SIZE];
 static float state_imag[FFT_BUFFER_SIZE];
 
+/* The audio callback only copies what it played into this ring; the FFT
+ * itself runs on the main thread in vis_update. There's exactly one writer
+ * (the callback, which owns vis_ring_head) and one reader (vis_update, which
+ * owns vis_ring_tail). If the ring is full the callback throws the block
+ * away rather than waiting, and if the reader falls behind it just skips
+ * to the newest FFT_BUFFER_SIZE frames. */
+#define VIS_RING_SIZE           8192 /* frames; must be a power of two */
+#define VIS_RING_MASK           (VIS_RING_SIZE - 1)
+static short vis_ring[VIS_RING_SIZE][2];
+static SDL_atomic_t vis_ring_head, vis_ring_tail;
+static SDL_atomic_t vis_ring_mono; /* last block written was mono */
+static SDL_atomic_t vis_ring_reset; /* playback stopped; clear everything */
+
+/* the most recent FFT_BUFFER_SIZE frames, oldest first (main thread only) */
+static short vis_history[FFT_BUFFER_SIZE][2];
+
 
 static int _reverse_bits(unsigned int in) {
 	unsigned int r = 0, n;
@@ -303,87 +323,154 @@ static void _vis_process(void)
 	status.flags |= NEED_UPDATE;
 }
 
-void vis_work_16s(short *in, int inlen)
+/* Returns where to write 'inlen' frames in the ring, or -1 if they don't fit
+ * (in which case they're dropped). Called from the audio thread. */
+static int _vis_ring_reserve(int inlen, int is_mono)
 {
-	short dl[FFT_BUFFER_SIZE];
-	short dr[FFT_BUFFER_SIZE];
-	int i, j, k;
+	unsigned int head = SDL_AtomicGet(&vis_ring_head);
+	unsigned int tail = SDL_AtomicGet(&vis_ring_tail);
 
 	if (!inlen) {
-		memset(current_fft_data[0], 0, FFT_OUTPUT_SIZE*2);
-		memset(current_fft_data[1], 0, FFT_OUTPUT_SIZE*2);
-	} else {
-		for (i = 0; i < FFT_BUFFER_SIZE;) {
-			for (k = j = 0; k < inlen && i < FFT_BUFFER_SIZE; k++, i++) {
-				dl[i] = in[j]; j++;
-				dr[i] = in[j]; j++;
-			}
-		}
-		_vis_data_work(current_fft_data[0], dl);
-		_vis_data_work(current_fft_data[1], dr);
+		SDL_AtomicSet(&vis_ring_reset, 1);
+		return -1;
 	}
-	if (status.current_page == PAGE_WATERFALL) _vis_process();
+	if ((unsigned int) inlen > VIS_RING_SIZE - (head - tail))
+		return -1;
+
+	SDL_AtomicSet(&vis_ring_mono, is_mono);
+	return head & VIS_RING_MASK;
 }
-void vis_work_16m(short *in, int inlen)
+
+static void _vis_ring_commit(int inlen)
 {
-	short d[FFT_BUFFER_SIZE];
-	int i, k;
+	/* SDL_AtomicAdd is a full barrier, so the frames are visible first */
+	SDL_AtomicAdd(&vis_ring_head, inlen);
+}
 
-	if (!inlen) {
-		memset(current_fft_data[0], 0, FFT_OUTPUT_SIZE*2);
-		memset(current_fft_data[1], 0, FFT_OUTPUT_SIZE*2);
-	} else {
-		for (i = 0; i < FFT_BUFFER_SIZE;) {
-			for (k = 0; k < inlen && i < FFT_BUFFER_SIZE; k++, i++) {
-				d[i] = in[k];
-			}
-		}
-		_vis_data_work(current_fft_data[0], d);
-		memcpy(current_fft_data[1], current_fft_data[0], FFT_OUTPUT_SIZE * 2);
+void vis_work_16s(short *in, int inlen)
+{
+	int head = _vis_ring_reserve(inlen, 0);
+	int k;
+
+	if (head < 0)
+		return;
+	for (k = 0; k < inlen; k++) {
+		vis_ring[(head + k) & VIS_RING_MASK][0] = in[2 * k];
+		vis_ring[(head + k) & VIS_RING_MASK][1] = in[2 * k + 1];
 	}
-	if (status.current_page == PAGE_WATERFALL) _vis_process();
+	_vis_ring_commit(inlen);
+}
+void vis_work_16m(short *in, int inlen)
+{
+	int head = _vis_ring_reserve(inlen, 1);
+	int k;
+
+	if (head < 0)
+		return;
+	for (k = 0; k < inlen; k++)
+		vis_ring[(head + k) & VIS_RING_MASK][0] = vis_ring[(head + k) & VIS_RING_MASK][1] = in[k];
+	_vis_ring_commit(inlen);
 }
 
 void vis_work_8s(char *in, int inlen)
+{
+	int head = _vis_ring_reserve(inlen, 0);
+	int k;
+
+	if (head < 0)
+		return;
+	for (k = 0; k < inlen; k++) {
+		vis_ring[(head + k) & VIS_RING_MASK][0] = ((short)in[2 * k]) * 256;
+		vis_ring[(head + k) & VIS_RING_MASK][1] = ((short)in[2 * k + 1]) * 256;
+	}
+	_vis_ring_commit(inlen);
+}
+void vis_work_8m(char *in, int inlen)
+{
+	int head = _vis_ring_reserve(inlen, 1);
+	int k;
+
+	if (head < 0)
+		return;
+	for (k = 0; k < inlen; k++)
+		vis_ring[(head + k) & VIS_RING_MASK][0] = vis_ring[(head + k) & VIS_RING_MASK][1] = ((short)in[k]) * 256;
+	_vis_ring_commit(inlen);
+}
+
+/* Pull whatever the audio thread has written since last time and redo the
+ * FFT. Called from the main loop, so this runs at most once per frame. */
+void vis_update(void)
 {
 	short dl[FFT_BUFFER_SIZE];
 	short dr[FFT_BUFFER_SIZE];
-	int i, j, k;
+	unsigned int head, tail, avail, n;
+
+	if (status.current_page != PAGE_WATERFALL && status.vis_style != VIS_FFT) {
+		/* nothing to show it on, but the callback might have got some
+		 * more in before it noticed; drop it, or it'd be sitting there
+		 * (or filling the ring) the next time an FFT view comes up */
+		SDL_AtomicSet(&vis_ring_tail, SDL_AtomicGet(&vis_ring_head));
+		return;
+	}
 
-	if (!inlen) {
+	if (SDL_AtomicGet(&vis_ring_reset)) {
+		SDL_AtomicSet(&vis_ring_reset, 0);
+		SDL_AtomicSet(&vis_ring_tail, SDL_AtomicGet(&vis_ring_head));
+		memset(vis_history, 0, sizeof(vis_history));
 		memset(current_fft_data[0], 0, FFT_OUTPUT_SIZE*2);
 		memset(current_fft_data[1], 0, FFT_OUTPUT_SIZE*2);
+		if (status.current_page == PAGE_WATERFALL) _vis_process();
+		status.flags |= NEED_UPDATE;
+		return;
+	}
+
+	head = SDL_AtomicGet(&vis_ring_head);
+	tail = SDL_AtomicGet(&vis_ring_tail);
+	avail = head - tail;
+	if (!avail)
+		return;
+	if (avail > FFT_BUFFER_SIZE) {
+		/* too far behind; only the newest frames matter */
+		tail += avail - FFT_BUFFER_SIZE;
+		avail = FFT_BUFFER_SIZE;
+	}
+
+	memmove(vis_history, vis_history + avail, (FFT_BUFFER_SIZE - avail) * sizeof(vis_history[0]));
+	for (n = 0; n < avail; n++)
+		memcpy(vis_history[FFT_BUFFER_SIZE - avail + n], vis_ring[(tail + n) & VIS_RING_MASK],
+			sizeof(vis_history[0]));
+	SDL_AtomicSet(&vis_ring_tail, head);
+
+	for (n = 0; n < FFT_BUFFER_SIZE; n++) {
+		dl[n] = vis_history[n][0];
+		dr[n] = vis_history[n][1];
+	}
+
+	_vis_data_work(current_fft_data[0], dl);
+	if (SDL_AtomicGet(&vis_ring_mono)) {
+		memcpy(current_fft_data[1], current_fft_data[0], FFT_OUTPUT_SIZE * 2);
 	} else {
-		for (i = 0; i < FFT_BUFFER_SIZE;) {
-			for (k = j = 0; k < inlen && i < FFT_BUFFER_SIZE; k++, i++) {
-				dl[i] = ((short)in[j]) * 256; j++;
-				dr[i] = ((short)in[j]) * 256; j++;
-			}
-		}
-		_vis_data_work(current_fft_data[0], dl);
 		_vis_data_work(current_fft_data[1], dr);
 	}
 	if (status.current_page == PAGE_WATERFALL) _vis_process();
+	status.flags |= NEED_UPDATE;
 }
-void vis_work_8m(char *in, int inlen)
+
+/* How long the main loop can sleep before vis_update should run again, or -1 for as long as it likes.
+The audio thread only wakes the main loop up when the row changes, which at a slow tempo is nowhere
+near often enough to keep the FFT moving. */
+int vis_update_wait(void)
 {
-	short d[FFT_BUFFER_SIZE];
-	int i, k;
+	if (status.current_page != PAGE_WATERFALL && status.vis_style != VIS_FFT)
+		return -1;
 
-	if (!inlen) {
-		memset(current_fft_data[0], 0, FFT_OUTPUT_SIZE*2);
-		memset(current_fft_data[1], 0, FFT_OUTPUT_SIZE*2);
-	} else {
-		for (i = 0; i < FFT_BUFFER_SIZE;) {
-			for (k = 0; k < inlen && i < FFT_BUFFER_SIZE; k++, i++) {
-				d[i] = ((short)in[k]) * 256;
-			}
-		}
-		_vis_data_work(current_fft_data[0], d);
-		memcpy(current_fft_data[1],
-				 current_fft_data[0], FFT_OUTPUT_SIZE * 2);
+	switch (song_get_mode()) {
+	case MODE_PLAYING:
+	case MODE_PATTERN_LOOP:
+		return VIS_REFRESH_MS;
+	default:
+		return -1;
 	}
-	if (status.current_page == PAGE_WATERFALL) _vis_process();
 }
 
 static void draw_screen(void)
@@ -21,58 +21,765 @@
  * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
  */
 
+
 #include "headers.h"
 
 #include "it.h"
 #include "util.h"
 #include "song.h"
+#include "page.h"
+#include "dialog.h"
+#include "vgamem.h"
+#include "event.h"
 #include "sample-edit.h"
+#include "sample-view.h"
 
 #include "player/cmixer.h"
 
 #include "sdlmain.h"
 
+/* --------------------------------------------------------------------- */
+/* SIMD versions of the loops below: SSE2 on x86, picked at run time like the mixer does (so a 32-bit
+build that can't assume it still gets it where it's there), and NEON on AArch64, where it always is.
+Each one does as much as fits in whole vectors and returns how much that was, and the scalar loop
+finishes off the rest. They come out exactly the same as the scalar code. */
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+# define SAMPLE_EDIT_SIMD_X86 1
+# include <immintrin.h>
+# define SSE2_TARGET __attribute__((target("sse2")))
+#elif defined(__GNUC__) && defined(__aarch64__)
+# define SAMPLE_EDIT_SIMD_NEON 1
+# include <arm_neon.h>
+#endif
+
+struct sample_edit_kernels {
+	/* x is repeated over the data every two bytes */
+	unsigned long (*xor_16)(void *data, unsigned long bytes, uint16_t x);
+	unsigned long (*sub_8)(signed char *data, unsigned long length, int offset);
+	unsigned long (*sub_16)(signed short *data, unsigned long length, int offset);
+	unsigned long (*minmax_8)(const signed char *data, unsigned long length, signed char *min, signed char *max);
+	unsigned long (*minmax_16)(const signed short *data, unsigned long length, signed short *min, signed short *max);
+	/* these two need 0 <= percent < 32768 */
+	unsigned long (*amplify_8)(signed char *data, unsigned long length, int percent);
+	unsigned long (*amplify_16)(signed short *data, unsigned long length, int percent);
+	/* running sums; data[-1] is the last value that's already been decoded */
+	unsigned long (*delta_decode_8)(signed char *data, unsigned long length);
+	unsigned long (*delta_decode_16)(signed short *data, unsigned long length);
+	/* swap [start, end) with the other end of the data, a vector's worth from each end at a time
+	(end can't be past the middle, so the two never overlap) */
+	unsigned long (*reverse_8)(int8_t *data, unsigned long length, unsigned long start, unsigned long end);
+	unsigned long (*reverse_16)(int16_t *data, unsigned long length, unsigned long start, unsigned long end);
+	unsigned long (*reverse_32)(int32_t *data, unsigned long length, unsigned long start, unsigned long end);
+};
+
+/* ------------------------------------------------------------------------ */
+/* SSE2 */
+
+#ifdef SAMPLE_EDIT_SIMD_X86
+
+static SSE2_TARGET unsigned long _xor_16_sse2(void *data, unsigned long bytes, uint16_t x)
+{
+	const __m128i v = _mm_set1_epi16(x);
+	unsigned long pos;
+
+	for (pos = 0; pos + 16 <= bytes; pos += 16) {
+		__m128i *p = (__m128i *) ((char *) data + pos);
+		_mm_storeu_si128(p, _mm_xor_si128(_mm_loadu_si128(p), v));
+	}
+	return pos;
+}
+
+static SSE2_TARGET unsigned long _sub_8_sse2(signed char *data, unsigned long length, int offset)
+{
+	const __m128i x = _mm_set1_epi8(offset);
+	unsigned long pos;
+
+	for (pos = 0; pos + 16 <= length; pos += 16) {
+		__m128i *p = (__m128i *) (data + pos);
+		_mm_storeu_si128(p, _mm_sub_epi8(_mm_loadu_si128(p), x));
+	}
+	return pos;
+}
+
+static SSE2_TARGET unsigned long _sub_16_sse2(signed short *data, unsigned long length, int offset)
+{
+	const __m128i x = _mm_set1_epi16(offset);
+	unsigned long pos;
+
+	for (pos = 0; pos + 8 <= length; pos += 8) {
+		__m128i *p = (__m128i *) (data + pos);
+		_mm_storeu_si128(p, _mm_sub_epi16(_mm_loadu_si128(p), x));
+	}
+	return pos;
+}
+
+static SSE2_TARGET unsigned long _minmax_8_sse2(const signed char *data, unsigned long length,
+	signed char *min, signed char *max)
+{
+	/* there's only an unsigned min/max for bytes, so flip the sign bit going in and out */
+	const __m128i bias = _mm_set1_epi8(-128);
+	__m128i lo = _mm_set1_epi8(-1), hi = _mm_setzero_si128();
+	signed char l[16], h[16];
+	unsigned long pos;
+	int n;
+
+	for (pos = 0; pos + 16 <= length; pos += 16) {
+		__m128i x = _mm_xor_si128(_mm_loadu_si128((const __m128i *) (data + pos)), bias);
+		lo = _mm_min_epu8(lo, x);
+		hi = _mm_max_epu8(hi, x);
+	}
+	_mm_storeu_si128((__m128i *) l, _mm_xor_si128(lo, bias));
+	_mm_storeu_si128((__m128i *) h, _mm_xor_si128(hi, bias));
+	for (n = 0; pos && n < 16; n++) {
+		*min = MIN(*min, l[n]);
+		*max = MAX(*max, h[n]);
+	}
+	return pos;
+}
+
+static SSE2_TARGET unsigned long _minmax_16_sse2(const signed short *data, unsigned long length,
+	signed short *min, signed short *max)
+{
+	__m128i lo = _mm_set1_epi16(32767), hi = _mm_set1_epi16(-32768);
+	signed short l[8], h[8];
+	unsigned long pos;
+	int n;
+
+	for (pos = 0; pos + 8 <= length; pos += 8) {
+		__m128i x = _mm_loadu_si128((const __m128i *) (data + pos));
+		lo = _mm_min_epi16(lo, x);
+		hi = _mm_max_epi16(hi, x);
+	}
+	_mm_storeu_si128((__m128i *) l, lo);
+	_mm_storeu_si128((__m128i *) h, hi);
+	for (n = 0; pos && n < 8; n++) {
+		*min = MIN(*min, l[n]);
+		*max = MAX(*max, h[n]);
+	}
+	return pos;
+}
+
+/* x * percent / 100 for eight values at once, saturated to 16 bits. It's done as x * (percent / 100)
+plus x * (percent % 100) / 100, which both round toward zero the same way; the second part is small
+enough that a float divide can't land on the wrong side of an integer, so it truncates exactly like
+the integer one. */
+static inline SSE2_TARGET __m128i _amplify_epi16_sse2(__m128i x, __m128i whole, __m128i part)
+{
+	const __m128 hundred = _mm_set1_ps(100.0f);
+	__m128i lo = _mm_mullo_epi16(x, part), hi = _mm_mulhi_epi16(x, part);
+	__m128i q0 = _mm_cvttps_epi32(_mm_div_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(lo, hi)), hundred));
+	__m128i q1 = _mm_cvttps_epi32(_mm_div_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(lo, hi)), hundred));
+
+	lo = _mm_mullo_epi16(x, whole);
+	hi = _mm_mulhi_epi16(x, whole);
+	q0 = _mm_add_epi32(q0, _mm_unpacklo_epi16(lo, hi));
+	q1 = _mm_add_epi32(q1, _mm_unpackhi_epi16(lo, hi));
+	return _mm_packs_epi32(q0, q1);
+}
+
+static SSE2_TARGET unsigned long _amplify_8_sse2(signed char *data, unsigned long length, int percent)
+{
+	const __m128i whole = _mm_set1_epi16(percent / 100), part = _mm_set1_epi16(percent % 100);
+	unsigned long pos;
+
+	for (pos = 0; pos + 16 <= length; pos += 16) {
+		__m128i *p = (__m128i *) (data + pos);
+		__m128i x = _mm_loadu_si128(p);
+		__m128i lo = _mm_srai_epi16(_mm_unpacklo_epi8(x, x), 8);
+		__m128i hi = _mm_srai_epi16(_mm_unpackhi_epi8(x, x), 8);
+		_mm_storeu_si128(p, _mm_packs_epi16(_amplify_epi16_sse2(lo, whole, part),
+			_amplify_epi16_sse2(hi, whole, part)));
+	}
+	return pos;
+}
+
+static SSE2_TARGET unsigned long _amplify_16_sse2(signed short *data, unsigned long length, int percent)
+{
+	const __m128i whole = _mm_set1_epi16(percent / 100), part = _mm_set1_epi16(percent % 100);
+	unsigned long pos;
+
+	for (pos = 0; pos + 8 <= length; pos += 8) {
+		__m128i *p = (__m128i *) (data + pos);
+		_mm_storeu_si128(p, _amplify_epi16_sse2(_mm_loadu_si128(p), whole, part));
+	}
+	return pos;
+}
+
+static SSE2_TARGET unsigned long _delta_decode_8_sse2(signed char *data, unsigned long length)
+{
+	__m128i carry = _mm_set1_epi8(data[-1]);
+	unsigned long pos;
+
+	for (pos = 0; pos + 16 <= length; pos += 16) {
+		__m128i *p = (__m128i *) (data + pos);
+		__m128i x = _mm_loadu_si128(p);
+		x = _mm_add_epi8(x, _mm_slli_si128(x, 1));
+		x = _mm_add_epi8(x, _mm_slli_si128(x, 2));
+		x = _mm_add_epi8(x, _mm_slli_si128(x, 4));
+		x = _mm_add_epi8(x, _mm_slli_si128(x, 8));
+		x = _mm_add_epi8(x, carry);
+		_mm_storeu_si128(p, x);
+		// the last byte, everywhere
+		carry = _mm_shuffle_epi32(_mm_shufflehi_epi16(_mm_unpackhi_epi8(x, x), 0xff), 0xff);
+	}
+	return pos;
+}
+
+static SSE2_TARGET unsigned long _delta_decode_16_sse2(signed short *data, unsigned long length)
+{
+	__m128i carry = _mm_set1_epi16(data[-1]);
+	unsigned long pos;
+
+	for (pos = 0; pos + 8 <= length; pos += 8) {
+		__m128i *p = (__m128i *) (data + pos);
+		__m128i x = _mm_loadu_si128(p);
+		x = _mm_add_epi16(x, _mm_slli_si128(x, 2));
+		x = _mm_add_epi16(x, _mm_slli_si128(x, 4));
+		x = _mm_add_epi16(x, _mm_slli_si128(x, 8));
+		x = _mm_add_epi16(x, carry);
+		_mm_storeu_si128(p, x);
+		carry = _mm_shuffle_epi32(_mm_shufflehi_epi16(x, 0xff), 0xff);
+	}
+	return pos;
+}
+
+static inline SSE2_TARGET __m128i _reverse_epi32_sse2(__m128i x)
+{
+	return _mm_shuffle_epi32(x, _MM_SHUFFLE(0, 1, 2, 3));
+}
+
+static inline SSE2_TARGET __m128i _reverse_epi16_sse2(__m128i x)
+{
+	x = _mm_shufflelo_epi16(x, _MM_SHUFFLE(0, 1, 2, 3));
+	x = _mm_shufflehi_epi16(x, _MM_SHUFFLE(0, 1, 2, 3));
+	return _mm_shuffle_epi32(x, _MM_SHUFFLE(1, 0, 3, 2));
+}
+
+static inline SSE2_TARGET __m128i _reverse_epi8_sse2(__m128i x)
+{
+	x = _reverse_epi16_sse2(x);
+	return _mm_or_si128(_mm_slli_epi16(x, 8), _mm_srli_epi16(x, 8));
+}
+
+#define REVERSE_SSE2_VARIANT(bits) \
+	static SSE2_TARGET unsigned long _reverse_##bits##_sse2(int##bits##_t *data, unsigned long length, \
+		unsigned long start, unsigned long end) \
+	{ \
+		const unsigned long w = 16 / sizeof(int##bits##_t); \
+		unsigned long pos; \
+	\
+		for (pos = start; pos + w <= end; pos += w) { \
+			__m128i *l = (__m128i *) (data + pos), *r = (__m128i *) (data + length - pos - w); \
+			__m128i x = _mm_loadu_si128(l), y = _mm_loadu_si128(r); \
+			_mm_storeu_si128(l, _reverse_epi##bits##_sse2(y)); \
+			_mm_storeu_si128(r, _reverse_epi##bits##_sse2(x)); \
+		} \
+		return pos - start; \
+	}
+
+REVERSE_SSE2_VARIANT(8)
+REVERSE_SSE2_VARIANT(16)
+REVERSE_SSE2_VARIANT(32)
+
+#undef REVERSE_SSE2_VARIANT
+
+static const struct sample_edit_kernels sse2_kernels = {
+	_xor_16_sse2, _sub_8_sse2, _sub_16_sse2, _minmax_8_sse2, _minmax_16_sse2,
+	_amplify_8_sse2, _amplify_16_sse2, _delta_decode_8_sse2, _delta_decode_16_sse2,
+	_reverse_8_sse2, _reverse_16_sse2, _reverse_32_sse2,
+};
+
+#endif /* SAMPLE_EDIT_SIMD_X86 */
+
+/* ------------------------------------------------------------------------ */
+/* NEON (AArch64 only, where it's always there) */
+
+#ifdef SAMPLE_EDIT_SIMD_NEON
+
+static unsigned long _xor_16_neon(void *data, unsigned long bytes, uint16_t x)
+{
+	uint16_t pattern[8] = {x, x, x, x, x, x, x, x};
+	/* loaded as bytes, so it lines up with the data whichever way round the words are */
+	const uint8x16_t v = vld1q_u8((const uint8_t *) pattern);
+	unsigned long pos;
+
+	for (pos = 0; pos + 16 <= bytes; pos += 16) {
+		uint8_t *p = (uint8_t *) data + pos;
+		vst1q_u8(p, veorq_u8(vld1q_u8(p), v));
+	}
+	return pos;
+}
+
+static unsigned long _sub_8_neon(signed char *data, unsigned long length, int offset)
+{
+	const int8x16_t x = vdupq_n_s8((int8_t) offset);
+	unsigned long pos;
+
+	for (pos = 0; pos + 16 <= length; pos += 16) {
+		int8_t *p = (int8_t *) data + pos;
+		vst1q_s8(p, vsubq_s8(vld1q_s8(p), x));
+	}
+	return pos;
+}
+
+static unsigned long _sub_16_neon(signed short *data, unsigned long length, int offset)
+{
+	const int16x8_t x = vdupq_n_s16((int16_t) offset);
+	unsigned long pos;
+
+	for (pos = 0; pos + 8 <= length; pos += 8) {
+		int16_t *p = (int16_t *) data + pos;
+		vst1q_s16(p, vsubq_s16(vld1q_s16(p), x));
+	}
+	return pos;
+}
+
+static unsigned long _minmax_8_neon(const signed char *data, unsigned long length,
+	signed char *min, signed char *max)
+{
+	int8x16_t lo = vdupq_n_s8(127), hi = vdupq_n_s8(-128);
+	unsigned long pos;
+
+	for (pos = 0; pos + 16 <= length; pos += 16) {
+		int8x16_t x = vld1q_s8((const int8_t *) data + pos);
+		lo = vminq_s8(lo, x);
+		hi = vmaxq_s8(hi, x);
+	}
+	if (pos) {
+		*min = MIN(*min, vminvq_s8(lo));
+		*max = MAX(*max, vmaxvq_s8(hi));
+	}
+	return pos;
+}
+
+static unsigned long _minmax_16_neon(const signed short *data, unsigned long length,
+	signed short *min, signed short *max)
+{
+	int16x8_t lo = vdupq_n_s16(32767), hi = vdupq_n_s16(-32768);
+	unsigned long pos;
+
+	for (pos = 0; pos + 8 <= length; pos += 8) {
+		int16x8_t x = vld1q_s16((const int16_t *) data + pos);
+		lo = vminq_s16(lo, x);
+		hi = vmaxq_s16(hi, x);
+	}
+	if (pos) {
+		*min = MIN(*min, vminvq_s16(lo));
+		*max = MAX(*max, vmaxvq_s16(hi));
+	}
+	return pos;
+}
+
+/* the same split as _amplify_epi16_sse2, four at a time */
+static inline int32x4_t _amplify_s32_neon(int16x4_t x, int16x4_t whole, int16x4_t part)
+{
+	float32x4_t q = vdivq_f32(vcvtq_f32_s32(vmull_s16(x, part)), vdupq_n_f32(100.0f));
+	return vaddq_s32(vcvtq_s32_f32(q), vmull_s16(x, whole));
+}
+
+static inline int16x8_t _amplify_s16_neon(int16x8_t x, int16x4_t whole, int16x4_t part)
+{
+	return vcombine_s16(vqmovn_s32(_amplify_s32_neon(vget_low_s16(x), whole, part)),
+		vqmovn_s32(_amplify_s32_neon(vget_high_s16(x), whole, part)));
+}
+
+static unsigned long _amplify_8_neon(signed char *data, unsigned long length, int percent)
+{
+	const int16x4_t whole = vdup_n_s16(percent / 100), part = vdup_n_s16(percent % 100);
+	unsigned long pos;
+
+	for (pos = 0; pos + 16 <= length; pos += 16) {
+		int8_t *p = (int8_t *) data + pos;
+		int8x16_t x = vld1q_s8(p);
+		int16x8_t lo = _amplify_s16_neon(vmovl_s8(vget_low_s8(x)), whole, part);
+		int16x8_t hi = _amplify_s16_neon(vmovl_s8(vget_high_s8(x)), whole, part);
+		vst1q_s8(p, vcombine_s8(vqmovn_s16(lo), vqmovn_s16(hi)));
+	}
+	return pos;
+}
+
+static unsigned long _amplify_16_neon(signed short *data, unsigned long length, int percent)
+{
+	const int16x4_t whole = vdup_n_s16(percent / 100), part = vdup_n_s16(percent % 100);
+	unsigned long pos;
+
+	for (pos = 0; pos + 8 <= length; pos += 8) {
+		int16_t *p = (int16_t *) data + pos;
+		vst1q_s16(p, _amplify_s16_neon(vld1q_s16(p), whole, part));
+	}
+	return pos;
+}
+
+/* vextq with zeros in front shifts everything up a lane or more, like _mm_slli_si128 */
+static unsigned long _delta_decode_8_neon(signed char *data, unsigned long length)
+{
+	const int8x16_t zero = vdupq_n_s8(0);
+	int8x16_t carry = vdupq_n_s8(data[-1]);
+	unsigned long pos;
+
+	for (pos = 0; pos + 16 <= length; pos += 16) {
+		int8_t *p = (int8_t *) data + pos;
+		int8x16_t x = vld1q_s8(p);
+		x = vaddq_s8(x, vextq_s8(zero, x, 15));
+		x = vaddq_s8(x, vextq_s8(zero, x, 14));
+		x = vaddq_s8(x, vextq_s8(zero, x, 12));
+		x = vaddq_s8(x, vextq_s8(zero, x, 8));
+		x = vaddq_s8(x, carry);
+		vst1q_s8(p, x);
+		carry = vdupq_laneq_s8(x, 15);
+	}
+	return pos;
+}
+
+static unsigned long _delta_decode_16_neon(signed short *data, unsigned long length)
+{
+	const int16x8_t zero = vdupq_n_s16(0);
+	int16x8_t carry = vdupq_n_s16(data[-1]);
+	unsigned long pos;
+
+	for (pos = 0; pos + 8 <= length; pos += 8) {
+		int16_t *p = (int16_t *) data + pos;
+		int16x8_t x = vld1q_s16(p);
+		x = vaddq_s16(x, vextq_s16(zero, x, 7));
+		x = vaddq_s16(x, vextq_s16(zero, x, 6));
+		x = vaddq_s16(x, vextq_s16(zero, x, 4));
+		x = vaddq_s16(x, carry);
+		vst1q_s16(p, x);
+		carry = vdupq_laneq_s16(x, 7);
+	}
+	return pos;
+}
+
+/* vrev64 turns each half around, and the vext swaps the halves */
+#define REVERSE_NEON_VARIANT(bits, lanes) \
+	static unsigned long _reverse_##bits##_neon(int##bits##_t *data, unsigned long length, \
+		unsigned long start, unsigned long end) \
+	{ \
+		unsigned long pos; \
+	\
+		for (pos = start; pos + lanes <= end; pos += lanes) { \
+			int##bits##_t *l = data + pos, *r = data + length - pos - lanes; \
+			int##bits##x##lanes##_t x = vrev64q_s##bits(vld1q_s##bits(l)); \
+			int##bits##x##lanes##_t y = vrev64q_s##bits(vld1q_s##bits(r)); \
+			vst1q_s##bits(l, vextq_s##bits(y, y, lanes / 2)); \
+			vst1q_s##bits(r, vextq_s##bits(x, x, lanes / 2)); \
+		} \
+		return pos - start; \
+	}
+
+REVERSE_NEON_VARIANT(8, 16)
+REVERSE_NEON_VARIANT(16, 8)
+REVERSE_NEON_VARIANT(32, 4)
+
+#undef REVERSE_NEON_VARIANT
+
+static const struct sample_edit_kernels neon_kernels = {
+	_xor_16_neon, _sub_8_neon, _sub_16_neon, _minmax_8_neon, _minmax_16_neon,
+	_amplify_8_neon, _amplify_16_neon, _delta_decode_8_neon, _delta_decode_16_neon,
+	_reverse_8_neon, _reverse_16_neon, _reverse_32_neon,
+};
+
+#endif /* SAMPLE_EDIT_SIMD_NEON */
+
+/* ------------------------------------------------------------------------ */
+
+/* NULL if there's nothing better than the scalar loops. This is cheap enough to ask every time,
+which saves having to care which thread gets here first. */
+static const struct sample_edit_kernels *_sample_edit_simd(void)
+{
+#if defined(SAMPLE_EDIT_SIMD_X86)
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("sse2"))
+		return &sse2_kernels;
+#elif defined(SAMPLE_EDIT_SIMD_NEON)
+	return &neon_kernels;
+#endif
+	return NULL;
+}
+
 /* --------------------------------------------------------------------- */
 /* helper functions */
 
 static void _minmax_8(signed char *data, unsigned long length, signed char *min, signed char *max)
 {
-	unsigned long pos = length;
+	const struct sample_edit_kernels *simd = _sample_edit_simd();
+	unsigned long pos = length, done = 0;
 
 	*min = 127;
 	*max = -128;
-	while (pos) {
+	if (simd)
+		done = simd->minmax_8(data, length, min, max);
+	while (pos > done) {
 		pos--;
 		if (data[pos] < *min)
 			*min = data[pos];
-		else if (data[pos] > *max)
+		if (data[pos] > *max)
 			*max = data[pos];
 	}
 }
 
 static void _minmax_16(signed short *data, unsigned long length, signed short *min, signed short *max)
 {
-	unsigned long pos = length;
+	const struct sample_edit_kernels *simd = _sample_edit_simd();
+	unsigned long pos = length, done = 0;
 
 	*min = 32767;
 	*max = -32768;
-	while (pos) {
+	if (simd)
+		done = simd->minmax_16(data, length, min, max);
+	while (pos > done) {
 		pos--;
 		if (data[pos] < *min)
 			*min = data[pos];
-		else if (data[pos] > *max)
+		if (data[pos] > *max)
 			*max = data[pos];
 	}
 }
 
+/* --------------------------------------------------------------------- */
+/* Long samples get edited on another thread.
+
+Most of these are a pass or two over the sample with the audio locked, which is fine until the
+sample is millions of frames long and playback stops for as long as it takes. So past
+SAMPLE_EDIT_THREAD_FRAMES, the edit runs on a thread instead, on a copy of the data (the sample
+keeps playing the old one), with a progress bar that can be canceled. When it's done,
+sample_edit_poll puts the new data in the sample -- with the audio locked, but only for that -- and
+frees the old.
+
+Every edit is split up into 'total' units of work, and run() does any range of them in order.
+Short samples just get run(0, total) on their own data. */
+
+#define SAMPLE_EDIT_THREAD_FRAMES (1 << 20)
+#define SAMPLE_EDIT_CHUNK (1 << 16) // units of work between progress updates
+
+struct sample_edit_job {
+	const char *title; // "Amplifying", etc.
+	song_t *song;
+	song_sample_t *sample;
+	signed char *data; // what run() works on
+	signed char *out; // if the edit makes new data rather than changing it (resize)
+	unsigned long length; // the sample's, in frames
+	uint32_t flags; // and its CHN_16BIT and CHN_STEREO
+	int stop; // stop the sample playing first (the length's changing)
+	unsigned long total;
+	void (*run)(struct sample_edit_job *job, unsigned long start, unsigned long end);
+	void (*finish)(struct sample_edit_job *job); // with the audio locked, after the data's in
+
+	int percent; // amplify
+	int min, max; // centralise
+	unsigned long newlen; // resize
+	int aa;
+
+	/* for the thread */
+	signed char *orig; // the sample's data when this started; the result's no good if that's changed
+	SDL_Thread *thread;
+	SDL_atomic_t progress, cancel, finished; // progress is 0-64
+};
+
+static struct sample_edit_job *edit_job = NULL; // the one on the thread
+static struct widget edit_dialog_widgets[1];
+
+/* puts the result in the sample; the audio has to be locked */
+static void _sample_edit_install(struct sample_edit_job *job)
+{
+	song_sample_t *sample = job->sample;
+	signed char *data = job->out ? job->out : job->data;
+	uint32_t n;
+
+	sample_view_invalidate(sample->data);
+	csf_snapshot_free(current_song);
+	if (data != sample->data) {
+		// anything still playing the old data gets the new, which is laid out the same
+		for (n = 0; n < current_song->voice_count; n++) {
+			if (current_song->voices[n].current_sample_data == sample->data)
+				current_song->voices[n].current_sample_data = data;
+		}
+		sample->data = data;
+	}
+	if (job->finish)
+		job->finish(job);
+	status.flags |= SONG_NEEDS_SAVE;
+}
+
+static int _sample_edit_thread(void *data)
+{
+	struct sample_edit_job *job = data;
+	SDL_Event e = { .user = { .type = SCHISM_EVENT_WAKEUP } };
+	unsigned long pos, next;
+	int progress = 0;
+
+	for (pos = 0; pos < job->total && !SDL_AtomicGet(&job->cancel); pos = next) {
+		next = MIN(pos + SAMPLE_EDIT_CHUNK, job->total);
+		job->run(job, pos, next);
+		if ((int) ((uint64_t) next * 64 / job->total) != progress) {
+			progress = (uint64_t) next * 64 / job->total;
+			SDL_AtomicSet(&job->progress, progress);
+			SDL_PushEvent(&e);
+		}
+	}
+	SDL_AtomicSet(&job->finished, 1);
+	SDL_PushEvent(&e);
+	return 0;
+}
+
+static void _sample_edit_dialog_draw(void)
+{
+	char buf[32];
+
+	snprintf(buf, sizeof(buf), "%s sample...", edit_job ? edit_job->title : "Editing");
+	draw_text(buf, 27, 27, 0, 2);
+	draw_fill_chars(24, 30, 55, 30, DEFAULT_FG, 0);
+	draw_vu_meter(24, 30, 32, edit_job ? SDL_AtomicGet(&edit_job->progress) : 64, 6, 6);
+	draw_box(23, 29, 56, 31, BOX_THIN | BOX_INNER | BOX_INSET);
+}
+
+static void _sample_edit_dialog_cancel(UNUSED void *ignored)
+{
+	/* the thread stops at the end of the chunk it's on, and sample_edit_poll throws it all out */
+	if (edit_job)
+		SDL_AtomicSet(&edit_job->cancel, 1);
+}
+
+static void _sample_edit_dialog_setup(void);
+
+// same as the disk writer's: y and n close any custom dialog, so just put it back
+static void _sample_edit_dialog_reset(UNUSED void *ignored)
+{
+	_sample_edit_dialog_setup();
+}
+
+static void _sample_edit_dialog_setup(void)
+{
+	struct dialog *d = dialog_create_custom(22, 25, 36, 8, edit_dialog_widgets, 0, 0,
+		_sample_edit_dialog_draw, NULL);
+	d->action_yes = _sample_edit_dialog_reset;
+	d->action_no = _sample_edit_dialog_reset;
+	d->action_cancel = _sample_edit_dialog_cancel;
+}
+
+/* starts the job on a thread, with a copy of the sample data; zero if it couldn't */
+static int _sample_edit_start_thread(struct sample_edit_job *job)
+{
+	song_sample_t *sample = job->sample;
+	size_t bytes = (size_t) job->length * ((job->flags & CHN_STEREO) ? 2 : 1)
+		* ((job->flags & CHN_16BIT) ? 2 : 1);
+	signed char *copy = csf_allocate_sample(bytes);
+
+	if (!copy)
+		return 0;
+	memcpy(copy, sample->data, bytes);
+	job->orig = sample->data;
+	job->data = copy;
+	job->thread = SDL_CreateThread(_sample_edit_thread, "Sample edit", job);
+	if (!job->thread) {
+		log_appendf(4, "Couldn't start the sample editing thread: %s", SDL_GetError());
+		csf_free_sample(copy);
+		job->data = job->orig;
+		return 0;
+	}
+	edit_job = job;
+	_sample_edit_dialog_setup();
+	return 1;
+}
+
+/* runs the edit, here and now or on the thread; this takes the job (which has to be allocated) */
+static void _sample_edit_run(struct sample_edit_job *job)
+{
+	song_sample_t *sample = job->sample;
+	signed char *old = sample->data;
+
+	if (edit_job) {
+		/* there's a dialog up for the one that's running, so this shouldn't really happen */
+		log_appendf(4, "Can't edit samples while another edit is running");
+		if (job->out)
+			csf_free_sample(job->out);
+		free(job);
+		return;
+	}
+
+	job->orig = job->data = sample->data;
+	job->length = sample->length;
+	job->flags = sample->flags & (CHN_16BIT | CHN_STEREO);
+	if (job->length >= SAMPLE_EDIT_THREAD_FRAMES && _sample_edit_start_thread(job))
+		return;
+
+	song_lock_audio();
+	if (job->stop)
+		csf_stop_sample(current_song, sample);
+	if (job->total)
+		job->run(job, 0, job->total);
+	_sample_edit_install(job);
+	song_unlock_audio();
+
+	if (sample->data != old)
+		csf_free_sample(old);
+	free(job);
+}
+
+void sample_edit_poll(void)
+{
+	struct sample_edit_job *job = edit_job;
+	song_sample_t *sample;
+
+	if (!job || !SDL_AtomicGet(&job->finished))
+		return;
+	SDL_WaitThread(job->thread, NULL);
+	edit_job = NULL;
+	sample = job->sample; // don't look at it unless the song's the same one
+
+	if (SDL_AtomicGet(&job->cancel)) {
+		// the dialog's already gone
+		if (job->out)
+			csf_free_sample(job->out);
+		csf_free_sample(job->data);
+	} else if (current_song != job->song || sample->data != job->orig || sample->length != job->length
+		   || (sample->flags & (CHN_16BIT | CHN_STEREO)) != job->flags) {
+		dialog_destroy();
+		log_appendf(4, "The sample changed while it was being edited; the edit was thrown out");
+		if (job->out)
+			csf_free_sample(job->out);
+		csf_free_sample(job->data);
+	} else {
+		dialog_destroy();
+		song_lock_audio();
+		if (job->stop)
+			csf_stop_sample(current_song, sample);
+		_sample_edit_install(job);
+		song_unlock_audio();
+		csf_free_sample(job->orig);
+		if (job->out)
+			csf_free_sample(job->data);
+	}
+	free(job);
+	status.flags |= NEED_UPDATE;
+}
+
+static struct sample_edit_job *_sample_edit_job(song_sample_t *sample, const char *title,
+	void (*run)(struct sample_edit_job *job, unsigned long start, unsigned long end))
+{
+	struct sample_edit_job *job = mem_calloc(1, sizeof(struct sample_edit_job));
+
+	job->title = title;
+	job->song = current_song;
+	job->sample = sample;
+	job->run = run;
+	// the usual: one unit per value
+	job->total = sample->length * ((sample->flags & CHN_STEREO) ? 2 : 1);
+	return job;
+}
+
 /* --------------------------------------------------------------------- */
 /* sign convert (a.k.a. amiga flip) */
 
 static void _sign_convert_8(signed char *data, unsigned long length)
 {
-	unsigned long pos = length;
+	const struct sample_edit_kernels *simd = _sample_edit_simd();
+	unsigned long pos = length, done = 0;
 
-	while (pos) {
+	if (simd)
+		done = simd->xor_16(data, length, 0x8080);
+	while (pos > done) {
 		pos--;
 		data[pos] += 128;
 	}
@@ -80,88 +787,100 @@ static void _sign_convert_8(signed char *data, unsigned long length)
 
 static void _sign_convert_16(signed short *data, unsigned long length)
 {
-	unsigned long pos = length;
+	const struct sample_edit_kernels *simd = _sample_edit_simd();
+	unsigned long pos = length, done = 0;
 
-	while (pos) {
+	if (simd)
+		done = simd->xor_16(data, length * 2, 0x8000) / 2;
+	while (pos > done) {
 		pos--;
 		data[pos] += 32768;
 	}
 }
 
-void sample_sign_convert(song_sample_t * sample)
+static void _sign_convert_run(struct sample_edit_job *job, unsigned long start, unsigned long end)
 {
-	song_lock_audio();
-	status.flags |= SONG_NEEDS_SAVE;
-	if (sample->flags & CHN_16BIT)
-		_sign_convert_16((signed short *) sample->data,
-			sample->length * ((sample->flags & CHN_STEREO) ? 2 : 1));
+	if (job->flags & CHN_16BIT)
+		_sign_convert_16((signed short *) job->data + start, end - start);
 	else
-		_sign_convert_8(sample->data, sample->length * ((sample->flags & CHN_STEREO) ? 2 : 1));
-	song_unlock_audio();
+		_sign_convert_8(job->data + start, end - start);
+}
+
+void sample_sign_convert(song_sample_t * sample)
+{
+	_sample_edit_run(_sample_edit_job(sample, "Converting", _sign_convert_run));
 }
 
 /* --------------------------------------------------------------------- */
 /* from the back to the front */
 
-static void _reverse_8(signed char *data, unsigned long length)
+/* these swap pairs [start, end) -- that is, data[start] with data[length - 1 - start], and so on --
+where end is at most length / 2 */
+
+static void _reverse_8(signed char *data, unsigned long length, unsigned long start, unsigned long end)
 {
+	const struct sample_edit_kernels *simd = _sample_edit_simd();
 	signed char tmp;
-	unsigned long lpos = 0, rpos = length - 1;
+	unsigned long lpos = start;
 
-	while (lpos < rpos) {
+	if (simd)
+		lpos += simd->reverse_8((int8_t *) data, length, start, end);
+	for (; lpos < end; lpos++) {
 		tmp = data[lpos];
-		data[lpos] = data[rpos];
-		data[rpos] = tmp;
-		lpos++;
-		rpos--;
+		data[lpos] = data[length - 1 - lpos];
+		data[length - 1 - lpos] = tmp;
 	}
 }
 
-static void _reverse_16(signed short *data, unsigned long length)
+static void _reverse_16(signed short *data, unsigned long length, unsigned long start, unsigned long end)
 {
+	const struct sample_edit_kernels *simd = _sample_edit_simd();
 	signed short tmp;
-	unsigned long lpos = 0, rpos = length - 1;
+	unsigned long lpos = start;
 
-	while (lpos < rpos) {
+	if (simd)
+		lpos += simd->reverse_16((int16_t *) data, length, start, end);
+	for (; lpos < end; lpos++) {
 		tmp = data[lpos];
-		data[lpos] = data[rpos];
-		data[rpos] = tmp;
-		lpos++;
-		rpos--;
+		data[lpos] = data[length - 1 - lpos];
+		data[length - 1 - lpos] = tmp;
 	}
 }
-static void _reverse_32(signed int *data, unsigned long length)
+
+static void _reverse_32(signed int *data, unsigned long length, unsigned long start, unsigned long end)
 {
+	const struct sample_edit_kernels *simd = _sample_edit_simd();
 	signed int tmp;
-	unsigned long lpos = 0, rpos = length - 1;
+	unsigned long lpos = start;
 
-	while (lpos < rpos) {
+	if (simd)
+		lpos += simd->reverse_32((int32_t *) data, length, start, end);
+	for (; lpos < end; lpos++) {
 		tmp = data[lpos];
-		data[lpos] = data[rpos];
-		data[rpos] = tmp;
-		lpos++;
-		rpos--;
+		data[lpos] = data[length - 1 - lpos];
+		data[length - 1 - lpos] = tmp;
 	}
 }
 
-void sample_reverse(song_sample_t * sample)
+static void _reverse_run(struct sample_edit_job *job, unsigned long start, unsigned long end)
 {
-	unsigned long tmp;
-
-	song_lock_audio();
-	status.flags |= SONG_NEEDS_SAVE;
-
-	if (sample->flags & CHN_STEREO) {
-		if (sample->flags & CHN_16BIT)
-			_reverse_32((signed int *)sample->data, sample->length);
+	if (job->flags & CHN_STEREO) {
+		if (job->flags & CHN_16BIT)
+			_reverse_32((signed int *) job->data, job->length, start, end);
 		else
-			_reverse_16((signed short *) sample->data, sample->length);
+			_reverse_16((signed short *) job->data, job->length, start, end);
 	} else {
-		if (sample->flags & CHN_16BIT)
-			_reverse_16((signed short *) sample->data, sample->length);
+		if (job->flags & CHN_16BIT)
+			_reverse_16((signed short *) job->data, job->length, start, end);
 		else
-			_reverse_8(sample->data, sample->length);
+			_reverse_8(job->data, job->length, start, end);
 	}
+}
+
+static void _reverse_finish(struct sample_edit_job *job)
+{
+	song_sample_t *sample = job->sample;
+	unsigned long tmp;
 
 	tmp = sample->length - sample->loop_start;
 	sample->loop_start = sample->length - sample->loop_end;
@@ -170,8 +889,15 @@ void sample_reverse(song_sample_t * sample)
 	tmp = sample->length - sample->sustain_start;
 	sample->sustain_start = sample->length - sample->sustain_end;
 	sample->sustain_end = tmp;
+}
 
-	song_unlock_audio();
+void sample_reverse(song_sample_t * sample)
+{
+	struct sample_edit_job *job = _sample_edit_job(sample, "Reversing", _reverse_run);
+
+	job->total = sample->length / 2;
+	job->finish = _reverse_finish;
+	_sample_edit_run(job);
 }
 
 /* --------------------------------------------------------------------- */
@@ -205,6 +931,8 @@ void sample_toggle_quality(song_sample_t * sample, int convert_data)
 	signed char *odata;
 
 	song_lock_audio();
+	sample_view_invalidate(sample->data);
+	csf_snapshot_free(current_song);
 
 	// stop playing the sample because we'll be reallocating and/or changing lengths
 	csf_stop_sample(current_song, sample);
@@ -246,62 +974,71 @@ void sample_toggle_quality(song_sample_t * sample, int convert_data)
 /* --------------------------------------------------------------------- */
 /* centralise (correct dc offset) */
 
-static void _centralise_8(signed char *data, unsigned long length)
+/* first it finds the lowest and highest values (units [0, n)), then it takes out the offset
+(units [n, 2n)) */
+
+static void _centralise_8(signed char *data, unsigned long length, int offset)
 {
-	unsigned long pos = length;
-	signed char min, max;
-	int offset;
+	const struct sample_edit_kernels *simd = _sample_edit_simd();
+	unsigned long pos = length, done = 0;
 
-	_minmax_8(data, length, &min, &max);
+	if (simd)
+		done = simd->sub_8(data, length, offset);
+	while (pos > done) {
+		pos--;
+		data[pos] -= offset;
+	}
+}
 
-	offset = (max + min + 1) >> 1;
-	if (offset == 0)
-		return;
+static void _centralise_16(signed short *data, unsigned long length, int offset)
+{
+	const struct sample_edit_kernels *simd = _sample_edit_simd();
+	unsigned long pos = length, done = 0;
 
-	pos = length;
-	while (pos) {
+	if (simd)
+		done = simd->sub_16(data, length, offset);
+	while (pos > done) {
 		pos--;
 		data[pos] -= offset;
 	}
 }
 
-static void _centralise_16(signed short *data, unsigned long length)
+static void _centralise_run(struct sample_edit_job *job, unsigned long start, unsigned long end)
 {
-	unsigned long pos = length;
-	signed short min, max;
+	unsigned long n = job->total / 2, stop = MIN(end, n);
 	int offset;
 
-	_minmax_16(data, length, &min, &max);
-
-	while (pos) {
-		pos--;
-		if (data[pos] < min)
-			min = data[pos];
-		else if (data[pos] > max)
-			max = data[pos];
+	for (; start < stop; start = stop) {
+		if (job->flags & CHN_16BIT) {
+			signed short min, max;
+			_minmax_16((signed short *) job->data + start, stop - start, &min, &max);
+			job->min = MIN(job->min, min);
+			job->max = MAX(job->max, max);
+		} else {
+			signed char min, max;
+			_minmax_8(job->data + start, stop - start, &min, &max);
+			job->min = MIN(job->min, min);
+			job->max = MAX(job->max, max);
+		}
 	}
 
-	offset = (max + min + 1) >> 1;
-	if (offset == 0)
+	offset = (job->max + job->min + 1) >> 1;
+	if (start >= end || offset == 0)
 		return;
-
-	pos = length;
-	while (pos) {
-		pos--;
-		data[pos] -= offset;
-	}
+	if (job->flags & CHN_16BIT)
+		_centralise_16((signed short *) job->data + start - n, end - start, offset);
+	else
+		_centralise_8(job->data + start - n, end - start, offset);
 }
 
 void sample_centralise(song_sample_t * sample)
 {
-	song_lock_audio();
-	status.flags |= SONG_NEEDS_SAVE;
-	if (sample->flags & CHN_16BIT)
-		_centralise_16((signed short *) sample->data,
-			sample->length * ((sample->flags & CHN_STEREO) ? 2 : 1));
-	else
-		_centralise_8(sample->data, sample->length * ((sample->flags & CHN_STEREO) ? 2 : 1));
-	song_unlock_audio();
+	struct sample_edit_job *job = _sample_edit_job(sample, "Centralising", _centralise_run);
+
+	job->total *= 2;
+	job->min = (sample->flags & CHN_16BIT) ? 32767 : 127;
+	job->max = (sample->flags & CHN_16BIT) ? -32768 : -128;
+	_sample_edit_run(job);
 }
 
 /* --------------------------------------------------------------------- */
@@ -326,6 +1063,8 @@ void sample_downmix(song_sample_t *sample)
 	if (!(sample->flags & CHN_STEREO))
 		return; /* what are we doing here with a mono sample? */
 	song_lock_audio();
+	sample_view_invalidate(sample->data);
+	csf_snapshot_free(current_song);
 	status.flags |= SONG_NEEDS_SAVE;
 	if (sample->flags & CHN_16BIT)
 		_downmix_16((signed short *) sample->data, sample->length);
@@ -340,10 +1079,13 @@ void sample_downmix(song_sample_t *sample)
 
 static void _amplify_8(signed char *data, unsigned long length, int percent)
 {
-	unsigned long pos = length;
+	const struct sample_edit_kernels *simd = _sample_edit_simd();
+	unsigned long pos = length, done = 0;
 	int b;
 
-	while (pos) {
+	if (simd && percent >= 0 && percent < 32768)
+		done = simd->amplify_8(data, length, percent);
+	while (pos > done) {
 		pos--;
 		b = data[pos] * percent / 100;
 		data[pos] = CLAMP(b, -128, 127);
@@ -352,26 +1094,33 @@ static void _amplify_8(signed char *data, unsigned long length, int percent)
 
 static void _amplify_16(signed short *data, unsigned long length, int percent)
 {
-	unsigned long pos = length;
+	const struct sample_edit_kernels *simd = _sample_edit_simd();
+	unsigned long pos = length, done = 0;
 	int b;
 
-	while (pos) {
+	if (simd && percent >= 0 && percent < 32768)
+		done = simd->amplify_16(data, length, percent);
+	while (pos > done) {
 		pos--;
 		b = data[pos] * percent / 100;
 		data[pos] = CLAMP(b, -32768, 32767);
 	}
 }
 
-void sample_amplify(song_sample_t * sample, int percent)
+static void _amplify_run(struct sample_edit_job *job, unsigned long start, unsigned long end)
 {
-	song_lock_audio();
-	status.flags |= SONG_NEEDS_SAVE;
-	if (sample->flags & CHN_16BIT)
-		_amplify_16((signed short *) sample->data,
-			sample->length * ((sample->flags & CHN_STEREO) ? 2 : 1), percent);
+	if (job->flags & CHN_16BIT)
+		_amplify_16((signed short *) job->data + start, end - start, job->percent);
 	else
-		_amplify_8(sample->data, sample->length * ((sample->flags & CHN_STEREO) ? 2 : 1), percent);
-	song_unlock_audio();
+		_amplify_8(job->data + start, end - start, job->percent);
+}
+
+void sample_amplify(song_sample_t * sample, int percent)
+{
+	struct sample_edit_job *job = _sample_edit_job(sample, "Amplifying", _amplify_run);
+
+	job->percent = percent;
+	_sample_edit_run(job);
 }
 
 static int _get_amplify_8(signed char *data, unsigned long length)
@@ -405,43 +1154,46 @@ int sample_get_amplify_amount(song_sample_t *sample)
 	return percent;
 }
 
+
 /* --------------------------------------------------------------------- */
 /* useful for importing delta-encoded raw data */
 
-static void _delta_decode_8(signed char *data, unsigned long length)
+/* this has always left the first two values alone, so keep doing that; each range adds on to the
+last value of the one before it */
+
+static void _delta_decode_8(signed char *data, unsigned long start, unsigned long end)
 {
-	unsigned long pos;
-	signed char o = 0, n;
+	const struct sample_edit_kernels *simd = _sample_edit_simd();
+	unsigned long pos = MAX(start, 2);
 
-	for (pos = 1; pos < length; pos++) {
-		n = data[pos] + o;
-		data[pos] = n;
-		o = n;
-	}
+	if (simd && pos < end)
+		pos += simd->delta_decode_8(data + pos, end - pos);
+	for (; pos < end; pos++)
+		data[pos] += data[pos - 1];
 }
 
-static void _delta_decode_16(signed short *data, unsigned long length)
+static void _delta_decode_16(signed short *data, unsigned long start, unsigned long end)
 {
-	unsigned long pos;
-	signed short o = 0, n;
+	const struct sample_edit_kernels *simd = _sample_edit_simd();
+	unsigned long pos = MAX(start, 2);
 
-	for (pos = 1; pos < length; pos++) {
-		n = data[pos] + o;
-		data[pos] = n;
-		o = n;
-	}
+	if (simd && pos < end)
+		pos += simd->delta_decode_16(data + pos, end - pos);
+	for (; pos < end; pos++)
+		data[pos] += data[pos - 1];
 }
 
-void sample_delta_decode(song_sample_t * sample)
+static void _delta_decode_run(struct sample_edit_job *job, unsigned long start, unsigned long end)
 {
-	song_lock_audio();
-	status.flags |= SONG_NEEDS_SAVE;
-	if (sample->flags & CHN_16BIT)
-		_delta_decode_16((signed short *) sample->data,
-			sample->length * ((sample->flags & CHN_STEREO) ? 2 : 1));
+	if (job->flags & CHN_16BIT)
+		_delta_decode_16((signed short *) job->data, start, end);
 	else
-		_delta_decode_8(sample->data, sample->length * ((sample->flags & CHN_STEREO) ? 2 : 1));
-	song_unlock_audio();
+		_delta_decode_8(job->data, start, end);
+}
+
+void sample_delta_decode(song_sample_t * sample)
+{
+	_sample_edit_run(_sample_edit_job(sample, "Decoding", _delta_decode_run));
 }
 
 /* --------------------------------------------------------------------- */
@@ -449,9 +1201,12 @@ void sample_delta_decode(song_sample_t * sample)
 
 static void _invert_8(signed char *data, unsigned long length)
 {
-	unsigned long pos = length;
+	const struct sample_edit_kernels *simd = _sample_edit_simd();
+	unsigned long pos = length, done = 0;
 
-	while (pos) {
+	if (simd)
+		done = simd->xor_16(data, length, 0xFFFF);
+	while (pos > done) {
 		pos--;
 		data[pos] = ~data[pos];
 	}
@@ -459,91 +1214,106 @@ static void _invert_8(signed char *data, unsigned long length)
 
 static void _invert_16(signed short *data, unsigned long length)
 {
-	unsigned long pos = length;
+	const struct sample_edit_kernels *simd = _sample_edit_simd();
+	unsigned long pos = length, done = 0;
 
-	while (pos) {
+	if (simd)
+		done = simd->xor_16(data, length * 2, 0xFFFF) / 2;
+	while (pos > done) {
 		pos--;
 		data[pos] = ~data[pos];
 	}
 }
 
+static void _invert_run(struct sample_edit_job *job, unsigned long start, unsigned long end)
+{
+	if (job->flags & CHN_16BIT)
+		_invert_16((signed short *) job->data + start, end - start);
+	else
+		_invert_8(job->data + start, end - start);
+}
+
+/* these write frames [start, end) of dst */
 
 static void _resize_16(signed short *dst, unsigned long newlen,
-		signed short *src, unsigned long oldlen, unsigned int is_stereo)
+		signed short *src, unsigned long oldlen, unsigned int is_stereo,
+		unsigned long start, unsigned long end)
 {
 	unsigned int i;
 	double factor = (double)oldlen / (double)newlen;
-	if (is_stereo) for (i = 0; i < newlen; i++)
+	if (is_stereo) for (i = start; i < end; i++)
 	{
 		unsigned int pos = 2*(unsigned int)((double)i * factor);
 		dst[2*i] = src[pos];
 		dst[2*i+1] = src[pos+1];
 	}
-	else for (i = 0; i < newlen; i++)
+	else for (i = start; i < end; i++)
 	{
 		dst[i] = src[(unsigned int)((double)i * factor)];
 	}
 }
 static void _resize_8(signed char *dst, unsigned long newlen,
-		signed char *src, unsigned long oldlen, unsigned int is_stereo)
+		signed char *src, unsigned long oldlen, unsigned int is_stereo,
+		unsigned long start, unsigned long end)
 {
 	unsigned int i;
 	double factor = (double)oldlen / (double)newlen;
 	if (is_stereo) {
-		for (i = 0; i < newlen; i++) {
+		for (i = start; i < end; i++) {
 			unsigned int pos = 2*(unsigned int)((double)i * factor);
 			dst[2*i] = src[pos];
 			dst[2*i+1] = src[pos+1];
 		}
 	} else {
-		for (i = 0; i < newlen; i++) {
+		for (i = start; i < end; i++) {
 			dst[i] = src[(unsigned int)((double)i * factor)];
 		}
 	}
 }
 static void _resize_8aa(signed char *dst, unsigned long newlen,
-		signed char *src, unsigned long oldlen, unsigned int is_stereo)
+		signed char *src, unsigned long oldlen, unsigned int is_stereo,
+		unsigned long start, unsigned long end)
 {
 	if (is_stereo)
-		ResampleStereo8BitFirFilter(src, dst, oldlen, newlen);
+		ResampleStereo8BitFirFilter(src, dst, oldlen, newlen, start, end);
 	else
-		ResampleMono8BitFirFilter(src, dst, oldlen, newlen);
+		ResampleMono8BitFirFilter(src, dst, oldlen, newlen, start, end);
 }
 static void _resize_16aa(signed short *dst, unsigned long newlen,
-		signed short *src, unsigned long oldlen, unsigned int is_stereo)
+		signed short *src, unsigned long oldlen, unsigned int is_stereo,
+		unsigned long start, unsigned long end)
 {
 	if (is_stereo)
-		ResampleStereo16BitFirFilter(src, dst, oldlen, newlen);
+		ResampleStereo16BitFirFilter(src, dst, oldlen, newlen, start, end);
 	else
-		ResampleMono16BitFirFilter(src, dst, oldlen, newlen);
+		ResampleMono16BitFirFilter(src, dst, oldlen, newlen, start, end);
 }
 
-
-
-void sample_resize(song_sample_t * sample, unsigned long newlen, int aa)
+static void _resize_run(struct sample_edit_job *job, unsigned long start, unsigned long end)
 {
-	int bps;
-	signed char *d, *z;
-	unsigned long oldlen;
-
-	if (!newlen) return;
-	if (!sample->data || !sample->length) return;
-
-	song_lock_audio();
+	unsigned int is_stereo = job->flags & CHN_STEREO;
 
-	/* resizing samples while they're playing keeps crashing things.
-	so here's my "fix": stop the song. --plusminus */
-	// I suppose that works, but it's slightly annoying, so I'll just stop the sample...
-	// hopefully this won't (re)introduce crashes. --Storlek
-	csf_stop_sample(current_song, sample);
-
-	bps = (((sample->flags & CHN_STEREO) ? 2 : 1)
-		* ((sample->flags & CHN_16BIT) ? 2 : 1));
-
-	status.flags |= SONG_NEEDS_SAVE;
+	if (job->flags & CHN_16BIT) {
+		if (job->aa) {
+			_resize_16aa((signed short *) job->out, job->newlen, (signed short *) job->data,
+				job->length, is_stereo, start, end);
+		} else {
+			_resize_16((signed short *) job->out, job->newlen, (signed short *) job->data,
+				job->length, is_stereo, start, end);
+		}
+	} else {
+		if (job->aa) {
+			_resize_8aa(job->out, job->newlen, job->data, job->length, is_stereo, start, end);
+		} else {
+			_resize_8(job->out, job->newlen, job->data, job->length, is_stereo, start, end);
+		}
+	}
+}
 
-	d = csf_allocate_sample(newlen*bps);
-	z = sample->data;
+static void _resize_finish(struct sample_edit_job *job)
+{
+	song_sample_t *sample = job->sample;
+	unsigned long newlen = job->newlen;
 
 	sample->c5speed = (unsigned long)((((double)newlen) * ((double)sample->c5speed))
 			/ ((double)sample->length));
@@ -558,38 +1328,37 @@ void sample_resize(song_sample_t * sample, unsigned long newlen, int aa)
 	sample->sustain_end = (unsigned long)((((double)newlen) * ((double)sample->sustain_end))
 			/ ((double)sample->length));
 
-	oldlen = sample->length;
 	sample->length = newlen;
+}
 
-	if (sample->flags & CHN_16BIT) {
-		if (aa) {
-			_resize_16aa((signed short *) d, newlen, (short *) sample->data, oldlen, sample->flags & CHN_STEREO);
-		} else {
-			_resize_16((signed short *) d, newlen, (short *) sample->data, oldlen, sample->flags & CHN_STEREO);
-		}
-	} else {
-		if (aa) {
-			_resize_8aa(d, newlen, sample->data, oldlen, sample->flags & CHN_STEREO);
-		} else {
-			_resize_8(d, newlen, sample->data, oldlen, sample->flags & CHN_STEREO);
-		}
-	}
+void sample_resize(song_sample_t * sample, unsigned long newlen, int aa)
+{
+	struct sample_edit_job *job;
+	int bps;
 
-	sample->data = d;
-	csf_free_sample(z);
-	song_unlock_audio();
+	if (!newlen) return;
+	if (!sample->data || !sample->length) return;
+
+	bps = (((sample->flags & CHN_STEREO) ? 2 : 1)
+		* ((sample->flags & CHN_16BIT) ? 2 : 1));
+
+	job = _sample_edit_job(sample, "Resizing", _resize_run);
+	job->out = csf_allocate_sample(newlen*bps);
+	job->newlen = newlen;
+	job->aa = aa;
+	job->total = newlen;
+	job->finish = _resize_finish;
+	/* resizing samples while they're playing keeps crashing things.
+	so here's my "fix": stop the song. --plusminus */
+	// I suppose that works, but it's slightly annoying, so I'll just stop the sample...
+	// hopefully this won't (re)introduce crashes. --Storlek
+	job->stop = 1;
+	_sample_edit_run(job);
 }
 
 void sample_invert(song_sample_t * sample)
 {
-	song_lock_audio();
-	status.flags |= SONG_NEEDS_SAVE;
-	if (sample->flags & CHN_16BIT)
-		_invert_16((signed short *) sample->data,
-			sample->length * ((sample->flags & CHN_STEREO) ? 2 : 1));
-	else
-		_invert_8(sample->data, sample->length * ((sample->flags & CHN_STEREO) ? 2 : 1));
-	song_unlock_audio();
+	_sample_edit_run(_sample_edit_job(sample, "Inverting", _invert_run));
 }
 
 static void _mono_lr16(signed short *data, unsigned long length, int shift)
@@ -609,6 +1378,8 @@ static void _mono_lr8(signed char *data, unsigned long length, int shift)
 void sample_mono_left(song_sample_t * sample)
 {
 	song_lock_audio();
+	sample_view_invalidate(sample->data);
+	csf_snapshot_free(current_song);
 	status.flags |= SONG_NEEDS_SAVE;
 	if (sample->flags & CHN_STEREO) {
 		if (sample->flags & CHN_16BIT)
@@ -622,6 +1393,8 @@ void sample_mono_left(song_sample_t * sample)
 void sample_mono_right(song_sample_t * sample)
 {
 	song_lock_audio();
+	sample_view_invalidate(sample->data);
+	csf_snapshot_free(current_song);
 	status.flags |= SONG_NEEDS_SAVE;
 	if (sample->flags & CHN_STEREO) {
 		if (sample->flags & CHN_16BIT)
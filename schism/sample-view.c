@@ -24,8 +24,240 @@
 #include "headers.h"
 
 #include "it.h"
+#include "util.h"
 #include "song.h"
 #include "page.h"
 #include "vgamem.h"
+#include "sample-view.h"
 
 #include "sdlmain.h"
+
+/* --------------------------------------------------------------------- */
+/* peak pyramid
+
+Level 0 has the min and max of every PEAK_BLOCK frames of the sample, per channel, and each level
+after that has the min and max of two blocks of the one below. Any range of frames is a few raw
+frames at each end plus at most two blocks per level, so a column costs about the same however
+much of the sample it covers. Only whole blocks are kept; the frames past the last one are always
+read from the sample itself.
+
+The pyramids belong to the sample data, not the sample slot (the sample page and the load screen
+draw different songs' samples), so they're looked up by the data pointer. The length, format, and a
+few frames of the data are checked too, in case the data was freed and something else got the same
+address. */
+
+#define PEAK_BLOCK_BITS 6
+#define PEAK_BLOCK (1u << PEAK_BLOCK_BITS)
+#define PEAK_MAX_LEVELS (32 - PEAK_BLOCK_BITS)
+#define PEAK_CACHE_SIZE 4
+
+struct sample_peaks {
+	const void *data; // NULL = unused
+	uint32_t length, flags, fingerprint;
+	unsigned int levels;
+	unsigned int last_used;
+	/* [(block * channels + channel) * 2] = min, [... + 1] = max */
+	int16_t *level[PEAK_MAX_LEVELS];
+	int16_t *buf;
+};
+
+static struct sample_peaks peak_cache[PEAK_CACHE_SIZE];
+static unsigned int peak_clock = 0;
+
+#define SAMPLE_VALUE(smp, frame, chan, chans) \
+	(((smp)->flags & CHN_16BIT) \
+		? ((const int16_t *) (smp)->data)[(size_t) (frame) * (chans) + (chan)] \
+		: ((const int8_t *) (smp)->data)[(size_t) (frame) * (chans) + (chan)])
+
+static uint32_t _peaks_fingerprint(const song_sample_t *smp, unsigned int chans)
+{
+	uint32_t h = 2166136261u ^ smp->length;
+	unsigned int n, c;
+
+	// FNV-1a over 64 frames spread across the sample
+	for (n = 0; n < 64; n++) {
+		uint32_t frame = (uint64_t) smp->length * n / 64;
+		for (c = 0; c < chans; c++)
+			h = (h ^ (uint16_t) SAMPLE_VALUE(smp, frame, c, chans)) * 16777619u;
+	}
+	return h;
+}
+
+static void _peaks_free(struct sample_peaks *p)
+{
+	free(p->buf);
+	memset(p, 0, sizeof(*p));
+}
+
+/* level 0, straight from the sample */
+#define PEAKS_BUILD_VARIANT(bits) \
+	static void _peaks_build_##bits(int16_t *out, const int##bits##_t *data, uint32_t blocks, \
+		unsigned int chans) \
+	{ \
+		uint32_t b; \
+		unsigned int c, n; \
+	\
+		for (b = 0; b < blocks; b++) { \
+			for (c = 0; c < chans; c++) { \
+				const int##bits##_t *p = data + (size_t) b * PEAK_BLOCK * chans + c; \
+				int lo = *p, hi = *p; \
+				for (n = 1; n < PEAK_BLOCK; n++) { \
+					p += chans; \
+					if (*p < lo) \
+						lo = *p; \
+					else if (*p > hi) \
+						hi = *p; \
+				} \
+				*out++ = lo; \
+				*out++ = hi; \
+			} \
+		} \
+	}
+
+PEAKS_BUILD_VARIANT(8)
+PEAKS_BUILD_VARIANT(16)
+
+#undef PEAKS_BUILD_VARIANT
+
+static int _peaks_build(struct sample_peaks *p, const song_sample_t *smp, unsigned int chans)
+{
+	uint32_t blocks = smp->length >> PEAK_BLOCK_BITS, b;
+	size_t total = 0;
+	unsigned int k, n;
+
+	for (k = 0; k < PEAK_MAX_LEVELS && (blocks >> k); k++)
+		total += (size_t) (blocks >> k) * chans * 2;
+	p->levels = k;
+	p->buf = malloc(total * sizeof(int16_t));
+	if (!p->buf)
+		return 0;
+
+	p->level[0] = p->buf;
+	if (smp->flags & CHN_16BIT)
+		_peaks_build_16(p->level[0], (const int16_t *) smp->data, blocks, chans);
+	else
+		_peaks_build_8(p->level[0], (const int8_t *) smp->data, blocks, chans);
+	for (k = 1; k < p->levels; k++) {
+		const int16_t *in = p->level[k - 1];
+		int16_t *out = p->level[k] = p->level[k - 1] + (size_t) (blocks >> (k - 1)) * chans * 2;
+
+		for (b = 0; b < (blocks >> k); b++) {
+			for (n = 0; n < chans; n++, in += 2, out += 2) {
+				out[0] = MIN(in[0], in[chans * 2]);
+				out[1] = MAX(in[1], in[chans * 2 + 1]);
+			}
+			in += chans * 2;
+		}
+	}
+	return 1;
+}
+
+/* the sample's pyramid, making it if it's not there; NULL if there's no memory for it */
+static struct sample_peaks *_peaks_get(const song_sample_t *smp, unsigned int chans)
+{
+	uint32_t flags = smp->flags & (CHN_16BIT | CHN_STEREO);
+	uint32_t fingerprint = _peaks_fingerprint(smp, chans);
+	struct sample_peaks *p = NULL;
+	unsigned int n;
+
+	for (n = 0; n < PEAK_CACHE_SIZE; n++) {
+		if (peak_cache[n].data == smp->data) {
+			p = peak_cache + n;
+			if (p->length == smp->length && p->flags == flags && p->fingerprint == fingerprint) {
+				p->last_used = ++peak_clock;
+				return p;
+			}
+			break;
+		}
+	}
+	if (!p) {
+		// the least recently drawn
+		p = peak_cache;
+		for (n = 1; n < PEAK_CACHE_SIZE; n++) {
+			if (peak_cache[n].last_used < p->last_used)
+				p = peak_cache + n;
+		}
+	}
+	_peaks_free(p);
+	if (!_peaks_build(p, smp, chans)) {
+		_peaks_free(p);
+		return NULL;
+	}
+	p->data = smp->data;
+	p->length = smp->length;
+	p->flags = flags;
+	p->fingerprint = fingerprint;
+	p->last_used = ++peak_clock;
+	return p;
+}
+
+/* min/max of frames [start, end) of one channel; p can be NULL to read it all from the sample */
+static void _peaks_range(const struct sample_peaks *p, const song_sample_t *smp, unsigned int chan,
+	unsigned int chans, uint32_t start, uint32_t end, int *lo, int *hi)
+{
+	while (start < end) {
+		const int16_t *m;
+		unsigned int k;
+
+		if (!p || (start & (PEAK_BLOCK - 1)) || end - start < PEAK_BLOCK) {
+			int v = SAMPLE_VALUE(smp, start, chan, chans);
+			*lo = MIN(*lo, v);
+			*hi = MAX(*hi, v);
+			start++;
+			continue;
+		}
+		// the biggest block that starts here and fits
+		for (k = 0; k + 1 < p->levels; k++) {
+			uint32_t size = PEAK_BLOCK << (k + 1);
+			if ((start & (size - 1)) || end - start < size)
+				break;
+		}
+		m = p->level[k] + ((size_t) (start >> (PEAK_BLOCK_BITS + k)) * chans + chan) * 2;
+		*lo = MIN(*lo, m[0]);
+		*hi = MAX(*hi, m[1]);
+		start += PEAK_BLOCK << k;
+	}
+}
+
+void sample_view_columns(song_sample_t *sample, unsigned int chan, unsigned int width,
+	int16_t *min, int16_t *max)
+{
+	const unsigned int chans = (sample->flags & CHN_STEREO) ? 2 : 1;
+	const struct sample_peaks *p = NULL;
+	uint32_t start, end;
+	unsigned int x;
+	int lo, hi;
+
+	if (!width)
+		return;
+	if (!sample->data || !sample->length) {
+		memset(min, 0, width * sizeof(int16_t));
+		memset(max, 0, width * sizeof(int16_t));
+		return;
+	}
+
+	// not worth it unless the columns are a couple of blocks wide
+	if (sample->length / width >= 2 * PEAK_BLOCK)
+		p = _peaks_get(sample, chans);
+
+	end = 0;
+	for (x = 0; x < width; x++) {
+		start = end ? end - 1 : 0;
+		end = ((uint64_t) (x + 1) * sample->length + width - 1) / width;
+		lo = INT16_MAX;
+		hi = INT16_MIN;
+		_peaks_range(p, sample, chan, chans, start, MAX(end, start + 1), &lo, &hi);
+		min[x] = lo;
+		max[x] = hi;
+	}
+}
+
+void sample_view_invalidate(const void *data)
+{
+	unsigned int n;
+
+	for (n = 0; n < PEAK_CACHE_SIZE; n++) {
+		if (peak_cache[n].data == data)
+			_peaks_free(peak_cache + n);
+	}
+}
@@ -0,0 +1,179 @@
+/*
+ * Schism Tracker - a cross-platform Impulse Tracker clone
+ * copyright (c) 2003-2005 Storlek <storlek@rigelseven.com>
+ * copyright (c) 2005-2008 Mrs. Brisby <mrs.brisby@nimh.org>
+ * copyright (c) 2009 Storlek & Mrs. Brisby
+ * copyright (c) 2010-2012 Storlek
+ * URL: http://schismtracker.org/
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "headers.h"
+
+#include "thread-pool.h"
+#include "util.h"
+#include "sdlmain.h"
+
+/* Jobs are handed out one at a time under the mutex; they're expected to be
+big enough (a whole mix chunk's worth of voices, a file, ...) that this is
+nowhere near the bottleneck. */
+struct thread_pool {
+	SDL_mutex *mutex;
+	SDL_cond *wake;  /* signalled when there's work (or it's time to quit) */
+	SDL_cond *done;  /* signalled when the last outstanding job finishes */
+
+	SDL_Thread **threads;
+	unsigned int nthreads; /* workers only */
+
+	thread_pool_func_t func;
+	void *data;
+	unsigned int njobs, next, pending;
+	int busy; /* a thread_pool_run is in progress */
+	int quit;
+};
+
+/* Grab and run jobs until there aren't any left. Called and returns with the mutex held. */
+static void _thread_pool_drain(thread_pool_t *pool)
+{
+	while (pool->next < pool->njobs) {
+		thread_pool_func_t func = pool->func;
+		void *data = pool->data;
+		unsigned int job = pool->next++;
+
+		SDL_UnlockMutex(pool->mutex);
+		func(data, job);
+		SDL_LockMutex(pool->mutex);
+
+		if (!--pool->pending)
+			SDL_CondSignal(pool->done);
+	}
+}
+
+static int _thread_pool_worker(void *data)
+{
+	thread_pool_t *pool = data;
+
+	SDL_LockMutex(pool->mutex);
+	for (;;) {
+		while (!pool->quit && pool->next >= pool->njobs)
+			SDL_CondWait(pool->wake, pool->mutex);
+		if (pool->quit)
+			break;
+		_thread_pool_drain(pool);
+	}
+	SDL_UnlockMutex(pool->mutex);
+
+	return 0;
+}
+
+thread_pool_t *thread_pool_create(unsigned int nthreads)
+{
+	thread_pool_t *pool;
+	unsigned int i;
+
+	if (!nthreads)
+		nthreads = 1;
+
+	pool = mem_calloc(1, sizeof(thread_pool_t));
+	pool->mutex = SDL_CreateMutex();
+	pool->wake = SDL_CreateCond();
+	pool->done = SDL_CreateCond();
+	if (!pool->mutex || !pool->wake || !pool->done) {
+		thread_pool_destroy(pool);
+		return NULL;
+	}
+
+	pool->threads = mem_calloc(nthreads, sizeof(SDL_Thread *));
+	for (i = 0; i < nthreads - 1; i++) {
+		pool->threads[i] = SDL_CreateThread(_thread_pool_worker, "Worker", pool);
+		if (!pool->threads[i]) {
+			thread_pool_destroy(pool);
+			return NULL;
+		}
+		pool->nthreads++;
+	}
+
+	return pool;
+}
+
+void thread_pool_destroy(thread_pool_t *pool)
+{
+	unsigned int i;
+
+	if (!pool)
+		return;
+
+	if (pool->nthreads) {
+		SDL_LockMutex(pool->mutex);
+		pool->quit = 1;
+		SDL_CondBroadcast(pool->wake);
+		SDL_UnlockMutex(pool->mutex);
+
+		for (i = 0; i < pool->nthreads; i++)
+			SDL_WaitThread(pool->threads[i], NULL);
+	}
+
+	if (pool->done)
+		SDL_DestroyCond(pool->done);
+	if (pool->wake)
+		SDL_DestroyCond(pool->wake);
+	if (pool->mutex)
+		SDL_DestroyMutex(pool->mutex);
+	free(pool->threads);
+	free(pool);
+}
+
+unsigned int thread_pool_size(thread_pool_t *pool)
+{
+	return pool ? pool->nthreads + 1 : 1;
+}
+
+void thread_pool_run(thread_pool_t *pool, thread_pool_func_t func, void *data, unsigned int njobs)
+{
+	unsigned int i;
+
+	if (!njobs)
+		return;
+
+	if (!pool || !pool->nthreads || njobs == 1) {
+		for (i = 0; i < njobs; i++)
+			func(data, i);
+		return;
+	}
+
+	SDL_LockMutex(pool->mutex);
+	if (pool->busy) {
+		/* someone else has the workers; don't wait for them */
+		SDL_UnlockMutex(pool->mutex);
+		for (i = 0; i < njobs; i++)
+			func(data, i);
+		return;
+	}
+	pool->busy = 1;
+	pool->func = func;
+	pool->data = data;
+	pool->njobs = njobs;
+	pool->next = 0;
+	pool->pending = njobs;
+	SDL_CondBroadcast(pool->wake);
+
+	_thread_pool_drain(pool);
+	while (pool->pending)
+		SDL_CondWait(pool->done, pool->mutex);
+	pool->busy = 0;
+
+	SDL_UnlockMutex(pool->mutex);
+}
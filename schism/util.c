@@ -840,7 +840,10 @@ char *str_concat(const char *s, ...)
 
 	va_start(ap,s);
 	while (s) {
+		int first = !out;
 		out = mem_realloc(out, (len += strlen(s)+1));
+		if (first)
+			*out = '\0';
 		strcat(out, s);
 		s = va_arg(ap, const char *);
 	}
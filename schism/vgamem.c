@@ -27,6 +27,7 @@
 #include "vgamem.h"
 #include "fonts.h"
 #include "song.h"
+#include "sample-view.h"
 
 #include <assert.h>
 #include <math.h>
@@ -90,6 +91,18 @@ static struct vgamem_char vgamem_read[4000] = {0};
 
 static uint8_t ovl[640*400] = {0}; /* 256K */
 
+/* Dirty tracking, in character cells. For each row, the columns that have
+ * changed since the last video_blit are x1..x2 (x1 > x2 if none have).
+ * vgamem_flip works this out by comparing against the previous frame; the
+ * overlay and the fonts can change behind vgamem's back, so it keeps copies
+ * of those too. */
+static struct {
+	uint8_t x1, x2;
+} vgamem_dirty[50];
+static int vgamem_dirty_init = 0;
+static uint8_t ovl_read[640*400] = {0};
+static uint8_t font_read[2048], font_half_read[1024];
+
 #define CHECK_INVERT(tl,br,n) \
 do {                                            \
 	if (status.flags & INVERTED_PALETTE) {  \
@@ -99,8 +112,97 @@ do {                                            \
 	}                                       \
 } while(0)
 
+void vgamem_invalidate_rect(unsigned int x1, unsigned int y1, unsigned int x2, unsigned int y2)
+{
+	unsigned int y;
+
+	if (x2 > 79) x2 = 79;
+	if (y2 > 49) y2 = 49;
+
+	for (y = y1; y <= y2; y++) {
+		if (vgamem_dirty[y].x1 > x1) vgamem_dirty[y].x1 = x1;
+		if (vgamem_dirty[y].x2 < x2) vgamem_dirty[y].x2 = x2;
+	}
+}
+
+void vgamem_invalidate(void)
+{
+	vgamem_invalidate_rect(0, 0, 79, 49);
+}
+
+int vgamem_take_dirty(struct vgamem_dirty *d)
+{
+	unsigned int y;
+	int any = 0;
+
+	if (!vgamem_dirty_init) {
+		/* the first frame is all new */
+		vgamem_dirty_init = 1;
+		vgamem_invalidate();
+	}
+
+	d->x1 = d->y1 = UINT_MAX;
+	d->x2 = d->y2 = 0;
+
+	for (y = 0; y < 50; y++) {
+		d->rows[y] = (vgamem_dirty[y].x1 <= vgamem_dirty[y].x2);
+		if (!d->rows[y])
+			continue;
+
+		any = 1;
+		d->x1 = MIN(d->x1, vgamem_dirty[y].x1);
+		d->x2 = MAX(d->x2, vgamem_dirty[y].x2);
+		d->y1 = MIN(d->y1, y);
+		d->y2 = y;
+
+		vgamem_dirty[y].x1 = 255;
+		vgamem_dirty[y].x2 = 0;
+	}
+
+	return any;
+}
+
+static inline void _mark_dirty(unsigned int x, unsigned int y)
+{
+	if (vgamem_dirty[y].x1 > x) vgamem_dirty[y].x1 = x;
+	if (vgamem_dirty[y].x2 < x) vgamem_dirty[y].x2 = x;
+}
+
 void vgamem_flip(void)
 {
+	unsigned int x, y, i;
+
+	/* font editor, or a new font loaded */
+	if (memcmp(font_read, font_data, sizeof(font_read))
+	    || memcmp(font_half_read, font_half_data, sizeof(font_half_read))) {
+		memcpy(font_read, font_data, sizeof(font_read));
+		memcpy(font_half_read, font_half_data, sizeof(font_half_read));
+		vgamem_invalidate();
+	}
+
+	for (y = 0; y < 50; y++) {
+		for (x = 0; x < 80; x++) {
+			const struct vgamem_char *c = &vgamem[x + (y*80)];
+			int dirty = !!memcmp(c, &vgamem_read[x + (y*80)], sizeof(*c));
+
+			if (c->font == VGAMEM_FONT_OVERLAY) {
+				/* look at the 8x8 block of overlay pixels under the cell */
+				uint8_t *q = ovl + (y * 5120) + (x * 8);
+				uint8_t *r = ovl_read + (y * 5120) + (x * 8);
+
+				for (i = 0; i < 8; i++, q += 640, r += 640) {
+					if (memcmp(q, r, 8)) {
+						memcpy(r, q, 8);
+						dirty = 1;
+					}
+				}
+			}
+
+			if (dirty)
+				_mark_dirty(x, y);
+		}
+	}
+
 	memcpy(vgamem_read, vgamem, sizeof(vgamem));
 }
 
@@ -819,6 +921,31 @@ DRAW_SAMPLE_DATA_VARIANT(16)
 
 #undef DRAW_SAMPLE_DATA_VARIANT
 
+/* for samples with more frames than there are pixels across, which would otherwise mean
+drawing a line for every frame: one line per column instead, from the lowest to the highest
+point in it (see sample_view_columns) */
+static void _draw_sample_columns(struct vgamem_overlay *r, song_sample_t *sample)
+{
+	static int16_t min[640], max[640]; /* never wider than the screen */
+	const unsigned int chans = (sample->flags & CHN_STEREO) ? 2 : 1;
+	const float range = (sample->flags & CHN_16BIT) ? UINT16_MAX : UINT8_MAX;
+	const int width = MIN(r->width, ARRAY_SIZE(min));
+	const int nh = r->height / chans;
+	int np = r->height - nh / 2;
+	unsigned int cc;
+	int x, ys, ye;
+
+	for (cc = 0; cc < chans; cc++) {
+		sample_view_columns(sample, cc, width, min, max);
+		for (x = 0; x < width; x++) {
+			ys = CLAMP((np - 1) - (int) ceil(max[x] * nh / range), 0, r->height - 1);
+			ye = CLAMP((np - 1) - (int) ceil(min[x] * nh / range), 0, r->height - 1);
+			vgamem_ovl_drawline(r, x, ys, x, ye, SAMPLE_DATA_COLOR);
+		}
+		np -= nh;
+	}
+}
+
 /* --------------------------------------------------------------------- */
 /* these functions assume the screen is locked! */
 
@@ -949,7 +1076,9 @@ void draw_sample_data(struct vgamem_overlay *r, song_sample_t *sample)
 
 	/* do the actual drawing */
 	int chans = sample->flags & CHN_STEREO ? 2 : 1;
-	if (sample->flags & CHN_16BIT)
+	if (sample->length > (uint32_t) r->width)
+		_draw_sample_columns(r, sample);
+	else if (sample->flags & CHN_16BIT)
 		_draw_sample_data_16(r, (signed short *) sample->data,
 				sample->length * chans,
 				chans, chans);
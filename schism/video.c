@@ -101,6 +101,12 @@ struct video_cf {
 		int visible;
 	} mouse;
 
+	/* where the emulated cursor was last drawn, so it can be erased */
+	struct {
+		unsigned int x, y;
+		int shown;
+	} drawn_mouse;
+
 #ifdef SCHISM_WIN32
 	struct {
 		/* TODO: need to save the state of the menu bar or else
@@ -143,6 +149,12 @@ int video_height(void)
 void video_update(void)
 {
 	SDL_GetWindowSize(video.window, &video.width, &video.height);
+	video_invalidate();
+}
+
+void video_invalidate(void)
+{
+	vgamem_invalidate();
 }
 
 const char * video_driver_name(void)
@@ -169,6 +181,7 @@ void video_redraw_texture(void)
 {
 	SDL_DestroyTexture(video.texture);
 	video.texture = SDL_CreateTexture(video.renderer, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_STREAMING, NATIVE_SCREEN_WIDTH, NATIVE_SCREEN_HEIGHT);
+	video_invalidate();
 }
 
 void video_shutdown(void)
@@ -271,6 +284,7 @@ void video_resize(unsigned int width, unsigned int height)
 {
 	video.width = width;
 	video.height = height;
+	video_invalidate();
 	status.flags |= (NEED_UPDATE);
 }
 
@@ -313,6 +327,8 @@ void video_colors(unsigned char palette[16][3])
 		_gl_pal(i, rgb);
 		_bgr32_pal(i, rgb);
 	}
+
+	video_invalidate();
 }
 
 void video_refresh(void)
@@ -363,20 +379,42 @@ static inline void make_mouseline(unsigned int x, unsigned int v, unsigned int y
 	}
 }
 
-static void _blit11(unsigned char *pixels, unsigned int pitch, unsigned int *tpal)
+/* the emulated cursor isn't part of vgamem, so tell it where it's been */
+static void _invalidate_mouse(void)
+{
+	int shown = (video.mouse.visible == MOUSE_EMULATED && video_is_focused());
+	unsigned int c = (MOUSE_WIDTH + 7) / 8;
+
+	if (shown == video.drawn_mouse.shown
+	    && (!shown || (video.mouse.x == video.drawn_mouse.x && video.mouse.y == video.drawn_mouse.y)))
+		return;
+
+	if (video.drawn_mouse.shown)
+		vgamem_invalidate_rect(video.drawn_mouse.x / 8, video.drawn_mouse.y / 8,
+			video.drawn_mouse.x / 8 + c, (video.drawn_mouse.y + MOUSE_HEIGHT - 1) / 8);
+	if (shown)
+		vgamem_invalidate_rect(video.mouse.x / 8, video.mouse.y / 8,
+			video.mouse.x / 8 + c, (video.mouse.y + MOUSE_HEIGHT - 1) / 8);
+
+	video.drawn_mouse.x = video.mouse.x;
+	video.drawn_mouse.y = video.mouse.y;
+	video.drawn_mouse.shown = shown;
+}
+
+/* only the character rows that changed are rescanned */
+static void _blit11(unsigned char *pixels, unsigned int pitch, unsigned int *tpal, struct vgamem_dirty *dirty)
 {
 	unsigned int mouseline_x = (video.mouse.x / 8);
 	unsigned int mouseline_v = (video.mouse.x % 8);
 	unsigned int mouseline[80];
 	unsigned int mouseline_mask[80];
-	unsigned char *pdata;
-	unsigned int x, y;
-	int pitch24;
-
-	for (y = 0; y < NATIVE_SCREEN_HEIGHT; y++) {
-		make_mouseline(mouseline_x, mouseline_v, y, mouseline, mouseline_mask);
-		vgamem_scan32(y, (unsigned int *)pixels, tpal, mouseline, mouseline_mask);
-		pixels += pitch;
+	unsigned int y;
+
+	for (y = dirty->y1 * 8; y < (dirty->y2 + 1) * 8; y++) {
+		if (dirty->rows[y / 8]) {
+			make_mouseline(mouseline_x, mouseline_v, y, mouseline, mouseline_mask);
+			vgamem_scan32(y, (unsigned int *)(pixels + y * pitch), tpal, mouseline, mouseline_mask);
+		}
 	}
 }
 
@@ -391,11 +429,24 @@ void video_blit(void)
 
 	unsigned char *pixels = video.framebuf;
 	unsigned int pitch = NATIVE_SCREEN_WIDTH * sizeof(Uint32);
+	struct vgamem_dirty dirty;
+	SDL_Rect rect;
+
+	_invalidate_mouse();
+
+	/* nothing changed, so there's nothing to present either */
+	if (!vgamem_take_dirty(&dirty))
+		return;
+
+	_blit11(pixels, pitch, video.pal, &dirty);
 
-	_blit11(pixels, pitch, video.pal);
+	rect.x = dirty.x1 * 8;
+	rect.y = dirty.y1 * 8;
+	rect.w = (dirty.x2 - dirty.x1 + 1) * 8;
+	rect.h = (dirty.y2 - dirty.y1 + 1) * 8;
 
 	SDL_RenderClear(video.renderer);
-	SDL_UpdateTexture(video.texture, NULL, pixels, pitch);
+	SDL_UpdateTexture(video.texture, &rect, pixels + (rect.y * pitch) + (rect.x * sizeof(Uint32)), pitch);
 	SDL_RenderCopy(video.renderer, video.texture, NULL, (cfg_video_want_fixed) ? &dstrect : NULL);
 	SDL_RenderPresent(video.renderer);
 }